@@ -0,0 +1,284 @@
+#include "board.h"
+#include "engine.h"
+#include "epd.h"
+#include "output.h"
+#include "transposition.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Batch analysis of a file of positions on all cores
+//
+// Usage: ./build/analyse [positions_file | -] [--threads n] [--depth n]
+//                        [--nodes n] [--movetime ms] [--hash mb] [--ordered]
+//                        [--output file [--resume]]
+//
+// Each line holds a FEN or an EPD record, positions are read from stdin
+// without a file or with -. Lines are handed out to a pool of threads, each
+// running its own single threaded search to the given budget (depth 8 if
+// none), and every result is written as one JSON line once it's ready, or in
+// input order with --ordered:
+//   {"line":3,"id":"WAC.003","fen":"...","bestmove":"e2e4","score":{"cp":31},
+//    "depth":8,"pv":["e2e4","e7e5"],"nodes":123456,"time_ms":210}
+// Scores are from the side to move's point of view. Lines that don't parse
+// give {"line":n,"error":"..."}, blank lines and lines starting with # are
+// skipped. Positions with a single legal move are searched like the others.
+// Results are flushed as they're written, with --resume the lines already
+// in the output file are kept and not analysed again. With --ordered at
+// most PENDING_PER_THREAD results per thread are held back, see output.h.
+
+#define DEFAULT_DEPTH 8
+#define PENDING_PER_THREAD 16
+
+typedef struct {
+    SearchLimits limits;
+
+    pthread_mutex_t input_lock;
+    FILE *input;
+    int line_number;            // of the last line read
+    const uint8_t *done;        // bitset of lines written by an earlier run
+    int done_count;             // lines the bitset covers
+
+    OrderedOutput output;
+
+    pthread_mutex_t stats_lock;
+    int analysed;
+    uint64_t nodes;
+} Batch;
+
+static void appendMove(Text *t, Move m)
+{
+    char move_str[10];
+    printMoveToString(move_str, sizeof(move_str), m, false);
+    textAppendf(t, "\"%s\"", move_str);
+}
+
+static bool isDone(const Batch *batch, int line)
+{
+    return line < batch->done_count && (batch->done[line / 8] & (1 << (line % 8)));
+}
+
+// Reads the next line to analyse, lines without output are passed on here
+// Returns its number, 0 at the end of the input
+static int readLine(Batch *batch, char **line, size_t *size)
+{
+    pthread_mutex_lock(&batch->input_lock);
+    int number = 0;
+    while (getline(line, size, batch->input) != -1) {
+        number = ++batch->line_number;
+        const char *text = *line + strspn(*line, " \t\r\n");
+        if (*text != '\0' && *text != '#' && !isDone(batch, number))
+            break;
+        orderedOutputWrite(&batch->output, number, NULL);
+        number = 0;
+    }
+    pthread_mutex_unlock(&batch->input_lock);
+    return number;
+}
+
+static void analyseLine(Batch *batch, int number, const char *line, Text *t)
+{
+    textAppendf(t, "{\"line\":%d", number);
+
+    EpdRecord rec;
+    EpdError err = parseEpd(line, strlen(line), &rec);
+    if (err != EPD_OK) {
+        textAppendf(t, ",\"error\":");
+        const char *error = err == EPD_BAD_FEN ? fenErrorString(rec.fen_error)
+                                               : epdErrorString(err);
+        textAppendJsonString(t, error, strlen(error));
+        textAppendf(t, "}\n");
+        return;
+    }
+
+    SearchContext ctx = {.limits = batch->limits, .threads = 1, .search_single_move = true};
+    atomic_init(&ctx.stop, false);
+    atomic_init(&ctx.ponder, false);
+    atomic_init(&ctx.nodes, 0);
+    SearchInfo info;
+    Move best_move = findBestMove(&rec.board, &ctx, &info);
+
+    if (rec.id[0] != '\0') {
+        textAppendf(t, ",\"id\":");
+        textAppendJsonString(t, rec.id, strlen(rec.id));
+    }
+    char fen[FEN_MAX_LENGTH];
+    writeFen(&rec.board, fen);
+    textAppendf(t, ",\"fen\":\"%s\",\"bestmove\":", fen);
+    if (best_move != EMPTY_MOVE)
+        appendMove(t, best_move);
+    else
+        textAppendf(t, "null");
+
+    // Side to move's point of view, as in UCI
+    bool white = rec.board.color_to_move & WHITE;
+    int score = white ? info.score : -info.score;
+    if (best_move == EMPTY_MOVE && isKingChecked(&rec.board, rec.board.color_to_move))
+        textAppendf(t, ",\"score\":{\"mate\":0}");
+    else if (IS_MATE_SCORE(score))
+        textAppendf(t, ",\"score\":{\"mate\":%d}",
+                score > 0 ? (MATE_SCORE - score + 1) / 2 : -(MATE_SCORE + score + 1) / 2);
+    else
+        textAppendf(t, ",\"score\":{\"cp\":%d}", score);
+
+    textAppendf(t, ",\"depth\":%d,\"pv\":[", info.depth);
+    for (int i = 0; i < info.pv_length; i++) {
+        if (i > 0)
+            textAppendf(t, ",");
+        appendMove(t, info.pv[i]);
+    }
+    textAppendf(t, "],\"nodes\":%lu,\"time_ms\":%.0lf}\n", (unsigned long)info.nodes,
+            info.ms);
+
+    pthread_mutex_lock(&batch->stats_lock);
+    batch->analysed++;
+    batch->nodes += info.nodes;
+    pthread_mutex_unlock(&batch->stats_lock);
+}
+
+static void *analyseThread(void *arg)
+{
+    Batch *batch = arg;
+    char *line = NULL;
+    size_t size = 0;
+    int number;
+    while ((number = readLine(batch, &line, &size)) != 0) {
+        Text t = {0};
+        analyseLine(batch, number, line, &t);
+        orderedOutputWrite(&batch->output, number, &t);
+    }
+    free(line);
+    return NULL;
+}
+
+// Marks the lines in an earlier run's output and cuts off a result that was
+// only partly written. Returns the bitset, NULL if there's no output yet
+static uint8_t *readDoneLines(const char *path, int *count)
+{
+    FILE *f = fopen(path, "r+");
+    if (f == NULL)
+        return NULL;
+
+    uint8_t *done = NULL;
+    *count = 0;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    long complete = 0;
+    while ((len = getline(&line, &size, f)) != -1 && line[len - 1] == '\n') {
+        complete += len;
+        int number;
+        if (sscanf(line, "{\"line\":%d", &number) != 1 || number <= 0)
+            continue;
+        if (number >= *count) {
+            int needed = (number + 64) & ~7;
+            int new_count = MAX(2 * *count, needed);
+            done = realloc(done, new_count / 8);
+            memset(done + *count / 8, 0, (new_count - *count) / 8);
+            *count = new_count;
+        }
+        done[number / 8] |= 1 << (number % 8);
+    }
+    free(line);
+    if (ftruncate(fileno(f), complete) != 0)
+        perror("analyse: can't truncate the output");
+    fclose(f);
+    return done != NULL ? done : calloc(1, 1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *input = NULL, *output = NULL;
+    int n_threads = sysconf(_SC_NPROCESSORS_ONLN), hash_mb = TT_DEFAULT_MB;
+    bool ordered = false, resume = false, usage = false;
+    SearchLimits limits = {0};
+    for (int i = 1; i < argc && !usage; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            n_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+            limits.depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc)
+            limits.nodes = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--movetime") == 0 && i + 1 < argc)
+            limits.movetime = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc)
+            hash_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ordered") == 0)
+            ordered = true;
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (strcmp(argv[i], "--resume") == 0)
+            resume = true;
+        else if (input == NULL && (argv[i][0] != '-' || strcmp(argv[i], "-") == 0))
+            input = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || (resume && output == NULL)) {
+        fprintf(stderr, "Usage: %s [positions_file | -] [--threads n] [--depth n] [--nodes n] "
+                        "[--movetime ms] [--hash mb] [--ordered] [--output file [--resume]]\n",
+                argv[0]);
+        return 1;
+    }
+    n_threads = MAX(1, MIN(n_threads, 256));
+    if (limits.depth <= 0 && limits.nodes == 0 && limits.movetime <= 0)
+        limits.depth = DEFAULT_DEPTH;
+
+    precomputeValues();
+    if (hash_mb > 0 && !setTranspositionTableSize(hash_mb)) {
+        fprintf(stderr, "analyse: can't allocate %d MB hash\n", hash_mb);
+        return 1;
+    }
+
+    static Batch batch = {
+        .input_lock = PTHREAD_MUTEX_INITIALIZER,
+        .stats_lock = PTHREAD_MUTEX_INITIALIZER,
+    };
+    batch.limits = limits;
+    batch.input = input == NULL || strcmp(input, "-") == 0 ? stdin : fopen(input, "r");
+    if (batch.input == NULL) {
+        fprintf(stderr, "analyse: can't open %s\n", input);
+        return 1;
+    }
+    uint8_t *done = NULL;
+    if (resume)
+        done = readDoneLines(output, &batch.done_count);
+    batch.done = done;
+    FILE *out = output == NULL ? stdout : fopen(output, resume ? "a" : "w");
+    if (out == NULL) {
+        fprintf(stderr, "analyse: can't open %s\n", output);
+        return 1;
+    }
+    orderedOutputInit(&batch.output, out, ordered, 1, PENDING_PER_THREAD * n_threads);
+
+    double start = wallTimeMs();
+    pthread_t *tids = malloc(n_threads * sizeof(pthread_t));
+    int started = 0;
+    for (int i = 0; i < n_threads; i++) {
+        if (pthread_create(&tids[i], NULL, analyseThread, &batch) != 0)
+            break;
+        started++;
+    }
+    if (started == 0)
+        analyseThread(&batch);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    double seconds = (wallTimeMs() - start) / 1000;
+
+    fprintf(stderr, "Analysed %d positions in %.1lf s with %d threads, %lu nodes, %.0lf nps\n",
+            batch.analysed, seconds, MAX(started, 1), (unsigned long)batch.nodes,
+            seconds > 0 ? batch.nodes / seconds : 0);
+
+    free(tids);
+    free(done);
+    orderedOutputFree(&batch.output);
+    if (batch.input != stdin)
+        fclose(batch.input);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+// Files of resources/ compiled into the GUI binary, so it starts from any
+// working directory. build/assets.c is generated by the Makefile with
+// `xxd -i`, which names each array after its file
+
+extern unsigned char chess_pieces_png[];
+extern unsigned int chess_pieces_png_len;
+
+extern unsigned char capture_mp3[];
+extern unsigned int capture_mp3_len;
+extern unsigned char move_check_mp3[];
+extern unsigned int move_check_mp3_len;
+extern unsigned char move_self_mp3[];
+extern unsigned int move_self_mp3_len;
+extern unsigned char promote_mp3[];
+extern unsigned int promote_mp3_len;
+
+#endif // !ASSETS_H
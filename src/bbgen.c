@@ -0,0 +1,72 @@
+#include "bitbase.h"
+#include "engine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Generates endgame bitbases, see bitbase.h
+//
+// Usage: ./build/bbgen [--threads n] [--dir directory] [all|TABLE ...]
+//
+// Without tables the 3 piece ones are built, all builds every 3 and 4 piece
+// table. Tables are written to ./bitbases by default, those already there
+// are loaded instead of being built again.
+
+// Every table of 3 and 4 pieces that isn't always drawn
+static int allTableNames(char names[][8])
+{
+    const char *letters = "QRBNP";
+    int n = 0;
+    for (int i = 0; i < 5; i++) {
+        if (letters[i] != 'B' && letters[i] != 'N')
+            sprintf(names[n++], "K%cK", letters[i]);
+        for (int j = i; j < 5; j++) {
+            sprintf(names[n++], "K%c%cK", letters[i], letters[j]);
+            sprintf(names[n++], "K%cK%c", letters[i], letters[j]);
+        }
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = "bitbases";
+    int n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    char names[64][8];
+    int n_names = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            n_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "all") == 0) {
+            n_names = allTableNames(names);
+        }
+        else if (argv[i][0] != '-' && strlen(argv[i]) < sizeof(names[0]) && n_names < 64) {
+            strcpy(names[n_names++], argv[i]);
+        }
+        else {
+            fprintf(stderr, "Usage: %s [--threads n] [--dir directory] [all|TABLE ...]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (n_names == 0) {
+        strcpy(names[n_names++], "KQK");
+        strcpy(names[n_names++], "KRK");
+        strcpy(names[n_names++], "KPK");
+    }
+
+    precomputeValues();
+    for (int i = 0; i < n_names; i++) {
+        printf("Generating %s with %d threads\n", names[i], n_threads);
+        if (!generateBitbase(names[i], dir, n_threads))
+            return 1;
+    }
+    printf("%d tables in %s\n", bitbaseCount(), dir);
+    return 0;
+}
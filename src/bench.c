@@ -0,0 +1,432 @@
+#include "board.h"
+#include "engine.h"
+#include "epd.h"
+#include "evalcache.h"
+#include "nnue.h"
+#include "notation.h"
+#include "packed.h"
+#include "pawntable.h"
+#include "perfcounter.h"
+#include "pgn.h"
+#include "transposition.h"
+#include "utils.h"
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Benchmark driver, runs fixed perft and search workloads and reports wall
+// time and nodes per second. Hardware counters are read alongside when the
+// kernel allows it (Linux perf_event_open), otherwise only time is reported.
+//
+// Usage: ./build/bench [perft|search|nnue|fen|pgn|all] [--no-perf]
+//                      [--eval-cache entries] [--nnue network_file]
+//
+// nnue runs the search workloads with both evaluations to compare NPS,
+// with a random network if no network file is given, fen measures parsing
+// and writing positions, pgn reading games
+
+typedef struct {
+    char *fen;
+    int depth;
+} Workload;
+
+static const Workload PERFT_WORKLOADS[] = {
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5},
+    {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4},
+};
+
+static const Workload SEARCH_WORKLOADS[] = {
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5},
+    {"r1bqkbnr/ppp2ppp/8/3Pn3/2B5/5N2/PPPPQPPP/RNB2RK1 b kq - 0 1", 5},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6},
+};
+
+static void printResult(const char *label, uint64_t nodes, double ms)
+{
+    double nps = ms > 0 ? nodes * 1000.0 / ms : 0;
+    printf("%-14s nodes: %10lu, time: %9.2lf ms, nps: %10.0lf\n", label,
+           (unsigned long)nodes, ms, nps);
+}
+
+static void benchPerft(PerfCounters *pc)
+{
+    printf("\nbenchPerft()\n");
+    const int n = sizeof(PERFT_WORKLOADS) / sizeof(PERFT_WORKLOADS[0]);
+    uint64_t total_nodes = 0;
+    double total_ms = 0;
+
+    for (int i = 0; i < n; i++) {
+        Board b = initBoardFromFen(PERFT_WORKLOADS[i].fen);
+        perfCountersStart(pc);
+        double start = wallTimeMs();
+        uint64_t nodes = generateTillDepth(b, PERFT_WORKLOADS[i].depth, false);
+        double ms = wallTimeMs() - start;
+        perfCountersStop(pc);
+
+        char label[20];
+        snprintf(label, sizeof(label), "perft %d:", i + 1);
+        printResult(label, nodes, ms);
+        printPerfCounters(pc, nodes);
+        total_nodes += nodes;
+        total_ms += ms;
+    }
+    printResult("perft total:", total_nodes, total_ms);
+}
+
+static void benchSearch(PerfCounters *pc)
+{
+    printf("\nbenchSearch(), eval: %s\n", getEvalMode() == EVAL_NNUE ? "nnue" : "classic");
+    const int n = sizeof(SEARCH_WORKLOADS) / sizeof(SEARCH_WORKLOADS[0]);
+    uint64_t total_nodes = 0;
+    double total_ms = 0;
+    resetPawnTableStats();
+    resetEvalCacheStats();
+    resetLazyEvalStats();
+
+    for (int i = 0; i < n; i++) {
+        Board b = initBoardFromFen(SEARCH_WORKLOADS[i].fen);
+        bool is_maximizing = (b.color_to_move & WHITE) ? true : false;
+        NODES_SEARCHED = 0;
+        clearTranspositionTable();
+        nnueResetStack(&b);
+        perfCountersStart(pc);
+        double start = wallTimeMs();
+        bestEvaluation(&b, SEARCH_WORKLOADS[i].depth, is_maximizing, INT_MIN, INT_MAX);
+        double ms = wallTimeMs() - start;
+        perfCountersStop(pc);
+
+        char label[20];
+        snprintf(label, sizeof(label), "search %d:", i + 1);
+        printResult(label, NODES_SEARCHED, ms);
+        printPerfCounters(pc, NODES_SEARCHED);
+        total_nodes += NODES_SEARCHED;
+        total_ms += ms;
+    }
+    printResult("search total:", total_nodes, total_ms);
+
+    PawnTableStats pawn_stats = getPawnTableStats();
+    uint64_t probes = pawn_stats.hits + pawn_stats.misses;
+    printf("pawn table: %d entries, probes: %lu, hit rate: %.2lf%%\n",
+           PAWN_TABLE_SIZE, (unsigned long)probes,
+           probes ? 100.0 * pawn_stats.hits / probes : 0.0);
+
+    EvalCacheStats eval_stats = getEvalCacheStats();
+    probes = eval_stats.hits + eval_stats.misses;
+    printf("eval cache: %lu entries, probes: %lu, hit rate: %.2lf%%\n",
+           (unsigned long)getEvalCacheSize(), (unsigned long)probes,
+           probes ? 100.0 * eval_stats.hits / probes : 0.0);
+
+    LazyEvalStats lazy_stats = getLazyEvalStats();
+    printf("lazy eval: margin: %d, evals: %lu, lazy exits: %.2lf%%\n", LAZY_EVAL_MARGIN,
+           (unsigned long)lazy_stats.evals,
+           lazy_stats.evals ? 100.0 * lazy_stats.lazy_exits / lazy_stats.evals : 0.0);
+}
+
+// Same search workloads with the classic evaluation and the network
+static void benchNnue(PerfCounters *pc)
+{
+    printf("\nbenchNnue(), simd: %s\n", nnueSimdName());
+    setEvalMode(EVAL_CLASSIC);
+    benchSearch(pc);
+    setEvalMode(EVAL_NNUE);
+    benchSearch(pc);
+    setEvalMode(EVAL_CLASSIC);
+}
+
+static void printRate(const char *label, uint64_t positions, double ms)
+{
+    double per_second = ms > 0 ? positions * 1000.0 / ms : 0;
+    printf("%-14s positions: %9lu, time: %9.2lf ms, per second: %10.0lf, per minute: %7.1lfM\n",
+           label, (unsigned long)positions, ms, per_second, per_second * 60 / 1e6);
+}
+
+// Reads and writes positions of random games as FEN and EPD lines and as
+// packed records, the speed of bulk loading position files
+static void benchFen(void)
+{
+    printf("\nbenchFen()\n");
+    enum { POSITIONS = 20000, PASSES = 50 };
+    Board *boards = malloc(POSITIONS * sizeof(Board));
+    char *fens = malloc(POSITIONS * FEN_MAX_LENGTH);
+    char *epds = malloc(POSITIONS * (FEN_MAX_LENGTH + 64));
+    size_t fens_len = 0, epds_len = 0;
+
+    srand(1);
+    Board start = initBoardFromFen(PERFT_WORKLOADS[0].fen), b = start;
+    for (int i = 0; i < POSITIONS; i++) {
+        MoveList mlist = generateMoves(&b);
+        b = mlist.count == 0 || b.halfmove_clock >= 100
+                ? start
+                : moveMake(mlist.moves[rand64() % mlist.count], b);
+        boards[i] = b;
+
+        int n = writeFen(&b, fens + fens_len);
+        fens_len += n;
+        fens[fens_len++] = '\n';
+
+        // EPD drops the clocks
+        int fields = 0, len = 0;
+        while (fields < 4)
+            fields += fens[fens_len - n - 1 + len++] == ' ';
+        memcpy(epds + epds_len, fens + fens_len - n - 1, len);
+        epds_len += len;
+        epds_len += sprintf(epds + epds_len, "id \"random.%d\"; D1 %zu;\n", i, mlist.count);
+    }
+
+    uint64_t checksum = 0, parsed = 0;
+    double start_ms = wallTimeMs();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (const char *line = fens; line < fens + fens_len;) {
+            const char *eol = memchr(line, '\n', fens + fens_len - line);
+            Board parsed_board;
+            if (parseFen(line, eol - line, &parsed_board, NULL) == FEN_OK) {
+                checksum ^= parsed_board.zobrist_hash;
+                parsed++;
+            }
+            line = eol + 1;
+        }
+    }
+    printRate("fen parse:", parsed, wallTimeMs() - start_ms);
+
+    char fen[FEN_MAX_LENGTH];
+    uint64_t written = 0;
+    start_ms = wallTimeMs();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (int i = 0; i < POSITIONS; i++) {
+            checksum += writeFen(&boards[i], fen);
+            written++;
+        }
+    }
+    printRate("fen write:", written, wallTimeMs() - start_ms);
+
+    parsed = 0;
+    start_ms = wallTimeMs();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (const char *line = epds; line < epds + epds_len;) {
+            const char *eol = memchr(line, '\n', epds + epds_len - line);
+            EpdRecord rec;
+            if (parseEpd(line, eol - line, &rec) == EPD_OK) {
+                checksum ^= rec.board.zobrist_hash + rec.perft[1];
+                parsed++;
+            }
+            line = eol + 1;
+        }
+    }
+    printRate("epd parse:", parsed, wallTimeMs() - start_ms);
+
+    PackedPosition *packed = malloc(POSITIONS * sizeof(PackedPosition));
+    uint64_t packed_count = 0;
+    start_ms = wallTimeMs();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (int i = 0; i < POSITIONS; i++) {
+            packPosition(&boards[i], &packed[i]);
+            packed_count++;
+        }
+    }
+    printRate("packed write:", packed_count, wallTimeMs() - start_ms);
+
+    parsed = 0;
+    start_ms = wallTimeMs();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (int i = 0; i < POSITIONS; i++) {
+            Board unpacked;
+            if (unpackPosition(&packed[i], &unpacked)) {
+                checksum ^= unpacked.zobrist_hash;
+                parsed++;
+            }
+        }
+    }
+    printRate("packed read:", parsed, wallTimeMs() - start_ms);
+    printf("checksum: %016lx\n", (unsigned long)checksum);
+    free(packed);
+
+    free(boards);
+    free(fens);
+    free(epds);
+}
+
+// Random games written with tags, comments, variations and NAGs, read back
+// from memory on one thread and from a file on all cores
+static void countGame(const PgnGame *game, int thread, void *data)
+{
+    (void)thread;
+    atomic_fetch_add((_Atomic uint64_t *)data, game->move_count);
+}
+
+static void printGameRate(const char *label, uint64_t games, uint64_t plies, double ms)
+{
+    double per_second = ms > 0 ? games * 1000.0 / ms : 0;
+    printf("%-14s games: %9lu, time: %9.2lf ms, games per second: %9.0lf, plies per second: "
+           "%10.0lf\n", label, (unsigned long)games, ms, per_second,
+           ms > 0 ? plies * 1000.0 / ms : 0);
+}
+
+static void benchPgn(void)
+{
+    printf("\nbenchPgn()\n");
+    enum { GAMES = 2000, MAX_PLIES = 160, PASSES = 10 };
+    size_t capacity = GAMES * (MAX_PLIES * 12 + 512), len = 0;
+    char *pgn = malloc(capacity);
+    static const char *RESULTS[3] = {"1-0", "0-1", "1/2-1/2"};
+
+    srand(2);
+    Board start = initBoardFromFen(PERFT_WORKLOADS[0].fen);
+    uint64_t total_plies = 0;
+    for (int g = 0; g < GAMES; g++) {
+        const char *result = RESULTS[g % 3];
+        len += sprintf(pgn + len,
+                       "[Event \"Random game %d\"]\n[Site \"bench\"]\n[Round \"%d\"]\n"
+                       "[White \"Engine, A\"]\n[Black \"Engine, B\"]\n[Result \"%s\"]\n\n",
+                       g, g + 1, result);
+        Board b = start;
+        int plies = 0;
+        for (; plies < MAX_PLIES; plies++) {
+            MoveList mlist = generateMoves(&b);
+            if (mlist.count == 0 || b.halfmove_clock >= 100)
+                break;
+            Move m = mlist.moves[rand64() % mlist.count];
+            char san[SAN_MAX_LENGTH];
+            writeSan(&b, m, san);
+            if (plies % 2 == 0)
+                len += sprintf(pgn + len, "%d. ", plies / 2 + 1);
+            len += sprintf(pgn + len, "%s ", san);
+            if (plies % 40 == 17)
+                len += sprintf(pgn + len, "{ a comment } ");
+            if (plies % 40 == 29) {
+                writeSan(&b, mlist.moves[0], san);
+                len += sprintf(pgn + len, "$1 (%d%s %s $2) ", plies / 2 + 1,
+                               plies % 2 == 0 ? "." : "...", san);
+            }
+            if (plies % 16 == 15)
+                pgn[len++] = '\n';
+            b = moveMake(m, b);
+        }
+        total_plies += plies;
+        len += sprintf(pgn + len, "%s\n\n", result);
+    }
+
+    uint64_t games = 0, plies = 0, errors = 0;
+    PgnGame *game = malloc(sizeof(PgnGame));
+    double start_ms = wallTimeMs();
+    for (int pass = 0; pass < PASSES; pass++) {
+        PgnReader r;
+        pgnReaderInit(&r, pgn, len);
+        while (pgnReadGame(&r, game)) {
+            games++;
+            plies += game->move_count;
+            errors += game->error != PGN_OK;
+        }
+    }
+    printGameRate("pgn memory:", games, plies, wallTimeMs() - start_ms);
+    if (errors > 0 || plies != total_plies * PASSES)
+        printf("pgn: %lu games with errors, %lu of %lu plies read\n", (unsigned long)errors,
+               (unsigned long)plies, (unsigned long)(total_plies * PASSES));
+    free(game);
+
+    // Same games repeated into a file, read by every core
+    char path[] = "/tmp/benchpgnXXXXXX";
+    int fd = mkstemp(path);
+    FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (f == NULL) {
+        printf("pgn: can't create a temporary file\n");
+        free(pgn);
+        return;
+    }
+    for (int pass = 0; pass < PASSES; pass++)
+        fwrite(pgn, 1, len, f);
+    fclose(f);
+
+    int n_threads = MAX(1, (int)sysconf(_SC_NPROCESSORS_ONLN));
+    const char *paths[1] = {path};
+    _Atomic uint64_t file_plies = 0;
+    start_ms = wallTimeMs();
+    long file_games = pgnReadFiles(paths, 1, n_threads, countGame, &file_plies);
+    char label[32];
+    snprintf(label, sizeof(label), "pgn %dt file:", n_threads);
+    printGameRate(label, MAX(file_games, 0), file_plies, wallTimeMs() - start_ms);
+    unlink(path);
+    free(pgn);
+}
+
+int main(int argc, char **argv)
+{
+    bool run_perft = false, run_search = false, run_nnue = false, run_fen = false;
+    bool run_pgn = false;
+    bool use_perf = true;
+    long eval_cache_entries = EVAL_CACHE_DEFAULT_SIZE;
+    char *nnue_file = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "perft") == 0)
+            run_perft = true;
+        else if (strcmp(argv[i], "search") == 0)
+            run_search = true;
+        else if (strcmp(argv[i], "nnue") == 0)
+            run_nnue = true;
+        else if (strcmp(argv[i], "fen") == 0)
+            run_fen = true;
+        else if (strcmp(argv[i], "pgn") == 0)
+            run_pgn = true;
+        else if (strcmp(argv[i], "all") == 0)
+            run_perft = run_search = run_nnue = run_fen = run_pgn = true;
+        else if (strcmp(argv[i], "--no-perf") == 0)
+            use_perf = false;
+        else if (strcmp(argv[i], "--eval-cache") == 0 && i + 1 < argc)
+            eval_cache_entries = atol(argv[++i]);
+        else if (strcmp(argv[i], "--nnue") == 0 && i + 1 < argc)
+            nnue_file = argv[++i];
+        else {
+            fprintf(stderr, "Usage: %s [perft|search|nnue|fen|pgn|all] [--no-perf] "
+                            "[--eval-cache entries] [--nnue network_file]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!run_perft && !run_search && !run_nnue && !run_fen && !run_pgn)
+        run_perft = run_search = run_nnue = run_fen = run_pgn = true;
+
+    precomputeValues();
+    setEvalCacheSize(eval_cache_entries > 0 ? eval_cache_entries : 0);
+
+    if (run_nnue) {
+        if (nnue_file == NULL) {
+            printf("No network file given, using a random network\n");
+            nnueInitRandom(1);
+        }
+        else if (!nnueLoad(nnue_file)) {
+            return 1;
+        }
+    }
+
+    PerfCounters pc = {0};
+    if (use_perf && perfCountersOpen(&pc)) {
+        printf("Hardware counters:");
+        for (int e = 0; e < NUM_PERF_EVENTS; e++)
+            printf(" %s[%s]", PERF_EVENT_NAMES[e], pc.available[e] ? "on" : "off");
+        printf("\n");
+    }
+    else {
+        perfCountersClose(&pc);
+        printf("Hardware counters unavailable, reporting wall time only\n");
+    }
+
+    if (run_perft)
+        benchPerft(&pc);
+    if (run_search)
+        benchSearch(&pc);
+    if (run_nnue)
+        benchNnue(&pc);
+    if (run_fen)
+        benchFen();
+    if (run_pgn)
+        benchPgn();
+
+    perfCountersClose(&pc);
+    return 0;
+}
@@ -0,0 +1,596 @@
+#include "bitbase.h"
+#include "engine.h"
+#include "generator.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BITBASE_HEADER_SIZE 16
+#define MAX_BITBASES 64
+
+// Generation state of a position besides BitbaseResult values,
+// BITBASE_UNKNOWN doubles as not yet resolved
+#define GEN_INVALID 4
+
+typedef struct {
+    char name[8];
+    int n_pieces;     // besides kings
+    Piece pieces[2];  // colored, white is the stronger side, by PieceIdx
+    bool has_pawns;
+    uint32_t key;     // see materialKey()
+    uint64_t size;    // number of positions
+    const uint8_t *data; // 2 bit results, NULL while generating
+
+    // Backing memory, either a mapped file or results we generated
+    void *mapping;
+    size_t mapping_size;
+    uint8_t *allocated;
+
+    _Atomic uint8_t *gen; // one state per position while generating
+} Bitbase;
+
+static Bitbase bitbases[MAX_BITBASES];
+static int bitbase_count = 0;
+
+// Strong king squares with pawnless tables (a1-d1-d4 triangle)
+static const int TRIANGLE[10] = {0, 1, 2, 3, 9, 10, 11, 18, 19, 27};
+static int TRIANGLE_IDX[64];
+
+static const char PIECE_LETTERS[6] = {
+    [KING_IDX] = 'K', [QUEEN_IDX] = 'Q',  [BISHOP_IDX] = 'B',
+    [KNIGHT_IDX] = 'N', [ROOK_IDX] = 'R', [PAWN_IDX] = 'P',
+};
+static const Piece PIECE_TYPES[6] = {
+    [KING_IDX] = KING, [QUEEN_IDX] = QUEEN,   [BISHOP_IDX] = BISHOP,
+    [KNIGHT_IDX] = KNIGHT, [ROOK_IDX] = ROOK, [PAWN_IDX] = PAWN,
+};
+static const int PIECE_STRENGTH[6] = {
+    [KING_IDX] = 0, [QUEEN_IDX] = 9,   [BISHOP_IDX] = 3,
+    [KNIGHT_IDX] = 3, [ROOK_IDX] = 5, [PAWN_IDX] = 1,
+};
+// Order of pieces in table names, strongest first
+static const int NAME_ORDER[5] = {QUEEN_IDX, ROOK_IDX, BISHOP_IDX, KNIGHT_IDX, PAWN_IDX};
+
+static void initIndexing(void)
+{
+    for (int sq = 0; sq < 64; sq++)
+        TRIANGLE_IDX[sq] = -1;
+    for (int i = 0; i < 10; i++)
+        TRIANGLE_IDX[TRIANGLE[i]] = i;
+}
+
+//
+// Material signatures
+//
+
+// Base 3 number with a digit per colored piece type besides kings,
+// counts[col_idx][piece_idx], colors swapped if flip
+static uint32_t materialKey(const int counts[2][6], bool flip)
+{
+    uint32_t key = 0;
+    for (int col_idx = 0; col_idx < 2; col_idx++)
+        for (int piece_idx = QUEEN_IDX; piece_idx <= PAWN_IDX; piece_idx++)
+            key = key * 3 + counts[col_idx ^ flip][piece_idx];
+    return key;
+}
+
+static void boardCounts(const Board *b, int counts[2][6])
+{
+    for (int col_idx = 0; col_idx < 2; col_idx++)
+        for (int piece_idx = 0; piece_idx < 6; piece_idx++)
+            counts[col_idx][piece_idx] = POPCOUNT(b->bitboards[col_idx][piece_idx]);
+}
+
+static bool isInsufficientMaterial(const int counts[2][6])
+{
+    int minors = 0;
+    for (int col_idx = 0; col_idx < 2; col_idx++) {
+        if (counts[col_idx][QUEEN_IDX] || counts[col_idx][ROOK_IDX] || counts[col_idx][PAWN_IDX])
+            return false;
+        minors += counts[col_idx][BISHOP_IDX] + counts[col_idx][KNIGHT_IDX];
+    }
+    return minors <= 1;
+}
+
+// Parses a name like KQKR into piece counts, colors as written
+static bool parseName(const char *name, int counts[2][6])
+{
+    memset(counts, 0, sizeof(int) * 12);
+    if (name[0] != 'K')
+        return false;
+    int col_idx = 0, total = 1;
+    for (const char *c = name + 1; *c; c++) {
+        int piece_idx = -1;
+        for (int i = 0; i < 6; i++)
+            if (PIECE_LETTERS[i] == *c)
+                piece_idx = i;
+        if (piece_idx < 0)
+            return false;
+        if (piece_idx == KING_IDX && col_idx++ == 1)
+            return false;
+        counts[col_idx][piece_idx] += piece_idx != KING_IDX;
+        total++;
+    }
+    return col_idx == 1 && total <= BITBASE_MAX_PIECES;
+}
+
+static int sideStrength(const int counts[6])
+{
+    int strength = 0;
+    for (int i = 0; i < 6; i++)
+        strength += counts[i] * PIECE_STRENGTH[i];
+    return strength;
+}
+
+// Writes the name with the stronger side first, returns true if the
+// colors of counts had to be swapped for that
+static bool canonicalName(const int counts[2][6], char name[8])
+{
+    char sides[2][4];
+    for (int col_idx = 0; col_idx < 2; col_idx++) {
+        int n = 0;
+        for (int i = 0; i < 5; i++)
+            for (int j = 0; j < counts[col_idx][NAME_ORDER[i]]; j++)
+                sides[col_idx][n++] = '0' + i;
+        sides[col_idx][n] = '\0';
+    }
+
+    int white = sideStrength(counts[0]), black = sideStrength(counts[1]);
+    bool flip = black > white || (black == white && strcmp(sides[1], sides[0]) < 0);
+    int n = 0;
+    for (int side = 0; side < 2; side++) {
+        name[n++] = 'K';
+        for (const char *c = sides[side ^ flip]; *c; c++)
+            name[n++] = PIECE_LETTERS[NAME_ORDER[*c - '0']];
+    }
+    name[n] = '\0';
+    return flip;
+}
+
+static Bitbase *findBitbase(uint32_t key)
+{
+    for (int i = 0; i < bitbase_count; i++)
+        if (bitbases[i].key == key)
+            return &bitbases[i];
+    return NULL;
+}
+
+// Sets up a table for canonical counts, returns NULL if there's no room
+static Bitbase *addBitbase(const int counts[2][6], const char *name)
+{
+    if (bitbase_count == MAX_BITBASES)
+        return NULL;
+    Bitbase *t = &bitbases[bitbase_count++];
+    memset(t, 0, sizeof(*t));
+    strcpy(t->name, name);
+    t->key = materialKey(counts, false);
+    for (int col_idx = 0; col_idx < 2; col_idx++) {
+        for (int piece_idx = QUEEN_IDX; piece_idx <= PAWN_IDX; piece_idx++) {
+            for (int j = 0; j < counts[col_idx][piece_idx]; j++)
+                t->pieces[t->n_pieces++] = (col_idx == 0 ? WHITE : BLACK) | PIECE_TYPES[piece_idx];
+            t->has_pawns |= piece_idx == PAWN_IDX && counts[col_idx][piece_idx] > 0;
+        }
+    }
+    t->size = 2 * (t->has_pawns ? 32 : 10) * 64;
+    for (int i = 0; i < t->n_pieces; i++)
+        t->size *= 64;
+    return t;
+}
+
+//
+// Indexing
+//
+
+// Index of b in t, colors and ranks of b are swapped if flip
+static uint64_t boardIndex(const Bitbase *t, const Board *b, bool flip)
+{
+    int sqs[4], n = 0;
+    sqs[n++] = b->king_squares[flip];
+    sqs[n++] = b->king_squares[!flip];
+    for (int i = 0; i < t->n_pieces; i++) {
+        int col_idx = ((t->pieces[i] & WHITE) ? 0 : 1) ^ flip;
+        uint64_t bb = b->bitboards[col_idx][getPieceIdx(t->pieces[i])];
+        // Second of two identical pieces takes the other square
+        if (i == 1 && t->pieces[1] == t->pieces[0])
+            bb &= bb - 1;
+        sqs[n++] = LSB(bb);
+    }
+
+    // Fold by symmetry so that the strong king is in the indexed region
+    int transform = flip ? 56 : 0;
+    if (((sqs[0] ^ transform) & 7) > 3)
+        transform ^= 7;
+    bool transpose = false;
+    if (!t->has_pawns) {
+        if (((sqs[0] ^ transform) >> 3) > 3)
+            transform ^= 56;
+        int king = sqs[0] ^ transform;
+        transpose = (king >> 3) > (king & 7);
+    }
+    for (int i = 0; i < n; i++) {
+        sqs[i] ^= transform;
+        if (transpose)
+            sqs[i] = ((sqs[i] & 7) << 3) | (sqs[i] >> 3);
+    }
+
+    int stm = ((b->color_to_move & WHITE) ? 0 : 1) ^ flip;
+    uint64_t index = stm * (t->has_pawns ? 32 : 10) +
+                     (t->has_pawns ? (sqs[0] >> 3) * 4 + (sqs[0] & 7) : TRIANGLE_IDX[sqs[0]]);
+    for (int i = 1; i < n; i++)
+        index = index * 64 + sqs[i];
+    return index;
+}
+
+// Inverse of boardIndex(), returns false for illegal positions
+static bool decodeIndex(const Bitbase *t, uint64_t index, Board *b)
+{
+    int n = 2 + t->n_pieces, sqs[4];
+    for (int i = n - 1; i >= 1; i--) {
+        sqs[i] = index % 64;
+        index /= 64;
+    }
+    int king_squares = t->has_pawns ? 32 : 10;
+    int king = index % king_squares, stm = index / king_squares;
+    sqs[0] = t->has_pawns ? (king / 4) * 8 + king % 4 : TRIANGLE[king];
+
+    const Piece placed[4] = {WHITE | KING, BLACK | KING, t->pieces[0], t->pieces[1]};
+    Piece pieces[64] = {EMPTY_PIECE};
+    for (int i = 0; i < n; i++) {
+        int rank = sqs[i] >> 3;
+        if (pieces[sqs[i]] != EMPTY_PIECE || ((placed[i] & PAWN) && (rank == 0 || rank == 7)))
+            return false;
+        pieces[sqs[i]] = placed[i];
+    }
+    *b = initBoardFromPieces(pieces, stm == 0 ? WHITE : BLACK);
+
+    // Side that just moved can't be left in check
+    return !isKingChecked(b, stm == 0 ? BLACK : WHITE);
+}
+
+static BitbaseResult readResult(const Bitbase *t, uint64_t index)
+{
+    return (t->data[index / 4] >> (2 * (index % 4))) & 3;
+}
+
+// En passant capture is possible, which the index can't represent
+static bool isEpRelevant(const Board *b)
+{
+    if (b->ep_square == -1)
+        return false;
+    int col_idx = (b->color_to_move & WHITE) ? 0 : 1;
+    return (pawnAttacks(1ull << b->ep_square, 1 - col_idx) & b->bitboards[col_idx][PAWN_IDX]) != 0;
+}
+
+BitbaseResult probeBitbase(const Board *b)
+{
+    if (bitbase_count == 0 || b->castle_rights != NO_CASTLE ||
+        POPCOUNT(b->occupancy[0] | b->occupancy[1]) > BITBASE_MAX_PIECES || isEpRelevant(b))
+        return BITBASE_UNKNOWN;
+
+    int counts[2][6];
+    boardCounts(b, counts);
+    uint32_t key = materialKey(counts, false), flipped_key = materialKey(counts, true);
+    for (int i = 0; i < bitbase_count; i++) {
+        const Bitbase *t = &bitbases[i];
+        if (t->data == NULL)
+            continue;
+        if (t->key == key)
+            return readResult(t, boardIndex(t, b, false));
+        if (t->key == flipped_key)
+            return readResult(t, boardIndex(t, b, true));
+    }
+    return BITBASE_UNKNOWN;
+}
+
+//
+// Loading
+//
+
+int bitbaseLoad(const char *dir)
+{
+    initIndexing();
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return 0;
+
+    int loaded = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        char name[8], canonical[8], path[1024];
+        size_t len = strlen(entry->d_name);
+        if (len < 4 || len - 3 >= sizeof(name) || strcmp(entry->d_name + len - 3, ".bb") != 0)
+            continue;
+        memcpy(name, entry->d_name, len - 3);
+        name[len - 3] = '\0';
+
+        int counts[2][6];
+        if (!parseName(name, counts) || canonicalName(counts, canonical) ||
+            strcmp(name, canonical) != 0 || findBitbase(materialKey(counts, false)) != NULL)
+            continue;
+
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            if (fd >= 0)
+                close(fd);
+            continue;
+        }
+        void *mapping = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+                                       : MAP_FAILED;
+        close(fd);
+        if (mapping == MAP_FAILED)
+            continue;
+
+        Bitbase *t = addBitbase(counts, name);
+        if (t == NULL) {
+            munmap(mapping, st.st_size);
+            break;
+        }
+        // The header is only read from files long enough to hold it
+        const unsigned char *header = mapping;
+        uint32_t version = 0;
+        uint64_t size = 0;
+        bool has_header = (size_t)st.st_size >= BITBASE_HEADER_SIZE;
+        if (has_header) {
+            memcpy(&version, header + 4, sizeof(version));
+            memcpy(&size, header + 8, sizeof(size));
+        }
+        if (!has_header || memcmp(header, "CEBB", 4) != 0 || version != BITBASE_VERSION ||
+            size != t->size || (size_t)st.st_size != BITBASE_HEADER_SIZE + (size + 3) / 4) {
+            fprintf(stderr, "bitbase: %s doesn't match the expected layout\n", path);
+            munmap(mapping, st.st_size);
+            bitbase_count--;
+            continue;
+        }
+        t->mapping = mapping;
+        t->mapping_size = st.st_size;
+        t->data = header + BITBASE_HEADER_SIZE;
+        loaded++;
+    }
+    closedir(d);
+    return loaded;
+}
+
+void bitbaseUnload(void)
+{
+    for (int i = 0; i < bitbase_count; i++) {
+        if (bitbases[i].mapping != NULL)
+            munmap(bitbases[i].mapping, bitbases[i].mapping_size);
+        free(bitbases[i].allocated);
+    }
+    bitbase_count = 0;
+}
+
+int bitbaseCount(void)
+{
+    return bitbase_count;
+}
+
+//
+// Generation
+//
+
+static int classify(const Bitbase *t, const Board *b);
+
+// Result of a position reached from t by one move
+static int childResult(const Bitbase *t, const Board *child)
+{
+    int counts[2][6];
+    boardCounts(child, counts);
+    uint32_t key = materialKey(counts, false);
+    if (key == t->key || materialKey(counts, true) == t->key) {
+        // Only a pawn moving two squares can leave en passant possible
+        if (isEpRelevant(child))
+            return classify(t, child);
+        return atomic_load_explicit(&t->gen[boardIndex(t, child, key != t->key)],
+                                    memory_order_relaxed);
+    }
+    if (isInsufficientMaterial(counts))
+        return BITBASE_DRAW;
+    return probeBitbase(child);
+}
+
+// Resolves b from the results of its children as far as they are known
+static int classify(const Bitbase *t, const Board *b)
+{
+    MoveList mlist = generateMoves(b);
+    if (mlist.count == 0)
+        return isKingChecked(b, b->color_to_move) ? BITBASE_LOSS : BITBASE_DRAW;
+
+    bool all_resolved = true, all_won = true;
+    for (size_t i = 0; i < mlist.count; i++) {
+        Board child = moveMake(mlist.moves[i], *b);
+        int result = childResult(t, &child);
+        if (result == BITBASE_LOSS)
+            return BITBASE_WIN;
+        all_won &= result == BITBASE_WIN;
+        all_resolved &= result != BITBASE_UNKNOWN;
+    }
+    if (all_won)
+        return BITBASE_LOSS;
+    return all_resolved ? BITBASE_DRAW : BITBASE_UNKNOWN;
+}
+
+typedef struct {
+    Bitbase *t;
+    uint64_t begin, end;
+    bool first_pass;
+    uint64_t changed;
+} GenerationJob;
+
+// One pass over a range of positions, resolving what can be resolved
+// Threads read each other's results as they are written, that only
+// speeds up convergence as results never change once set
+static void *generationPass(void *arg)
+{
+    GenerationJob *job = arg;
+    Bitbase *t = job->t;
+    job->changed = 0;
+    for (uint64_t index = job->begin; index < job->end; index++) {
+        if (atomic_load_explicit(&t->gen[index], memory_order_relaxed) != BITBASE_UNKNOWN)
+            continue;
+        Board b;
+        int result = decodeIndex(t, index, &b) ? classify(t, &b) : GEN_INVALID;
+        if (result == GEN_INVALID && !job->first_pass)
+            continue;
+        if (result != BITBASE_UNKNOWN) {
+            atomic_store_explicit(&t->gen[index], result, memory_order_relaxed);
+            job->changed++;
+        }
+    }
+    return NULL;
+}
+
+static bool writeBitbase(const Bitbase *t, const char *dir)
+{
+    char path[1024];
+    mkdir(dir, 0755);
+    snprintf(path, sizeof(path), "%s/%s.bb", dir, t->name);
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "bitbase: can't write %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    unsigned char header[BITBASE_HEADER_SIZE] = "CEBB";
+    uint32_t version = BITBASE_VERSION;
+    memcpy(header + 4, &version, sizeof(version));
+    memcpy(header + 8, &t->size, sizeof(t->size));
+    fwrite(header, 1, sizeof(header), f);
+    fwrite(t->data, 1, (t->size + 3) / 4, f);
+    return fclose(f) == 0;
+}
+
+// generateBitbase() once dir is loaded
+static bool buildBitbase(const char *name, const char *dir, int n_threads)
+{
+    initIndexing();
+    int counts[2][6];
+    char canonical[8];
+    if (!parseName(name, counts)) {
+        fprintf(stderr, "bitbase: %s isn't a material signature of up to %d pieces\n", name,
+                BITBASE_MAX_PIECES);
+        return false;
+    }
+    if (canonicalName(counts, canonical)) {
+        for (int piece_idx = 0; piece_idx < 6; piece_idx++) {
+            int tmp = counts[0][piece_idx];
+            counts[0][piece_idx] = counts[1][piece_idx];
+            counts[1][piece_idx] = tmp;
+        }
+    }
+    if (isInsufficientMaterial(counts)) {
+        fprintf(stderr, "bitbase: %s is always drawn, no table needed\n", canonical);
+        return false;
+    }
+    if (findBitbase(materialKey(counts, false)) != NULL)
+        return true;
+
+    // Tables reached by captures and promotions first
+    for (int col_idx = 0; col_idx < 2; col_idx++) {
+        for (int piece_idx = QUEEN_IDX; piece_idx <= PAWN_IDX; piece_idx++) {
+            if (counts[col_idx][piece_idx] == 0)
+                continue;
+            int sub[2][6];
+            char sub_name[8];
+            memcpy(sub, counts, sizeof(sub));
+            sub[col_idx][piece_idx]--;
+            canonicalName(sub, sub_name);
+            if (!isInsufficientMaterial(sub) && !buildBitbase(sub_name, dir, n_threads))
+                return false;
+            if (piece_idx != PAWN_IDX)
+                continue;
+
+            for (int promoted = QUEEN_IDX; promoted <= ROOK_IDX; promoted++) {
+                // Plain promotion, and promotions capturing each enemy piece
+                for (int captured = -1; captured <= PAWN_IDX; captured++) {
+                    memcpy(sub, counts, sizeof(sub));
+                    sub[col_idx][PAWN_IDX]--;
+                    sub[col_idx][promoted]++;
+                    if (captured >= 0) {
+                        if (captured == KING_IDX || captured == PAWN_IDX ||
+                            sub[1 - col_idx][captured] == 0)
+                            continue;
+                        sub[1 - col_idx][captured]--;
+                    }
+                    canonicalName(sub, sub_name);
+                    if (!isInsufficientMaterial(sub) && !buildBitbase(sub_name, dir, n_threads))
+                        return false;
+                }
+            }
+        }
+    }
+
+    Bitbase *t = addBitbase(counts, canonical);
+    if (t == NULL) {
+        fprintf(stderr, "bitbase: more than %d tables\n", MAX_BITBASES);
+        return false;
+    }
+    t->gen = calloc(t->size, sizeof(*t->gen));
+    t->allocated = calloc((t->size + 3) / 4, 1);
+    if (t->gen == NULL || t->allocated == NULL) {
+        fprintf(stderr, "bitbase: out of memory for %s\n", canonical);
+        free(t->gen);
+        free(t->allocated);
+        bitbase_count--;
+        return false;
+    }
+
+    n_threads = MAX(1, MIN(n_threads, 64));
+    pthread_t threads[64];
+    GenerationJob jobs[64];
+    uint64_t changed = 1;
+    for (int pass = 0; changed > 0; pass++) {
+        for (int i = 0; i < n_threads; i++) {
+            jobs[i] = (GenerationJob){
+                .t = t,
+                .begin = t->size * i / n_threads,
+                .end = t->size * (i + 1) / n_threads,
+                .first_pass = pass == 0,
+            };
+            pthread_create(&threads[i], NULL, generationPass, &jobs[i]);
+        }
+        changed = 0;
+        for (int i = 0; i < n_threads; i++) {
+            pthread_join(threads[i], NULL);
+            changed += jobs[i].changed;
+        }
+    }
+
+    // Positions never resolved can't be forced either way
+    uint64_t wins = 0, losses = 0;
+    for (uint64_t index = 0; index < t->size; index++) {
+        int state = t->gen[index];
+        int result = state == GEN_INVALID        ? 0
+                     : state == BITBASE_UNKNOWN ? BITBASE_DRAW
+                                                : state;
+        wins += result == BITBASE_WIN;
+        losses += result == BITBASE_LOSS;
+        t->allocated[index / 4] |= result << (2 * (index % 4));
+    }
+    free(t->gen);
+    t->gen = NULL;
+    t->data = t->allocated;
+    printf("bitbase: %s, %lu positions, %lu wins, %lu losses for the side to move\n", t->name,
+           (unsigned long)t->size, (unsigned long)wins, (unsigned long)losses);
+
+    return dir == NULL || writeBitbase(t, dir);
+}
+
+bool generateBitbase(const char *name, const char *dir, int n_threads)
+{
+    // Tables already written, this one or those it depends on, aren't rebuilt
+    if (dir != NULL)
+        bitbaseLoad(dir);
+    return buildBitbase(name, dir, n_threads);
+}
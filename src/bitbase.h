@@ -0,0 +1,47 @@
+#ifndef BITBASE_H
+#define BITBASE_H
+
+#include "board.h"
+
+#include <stdbool.h>
+
+// Win/draw/loss bitbases for endings with up to 4 pieces (kings included)
+//
+// Each table covers one material signature, named with the stronger side
+// first, e.g. KQKR, KPK. Positions are indexed by side to move, the strong
+// king folded by symmetry (a1-d1-d4 triangle, files a-d with pawns), the
+// weak king and the other pieces' squares. Results take 2 bits each.
+// Positions with castling rights or an en passant square aren't covered.
+//
+// File layout (little endian), mapped read only with mmap:
+//   16 byte header: "CEBB", uint32 version, uint64 number of positions
+//   2 bit results (BitbaseResult, 0 for illegal positions), 4 per byte
+
+#define BITBASE_MAX_PIECES 4
+#define BITBASE_VERSION 1
+
+// Score of a won bitbase position, on top of the evaluation so that the
+// search still prefers positions that are easier to convert
+#define BITBASE_WIN_SCORE 10000
+
+typedef enum {
+    BITBASE_UNKNOWN, // not covered by a loaded table
+    BITBASE_DRAW,
+    BITBASE_WIN,     // for the side to move
+    BITBASE_LOSS,
+} BitbaseResult;
+
+// Maps every table file (e.g. KQKR.bb) in dir, returns how many were loaded
+int bitbaseLoad(const char *dir);
+void bitbaseUnload(void);
+int bitbaseCount(void);
+
+// Result of b for the side to move, safe to call from multiple threads
+BitbaseResult probeBitbase(const Board *b);
+
+// Builds a table by retrograde analysis with n_threads threads, tables it
+// depends on (after captures and promotions) are loaded from dir or built
+// first. Tables are kept loaded and written to dir unless dir is NULL
+bool generateBitbase(const char *name, const char *dir, int n_threads);
+
+#endif // !BITBASE_H
@@ -1,4 +1,6 @@
 #include "board.h"
+#include "evaluate.h"
+#include "generator.h"
 #include "piece.h"
 #include "utils.h"
 #include "zobrist.h"
@@ -9,121 +11,250 @@
 #include <stdlib.h>
 #include <string.h>
 
-Board initBoardFromFen(char *starting_fen)
+static void initBoardState(Board *b);
+
+// Piece for each FEN letter, EMPTY_PIECE for anything else
+static const Piece FEN_PIECES[256] = {
+    ['K'] = WHITE | KING, ['Q'] = WHITE | QUEEN, ['B'] = WHITE | BISHOP,
+    ['N'] = WHITE | KNIGHT, ['R'] = WHITE | ROOK, ['P'] = WHITE | PAWN,
+    ['k'] = BLACK | KING, ['q'] = BLACK | QUEEN, ['b'] = BLACK | BISHOP,
+    ['n'] = BLACK | KNIGHT, ['r'] = BLACK | ROOK, ['p'] = BLACK | PAWN,
+};
+
+static const char *FEN_ERROR_STRINGS[] = {
+    [FEN_OK] = "ok",
+    [FEN_BAD_PLACEMENT] = "bad piece placement",
+    [FEN_BAD_KINGS] = "not one king per side",
+    [FEN_BAD_PAWNS] = "pawn on the first or last rank",
+    [FEN_BAD_SIDE] = "bad side to move",
+    [FEN_BAD_CASTLING] = "bad castling rights",
+    [FEN_BAD_EP_SQUARE] = "bad en passant square",
+    [FEN_BAD_CLOCKS] = "bad move clocks",
+    [FEN_OPPONENT_IN_CHECK] = "side not to move is in check",
+};
+
+const char *fenErrorString(FenError err)
+{
+    return FEN_ERROR_STRINGS[err];
+}
+
+static bool isFenSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Reads the next whitespace separated field of str[*pos, len)
+// Returns its length, 0 at the end of the string or line
+static size_t nextField(const char *str, size_t len, size_t *pos, const char **field)
+{
+    size_t i = *pos;
+    while (i < len && isFenSpace(str[i]))
+        i++;
+    size_t start = i;
+    while (i < len && str[i] != '\0' && str[i] != '\n' && !isFenSpace(str[i]))
+        i++;
+    *field = str + start;
+    *pos = i;
+    return i - start;
+}
+
+// Parses a field of only digits, false if it isn't one or overflows
+static bool parseClock(const char *field, size_t n, int *value)
+{
+    if (n == 0 || n > 9)
+        return false;
+    int v = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!isdigit((unsigned char)field[i]))
+            return false;
+        v = v * 10 + (field[i] - '0');
+    }
+    *value = v;
+    return true;
+}
+
+bool isSquareAttacked(const Board *b, int sq, int col_idx)
+{
+    const uint64_t *bb = b->bitboards[col_idx];
+    uint64_t occupied = b->occupancy[0] | b->occupancy[1];
+    return (KNIGHT_ATTACK_MAPS[sq] & bb[KNIGHT_IDX])
+           || (KING_ATTACK_MAPS[sq] & bb[KING_IDX])
+           || (pawnAttacks(1ull << sq, !col_idx) & bb[PAWN_IDX])
+           || (rookAttacks(sq, occupied) & (bb[ROOK_IDX] | bb[QUEEN_IDX]))
+           || (bishopAttacks(sq, occupied) & (bb[BISHOP_IDX] | bb[QUEEN_IDX]));
+}
+
+FenError parseFen(const char *str, size_t len, Board *out, size_t *consumed)
 {
-    // Initialize with default values
     Board b = {
         .castle_rights = NO_CASTLE,
         .ep_square = -1,
         .halfmove_clock = 0,
         .fullmoves = 1,
-        .king_squares = {-1},
-        .zobrist_hash = 0,
+        .king_squares = {-1, -1},
     };
+    size_t pos = 0;
+    const char *field;
+    size_t n;
 
-    Piece types[256];
-    types['K'] = WHITE | KING;
-    types['Q'] = WHITE | QUEEN;
-    types['B'] = WHITE | BISHOP;
-    types['N'] = WHITE | KNIGHT;
-    types['R'] = WHITE | ROOK;
-    types['P'] = WHITE | PAWN;
-    types['k'] = BLACK | KING;
-    types['q'] = BLACK | QUEEN;
-    types['b'] = BLACK | BISHOP;
-    types['n'] = BLACK | KNIGHT;
-    types['r'] = BLACK | ROOK;
-    types['p'] = BLACK | PAWN;
-
-    char fen[100];
-    strncpy(fen, starting_fen, sizeof(fen));
-
-    // Piece arrangement
-    char *arrangement = strtok(fen, " ");
-    if (arrangement == NULL)
-        assert(0 && "No piece arrangement information in FEN");
-
-    size_t n = strlen(arrangement);
+    // Piece placement, rank 8 first
+    n = nextField(str, len, &pos, &field);
     int rank = 7, file = 0;
     for (size_t i = 0; i < n; i++) {
-        char c = arrangement[i];
+        char c = field[i];
         if (c == '/') {
+            if (file != 8 || rank == 0)
+                return FEN_BAD_PLACEMENT;
             rank--;
             file = 0;
         }
-        else if (isalpha(c)) {
-            int sq = rank * 8 + file;
-            b.pieces[sq] = types[(uint8_t)c];
-            if (c == 'K')
-                b.king_squares[0] = sq;
-            else if (c == 'k')
-                b.king_squares[1] = sq;
-            file++;
+        else if (c >= '1' && c <= '8') {
+            file += c - '0';
+            if (file > 8)
+                return FEN_BAD_PLACEMENT;
         }
-        else if (isdigit(c)) {
-            int skips = c - '0';
-            for (int j = 0; j < skips; j++) {
-                b.pieces[rank * 8 + file] = EMPTY_PIECE;
-                file++;
+        else {
+            Piece p = FEN_PIECES[(uint8_t)c];
+            if (p == EMPTY_PIECE || file == 8)
+                return FEN_BAD_PLACEMENT;
+            int sq = rank * 8 + file++;
+            b.pieces[sq] = p;
+            if (p & KING) {
+                int col_idx = (p & WHITE) ? 0 : 1;
+                if (b.king_squares[col_idx] != -1)
+                    return FEN_BAD_KINGS;
+                b.king_squares[col_idx] = sq;
+            }
+            else if ((p & PAWN) && (rank == 0 || rank == 7)) {
+                return FEN_BAD_PAWNS;
             }
         }
     }
+    if (rank != 0 || file != 8)
+        return FEN_BAD_PLACEMENT;
+    if (b.king_squares[0] == -1 || b.king_squares[1] == -1)
+        return FEN_BAD_KINGS;
 
-    // Turn
-    char *turn = strtok(NULL, " ");
-    if (turn == NULL)
-        assert(0 && "Insufficient FEN string information");
-    b.color_to_move = (turn[0] == 'b' ? BLACK : WHITE);
+    // Side to move
+    n = nextField(str, len, &pos, &field);
+    if (n != 1 || (field[0] != 'w' && field[0] != 'b'))
+        return FEN_BAD_SIDE;
+    b.color_to_move = field[0] == 'w' ? WHITE : BLACK;
 
-    // Castle rights
-    char *rights = strtok(NULL, " ");
-    if (rights == NULL)
-        assert(0 && "No castling rights in FEN");
-
-    if (rights[0] != '-') {
-        n = strlen(rights);
+    // Castling rights, the king and rook must still be at home
+    n = nextField(str, len, &pos, &field);
+    if (n == 0 || n > 4)
+        return FEN_BAD_CASTLING;
+    if (!(n == 1 && field[0] == '-')) {
         for (size_t i = 0; i < n; i++) {
-            switch (rights[i]) {
-            case 'K':
-                b.castle_rights |= WKSC;
-                break;
-            case 'Q':
-                b.castle_rights |= WQSC;
-                break;
-            case 'k':
-                b.castle_rights |= BKSC;
-                break;
-            case 'q':
-                b.castle_rights |= BQSC;
-                break;
+            CastleRight right;
+            int king_sq, rook_sq;
+            Piece color;
+            switch (field[i]) {
+            case 'K': right = WKSC, color = WHITE, king_sq = 4, rook_sq = 7; break;
+            case 'Q': right = WQSC, color = WHITE, king_sq = 4, rook_sq = 0; break;
+            case 'k': right = BKSC, color = BLACK, king_sq = 60, rook_sq = 63; break;
+            case 'q': right = BQSC, color = BLACK, king_sq = 60, rook_sq = 56; break;
+            default: return FEN_BAD_CASTLING;
             }
+            if ((b.castle_rights & right) || b.pieces[king_sq] != (color | KING)
+                || b.pieces[rook_sq] != (color | ROOK))
+                return FEN_BAD_CASTLING;
+            b.castle_rights |= right;
         }
     }
 
-    // En passant target square
-    char *ep_square = strtok(NULL, " ");
-    if (ep_square == NULL)
-        assert(0 && "No ep square given in FEN");
-    if (ep_square[0] != '-') {
-        b.ep_square = squareNameToIdx(ep_square);
+    // En passant target, behind a pawn that just made a double push
+    n = nextField(str, len, &pos, &field);
+    if (n == 0)
+        return FEN_BAD_EP_SQUARE;
+    if (!(n == 1 && field[0] == '-')) {
+        if (n != 2 || field[0] < 'a' || field[0] > 'h')
+            return FEN_BAD_EP_SQUARE;
+        bool white = b.color_to_move == WHITE;
+        if (field[1] != (white ? '6' : '3'))
+            return FEN_BAD_EP_SQUARE;
+        int sq = (field[1] - '1') * 8 + (field[0] - 'a');
+        int pawn_sq = white ? sq - 8 : sq + 8;
+        int from_sq = white ? sq + 8 : sq - 8;
+        if (b.pieces[sq] != EMPTY_PIECE || b.pieces[from_sq] != EMPTY_PIECE
+            || b.pieces[pawn_sq] != ((white ? BLACK : WHITE) | PAWN))
+            return FEN_BAD_EP_SQUARE;
+        b.ep_square = sq;
+    }
+
+    // Move clocks are optional, EPD leaves them out
+    size_t end = pos;
+    n = nextField(str, len, &pos, &field);
+    if (n > 0 && isdigit((unsigned char)field[0])) {
+        if (!parseClock(field, n, &b.halfmove_clock))
+            return FEN_BAD_CLOCKS;
+        end = pos;
+        n = nextField(str, len, &pos, &field);
+        if (n > 0 && isdigit((unsigned char)field[0])) {
+            if (!parseClock(field, n, &b.fullmoves) || b.fullmoves == 0)
+                return FEN_BAD_CLOCKS;
+            end = pos;
+        }
     }
 
-    // Haflmove clock and fullmoves
-    char *halfmove_clock = strtok(NULL, " ");
-    if (halfmove_clock == NULL)
-        goto defer;
-    b.halfmove_clock = atoi(halfmove_clock);
+    initBoardState(&b);
+    int them = b.color_to_move == WHITE ? 1 : 0;
+    if (isSquareAttacked(&b, b.king_squares[them], !them))
+        return FEN_OPPONENT_IN_CHECK;
 
-    char *fullmoves = strtok(NULL, " ");
-    if (fullmoves == NULL)
-        goto defer;
-    b.fullmoves = atoi(fullmoves);
+    *out = b;
+    if (consumed != NULL)
+        *consumed = end;
+    return FEN_OK;
+}
+
+Board initBoardFromFen(const char *fen)
+{
+    Board b;
+    FenError err = parseFen(fen, strlen(fen), &b, NULL);
+    if (err != FEN_OK) {
+        fprintf(stderr, "Invalid FEN \"%s\": %s\n", fen, fenErrorString(err));
+        assert(0 && "Invalid FEN");
+    }
+    return b;
+}
 
-defer:
-    b.zobrist_hash = getZobristHash(&b);
+Board initBoardFromPieces(const Piece pieces[64], Piece color_to_move)
+{
+    Board b = {
+        .color_to_move = color_to_move,
+        .castle_rights = NO_CASTLE,
+        .ep_square = -1,
+        .fullmoves = 1,
+        .king_squares = {-1, -1},
+    };
+    memcpy(b.pieces, pieces, sizeof(b.pieces));
+    for (int sq = 0; sq < 64; sq++) {
+        if (pieces[sq] == (WHITE | KING))
+            b.king_squares[0] = sq;
+        else if (pieces[sq] == (BLACK | KING))
+            b.king_squares[1] = sq;
+    }
+    initBoardState(&b);
     return b;
 }
 
+// Fills bitboards, hashes and evaluation accumulators from pieces
+static void initBoardState(Board *b)
+{
+    for (int sq = 0; sq < 64; sq++) {
+        if (b->pieces[sq] == EMPTY_PIECE)
+            continue;
+        int col_idx = (b->pieces[sq] & WHITE) ? 0 : 1;
+        b->bitboards[col_idx][getPieceIdx(b->pieces[sq])] |= 1ull << sq;
+        b->occupancy[col_idx] |= 1ull << sq;
+    }
+    b->zobrist_hash = getZobristHash(b);
+    b->pawn_hash = getPawnZobristHash(b);
+    getPsqtScores(b, b->psqt, &b->phase);
+}
+
 // Hashes a chess position
 uint64_t getZobristHash(const Board *b)
 {
@@ -152,6 +283,19 @@ uint64_t getZobristHash(const Board *b)
     return hash;
 }
 
+// Hashes pawn placement only, positions with same pawn structure share it
+uint64_t getPawnZobristHash(const Board *b)
+{
+    uint64_t hash = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        if (!(b->pieces[sq] & PAWN))
+            continue;
+        int col_idx = (b->pieces[sq] & WHITE) ? 0 : 1;
+        hash ^= ZOBRIST.pieces[col_idx][PAWN_IDX][sq];
+    }
+    return hash;
+}
+
 void printBoard(const Board b)
 {
     for (int rank = 7; rank >= 0; rank--) {
@@ -184,59 +328,79 @@ void printBoard(const Board b)
     );
 }
 
-void printBoardFenToString(char *str, int max_str_size, const Board *b)
+// Writes n in decimal, returns the number of digits
+static int writeNumber(char *out, unsigned n)
 {
-    // Ex: starting postion fen: "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
-    char arrangement[100];
-    int i = -1;
+    char digits[10];
+    int count = 0;
+    do {
+        digits[count++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    for (int i = 0; i < count; i++)
+        out[i] = digits[count - 1 - i];
+    return count;
+}
 
+int writeFen(const Board *b, char *out)
+{
+    // Ex: starting postion fen: "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+    int i = 0;
     for (int rank = 7; rank >= 0; rank--) {
         int empty = 0;
         for (int file = 0; file < 8; file++) {
-            int sq = rank * 8 + file;
-            Piece p = b->pieces[sq];
+            Piece p = b->pieces[rank * 8 + file];
             if (p == EMPTY_PIECE) {
                 empty++;
-            } else {
-                if (empty > 0) {
-                    arrangement[++i] = empty + '0';
-                    empty = 0;
-                }
-                arrangement[++i] = pieceToNotation(p);
+                continue;
+            }
+            if (empty > 0) {
+                out[i++] = empty + '0';
+                empty = 0;
             }
+            out[i++] = pieceToNotation(p);
         }
         if (empty > 0)
-            arrangement[++i] = empty + '0';
-        arrangement[++i] = '/';
+            out[i++] = empty + '0';
+        if (rank > 0)
+            out[i++] = '/';
     }
-    arrangement[i] = '\0'; // remove last '/' and terminate the string
 
-    char turn = (b->color_to_move & WHITE ? 'w' : 'b');
+    out[i++] = ' ';
+    out[i++] = (b->color_to_move & WHITE) ? 'w' : 'b';
 
-    char castles[5];
-    i = -1;
-	if (b->castle_rights == NO_CASTLE) {
-		castles[++i] = '-';
-	} else {
-		if (b->castle_rights & WKSC) castles[++i] = 'K';
-		if (b->castle_rights & WQSC) castles[++i] = 'Q';
-		if (b->castle_rights & BKSC) castles[++i] = 'k';
-		if (b->castle_rights & BQSC) castles[++i] = 'q';
-	}
-    castles[++i] = '\0';
+    out[i++] = ' ';
+    if (b->castle_rights == NO_CASTLE)
+        out[i++] = '-';
+    if (b->castle_rights & WKSC) out[i++] = 'K';
+    if (b->castle_rights & WQSC) out[i++] = 'Q';
+    if (b->castle_rights & BKSC) out[i++] = 'k';
+    if (b->castle_rights & BQSC) out[i++] = 'q';
 
-
-    char ep_square[3];
-    i = -1;
+    out[i++] = ' ';
     if (b->ep_square == -1) {
-        ep_square[++i] = '-';
+        out[i++] = '-';
     } else {
-		ep_square[++i] = b->ep_square % 8 + 'a'; // file
-		ep_square[++i] = b->ep_square / 8 + '1'; // rank
+        out[i++] = b->ep_square % 8 + 'a';
+        out[i++] = b->ep_square / 8 + '1';
     }
-    ep_square[++i] = '\0';
 
-    // "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
-    snprintf(str, max_str_size,  "%s %c %s %s %d %d", arrangement, turn, castles, ep_square, b->halfmove_clock, b->fullmoves);
+    out[i++] = ' ';
+    i += writeNumber(out + i, b->halfmove_clock);
+    out[i++] = ' ';
+    i += writeNumber(out + i, b->fullmoves);
+    out[i] = '\0';
+    return i;
 }
 
+void printBoardFenToString(char *str, int max_str_size, const Board *b)
+{
+    if (max_str_size <= 0)
+        return;
+    char fen[FEN_MAX_LENGTH];
+    int n = writeFen(b, fen);
+    if (n >= max_str_size)
+        n = max_str_size - 1;
+    memcpy(str, fen, n);
+    str[n] = '\0';
+}
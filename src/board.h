@@ -4,6 +4,16 @@
 #include "piece.h"
 #include "castle.h"
 
+#include <stddef.h>
+
+// A piece put on or removed from a square by the last moveMake()
+// Consumed by NNUE to update its accumulators incrementally
+typedef struct {
+    Piece piece;
+    int8_t sq;
+    bool added;
+} DirtyPiece;
+
 typedef struct {
     Piece pieces[64];
     Piece color_to_move;
@@ -13,10 +23,63 @@ typedef struct {
     int fullmoves;
     int king_squares[2];
     uint64_t zobrist_hash;
+    uint64_t pawn_hash; // Zobrist hash of pawns only, keys the pawn table
+
+    // Bitboards mirroring pieces[], indexed by color (0 white, 1 black)
+    // and PieceIdx, updated incrementally by moveMake()
+    uint64_t bitboards[2][6];
+    uint64_t occupancy[2];
+
+    // Evaluation accumulators, updated incrementally by moveMake()
+    // psqt: material + piece square score from white's point of view,
+    // [0] midgame, [1] endgame. phase: sum of PHASE_WEIGHTS of pieces on board
+    int psqt[2];
+    int phase;
+
+    // Changes made by the last moveMake(), at most 4 (castling moves both
+    // king and rook), empty for a board made from fen
+    DirtyPiece dirty[4];
+    int dirty_count;
 } Board;
 
-Board initBoardFromFen(char *starting_fen);
+typedef enum {
+    FEN_OK,
+    FEN_BAD_PLACEMENT,      // rank or file count, unknown piece letter
+    FEN_BAD_KINGS,          // not exactly one king per side
+    FEN_BAD_PAWNS,          // pawn on the first or last rank
+    FEN_BAD_SIDE,
+    FEN_BAD_CASTLING,       // malformed, or king or rook not at home
+    FEN_BAD_EP_SQUARE,      // malformed, or no pawn that just double pushed
+    FEN_BAD_CLOCKS,
+    FEN_OPPONENT_IN_CHECK,
+} FenError;
+
+// The initial position
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+// Bytes writeFen() may write, including the null terminator
+#define FEN_MAX_LENGTH 128
+
+// Parses the FEN at the start of str[0, len), str doesn't have to be null
+// terminated. The move clocks are optional so EPD records parse too.
+// Reentrant, b is only written on success and consumed (may be NULL) is set
+// to the number of bytes read, what follows is left to the caller
+FenError parseFen(const char *str, size_t len, Board *b, size_t *consumed);
+const char *fenErrorString(FenError err);
+
+// Writes b's null terminated FEN to out, which has room for FEN_MAX_LENGTH
+// bytes, returns its length
+int writeFen(const Board *b, char *out);
+
+// parseFen() for trusted strings, asserts that the FEN is valid
+Board initBoardFromFen(const char *fen);
+// Board with pieces placed as given, no castling rights or en passant square
+Board initBoardFromPieces(const Piece pieces[64], Piece color_to_move);
+// Whether sq is attacked by pieces of color col_idx (0 white, 1 black),
+// from the bitboards
+bool isSquareAttacked(const Board *b, int sq, int col_idx);
 uint64_t getZobristHash(const Board *b);
+uint64_t getPawnZobristHash(const Board *b);
 void printBoard(const Board b);
 void printBoardFenToString(char *str, int max_str_size, const Board *b);
 
@@ -0,0 +1,73 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include "board.h"
+#include "move.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Opening books in Polyglot's .bin layout
+//
+// A book is an array of 16 byte big endian entries sorted by key: position
+// key, move, weight and a learn field that's kept but not used. Moves are
+// encoded as in Polyglot: to square in bits 0-5 and from square in bits
+// 6-11 (a1 = 0, h8 = 63), promotion piece in bits 12-14 (1 knight up to 4
+// queen), castling as the king taking its own rook. Books are memory mapped
+// and looked up with a binary search.
+//
+// Keys are Polyglot's, see polyglotKey(), so books written by other tools
+// work as well as those built from PGN collections with build/explorer book.
+
+#define BOOK_ENTRY_SIZE 16
+
+// Most moves bookProbe() returns for a position
+#define BOOK_MAX_MOVES 64
+
+typedef struct {
+    uint64_t key;
+    uint16_t move;
+    uint16_t weight;
+    uint32_t learn;
+} BookEntry;
+
+typedef struct {
+    Move move;
+    uint16_t weight;
+} BookMove;
+
+typedef struct {
+    const uint8_t *entries;     // BOOK_ENTRY_SIZE bytes each
+    uint64_t count;
+    void *mapping;
+    size_t mapping_size;
+} Book;
+
+// Polyglot's key of b, from its published table of 781 random numbers
+uint64_t polyglotKey(const Board *b);
+
+bool bookOpen(Book *book, const char *path);
+void bookClose(Book *book);
+
+// Moves of b in the book, heaviest first, at most max. Entries whose move
+// isn't legal in b (key collisions) are skipped
+int bookProbe(const Book *book, const Board *b, BookMove *moves, int max);
+
+// Book move for b, EMPTY_MOVE if b isn't in the book. Picked at random in
+// proportion to the weights, random being uniform over 64 bits, or the
+// heaviest one with best
+Move bookPick(const Book *book, const Board *b, bool best, uint64_t random);
+
+uint16_t bookEncodeMove(Move m);
+// Legal move of b the book move stands for, EMPTY_MOVE if none
+Move bookDecodeMove(const Board *b, uint16_t move);
+
+void bookEncodeEntry(const BookEntry *e, uint8_t *out);
+BookEntry bookDecodeEntry(const uint8_t *in);
+
+// Sorts entries by key and writes them as a book, returns false (and
+// prints why) if the file can't be written
+bool bookWrite(const char *path, BookEntry *entries, size_t n);
+
+#endif // !BOOK_H
@@ -0,0 +1,453 @@
+#include "dataset.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_BLOOM_HASHES 16
+#define MIN_SORT_RECORDS 1024
+#define RUN_IO_BUFFER (1 << 20)
+
+// Mixes the key into the step of the double hashing, zobrist hashes are
+// already uniform so the key itself is the first hash
+static uint64_t bloomStep(uint64_t key)
+{
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return key | 1;
+}
+
+bool bloomInit(BloomFilter *f, uint64_t expected, double fp_rate)
+{
+    // k = -log2(p) hashes and k / ln(2) bits per key are optimal, k is
+    // rounded up so the rate stays below p
+    double p = fp_rate > 0 && fp_rate < 1 ? fp_rate : DEDUP_FP_RATE;
+    int k = 0;
+    for (double q = p; q < 1 && k < MAX_BLOOM_HASHES; q *= 2)
+        k++;
+    uint64_t words = (uint64_t)(MAX(expected, 1) * (k / 0.6931471805599453) / 64) + 1;
+    f->bit_count = words * 64;
+    f->hash_count = MAX(k, 1);
+    f->bits = calloc(words, sizeof(uint64_t));
+    return f->bits != NULL;
+}
+
+void bloomFree(BloomFilter *f)
+{
+    free(f->bits);
+    f->bits = NULL;
+}
+
+void bloomClear(BloomFilter *f)
+{
+    memset(f->bits, 0, f->bit_count / 8);
+}
+
+bool bloomInsert(BloomFilter *f, uint64_t key)
+{
+    uint64_t step = bloomStep(key);
+    bool present = true;
+    for (int i = 0; i < f->hash_count; i++, key += step) {
+        uint64_t bit = key % f->bit_count, mask = 1ull << (bit % 64);
+        present = present && (f->bits[bit / 64] & mask);
+        f->bits[bit / 64] |= mask;
+    }
+    return present;
+}
+
+bool bloomContains(const BloomFilter *f, uint64_t key)
+{
+    uint64_t step = bloomStep(key);
+    for (int i = 0; i < f->hash_count; i++, key += step) {
+        uint64_t bit = key % f->bit_count;
+        if (!(f->bits[bit / 64] & (1ull << (bit % 64))))
+            return false;
+    }
+    return true;
+}
+
+// External merge sort of fixed size records: a buffer is sorted and spilled
+// to a run file when full, the runs are merged back with a min heap
+typedef struct {
+    size_t record_size;
+    int (*compare)(const void *, const void *);
+    const char *tmp_dir;
+    char *buffer;
+    size_t count, capacity;
+    char **runs;
+    int run_count;
+    bool failed;
+
+    // Merge state, the buffer is read back directly without runs
+    FILE **files;
+    char *heads;
+    int *heap;
+    int live;
+    size_t next;
+} Sorter;
+
+static void sorterInit(Sorter *s, size_t record_size, int (*compare)(const void *, const void *),
+                       const DedupOptions *opts)
+{
+    memset(s, 0, sizeof(*s));
+    s->record_size = record_size;
+    s->compare = compare;
+    s->tmp_dir = opts->tmp_dir != NULL ? opts->tmp_dir : "/tmp";
+    s->capacity = MAX(opts->memory / record_size, (size_t)MIN_SORT_RECORDS);
+    s->buffer = malloc(s->capacity * record_size);
+}
+
+static void spillRun(Sorter *s)
+{
+    static int run_sequence = 0;
+    qsort(s->buffer, s->count, s->record_size, s->compare);
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/dedup.%d.%d.run", s->tmp_dir, (int)getpid(), run_sequence++);
+    s->runs = realloc(s->runs, (s->run_count + 1) * sizeof(char *));
+    s->runs[s->run_count++] = strdup(path);
+
+    FILE *f = fopen(path, "wb");
+    bool ok = f != NULL && fwrite(s->buffer, s->record_size, s->count, f) == s->count;
+    if (f != NULL)
+        ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "dedup: can't write %s\n", path);
+        s->failed = true;
+    }
+    s->count = 0;
+}
+
+static void sorterAdd(Sorter *s, const void *record)
+{
+    if (s->count == s->capacity)
+        spillRun(s);
+    memcpy(s->buffer + s->count * s->record_size, record, s->record_size);
+    s->count++;
+}
+
+static const void *runHead(const Sorter *s, int run)
+{
+    return s->heads + run * s->record_size;
+}
+
+static void siftDown(Sorter *s, int i)
+{
+    for (;;) {
+        int smallest = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < s->live && s->compare(runHead(s, s->heap[l]), runHead(s, s->heap[smallest])) < 0)
+            smallest = l;
+        if (r < s->live && s->compare(runHead(s, s->heap[r]), runHead(s, s->heap[smallest])) < 0)
+            smallest = r;
+        if (smallest == i)
+            return;
+        int tmp = s->heap[i];
+        s->heap[i] = s->heap[smallest];
+        s->heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// Ends adding records, they're then read back in order with sorterNext()
+static bool sorterFinish(Sorter *s)
+{
+    if (s->run_count == 0) {
+        qsort(s->buffer, s->count, s->record_size, s->compare);
+        return true;
+    }
+    if (s->count > 0)
+        spillRun(s);
+    free(s->buffer);
+    s->buffer = NULL;
+
+    s->files = calloc(s->run_count, sizeof(FILE *));
+    s->heads = malloc(s->run_count * s->record_size);
+    s->heap = malloc(s->run_count * sizeof(int));
+    for (int i = 0; i < s->run_count && !s->failed; i++) {
+        s->files[i] = fopen(s->runs[i], "rb");
+        if (s->files[i] == NULL) {
+            fprintf(stderr, "dedup: can't read %s\n", s->runs[i]);
+            s->failed = true;
+            break;
+        }
+        setvbuf(s->files[i], NULL, _IOFBF, RUN_IO_BUFFER);
+        if (fread(s->heads + i * s->record_size, s->record_size, 1, s->files[i]) == 1)
+            s->heap[s->live++] = i;
+    }
+    for (int i = s->live / 2 - 1; i >= 0; i--)
+        siftDown(s, i);
+    return !s->failed;
+}
+
+static bool sorterNext(Sorter *s, void *record)
+{
+    if (s->run_count == 0) {
+        if (s->next == s->count)
+            return false;
+        memcpy(record, s->buffer + s->next++ * s->record_size, s->record_size);
+        return true;
+    }
+    if (s->live == 0)
+        return false;
+    int run = s->heap[0];
+    memcpy(record, runHead(s, run), s->record_size);
+    if (fread(s->heads + run * s->record_size, s->record_size, 1, s->files[run]) != 1)
+        s->heap[0] = s->heap[--s->live];
+    siftDown(s, 0);
+    return true;
+}
+
+static void sorterFree(Sorter *s)
+{
+    for (int i = 0; i < s->run_count; i++) {
+        if (s->files != NULL && s->files[i] != NULL)
+            fclose(s->files[i]);
+        unlink(s->runs[i]);
+        free(s->runs[i]);
+    }
+    free(s->runs);
+    free(s->files);
+    free(s->heads);
+    free(s->heap);
+    free(s->buffer);
+    memset(s, 0, sizeof(*s));
+}
+
+typedef struct {
+    uint64_t hash;
+    uint64_t index;     // in the inputs, keeps the first occurrence first
+    PackedPosition position;
+} Candidate;
+
+static int compareKeys(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int compareCandidates(const void *a, const void *b)
+{
+    const Candidate *x = a, *y = b;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+// The secondary check, the position itself without clocks and annotations
+static bool samePosition(const PackedPosition *a, const PackedPosition *b)
+{
+    return a->occupancy == b->occupancy && memcmp(a->pieces, b->pieces, sizeof(a->pieces)) == 0
+           && (a->flags & 31) == (b->flags & 31) && (a->fullmoves_ep >> 12) == (b->fullmoves_ep >> 12);
+}
+
+// Calls visit on every valid position of the inputs with its key, in order,
+// counting them in stats if not NULL
+typedef bool (*PositionVisitor)(const PackedPosition *p, uint64_t key, uint64_t index, void *data);
+
+static bool visitPositions(const DedupOptions *opts, DedupStats *stats, PositionVisitor visit,
+                           void *data)
+{
+    uint64_t index = 0;
+    for (int i = 0; i < opts->path_count; i++) {
+        PackedFile f;
+        if (!packedOpen(&f, opts->paths[i]))
+            return false;
+        madvise(f.mapping, f.mapping_size, MADV_SEQUENTIAL);
+        for (uint64_t j = 0; j < f.count; j++, index++) {
+            Board b;
+            if (stats != NULL)
+                stats->positions++;
+            if (!unpackPosition(&f.positions[j], &b)) {
+                if (stats != NULL)
+                    stats->invalid++;
+                continue;
+            }
+            if (!visit(&f.positions[j], b.zobrist_hash, index, data)) {
+                packedClose(&f);
+                return false;
+            }
+        }
+        packedClose(&f);
+    }
+    return true;
+}
+
+typedef struct {
+    BloomFilter *filter;
+    Sorter *sorter;
+    const uint64_t *keys;       // repeated keys, sorted, NULL without
+    uint64_t key_count;
+    PackedWriter *out;
+    DedupStats *stats;
+} DedupPass;
+
+static bool collectRepeatedKeys(const PackedPosition *p, uint64_t key, uint64_t index, void *data)
+{
+    (void)p, (void)index;
+    DedupPass *pass = data;
+    if (bloomInsert(pass->filter, key))
+        sorterAdd(pass->sorter, &key);
+    return !pass->sorter->failed;
+}
+
+static bool isRepeatedKey(const DedupPass *pass, uint64_t key)
+{
+    if (!bloomContains(pass->filter, key))
+        return false;
+    uint64_t lo = 0, hi = pass->key_count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (pass->keys[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < pass->key_count && pass->keys[lo] == key;
+}
+
+static bool splitPositions(const PackedPosition *p, uint64_t key, uint64_t index, void *data)
+{
+    DedupPass *pass = data;
+    if (!isRepeatedKey(pass, key)) {
+        pass->stats->written++;
+        return packedWrite(pass->out, p, 1);
+    }
+    Candidate c = {.hash = key, .index = index, .position = *p};
+    pass->stats->candidates++;
+    sorterAdd(pass->sorter, &c);
+    return !pass->sorter->failed;
+}
+
+// Writes the first of each position among candidates sharing a key
+static bool writeFirstOccurrences(Sorter *sorter, PackedWriter *out, DedupStats *stats)
+{
+    size_t kept_count = 0, kept_capacity = 16;
+    PackedPosition *kept = malloc(kept_capacity * sizeof(PackedPosition));
+    uint64_t hash = 0;
+    Candidate c;
+    bool ok = true;
+    while (ok && sorterNext(sorter, &c)) {
+        if (kept_count > 0 && c.hash != hash)
+            kept_count = 0;
+        hash = c.hash;
+        bool seen = false;
+        for (size_t i = 0; i < kept_count && !seen; i++)
+            seen = samePosition(&kept[i], &c.position);
+        if (seen)
+            continue;
+        if (kept_count == kept_capacity) {
+            kept_capacity *= 2;
+            kept = realloc(kept, kept_capacity * sizeof(PackedPosition));
+        }
+        kept[kept_count++] = c.position;
+        stats->written++;
+        ok = packedWrite(out, &c.position, 1);
+    }
+    free(kept);
+    return ok;
+}
+
+// Repeated keys made unique into a temporary file, mapped for lookups and
+// added to the cleared filter, which then screens most other keys out
+static bool writeKeys(Sorter *sorter, const char *path, DedupPass *pass)
+{
+    pass->key_count = 0;
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "dedup: can't write %s\n", path);
+        return false;
+    }
+    setvbuf(f, NULL, _IOFBF, RUN_IO_BUFFER);
+    bloomClear(pass->filter);
+    uint64_t key, last = 0;
+    bool ok = true;
+    while (ok && sorterNext(sorter, &key)) {
+        if (pass->key_count > 0 && key == last)
+            continue;
+        ok = fwrite(&key, sizeof(key), 1, f) == 1;
+        bloomInsert(pass->filter, key);
+        last = key;
+        pass->key_count++;
+    }
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "dedup: can't write %s\n", path);
+        return false;
+    }
+    if (pass->key_count == 0)
+        return true;
+
+    size_t size = pass->key_count * sizeof(uint64_t);
+    int fd = open(path, O_RDONLY);
+    void *mapping = fd >= 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (fd >= 0)
+        close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "dedup: can't mmap %s\n", path);
+        return false;
+    }
+    madvise(mapping, size, MADV_RANDOM);
+    pass->keys = mapping;
+    return true;
+}
+
+bool dedupPackedFiles(const DedupOptions *opts, const char *path, DedupStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    uint64_t expected = opts->expected;
+    for (int i = 0; i < opts->path_count && expected == 0; i++) {
+        PackedFile f;
+        if (!packedOpen(&f, opts->paths[i]))
+            return false;
+        expected += f.count;
+        packedClose(&f);
+    }
+
+    BloomFilter filter;
+    if (!bloomInit(&filter, expected, opts->fp_rate)) {
+        fprintf(stderr, "dedup: can't allocate the filter for %lu positions\n",
+                (unsigned long)expected);
+        return false;
+    }
+
+    // First pass, keys the filter has seen before
+    Sorter keys;
+    sorterInit(&keys, sizeof(uint64_t), compareKeys, opts);
+    DedupPass pass = {.filter = &filter, .sorter = &keys, .stats = stats};
+    bool ok = visitPositions(opts, stats, collectRepeatedKeys, &pass) && sorterFinish(&keys);
+
+    char keys_path[4096];
+    snprintf(keys_path, sizeof(keys_path), "%s/dedup.%d.keys",
+             opts->tmp_dir != NULL ? opts->tmp_dir : "/tmp", (int)getpid());
+    ok = ok && writeKeys(&keys, keys_path, &pass);
+    sorterFree(&keys);
+
+    // Second pass, positions with other keys are unique, the rest are sorted
+    // to find their first occurrences
+    PackedWriter out;
+    Sorter candidates;
+    sorterInit(&candidates, sizeof(Candidate), compareCandidates, opts);
+    pass.sorter = &candidates;
+    pass.out = &out;
+    bool opened = ok && packedWriterOpen(&out, path);
+    ok = opened && visitPositions(opts, NULL, splitPositions, &pass) && sorterFinish(&candidates)
+         && writeFirstOccurrences(&candidates, &out, stats);
+    if (opened)
+        ok = packedWriterClose(&out) && ok;
+    if (opened && !ok)
+        fprintf(stderr, "dedup: can't write %s\n", path);
+
+    if (pass.keys != NULL)
+        munmap((void *)pass.keys, pass.key_count * sizeof(uint64_t));
+    unlink(keys_path);
+    sorterFree(&candidates);
+    bloomFree(&filter);
+    return ok;
+}
@@ -0,0 +1,66 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include "packed.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bloom filter over 64 bit keys, e.g. zobrist hashes. No false negatives,
+// false positives at about the rate it was sized for
+typedef struct {
+    uint64_t *bits;
+    uint64_t bit_count;
+    int hash_count;
+} BloomFilter;
+
+// Sized for expected keys at fp_rate false positives, returns false if the
+// bits can't be allocated
+bool bloomInit(BloomFilter *f, uint64_t expected, double fp_rate);
+void bloomFree(BloomFilter *f);
+void bloomClear(BloomFilter *f);
+
+// Adds key, returns whether it may have been added before
+bool bloomInsert(BloomFilter *f, uint64_t key);
+bool bloomContains(const BloomFilter *f, uint64_t key);
+
+// Removes repeated positions from packed position files
+//
+// Positions are keyed by zobrist_hash. The first pass streams the keys
+// through a Bloom filter and collects the keys it may have seen before,
+// sorted and made unique with an external merge sort. The second pass
+// writes the positions whose key isn't among them straight through and
+// sorts the others by key and input order, keeping the first of each
+// position. Positions with the same key are compared square by square
+// (with the side to move, castle rights and en passant file) so hash
+// collisions are kept. Clocks and annotations aren't compared, the first
+// occurrence's are kept.
+//
+// Unique positions come out in input order, followed by the first
+// occurrences of repeated ones in key order.
+
+typedef struct {
+    const char *const *paths;   // packed position files
+    int path_count;
+    const char *tmp_dir;        // for sorted runs, "/tmp" if NULL
+    size_t memory;              // bytes of sort buffers
+    uint64_t expected;          // positions the filter is sized for, 0 for
+                                // the number in the inputs
+    double fp_rate;             // of the filter, 0 for DEDUP_FP_RATE
+} DedupOptions;
+
+#define DEDUP_FP_RATE 0.01
+
+typedef struct {
+    uint64_t positions;     // read
+    uint64_t invalid;       // not positions, dropped
+    uint64_t candidates;    // whose key the filter may have seen
+    uint64_t written;
+} DedupStats;
+
+// Writes the positions of opts->paths without repeats to path, returns
+// false (and prints why) if a file can't be read or written
+bool dedupPackedFiles(const DedupOptions *opts, const char *path, DedupStats *stats);
+
+#endif // !DATASET_H
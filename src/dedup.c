@@ -0,0 +1,75 @@
+#include "dataset.h"
+#include "engine.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Removes repeated positions from packed position files (dataset.h)
+//
+// Usage: ./build/dedup output.pack input.pack... [--expected n]
+//                      [--fp-rate p] [--memory mb] [--tmp dir]
+//
+// Memory is bounded by the Bloom filter, sized for --expected positions
+// (all of the inputs by default) at --fp-rate false positives (0.01, about
+// 10 bits per position), and the sort buffers of --memory MB (256 by
+// default). Sorted runs beyond that go to --tmp.
+
+#define DEFAULT_MEMORY_MB 256
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    const char **paths = calloc(argc, sizeof(char *));
+    DedupOptions opts = {.memory = (size_t)DEFAULT_MEMORY_MB << 20, .fp_rate = DEDUP_FP_RATE};
+    bool usage = false;
+    for (int i = 1; i < argc && !usage; i++) {
+        if (strcmp(argv[i], "--expected") == 0 && i + 1 < argc)
+            opts.expected = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--fp-rate") == 0 && i + 1 < argc)
+            opts.fp_rate = atof(argv[++i]);
+        else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc)
+            opts.memory = (size_t)atol(argv[++i]) << 20;
+        else if (strcmp(argv[i], "--tmp") == 0 && i + 1 < argc)
+            opts.tmp_dir = argv[++i];
+        else if (argv[i][0] == '-')
+            usage = true;
+        else if (output == NULL)
+            output = argv[i];
+        else
+            paths[opts.path_count++] = argv[i];
+    }
+    if (usage || opts.path_count == 0 || opts.fp_rate <= 0 || opts.fp_rate >= 1) {
+        fprintf(stderr, "Usage: %s output.pack input.pack... [--expected n] [--fp-rate p] "
+                        "[--memory mb] [--tmp dir]\n", argv[0]);
+        free(paths);
+        return 1;
+    }
+    for (int i = 0; i < opts.path_count; i++) {
+        if (strcmp(paths[i], output) == 0) {
+            fprintf(stderr, "dedup: output %s is also an input\n", output);
+            free(paths);
+            return 1;
+        }
+    }
+
+    precomputeValues();
+    opts.paths = paths;
+    double start = wallTimeMs();
+    DedupStats stats;
+    bool ok = dedupPackedFiles(&opts, output, &stats);
+    double seconds = (wallTimeMs() - start) / 1000;
+    if (ok) {
+        uint64_t valid = stats.positions - stats.invalid;
+        printf("%lu positions, %lu invalid, %lu written, %lu repeats removed (%.1lf%%)\n",
+               (unsigned long)stats.positions, (unsigned long)stats.invalid,
+               (unsigned long)stats.written, (unsigned long)(valid - stats.written),
+               valid > 0 ? 100.0 * (valid - stats.written) / valid : 0.0);
+        printf("%lu candidates sorted, %.1lf s, %.0lf positions/s\n",
+               (unsigned long)stats.candidates, seconds,
+               seconds > 0 ? stats.positions / seconds : 0.0);
+    }
+    free(paths);
+    return ok ? 0 : 1;
+}
@@ -1,19 +1,24 @@
 #include "engine.h"
+#include "bitbase.h"
 #include "direction.h"
+#include "evalcache.h"
 #include "generator.h"
 #include "movelist.h"
+#include "nnue.h"
+#include "transposition.h"
 #include "utils.h"
 #include "zobrist.h"
 
 #include <ctype.h>
 #include <assert.h>
 #include <limits.h>
+#include <pthread.h>
 #include <time.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 
-bool LOG_SEARCH = false;
+_Thread_local uint64_t NODES_SEARCHED = 0;
 
 // Used for sorting moves
 int compareMove(const void *m1, const void *m2);
@@ -23,6 +28,9 @@ void precomputeValues(void)
 {
     populateGeneratorValues();
     populateZobristValues();
+    populateEvalValues();
+    setEvalCacheSize(EVAL_CACHE_DEFAULT_SIZE);
+    setTranspositionTableSize(TT_DEFAULT_MB);
 }
 
 // Finds if king with given color is in check
@@ -62,6 +70,49 @@ MoveList generateMoves(const Board *b)
     return legalmoves;
 }
 
+// Puts piece on an empty square, keeping hash and eval accumulators in sync
+static void putPiece(Board *b, int sq, Piece p)
+{
+    int col_idx = (p & WHITE) ? 0 : 1;
+    int piece_idx = getPieceIdx(p);
+    b->pieces[sq] = p;
+    b->bitboards[col_idx][piece_idx] ^= 1ull << sq;
+    b->occupancy[col_idx] ^= 1ull << sq;
+    b->zobrist_hash ^= ZOBRIST.pieces[col_idx][piece_idx][sq];
+    if (piece_idx == PAWN_IDX)
+        b->pawn_hash ^= ZOBRIST.pieces[col_idx][PAWN_IDX][sq];
+    b->psqt[0] += PSQT[col_idx][piece_idx][sq][0];
+    b->psqt[1] += PSQT[col_idx][piece_idx][sq][1];
+    b->phase += PHASE_WEIGHTS[piece_idx];
+    b->dirty[b->dirty_count++] = (DirtyPiece){.piece = p, .sq = sq, .added = true};
+}
+
+// Removes piece from a non empty square
+static void removePiece(Board *b, int sq)
+{
+    Piece p = b->pieces[sq];
+    int col_idx = (p & WHITE) ? 0 : 1;
+    int piece_idx = getPieceIdx(p);
+    b->pieces[sq] = EMPTY_PIECE;
+    b->bitboards[col_idx][piece_idx] ^= 1ull << sq;
+    b->occupancy[col_idx] ^= 1ull << sq;
+    b->zobrist_hash ^= ZOBRIST.pieces[col_idx][piece_idx][sq];
+    if (piece_idx == PAWN_IDX)
+        b->pawn_hash ^= ZOBRIST.pieces[col_idx][PAWN_IDX][sq];
+    b->psqt[0] -= PSQT[col_idx][piece_idx][sq][0];
+    b->psqt[1] -= PSQT[col_idx][piece_idx][sq][1];
+    b->phase -= PHASE_WEIGHTS[piece_idx];
+    b->dirty[b->dirty_count++] = (DirtyPiece){.piece = p, .sq = sq, .added = false};
+}
+
+// Moves piece from src square to an empty dst square
+static void movePiece(Board *b, int src_sq, int dst_sq)
+{
+    Piece p = b->pieces[src_sq];
+    removePiece(b, src_sq);
+    putPiece(b, dst_sq, p);
+}
+
 Board moveMake(Move m, Board b)
 {
     const MoveFlag flag = getMoveFlag(m);
@@ -69,6 +120,7 @@ Board moveMake(Move m, Board b)
     const int dst_sq = getMoveDst(m);
     const int col_idx = (b.pieces[src_sq] & WHITE) ? 0 : 1;
     const int opp_col_idx = 1 - col_idx;
+    b.dirty_count = 0;
 
     //
     // En passant handling
@@ -88,11 +140,8 @@ Board moveMake(Move m, Board b)
     }
 
     // Capture pawn below dst square during en passant
-    if (flag == EP_CAPTURE) {
-        int captured_sq = dst_sq - pawn_forward_offset;
-        b.pieces[captured_sq] = EMPTY_PIECE;
-        b.zobrist_hash ^= ZOBRIST.pieces[opp_col_idx][PAWN_IDX][captured_sq];
-    }
+    if (flag == EP_CAPTURE)
+        removePiece(&b, dst_sq - pawn_forward_offset);
 
     //
     // Castles
@@ -109,22 +158,10 @@ Board moveMake(Move m, Board b)
     }
 
     // Move rook when castled
-    if (flag == QUEEN_CASTLE) {
-        int rook_src_sq = QSC_ROOK_SRC_SQ[col_idx];
-        int rook_dst_sq = QSC_ROOK_DST_SQ[col_idx];
-        b.pieces[rook_dst_sq] = b.pieces[rook_src_sq];
-        b.pieces[rook_src_sq] = EMPTY_PIECE;
-        b.zobrist_hash ^= ZOBRIST.pieces[col_idx][ROOK_IDX][rook_src_sq] ^
-                          ZOBRIST.pieces[col_idx][ROOK_IDX][rook_dst_sq];
-    }
-    else if (flag == KING_CASTLE) {
-        int rook_src_sq = KSC_ROOK_SRC_SQ[col_idx];
-        int rook_dst_sq = KSC_ROOK_DST_SQ[col_idx];
-        b.pieces[rook_dst_sq] = b.pieces[rook_src_sq];
-        b.pieces[rook_src_sq] = EMPTY_PIECE;
-        b.zobrist_hash ^= ZOBRIST.pieces[col_idx][ROOK_IDX][rook_src_sq] ^
-                          ZOBRIST.pieces[col_idx][ROOK_IDX][rook_dst_sq];
-    }
+    if (flag == QUEEN_CASTLE)
+        movePiece(&b, QSC_ROOK_SRC_SQ[col_idx], QSC_ROOK_DST_SQ[col_idx]);
+    else if (flag == KING_CASTLE)
+        movePiece(&b, KSC_ROOK_SRC_SQ[col_idx], KSC_ROOK_DST_SQ[col_idx]);
 
     // We lose castle right on a side if we move our rook
     if (b.pieces[src_sq] & ROOK) {
@@ -157,25 +194,11 @@ Board moveMake(Move m, Board b)
     //
 
     // Remove piece from dst square if non empty
-    if (b.pieces[dst_sq] != EMPTY_PIECE) {
-        int dst_pi = getPieceIdx(b.pieces[dst_sq]);
-        b.zobrist_hash ^= ZOBRIST.pieces[opp_col_idx][dst_pi][dst_sq];
-    }
-
-    // Put src piece at dst square
-    int src_pi = getPieceIdx(b.pieces[src_sq]);
-    b.pieces[dst_sq] = b.pieces[src_sq];
-    b.zobrist_hash ^= ZOBRIST.pieces[col_idx][src_pi][dst_sq];
-
-    // Empty src square
-    b.pieces[src_sq] = EMPTY_PIECE;
-    b.zobrist_hash ^= ZOBRIST.pieces[col_idx][src_pi][src_sq];
-
-    //
-    // Promotion (change piece at dst square)
-    //
+    if (b.pieces[dst_sq] != EMPTY_PIECE)
+        removePiece(&b, dst_sq);
 
     if (flag & PROMOTION) {
+        // Pawn disappears from src square, promoted piece appears at dst square
         Piece promoted_piece = EMPTY_PIECE;
         if (flag == KNIGHT_PROMOTION || flag == KNIGHT_PROMO_CAPTURE)
             promoted_piece = KNIGHT;
@@ -188,14 +211,11 @@ Board moveMake(Move m, Board b)
 
         assert(promoted_piece != EMPTY_PIECE);
 
-        // Remove piece currently sitting at dst square
-        // this is the piece moved from src square to dst square previously
-        b.zobrist_hash ^= ZOBRIST.pieces[col_idx][src_pi][dst_sq];
-
-        // Put new promoted piece at dst square
-        b.pieces[dst_sq] = b.color_to_move | promoted_piece;
-        int dst_pi = getPieceIdx(b.pieces[dst_sq]);
-        b.zobrist_hash ^= ZOBRIST.pieces[col_idx][dst_pi][dst_sq];
+        removePiece(&b, src_sq);
+        putPiece(&b, dst_sq, b.color_to_move | promoted_piece);
+    }
+    else {
+        movePiece(&b, src_sq, dst_sq);
     }
 
     // Change turn and update fullmoves
@@ -233,137 +253,635 @@ uint64_t generateTillDepth(Board b, int depth, bool show_move)
     return total;
 }
 
-int evaluateBoard(const Board *b)
+// Most recent positions before the root kept for repetition detection,
+// anything older is behind a capture or pawn move by the 50 move rule
+#define MAX_HISTORY 128
+
+// State of the search running on a thread, set up by findBestMove()
+typedef struct {
+    SearchContext *ctx;         // NULL for a bare bestEvaluation() call
+    bool is_main;               // main thread enforces node and time limits
+    bool stopped;
+    bool pondering;             // clock doesn't run until the ponder hit
+    double clock_start_ms;
+    int budget;                 // searchTimeBudget(), 0 if unlimited
+    bool soft_budget;
+    int hard_limit;
+    double deadline_ms;         // 0 if none
+    uint64_t nodes_reported;    // part of NODES_SEARCHED added to ctx->nodes
+    int ply;
+
+    // Hashes of positions before the current one, game history first
+    uint64_t keys[MAX_HISTORY + MAX_PLY + 1];
+    int key_count;
+
+    // Triangular table of principal variations, pv[ply] is the line
+    // found from ply onwards
+    Move pv[MAX_PLY + 1][MAX_PLY + 1];
+    int pv_length[MAX_PLY + 1];
+} SearchThread;
+
+static _Thread_local SearchThread THREAD;
+
+typedef struct {
+    const Board *b;
+    SearchContext *ctx;
+    MoveList root_moves;
+    int id;
+    double start_ms;
+} HelperArgs;
+
+// Clock games get a soft budget, the next iteration isn't started past
+// half of it, and a hard limit of twice the budget
+static void setTimeLimits(SearchThread *st, Piece color_to_move)
 {
-    enum PieceType {
-        king,
-        queen,
-        bishop,
-        knight,
-        rook,
-        pawn,
-    };
+    const SearchLimits *limits = &st->ctx->limits;
+    st->budget = searchTimeBudget(limits, color_to_move);
+    st->soft_budget = st->budget > 0 && limits->movetime <= 0;
+    st->hard_limit = st->budget;
+    if (st->soft_budget) {
+        int col_idx = (color_to_move & WHITE) ? 0 : 1;
+        st->hard_limit = MAX(MIN(st->budget * 2, limits->time[col_idx] / 2), 1);
+    }
+}
 
-    int count[2][6] = {0};
-
-    for (int sq = 0; sq < 64; sq++) {
-        int col_idx = b->pieces[sq] & WHITE ? 0 : 1;
-        if (b->pieces[sq] & KING)
-            count[col_idx][king]++;
-        else if (b->pieces[sq] & QUEEN)
-            count[col_idx][queen]++;
-        else if (b->pieces[sq] & BISHOP)
-            count[col_idx][bishop]++;
-        else if (b->pieces[sq] & KNIGHT)
-            count[col_idx][knight]++;
-        else if (b->pieces[sq] & ROOK)
-            count[col_idx][rook]++;
-        else if (b->pieces[sq] & PAWN)
-            count[col_idx][pawn]++;
-    }
-
-    // White is supposed to be maximizing
-    int material_score = (count[0][queen] - count[1][queen]) * 90 +
-                         (count[0][bishop] - count[1][bishop]) * 30 +
-                         (count[0][knight] - count[1][knight]) * 30 +
-                         (count[0][rook] - count[1][rook]) * 50 +
-                         (count[0][pawn] - count[1][pawn]) * 10;
-
-    return material_score;
+static void startClock(SearchThread *st, double now_ms)
+{
+    st->pondering = false;
+    st->clock_start_ms = now_ms;
+    st->deadline_ms = st->hard_limit > 0 ? now_ms + st->hard_limit : 0;
 }
 
+// Checks limits and the stop flag every 1024 nodes
+static bool shouldStop(SearchThread *st)
+{
+    if (st->stopped)
+        return true;
+    if (st->ctx == NULL || (NODES_SEARCHED & 1023) != 0)
+        return false;
+
+    SearchContext *ctx = st->ctx;
+    uint64_t new_nodes = NODES_SEARCHED - st->nodes_reported;
+    uint64_t nodes = atomic_fetch_add_explicit(&ctx->nodes, new_nodes, memory_order_relaxed) + new_nodes;
+    st->nodes_reported = NODES_SEARCHED;
+
+    if (st->is_main) {
+        if (st->pondering && !atomic_load(&ctx->ponder))
+            startClock(st, wallTimeMs());
+        if ((ctx->limits.nodes > 0 && nodes >= ctx->limits.nodes)
+            || (st->deadline_ms > 0 && wallTimeMs() >= st->deadline_ms))
+            atomic_store(&ctx->stop, true);
+    }
+    st->stopped = atomic_load_explicit(&ctx->stop, memory_order_relaxed);
+    return st->stopped;
+}
 
-Move findBestMove(const Board *b)
+// Repetition of an earlier position or 50 moves without progress
+static bool isDraw(const SearchThread *st, const Board *b)
 {
-    bool is_maximizing = (b->color_to_move & WHITE) ? true : false;
-    int minimax_depth = 6;
-    int best_score = is_maximizing ? INT_MIN : INT_MAX;
-    int best_move = EMPTY_MOVE;
-    int alpha = INT_MIN;
-    int beta = INT_MAX;
+    if (b->halfmove_clock >= 100)
+        return true;
+    int oldest = MAX(st->key_count - b->halfmove_clock, 0);
+    for (int i = st->key_count - 2; i >= oldest; i -= 2) {
+        if (st->keys[i] == b->zobrist_hash)
+            return true;
+    }
+    return false;
+}
 
-    MoveList mlist = generateMoves(b);
-    clock_t start = clock();
-    char move_str[20];
+// Mate scores are stored relative to the position, not the root
+static int scoreToTT(int score, int ply)
+{
+    if (score > MATE_BOUND)
+        return score + ply;
+    if (score < -MATE_BOUND)
+        return score - ply;
+    return score;
+}
 
-    // No need to search if only one valid move remaining
-    if (mlist.count == 1)
-        return mlist.moves[0];
+static int scoreFromTT(int score, int ply)
+{
+    if (score > MATE_BOUND)
+        return score - ply;
+    if (score < -MATE_BOUND)
+        return score + ply;
+    return score;
+}
 
+// Makes m the principal variation at current ply, followed by the child's
+static void updatePv(SearchThread *st, Move m)
+{
+    int ply = st->ply;
+    st->pv[ply][ply] = m;
+    for (int i = ply + 1; i < st->pv_length[ply + 1]; i++)
+        st->pv[ply][i] = st->pv[ply + 1][i];
+    st->pv_length[ply] = MAX(st->pv_length[ply + 1], ply + 1);
+}
+
+// Moves m (if present) to the front, keeping order of the others
+static void moveToFront(MoveList *mlist, Move m)
+{
+    for (size_t i = 1; i < mlist->count; i++) {
+        if (mlist->moves[i] == m) {
+            memmove(&mlist->moves[1], &mlist->moves[0], i * sizeof(Move));
+            mlist->moves[0] = m;
+            return;
+        }
+    }
+}
+
+// Searches captures and promotions until the position is quiet
+static int quiescence(const Board *b, bool is_maximizing, int alpha, int beta)
+{
+    SearchThread *st = &THREAD;
+    NODES_SEARCHED++;
+    st->pv_length[st->ply] = st->ply;
+    if (shouldStop(st))
+        return 0;
+
+    // Side to move may stand pat instead of capturing
+    int best_score = evaluateBoard(b, alpha, beta);
+    if (st->ply >= MAX_PLY)
+        return best_score;
+    if (is_maximizing) {
+        if (best_score >= beta)
+            return best_score;
+        alpha = MAX(alpha, best_score);
+    } else {
+        if (best_score <= alpha)
+            return best_score;
+        beta = MIN(beta, best_score);
+    }
+
+    MoveList mlist = generateMoves(b);
     for (size_t i = 0; i < mlist.count; i++) {
-        // printMoveToString(move_str, sizeof(move_str), mlist.moves[i], true);
-        Board updated = moveMake(mlist.moves[i], *b);
+        Move m = mlist.moves[i];
+        if (!(getMoveFlag(m) & (CAPTURE | PROMOTION)))
+            continue;
+        Board updated = moveMake(m, *b);
+        nnuePush(&updated);
+        st->ply++;
+        int score = quiescence(&updated, !is_maximizing, alpha, beta);
+        st->ply--;
+        nnuePop();
+        if (st->stopped)
+            return 0;
+
         if (is_maximizing) {
-            int score = bestEvaluation(&updated, minimax_depth - 1, false, alpha, beta);
-            if (LOG_SEARCH)
-                printf("Move: %s, is_maximizing: %d, score: %d, best_score: %d\n", move_str, is_maximizing, score, best_score);
-            if (score > best_score) {
-                best_score = score;
-                best_move = mlist.moves[i];
-            }
+            best_score = MAX(best_score, score);
+            if (score >= beta)
+                break;
+            alpha = MAX(alpha, score);
         } else {
-            int score = bestEvaluation(&updated, minimax_depth - 1, true, alpha, beta);
-            if (LOG_SEARCH)
-                printf("Move: %s, is_maximizing: %d, score: %d, best_score: %d\n", move_str, is_maximizing, score, best_score);
-            if (score < best_score) {
-                best_score = score;
-                best_move = mlist.moves[i];
-            }
+            best_score = MIN(best_score, score);
+            if (score <= alpha)
+                break;
+            beta = MIN(beta, score);
         }
     }
-
-    clock_t diff = clock() - start;
-    double ms = (double)diff * 1000 / (double)CLOCKS_PER_SEC;
-    printf("Searched depth: %d, Time elpased: %lf ms\n", minimax_depth, ms);
-    return best_move;
+    return best_score;
 }
 
 int bestEvaluation(const Board *b, int depth, bool is_maximizing, int alpha, int beta)
 {
-    if (depth == 0)
-        return evaluateBoard(b);
+    SearchThread *st = &THREAD;
+    NODES_SEARCHED++;
+    st->pv_length[st->ply] = st->ply;
+    if (shouldStop(st))
+        return 0;
+    if (st->ply > 0 && isDraw(st, b))
+        return 0;
+    if (st->ply >= MAX_PLY)
+        return evaluateBoard(b, alpha, beta);
+
+    // Bitbase draws need no search. Wins are still searched, evaluateBoard()
+    // only adds a bonus to them, which doesn't tell how to mate
+    if (st->ply > 0 && probeBitbase(b) == BITBASE_DRAW)
+        return 0;
+    if (depth <= 0)
+        return quiescence(b, is_maximizing, alpha, beta);
+
+    TTEntry entry;
+    Move tt_move = EMPTY_MOVE;
+    if (probeTranspositionTable(b->zobrist_hash, &entry)) {
+        tt_move = entry.move;
+        int score = scoreFromTT(entry.score, st->ply);
+        if (st->ply > 0 && entry.depth >= depth
+            && (entry.bound == TT_EXACT
+                || (entry.bound == TT_LOWER && score >= beta)
+                || (entry.bound == TT_UPPER && score <= alpha)))
+            return score;
+    }
 
-    int best_score = is_maximizing ? INT_MIN : INT_MAX;
     MoveList mlist = generateMoves(b);
-    char move_str[20];
+    if (mlist.count == 0) {
+        if (!isKingChecked(b, b->color_to_move))
+            return 0;   // stalemate
+        int mate = MATE_SCORE - st->ply;
+        return is_maximizing ? -mate : mate;
+    }
+    moveToFront(&mlist, tt_move);
+
+    const int alpha_orig = alpha;
+    const int beta_orig = beta;
+    int best_score = is_maximizing ? INT_MIN : INT_MAX;
+    Move best_move = EMPTY_MOVE;
+    st->keys[st->key_count++] = b->zobrist_hash;
 
     for (size_t i = 0; i < mlist.count; i++) {
-        // printMoveToString(move_str, sizeof(move_str), mlist.moves[i], true);
-        Board updated = moveMake(mlist.moves[i], *b);
+        Move m = mlist.moves[i];
+        Board updated = moveMake(m, *b);
+        nnuePush(&updated);
+        st->ply++;
+        int score = bestEvaluation(&updated, depth - 1, !is_maximizing, alpha, beta);
+        st->ply--;
+        nnuePop();
+        if (st->stopped)
+            break;
+
         if (is_maximizing) {
-            int score = bestEvaluation(&updated, depth - 1, false, alpha, beta);
-            if (LOG_SEARCH) {
-                for (int i = 0; i < 3 - depth; i++) printf("    ");
-                printf("Move: %s, is_maximizing: %d, score: %d, best_score: %d\n", move_str, is_maximizing, score, best_score);
-            }
             if (score > best_score) {
                 best_score = score;
-                alpha = score;
+                best_move = m;
             }
-            if (score >= beta) {
-                if (LOG_SEARCH) printf("score >= beta, pruning...\n");
-                return beta;
+            if (score >= beta)
+                break;
+            if (score > alpha) {
+                alpha = score;
+                updatePv(st, m);
             }
         } else {
-            int score = bestEvaluation(&updated, depth - 1, true, alpha, beta);
-            if (LOG_SEARCH) {
-                for (int i = 0; i < 3 - depth; i++) printf("    ");
-                printf("Move: %s, is_maximizing: %d, score: %d, best_score: %d\n", move_str, is_maximizing, score, best_score);
-            }
             if (score < best_score) {
                 best_score = score;
-                beta = score;
+                best_move = m;
             }
-            if (score <= alpha) {
-                if (LOG_SEARCH) printf("score <= alpha, pruning...");
-                return alpha;
+            if (score <= alpha)
+                break;
+            if (score < beta) {
+                beta = score;
+                updatePv(st, m);
             }
         }
     }
 
+    st->key_count--;
+    if (st->stopped)
+        return 0;
+
+    entry = (TTEntry){
+        .move = best_move,
+        .score = scoreToTT(best_score, st->ply),
+        .depth = depth,
+        .bound = best_score >= beta_orig ? TT_LOWER
+                 : best_score <= alpha_orig ? TT_UPPER : TT_EXACT,
+    };
+    storeTranspositionTable(b->zobrist_hash, &entry);
+    return best_score;
+}
+
+// Searches every root move to depth, the best one is moved to the front
+static int searchRoot(const Board *b, MoveList *root_moves, int depth)
+{
+    SearchThread *st = &THREAD;
+    bool is_maximizing = (b->color_to_move & WHITE) ? true : false;
+    int alpha = INT_MIN;
+    int beta = INT_MAX;
+    int best_score = is_maximizing ? INT_MIN : INT_MAX;
+    Move best_move = root_moves->moves[0];
+    st->ply = 0;
+    st->keys[st->key_count++] = b->zobrist_hash;
+
+    for (size_t i = 0; i < root_moves->count; i++) {
+        Move m = root_moves->moves[i];
+        Board updated = moveMake(m, *b);
+        nnuePush(&updated);
+        st->ply++;
+        int score = bestEvaluation(&updated, depth - 1, !is_maximizing, alpha, beta);
+        st->ply--;
+        nnuePop();
+        if (st->stopped)
+            break;
+
+        if (is_maximizing ? score > best_score : score < best_score) {
+            best_score = score;
+            best_move = m;
+            updatePv(st, m);
+            if (is_maximizing)
+                alpha = score;
+            else
+                beta = score;
+        }
+    }
+
+    st->key_count--;
+    if (!st->stopped) {
+        moveToFront(root_moves, best_move);
+        TTEntry entry = {.move = best_move, .score = best_score, .depth = depth, .bound = TT_EXACT};
+        storeTranspositionTable(b->zobrist_hash, &entry);
+    }
     return best_score;
 }
 
+// Lines cut short by transposition table hits are completed from the table
+static void extendPv(const Board *root, SearchInfo *info)
+{
+    Board b = *root;
+    for (int i = 0; i < info->pv_length; i++)
+        b = moveMake(info->pv[i], b);
+
+    TTEntry entry;
+    while (info->pv_length < info->depth && probeTranspositionTable(b.zobrist_hash, &entry)) {
+        MoveList mlist = generateMoves(&b);
+        size_t i = 0;
+        while (i < mlist.count && mlist.moves[i] != entry.move)
+            i++;
+        if (i == mlist.count)
+            break;
+        info->pv[info->pv_length++] = entry.move;
+        b = moveMake(entry.move, b);
+    }
+}
+
+int searchTimeBudget(const SearchLimits *limits, Piece color_to_move)
+{
+    if (limits->infinite)
+        return 0;
+    if (limits->movetime > 0)
+        return limits->movetime;
+    int col_idx = (color_to_move & WHITE) ? 0 : 1;
+    int time = limits->time[col_idx];
+    if (time <= 0)
+        return 0;
+
+    // Even share of the remaining time plus most of the increment,
+    // never more than half the clock
+    int moves_left = limits->movestogo > 0 ? limits->movestogo : 30;
+    int budget = time / moves_left + limits->inc[col_idx] * 3 / 4;
+    return MAX(MIN(budget, time / 2), 1);
+}
+
+// Iterative deepening on the calling thread, thread 0 reports iterations
+// and decides when to stop, the others only fill the transposition table
+static Move searchThread(const Board *b, SearchContext *ctx, MoveList root_moves,
+                         int id, double start_ms, SearchInfo *info)
+{
+    SearchThread *st = &THREAD;
+    st->ctx = ctx;
+    st->is_main = id == 0;
+    st->stopped = false;
+    st->nodes_reported = 0;
+    st->ply = 0;
+    st->key_count = 0;
+    int history = MIN(ctx->history_count, MAX_HISTORY);
+    for (int i = ctx->history_count - history; i < ctx->history_count; i++)
+        st->keys[st->key_count++] = ctx->history[i];
+
+    setTimeLimits(st, b->color_to_move);
+    startClock(st, start_ms);
+    if (atomic_load(&ctx->ponder)) {
+        st->pondering = true;
+        st->deadline_ms = 0;
+    }
+
+    NODES_SEARCHED = 0;
+    nnueResetStack(b);
+    int max_depth = MAX_PLY - 1;
+    if (ctx->limits.depth > 0)
+        max_depth = MIN(ctx->limits.depth, max_depth);
+
+    for (int depth = 1; depth <= max_depth && !st->stopped; depth++) {
+        // Half of the helpers search one ply deeper to diversify
+        int score = searchRoot(b, &root_moves, MIN(depth + (id & 1), MAX_PLY - 1));
+        if (st->stopped || !st->is_main)
+            continue;
+
+        SearchInfo iteration = {
+            .depth = depth,
+            .score = score,
+            .nodes = atomic_load(&ctx->nodes) + NODES_SEARCHED - st->nodes_reported,
+            .ms = wallTimeMs() - start_ms,
+            .hashfull = getTranspositionTableUsage(),
+            .pv_length = st->pv_length[0],
+        };
+        memcpy(iteration.pv, st->pv[0], st->pv_length[0] * sizeof(Move));
+        extendPv(b, &iteration);
+        if (info != NULL)
+            *info = iteration;
+        if (ctx->on_iteration != NULL)
+            ctx->on_iteration(&iteration, ctx->callback_data);
+
+        if (st->pondering && !atomic_load(&ctx->ponder))
+            startClock(st, wallTimeMs());
+        if (ctx->limits.infinite || st->pondering)
+            continue;
+        // Mates can't get any shorter
+        if (IS_MATE_SCORE(score) && MATE_SCORE - abs(score) <= depth)
+            break;
+        if (st->soft_budget && wallTimeMs() - st->clock_start_ms >= st->budget / 2.0)
+            break;
+    }
+
+    atomic_fetch_add(&ctx->nodes, NODES_SEARCHED - st->nodes_reported);
+    st->nodes_reported = NODES_SEARCHED;
+    st->ctx = NULL;
+    return root_moves.moves[0];
+}
+
+static void *helperThread(void *arg)
+{
+    HelperArgs *args = arg;
+    searchThread(args->b, args->ctx, args->root_moves, args->id, args->start_ms, NULL);
+    return NULL;
+}
+
+struct SearchPool {
+    pthread_mutex_t lock;
+    pthread_cond_t start;       // signaled when a search is handed out
+    pthread_cond_t done;        // and when the last helper finished it
+    int n_helpers;
+    pthread_t *tids;
+    HelperArgs *args;           // of the current search, one per helper
+    int active;                 // helpers taking part in it
+    int running;                // of those, still searching
+    uint32_t generation;        // bumped for each search
+    bool quit;
+};
+
+typedef struct {
+    SearchPool *pool;
+    int index;
+} PoolHelper;
+
+static void *poolThread(void *arg)
+{
+    PoolHelper *helper = arg;
+    SearchPool *pool = helper->pool;
+    int index = helper->index;
+    free(helper);
+
+    uint32_t seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->generation == seen && !pool->quit)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->quit)
+            break;
+        seen = pool->generation;
+        if (index >= pool->active)
+            continue;
+
+        HelperArgs args = pool->args[index];
+        pthread_mutex_unlock(&pool->lock);
+        helperThread(&args);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+SearchPool *searchPoolCreate(int n_helpers)
+{
+    SearchPool *pool = calloc(1, sizeof(SearchPool));
+    if (pool == NULL)
+        return NULL;
+    pool->tids = malloc(MAX(n_helpers, 1) * sizeof(pthread_t));
+    pool->args = malloc(MAX(n_helpers, 1) * sizeof(HelperArgs));
+    if (pool->tids == NULL || pool->args == NULL) {
+        free(pool->tids);
+        free(pool->args);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 0; i < n_helpers; i++) {
+        PoolHelper *helper = malloc(sizeof(PoolHelper));
+        if (helper == NULL)
+            break;
+        *helper = (PoolHelper){.pool = pool, .index = i};
+        if (pthread_create(&pool->tids[i], NULL, poolThread, helper) != 0) {
+            free(helper);
+            break;
+        }
+        pool->n_helpers++;
+    }
+    return pool;
+}
+
+void searchPoolDestroy(SearchPool *pool)
+{
+    if (pool == NULL)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->n_helpers; i++)
+        pthread_join(pool->tids[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->tids);
+    free(pool->args);
+    free(pool);
+}
+
+// Hands the search to the first n_helpers helpers of the pool
+static void startPoolSearch(SearchPool *pool, const HelperArgs *args, int n_helpers)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->active = MIN(n_helpers, pool->n_helpers);
+    for (int i = 0; i < pool->active; i++) {
+        pool->args[i] = *args;
+        pool->args[i].id = i + 1;
+    }
+    pool->running = pool->active;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void waitPoolSearch(SearchPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+Move findBestMove(const Board *b, SearchContext *ctx, SearchInfo *info)
+{
+    double start_ms = wallTimeMs();
+    MoveList root_moves = generateMoves(b);
+    if (info != NULL)
+        *info = (SearchInfo){0};
+    if (root_moves.count == 0)
+        return EMPTY_MOVE;
+
+    // No need to search if only one valid move remaining
+    bool unlimited = ctx->limits.infinite || atomic_load(&ctx->ponder);
+    if (root_moves.count == 1 && !unlimited && !ctx->search_single_move) {
+        if (info != NULL) {
+            info->pv[0] = root_moves.moves[0];
+            info->pv_length = 1;
+        }
+        return root_moves.moves[0];
+    }
+
+    TTEntry entry;
+    if (probeTranspositionTable(b->zobrist_hash, &entry))
+        moveToFront(&root_moves, entry.move);
+    newTranspositionSearch();
+    atomic_store(&ctx->nodes, 0);
+
+    int n_helpers = MAX(ctx->threads - 1, 0);
+    HelperArgs helper_args = {.b = b, .ctx = ctx, .root_moves = root_moves, .start_ms = start_ms};
+    pthread_t *tids = NULL;
+    HelperArgs *args = NULL;
+    int started = 0;
+    if (ctx->pool != NULL) {
+        startPoolSearch(ctx->pool, &helper_args, n_helpers);
+    } else {
+        tids = malloc(n_helpers * sizeof(pthread_t));
+        args = malloc(n_helpers * sizeof(HelperArgs));
+    }
+    for (int i = 0; i < n_helpers && tids != NULL && args != NULL; i++) {
+        args[i] = helper_args;
+        args[i].id = i + 1;
+        if (pthread_create(&tids[i], NULL, helperThread, &args[i]) != 0)
+            break;
+        started++;
+    }
+
+    Move best_move = searchThread(b, ctx, root_moves, 0, start_ms, info);
+
+    // An infinite search only returns once it's told to, pondering ends
+    // with the ponder hit at the latest
+    while ((ctx->limits.infinite || atomic_load(&ctx->ponder)) && !atomic_load(&ctx->stop)) {
+        struct timespec ts = {.tv_sec = 0, .tv_nsec = 1000000};
+        nanosleep(&ts, NULL);
+    }
+
+    atomic_store(&ctx->stop, true);
+    if (ctx->pool != NULL)
+        waitPoolSearch(ctx->pool);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    free(tids);
+    free(args);
+
+    if (info != NULL) {
+        info->nodes = atomic_load(&ctx->nodes);
+        info->ms = wallTimeMs() - start_ms;
+    }
+    return best_move;
+}
+
 void orderMoves(MoveList *mlist)
 {
     qsort(mlist->moves, mlist->count, sizeof(Move), compareMove);
@@ -2,10 +2,79 @@
 #define ENGINE_H
 
 #include "board.h"
+#include "evaluate.h"
 #include "move.h"
 #include "movelist.h"
+#include <stdatomic.h>
 #include <stdint.h>
 
+// Nodes visited by bestEvaluation() on the calling thread, reset by the caller
+extern _Thread_local uint64_t NODES_SEARCHED;
+
+#define MAX_PLY 64
+
+// Scores are from white's point of view, mate in n plies scores
+// MATE_SCORE - n for white and -(MATE_SCORE - n) for black
+#define MATE_SCORE 30000
+#define MATE_BOUND (MATE_SCORE - MAX_PLY)
+#define IS_MATE_SCORE(score) ((score) > MATE_BOUND || (score) < -MATE_BOUND)
+
+// Limits of findBestMove(), zero means unlimited. Without depth, nodes
+// movetime or time the search runs until stopped
+typedef struct {
+    int depth;
+    uint64_t nodes;
+    int movetime;       // ms
+    int time[2];        // ms left on the clock, [0] white, [1] black
+    int inc[2];         // ms added per move
+    int movestogo;      // moves until next time control, 0 if none
+    bool infinite;      // keep searching until stopped, even after a mate
+} SearchLimits;
+
+// Result of a completed iteration
+typedef struct {
+    int depth;
+    int score;          // white's point of view
+    uint64_t nodes;     // of all threads
+    double ms;
+    int hashfull;       // permille of the transposition table in use
+    Move pv[MAX_PLY];
+    int pv_length;
+} SearchInfo;
+
+typedef void (*SearchCallback)(const SearchInfo *info, void *data);
+
+// Helper threads kept between searches, see searchPoolCreate()
+typedef struct SearchPool SearchPool;
+
+// Everything findBestMove() is given, zero initialize and fill in
+typedef struct {
+    SearchLimits limits;
+    int threads;                // 0 or 1 for a single threaded search
+    bool search_single_move;    // search a position with one legal move
+                                // for its score, instead of returning it
+    SearchPool *pool;           // runs the helpers if set, instead of
+                                // threads started for this search
+
+    // Zobrist hashes of positions before the root, oldest first, to score
+    // repetitions as draws. May be NULL
+    const uint64_t *history;
+    int history_count;
+
+    // Called by the searching thread after every completed iteration
+    SearchCallback on_iteration;
+    void *callback_data;
+
+    // Set from any thread to end the search early
+    atomic_bool stop;
+
+    // Pondering: searching the position after the reply we expect, on the
+    // opponent's time. While set the search runs without limits, clearing
+    // it (a ponder hit) starts the clock and turns it into a normal search
+    atomic_bool ponder;
+    _Atomic uint64_t nodes;
+} SearchContext;
+
 // Handles computation of some constant variables, this should be called
 // from the main program before doing anything else
 void precomputeValues(void);
@@ -15,8 +84,24 @@ Board moveMake(Move m, Board b);
 bool isKingChecked(const Board *b, Piece color);
 
 uint64_t generateTillDepth(Board b, int depth, bool show_move);
-Move findBestMove(const Board *b);
-int evaluateBoard(const Board *b);
+
+// Iterative deepening search of b within ctx's limits, ctx->threads share
+// the transposition table (lazy SMP). Returns EMPTY_MOVE if b has no moves
+// info (may be NULL) receives the last completed iteration
+Move findBestMove(const Board *b, SearchContext *ctx, SearchInfo *info);
+
+// Starts n_helpers threads that wait for searches using the pool, for
+// callers that search many times and don't want to start threads each
+// time. Returns NULL on failure
+SearchPool *searchPoolCreate(int n_helpers);
+
+// Ends the helpers, no search may be using the pool
+void searchPoolDestroy(SearchPool *pool);
+
+// Fixed depth alpha-beta search without limits, ends in quiescence search
 int bestEvaluation(const Board *b, int depth, bool is_maximizing, int alpha, int beta);
 
+// Time findBestMove() aims to use with the given limits, 0 if unlimited
+int searchTimeBudget(const SearchLimits *limits, Piece color_to_move);
+
 #endif // ENGINE_H
@@ -0,0 +1,190 @@
+#include "enginethread.h"
+
+#include <string.h>
+#include <time.h>
+
+#define QUEUE_MASK (ENGINE_QUEUE_SIZE - 1)
+
+static void sleepMs(int ms)
+{
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+// Single producer single consumer ring buffers, the producer owns tail and
+// the consumer owns head. Release on publish, acquire on observe, so a slot
+// is fully written before the other side sees it
+
+static bool pushCommand(EngineCommandQueue *q, const EngineCommand *cmd)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail - head == ENGINE_QUEUE_SIZE)
+        return false;
+    q->slots[tail & QUEUE_MASK] = *cmd;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static bool popCommand(EngineCommandQueue *q, EngineCommand *cmd)
+{
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == tail)
+        return false;
+    *cmd = q->slots[head & QUEUE_MASK];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return true;
+}
+
+static bool pushEvent(EngineEventQueue *q, const EngineEvent *event)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail - head == ENGINE_QUEUE_SIZE)
+        return false;
+    q->slots[tail & QUEUE_MASK] = *event;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static bool popEvent(EngineEventQueue *q, EngineEvent *event)
+{
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == tail)
+        return false;
+    *event = q->slots[head & QUEUE_MASK];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return true;
+}
+
+typedef struct {
+    EngineThread *e;
+    uint32_t id;
+} IterationData;
+
+// Infos are dropped if the front end falls behind, the next one replaces them
+static void sendInfo(const SearchInfo *info, void *data)
+{
+    IterationData *it = data;
+    EngineEvent event = {.type = ENGINE_EVENT_INFO, .id = it->id, .info = *info};
+    pushEvent(&it->e->events, &event);
+}
+
+static void runSearch(EngineThread *e, const EngineCommand *cmd)
+{
+    IterationData it = {.e = e, .id = cmd->id};
+    SearchContext *ctx = &e->search;
+
+    // Front end only writes stop and ponder, set them last
+    ctx->limits = cmd->limits;
+    ctx->threads = e->threads;
+    ctx->pool = e->pool;
+    ctx->history = cmd->history;
+    ctx->history_count = cmd->history_count;
+    ctx->on_iteration = sendInfo;
+    ctx->callback_data = &it;
+    atomic_store(&ctx->nodes, 0);
+    atomic_store(&ctx->ponder, cmd->ponder);
+    atomic_store(&ctx->stop, false);
+
+    // Stop or ponder hit may have been sent before the flags were reset
+    if (atomic_load(&e->cancel_id) >= cmd->id)
+        atomic_store(&ctx->stop, true);
+    if (atomic_load(&e->ponderhit_id) >= cmd->id)
+        atomic_store(&ctx->ponder, false);
+
+    EngineEvent event = {.type = ENGINE_EVENT_BESTMOVE, .id = cmd->id};
+    event.best_move = findBestMove(&cmd->board, ctx, &event.info);
+    if (atomic_load(&ctx->ponder))
+        event.best_move = EMPTY_MOVE;   // stopped before the ponder hit
+
+    while (!pushEvent(&e->events, &event) && !atomic_load(&e->quitting))
+        sleepMs(1);
+}
+
+static void *worker(void *arg)
+{
+    EngineThread *e = arg;
+    EngineCommand cmd;
+    while (true) {
+        if (!popCommand(&e->commands, &cmd)) {
+            pthread_mutex_lock(&e->lock);
+            while (atomic_load(&e->commands.head) == atomic_load(&e->commands.tail))
+                pthread_cond_wait(&e->wake, &e->lock);
+            pthread_mutex_unlock(&e->lock);
+            continue;
+        }
+        if (cmd.type == ENGINE_CMD_QUIT)
+            return NULL;
+        runSearch(e, &cmd);
+    }
+}
+
+bool engineStart(EngineThread *e, int n_threads)
+{
+    memset(e, 0, sizeof(*e));
+    e->threads = n_threads;
+    if (n_threads > 1 && (e->pool = searchPoolCreate(n_threads - 1)) == NULL)
+        return false;
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->wake, NULL);
+    if (pthread_create(&e->tid, NULL, worker, e) != 0) {
+        searchPoolDestroy(e->pool);
+        return false;
+    }
+    return true;
+}
+
+void engineQuit(EngineThread *e)
+{
+    // Worker drops what's left to send and quits after the queued commands,
+    // which are all stopped
+    EngineCommand cmd = {.type = ENGINE_CMD_QUIT};
+    atomic_store(&e->quitting, true);
+    while (engineSend(e, &cmd) == 0)
+        sleepMs(1);
+    engineStop(e);
+    pthread_join(e->tid, NULL);
+    searchPoolDestroy(e->pool);
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->wake);
+}
+
+uint32_t engineSend(EngineThread *e, const EngineCommand *cmd)
+{
+    EngineCommand copy = *cmd;
+    copy.id = e->last_id + 1;
+    if (!pushCommand(&e->commands, &copy))
+        return 0;
+    e->last_id++;
+
+    // Under the lock so the worker can't miss it between its check and wait
+    pthread_mutex_lock(&e->lock);
+    pthread_cond_signal(&e->wake);
+    pthread_mutex_unlock(&e->lock);
+    return copy.id;
+}
+
+void engineStop(EngineThread *e)
+{
+    atomic_store(&e->cancel_id, e->last_id);
+    atomic_store(&e->search.stop, true);
+}
+
+void enginePonderHit(EngineThread *e)
+{
+    atomic_store(&e->ponderhit_id, e->last_id);
+    atomic_store(&e->search.ponder, false);
+}
+
+bool enginePoll(EngineThread *e, EngineEvent *event)
+{
+    return popEvent(&e->events, event);
+}
+
+uint64_t engineNodes(EngineThread *e)
+{
+    return atomic_load_explicit(&e->search.nodes, memory_order_relaxed);
+}
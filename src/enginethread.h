@@ -0,0 +1,110 @@
+#ifndef ENGINETHREAD_H
+#define ENGINETHREAD_H
+
+#include "board.h"
+#include "engine.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Long lived search thread for front ends that can't block, e.g. the GUI
+//
+// The front end sends commands and polls events through two single
+// producer, single consumer lock free queues. Commands carry a copy of the
+// position, so the worker never touches front end state. A search can be
+// stopped or turned from pondering into a normal search at any time
+// without going through the queue, the worker notices within a few ms.
+
+// Capacity of each queue, must be a power of 2
+#define ENGINE_QUEUE_SIZE 64
+
+// Positions before the searched one kept for repetition detection
+#define ENGINE_MAX_HISTORY 128
+
+typedef enum {
+    ENGINE_CMD_SEARCH,
+    ENGINE_CMD_QUIT,
+} EngineCommandType;
+
+typedef struct {
+    EngineCommandType type;
+    uint32_t id;            // set by engineSend(), echoed in events
+    Board board;
+    uint64_t history[ENGINE_MAX_HISTORY];   // oldest first
+    int history_count;
+    SearchLimits limits;
+    bool ponder;            // start pondering, see enginePonderHit()
+} EngineCommand;
+
+typedef enum {
+    ENGINE_EVENT_INFO,      // an iteration completed
+    ENGINE_EVENT_BESTMOVE,  // search finished, best_move is EMPTY_MOVE if
+                            // stopped while pondering or without moves
+} EngineEventType;
+
+typedef struct {
+    EngineEventType type;
+    uint32_t id;
+    Move best_move;
+    SearchInfo info;
+} EngineEvent;
+
+typedef struct {
+    EngineCommand slots[ENGINE_QUEUE_SIZE];
+    _Atomic uint32_t head;  // next slot read by the consumer
+    _Atomic uint32_t tail;  // next slot written by the producer
+} EngineCommandQueue;
+
+typedef struct {
+    EngineEvent slots[ENGINE_QUEUE_SIZE];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+} EngineEventQueue;
+
+typedef struct {
+    pthread_t tid;
+    int threads;
+    SearchPool *pool;   // helpers of every search, NULL if single threaded
+    EngineCommandQueue commands;
+    EngineEventQueue events;
+
+    // The worker sleeps on wake while the command queue is empty
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+
+    // Search being run by the worker, its stop and ponder flags are the
+    // only parts written by the front end
+    SearchContext search;
+
+    uint32_t last_id;               // of the last command sent
+    _Atomic uint32_t cancel_id;     // searches up to this id are stopped
+    _Atomic uint32_t ponderhit_id;  // and these don't ponder anymore
+    atomic_bool quitting;
+} EngineThread;
+
+// Starts the worker, each search uses n_threads threads, the helpers
+// among them are started once here and kept for every search
+bool engineStart(EngineThread *e, int n_threads);
+
+// Stops any search, waits for the worker to exit
+void engineQuit(EngineThread *e);
+
+// Queues a command, returns its id or 0 if the queue is full
+uint32_t engineSend(EngineThread *e, const EngineCommand *cmd);
+
+// Ends the running search and any queued ones, their bestmove events are
+// still sent
+void engineStop(EngineThread *e);
+
+// Pondering search carries on as a normal one from now
+void enginePonderHit(EngineThread *e);
+
+// Takes the next event, returns false if there's none
+bool enginePoll(EngineThread *e, EngineEvent *event);
+
+// Nodes searched so far by the running search
+uint64_t engineNodes(EngineThread *e);
+
+#endif // !ENGINETHREAD_H
@@ -0,0 +1,156 @@
+#include "epd.h"
+#include "notation.h"
+
+#include <string.h>
+
+static const char *EPD_ERROR_STRINGS[] = {
+    [EPD_OK] = "ok",
+    [EPD_BAD_FEN] = "bad position",
+    [EPD_BAD_OPERATION] = "bad operation",
+    [EPD_BAD_MOVE] = "bad move",
+};
+
+const char *epdErrorString(EpdError err)
+{
+    return EPD_ERROR_STRINGS[err];
+}
+
+static bool isEpdSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Reads the next operand of str[*pos, end) into [*token, *token + length)
+// Quotes are stripped from strings, returns false for an unterminated one
+static bool nextOperand(const char *str, size_t end, size_t *pos, const char **token,
+                        size_t *length)
+{
+    size_t i = *pos;
+    while (i < end && isEpdSpace(str[i]))
+        i++;
+    if (i < end && str[i] == '"') {
+        const char *close = memchr(str + i + 1, '"', end - i - 1);
+        if (close == NULL)
+            return false;
+        *token = str + i + 1;
+        *length = close - *token;
+        *pos = close - str + 1;
+        return true;
+    }
+    size_t start = i;
+    while (i < end && !isEpdSpace(str[i]))
+        i++;
+    *token = str + start;
+    *length = i - start;
+    *pos = i;
+    return true;
+}
+
+static bool parseCount(const char *token, size_t n, uint64_t *value)
+{
+    if (n == 0 || n > 19)
+        return false;
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (token[i] < '0' || token[i] > '9')
+            return false;
+        v = v * 10 + (token[i] - '0');
+    }
+    *value = v;
+    return true;
+}
+
+static bool isOpcode(const char *token, size_t n, const char *opcode)
+{
+    return n == strlen(opcode) && memcmp(token, opcode, n) == 0;
+}
+
+// Reads the moves of a bm or am operation
+static EpdError parseMoves(const EpdRecord *rec, const char *str, size_t end, size_t pos,
+                           Move *moves, int *count)
+{
+    const char *token;
+    size_t n;
+    while (nextOperand(str, end, &pos, &token, &n) && n > 0) {
+        Move m = parseSan(&rec->board, token, n);
+        if (m == EMPTY_MOVE || *count == EPD_MAX_MOVES)
+            return EPD_BAD_MOVE;
+        moves[(*count)++] = m;
+    }
+    return EPD_OK;
+}
+
+// One operation in str[start, end), the semicolon excluded
+static EpdError parseOperation(EpdRecord *rec, const char *str, size_t start, size_t end)
+{
+    size_t pos = start;
+    const char *opcode;
+    size_t n;
+    if (!nextOperand(str, end, &pos, &opcode, &n))
+        return EPD_BAD_OPERATION;
+    if (n == 0)
+        return EPD_OK;
+
+    if (isOpcode(opcode, n, "bm"))
+        return parseMoves(rec, str, end, pos, rec->best_moves, &rec->best_move_count);
+    if (isOpcode(opcode, n, "am"))
+        return parseMoves(rec, str, end, pos, rec->avoid_moves, &rec->avoid_move_count);
+
+    const char *operand;
+    size_t length;
+    if (!nextOperand(str, end, &pos, &operand, &length))
+        return EPD_BAD_OPERATION;
+
+    if (isOpcode(opcode, n, "id")) {
+        if (length >= EPD_MAX_ID_LENGTH)
+            length = EPD_MAX_ID_LENGTH - 1;
+        memcpy(rec->id, operand, length);
+        rec->id[length] = '\0';
+    }
+    else if (n >= 2 && n <= 3 && opcode[0] == 'D' && opcode[1] >= '1' && opcode[1] <= '9') {
+        uint64_t depth;
+        if (!parseCount(opcode + 1, n - 1, &depth) || depth > EPD_MAX_DEPTH
+            || !parseCount(operand, length, &rec->perft[depth]))
+            return EPD_BAD_OPERATION;
+        if ((int)depth > rec->perft_depth)
+            rec->perft_depth = depth;
+    }
+    else if (isOpcode(opcode, n, "hmvc") || isOpcode(opcode, n, "fmvn")) {
+        uint64_t value;
+        if (!parseCount(operand, length, &value) || value > 1000000)
+            return EPD_BAD_OPERATION;
+        if (opcode[0] == 'h')
+            rec->board.halfmove_clock = value;
+        else
+            rec->board.fullmoves = value;
+    }
+    return EPD_OK;
+}
+
+EpdError parseEpd(const char *line, size_t len, EpdRecord *rec)
+{
+    memset(rec, 0, sizeof(*rec));
+    size_t pos;
+    rec->fen_error = parseFen(line, len, &rec->board, &pos);
+    if (rec->fen_error != FEN_OK)
+        return EPD_BAD_FEN;
+
+    // Operations up to the end of the line, strings may hold semicolons
+    while (pos < len && line[pos] != '\0' && line[pos] != '\n') {
+        size_t end = pos;
+        bool in_string = false;
+        while (end < len && line[end] != '\0' && line[end] != '\n'
+               && (in_string || line[end] != ';')) {
+            if (line[end] == '"')
+                in_string = !in_string;
+            end++;
+        }
+        if (in_string)
+            return EPD_BAD_OPERATION;
+        EpdError err = parseOperation(rec, line, pos, end);
+        if (err != EPD_OK)
+            return err;
+        pos = end < len && line[end] == ';' ? end + 1 : end;
+    }
+    return EPD_OK;
+}
@@ -0,0 +1,45 @@
+#ifndef EPD_H
+#define EPD_H
+
+#include "board.h"
+#include "move.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Extended Position Description: the first 4 FEN fields followed by
+// operations, each an opcode and operands ended by a semicolon
+//   r1b1k2r/... w kq - bm Nxe5 Qh5; id "WAC.001";
+//   rnbqkbnr/... w KQkq - ;D1 20 ;D2 400 ;D3 8902
+// Opcodes read: bm, am (moves in SAN), id, D1.. (perft counts), hmvc and
+// fmvn (move clocks), others are skipped
+
+#define EPD_MAX_MOVES 8
+#define EPD_MAX_DEPTH 15
+#define EPD_MAX_ID_LENGTH 64
+
+typedef enum {
+    EPD_OK,
+    EPD_BAD_FEN,            // see fen_error
+    EPD_BAD_OPERATION,      // unterminated string or bad number
+    EPD_BAD_MOVE,           // illegal, ambiguous or too many moves
+} EpdError;
+
+typedef struct {
+    Board board;
+    Move best_moves[EPD_MAX_MOVES];
+    int best_move_count;
+    Move avoid_moves[EPD_MAX_MOVES];
+    int avoid_move_count;
+    char id[EPD_MAX_ID_LENGTH];         // null terminated, empty if none
+    uint64_t perft[EPD_MAX_DEPTH + 1];  // perft[d] from Dd, 0 if not given
+    int perft_depth;                    // deepest Dd given
+    FenError fen_error;
+} EpdRecord;
+
+// Parses one record from line[0, len), no null terminator needed
+// Reentrant, rec is filled as far as parsing got on error
+EpdError parseEpd(const char *line, size_t len, EpdRecord *rec);
+const char *epdErrorString(EpdError err);
+
+#endif // !EPD_H
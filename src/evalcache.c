@@ -0,0 +1,114 @@
+#include "evalcache.h"
+#include "utils.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+// Same lockless scheme as the pawn table, check is key ^ data
+// so a slot half written by another thread fails verification
+typedef struct {
+    _Atomic uint64_t check;
+    _Atomic uint64_t data;
+} EvalSlot;
+
+static EvalSlot *eval_cache = NULL;
+static size_t eval_cache_size = 0;
+
+static _Atomic uint64_t eval_cache_hits;
+static _Atomic uint64_t eval_cache_misses;
+static _Thread_local uint32_t local_hits, local_misses;
+
+static void flushEvalCacheStats(void)
+{
+    atomic_fetch_add_explicit(&eval_cache_hits, local_hits, memory_order_relaxed);
+    atomic_fetch_add_explicit(&eval_cache_misses, local_misses, memory_order_relaxed);
+    local_hits = local_misses = 0;
+}
+
+bool setEvalCacheSize(size_t entries)
+{
+    free(eval_cache);
+    eval_cache = NULL;
+    eval_cache_size = 0;
+    if (entries == 0)
+        return true;
+
+    // Round down to a power of 2 so index is a mask of the key
+    size_t size = 1;
+    while (size * 2 <= entries)
+        size *= 2;
+
+    eval_cache = calloc(size, sizeof(EvalSlot));
+    if (eval_cache == NULL)
+        return false;
+    eval_cache_size = size;
+    return true;
+}
+
+size_t getEvalCacheSize(void)
+{
+    return eval_cache_size;
+}
+
+void clearEvalCache(void)
+{
+    for (size_t i = 0; i < eval_cache_size; i++) {
+        atomic_store_explicit(&eval_cache[i].check, 0, memory_order_relaxed);
+        atomic_store_explicit(&eval_cache[i].data, 0, memory_order_relaxed);
+    }
+}
+
+bool probeEvalCache(uint64_t key, int *score)
+{
+    if (eval_cache_size == 0)
+        return false;
+
+    EvalSlot *slot = &eval_cache[key & (eval_cache_size - 1)];
+    uint64_t check = atomic_load_explicit(&slot->check, memory_order_relaxed);
+    uint64_t data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+
+    if (local_hits + local_misses >= STATS_BATCH)
+        flushEvalCacheStats();
+
+    // Stored data always has its high bit set, so empty slots never verify
+    if ((check ^ data) != key || data == 0) {
+        local_misses++;
+        return false;
+    }
+
+    *score = (int32_t)(uint32_t)data;
+    local_hits++;
+    return true;
+}
+
+// Always replaces whatever is in the slot
+void storeEvalCache(uint64_t key, int score)
+{
+    if (eval_cache_size == 0)
+        return;
+
+    EvalSlot *slot = &eval_cache[key & (eval_cache_size - 1)];
+
+    // High bit marks the slot as used
+    uint64_t data = (uint64_t)(uint32_t)score | (1ull << 63);
+    atomic_store_explicit(&slot->data, data, memory_order_relaxed);
+    atomic_store_explicit(&slot->check, key ^ data, memory_order_relaxed);
+}
+
+// Other threads' counts are up to STATS_BATCH probes behind
+EvalCacheStats getEvalCacheStats(void)
+{
+    flushEvalCacheStats();
+    EvalCacheStats stats = {
+        .hits = atomic_load_explicit(&eval_cache_hits, memory_order_relaxed),
+        .misses = atomic_load_explicit(&eval_cache_misses, memory_order_relaxed),
+    };
+    return stats;
+}
+
+void resetEvalCacheStats(void)
+{
+    local_hits = local_misses = 0;
+    atomic_store_explicit(&eval_cache_hits, 0, memory_order_relaxed);
+    atomic_store_explicit(&eval_cache_misses, 0, memory_order_relaxed);
+}
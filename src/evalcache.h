@@ -0,0 +1,30 @@
+#ifndef EVALCACHE_H
+#define EVALCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Default number of entries, allocated by precomputeValues()
+#define EVAL_CACHE_DEFAULT_SIZE (1 << 16)
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+} EvalCacheStats;
+
+// Resizes (and clears) the cache, entries is rounded down to a power of 2
+// 0 disables the cache. Not safe to call while other threads evaluate
+bool setEvalCacheSize(size_t entries);
+size_t getEvalCacheSize(void);
+void clearEvalCache(void);
+
+// Direct mapped lookup by zobrist hash, returns false on a miss
+// Safe to call from multiple threads, torn entries are detected and missed
+bool probeEvalCache(uint64_t key, int *score);
+void storeEvalCache(uint64_t key, int score);
+
+EvalCacheStats getEvalCacheStats(void);
+void resetEvalCacheStats(void);
+
+#endif // !EVALCACHE_H
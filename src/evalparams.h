@@ -0,0 +1,37 @@
+#ifndef EVALPARAMS_H
+#define EVALPARAMS_H
+
+// Weights of the classic evaluation, [..][0] midgame, [..][1] endgame
+// Defined in evalparams.c, which is generated by ./build/tuner
+
+// Piece values, indexed by PieceIdx
+extern const int MATERIAL[6][2];
+
+// Piece square tables, laid out as seen from white's side,
+// first row is the 8th rank (a8 ... h8), last row is the 1st rank
+extern const int PAWN_MG[64], PAWN_EG[64];
+extern const int KNIGHT_MG[64], KNIGHT_EG[64];
+extern const int BISHOP_MG[64], BISHOP_EG[64];
+extern const int ROOK_MG[64], ROOK_EG[64];
+extern const int QUEEN_MG[64], QUEEN_EG[64];
+extern const int KING_MG[64], KING_EG[64];
+
+// Per attacked square not occupied by own pieces or attacked by enemy pawns
+extern const int MOBILITY[6][2];
+
+// Indexed by relative rank of the passed pawn
+extern const int PASSED_PAWN[8][2];
+
+// Passed pawn whose square in front is empty, by relative rank
+extern const int PASSED_PAWN_FREE[8][2];
+
+extern const int DOUBLED_PAWN[2];
+extern const int ISOLATED_PAWN[2];
+
+// Per square of the enemy king zone (king and its neighbours) attacked
+extern const int KING_ZONE_ATTACK[2];
+
+extern const int ROOK_OPEN_FILE[2];
+extern const int ROOK_SEMI_OPEN_FILE[2];
+
+#endif // !EVALPARAMS_H
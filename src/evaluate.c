@@ -0,0 +1,390 @@
+#include "evaluate.h"
+#include "bitbase.h"
+#include "evalcache.h"
+#include "evalparams.h"
+#include "generator.h"
+#include "nnue.h"
+#include "pawntable.h"
+#include "utils.h"
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+int PSQT[2][6][64][2];
+
+// Adds coef to the trace of a weight when evaluation is being traced
+#define TRACE(param, coef)                                                     \
+    do {                                                                       \
+        if (trace)                                                             \
+            trace->coefs[param] += (coef);                                     \
+    } while (0)
+
+static EvalMode eval_mode = EVAL_CLASSIC;
+
+static _Atomic uint64_t lazy_evals = 0;
+static _Atomic uint64_t lazy_exits = 0;
+static _Thread_local uint32_t local_evals, local_exits;
+
+static void flushLazyEvalStats(void)
+{
+    atomic_fetch_add_explicit(&lazy_evals, local_evals, memory_order_relaxed);
+    atomic_fetch_add_explicit(&lazy_exits, local_exits, memory_order_relaxed);
+    local_evals = local_exits = 0;
+}
+
+// File masks used for pawn structure and open file detection
+// PASSED_PAWN_MASKS[col][sq]: squares in front of a pawn on its own and
+// adjacent files, no enemy pawn there means the pawn is passed
+static uint64_t FILE_MASKS[8];
+static uint64_t ADJACENT_FILE_MASKS[8];
+static uint64_t PASSED_PAWN_MASKS[2][64];
+
+const int PHASE_WEIGHTS[6] = {
+    [KING_IDX] = 0,
+    [QUEEN_IDX] = 4,
+    [BISHOP_IDX] = 1,
+    [KNIGHT_IDX] = 1,
+    [ROOK_IDX] = 2,
+    [PAWN_IDX] = 0,
+};
+
+// Indexed by PieceIdx, [0] midgame, [1] endgame
+static const int *PIECE_SQUARE_TABLES[6][2] = {
+    [KING_IDX] = {KING_MG, KING_EG},
+    [QUEEN_IDX] = {QUEEN_MG, QUEEN_EG},
+    [BISHOP_IDX] = {BISHOP_MG, BISHOP_EG},
+    [KNIGHT_IDX] = {KNIGHT_MG, KNIGHT_EG},
+    [ROOK_IDX] = {ROOK_MG, ROOK_EG},
+    [PAWN_IDX] = {PAWN_MG, PAWN_EG},
+};
+
+// Folds material into piece square tables for both colors
+// Called by engine during start, via precomputeValues()
+void populateEvalValues(void)
+{
+    for (int piece_idx = 0; piece_idx < 6; piece_idx++) {
+        for (int sq = 0; sq < 64; sq++) {
+            for (int stage = 0; stage < 2; stage++) {
+                const int *table = PIECE_SQUARE_TABLES[piece_idx][stage];
+                int material = MATERIAL[piece_idx][stage];
+
+                // Tables are written rank 8 first, so a white piece on sq
+                // is found at the vertically flipped index
+                PSQT[0][piece_idx][sq][stage] = material + table[sq ^ 56];
+                PSQT[1][piece_idx][sq][stage] = -(material + table[sq]);
+            }
+        }
+    }
+
+    for (int file = 0; file < 8; file++)
+        FILE_MASKS[file] = 0x0101010101010101ull << file;
+    for (int file = 0; file < 8; file++) {
+        ADJACENT_FILE_MASKS[file] = 0;
+        if (file > 0)
+            ADJACENT_FILE_MASKS[file] |= FILE_MASKS[file - 1];
+        if (file < 7)
+            ADJACENT_FILE_MASKS[file] |= FILE_MASKS[file + 1];
+    }
+
+    for (int sq = 0; sq < 64; sq++) {
+        int rank = sq / 8, file = sq % 8;
+        uint64_t files = FILE_MASKS[file] | ADJACENT_FILE_MASKS[file];
+        uint64_t above = rank == 7 ? 0 : ~0ull << ((rank + 1) * 8);
+        uint64_t below = rank == 0 ? 0 : ~0ull >> ((8 - rank) * 8);
+        PASSED_PAWN_MASKS[0][sq] = files & above;
+        PASSED_PAWN_MASKS[1][sq] = files & below;
+    }
+}
+
+void getPsqtScores(const Board *b, int psqt[2], int *phase)
+{
+    psqt[0] = psqt[1] = 0;
+    *phase = 0;
+
+    for (int sq = 0; sq < 64; sq++) {
+        if (b->pieces[sq] == EMPTY_PIECE)
+            continue;
+        int col_idx = (b->pieces[sq] & WHITE) ? 0 : 1;
+        int piece_idx = getPieceIdx(b->pieces[sq]);
+        psqt[0] += PSQT[col_idx][piece_idx][sq][0];
+        psqt[1] += PSQT[col_idx][piece_idx][sq][1];
+        *phase += PHASE_WEIGHTS[piece_idx];
+    }
+}
+
+// Evaluates doubled, isolated and passed pawn terms of both sides
+// Only depends on pawn placement so the result is cached by pawn_hash
+static PawnEntry evaluatePawns(const Board *b, EvalTrace *trace)
+{
+    PawnEntry entry = {.score = {0, 0}, .passed = {0, 0}};
+    int *score = entry.score;
+
+    for (int col_idx = 0; col_idx < 2; col_idx++) {
+        const int sign = col_idx == 0 ? 1 : -1;
+        const uint64_t pawns = b->bitboards[col_idx][PAWN_IDX];
+        const uint64_t enemy_pawns = b->bitboards[1 - col_idx][PAWN_IDX];
+
+        for (int file = 0; file < 8; file++) {
+            int count = POPCOUNT(pawns & FILE_MASKS[file]);
+            if (count == 0)
+                continue;
+            if (count > 1) {
+                score[0] += sign * DOUBLED_PAWN[0] * (count - 1);
+                score[1] += sign * DOUBLED_PAWN[1] * (count - 1);
+                TRACE(EP_DOUBLED_PAWN, sign * (count - 1));
+            }
+            if ((pawns & ADJACENT_FILE_MASKS[file]) == 0) {
+                score[0] += sign * ISOLATED_PAWN[0] * count;
+                score[1] += sign * ISOLATED_PAWN[1] * count;
+                TRACE(EP_ISOLATED_PAWN, sign * count);
+            }
+        }
+
+        for (uint64_t bb = pawns; bb; bb &= bb - 1) {
+            int sq = LSB(bb);
+            if (PASSED_PAWN_MASKS[col_idx][sq] & enemy_pawns)
+                continue;
+            int relative_rank = col_idx == 0 ? sq / 8 : 7 - sq / 8;
+            score[0] += sign * PASSED_PAWN[relative_rank][0];
+            score[1] += sign * PASSED_PAWN[relative_rank][1];
+            TRACE(EP_PASSED_PAWN + relative_rank, sign);
+            entry.passed[col_idx] |= 1ull << sq;
+        }
+    }
+
+    return entry;
+}
+
+// Adds passed pawn terms that depend on other pieces too
+static void evaluatePassedPawns(const Board *b, const uint64_t passed[2], int score[2],
+                                EvalTrace *trace)
+{
+    const uint64_t occupied = b->occupancy[0] | b->occupancy[1];
+    for (int col_idx = 0; col_idx < 2; col_idx++) {
+        const int sign = col_idx == 0 ? 1 : -1;
+        for (uint64_t bb = passed[col_idx]; bb; bb &= bb - 1) {
+            int sq = LSB(bb);
+            int stop_sq = col_idx == 0 ? sq + 8 : sq - 8;
+            if (occupied & (1ull << stop_sq))
+                continue;
+            int relative_rank = col_idx == 0 ? sq / 8 : 7 - sq / 8;
+            score[0] += sign * PASSED_PAWN_FREE[relative_rank][0];
+            score[1] += sign * PASSED_PAWN_FREE[relative_rank][1];
+            TRACE(EP_PASSED_PAWN_FREE + relative_rank, sign);
+        }
+    }
+}
+
+// Adds mobility, king zone attacks and rook file terms of both sides to score
+static void evaluatePieces(const Board *b, int score[2], EvalTrace *trace)
+{
+    const uint64_t occupied = b->occupancy[0] | b->occupancy[1];
+    const uint64_t all_pawns = b->bitboards[0][PAWN_IDX] | b->bitboards[1][PAWN_IDX];
+
+    for (int col_idx = 0; col_idx < 2; col_idx++) {
+        const int sign = col_idx == 0 ? 1 : -1;
+        const int opp_col_idx = 1 - col_idx;
+        const uint64_t own_pawns = b->bitboards[col_idx][PAWN_IDX];
+        const uint64_t safe_squares =
+            ~b->occupancy[col_idx] &
+            ~pawnAttacks(b->bitboards[opp_col_idx][PAWN_IDX], opp_col_idx);
+
+        int enemy_king_sq = b->king_squares[opp_col_idx];
+        uint64_t king_zone = KING_ATTACK_MAPS[enemy_king_sq] | (1ull << enemy_king_sq);
+        int zone_attacks = 0;
+
+        for (int piece_idx = QUEEN_IDX; piece_idx <= ROOK_IDX; piece_idx++) {
+            for (uint64_t bb = b->bitboards[col_idx][piece_idx]; bb; bb &= bb - 1) {
+                int sq = LSB(bb);
+                uint64_t attacks;
+                if (piece_idx == KNIGHT_IDX)
+                    attacks = KNIGHT_ATTACK_MAPS[sq];
+                else if (piece_idx == BISHOP_IDX)
+                    attacks = bishopAttacks(sq, occupied);
+                else if (piece_idx == ROOK_IDX)
+                    attacks = rookAttacks(sq, occupied);
+                else
+                    attacks = bishopAttacks(sq, occupied) | rookAttacks(sq, occupied);
+
+                int mobility = POPCOUNT(attacks & safe_squares);
+                score[0] += sign * MOBILITY[piece_idx][0] * mobility;
+                score[1] += sign * MOBILITY[piece_idx][1] * mobility;
+                TRACE(EP_MOBILITY + piece_idx, sign * mobility);
+                zone_attacks += POPCOUNT(attacks & king_zone);
+
+                if (piece_idx == ROOK_IDX) {
+                    uint64_t file = FILE_MASKS[sq % 8];
+                    if ((file & all_pawns) == 0) {
+                        score[0] += sign * ROOK_OPEN_FILE[0];
+                        score[1] += sign * ROOK_OPEN_FILE[1];
+                        TRACE(EP_ROOK_OPEN_FILE, sign);
+                    }
+                    else if ((file & own_pawns) == 0) {
+                        score[0] += sign * ROOK_SEMI_OPEN_FILE[0];
+                        score[1] += sign * ROOK_SEMI_OPEN_FILE[1];
+                        TRACE(EP_ROOK_SEMI_OPEN_FILE, sign);
+                    }
+                }
+            }
+        }
+
+        score[0] += sign * KING_ZONE_ATTACK[0] * zone_attacks;
+        score[1] += sign * KING_ZONE_ATTACK[1] * zone_attacks;
+        TRACE(EP_KING_ZONE_ATTACK, sign * zone_attacks);
+    }
+}
+
+// Tapered evaluation from white's point of view (white is maximizing)
+// Interpolates between midgame and endgame scores by game phase
+// Sets is_lazy and skips pawn and piece terms when material/psqt is
+// outside the window by more than LAZY_EVAL_MARGIN
+static int evaluateClassic(const Board *b, int alpha, int beta, bool *is_lazy)
+{
+    int phase = MIN(b->phase, MAX_PHASE);
+    int lazy = (b->psqt[0] * phase + b->psqt[1] * (MAX_PHASE - phase)) / MAX_PHASE;
+    if (++local_evals >= STATS_BATCH)
+        flushLazyEvalStats();
+    // Written so that INT_MIN/INT_MAX windows can't overflow
+    *is_lazy = lazy + LAZY_EVAL_MARGIN < alpha || lazy - LAZY_EVAL_MARGIN > beta;
+    if (*is_lazy) {
+        local_exits++;
+        return lazy;
+    }
+
+    PawnEntry pawns;
+    if (!probePawnTable(b->pawn_hash, &pawns)) {
+        pawns = evaluatePawns(b, NULL);
+        storePawnTable(b->pawn_hash, &pawns);
+    }
+
+    int score[2] = {b->psqt[0] + pawns.score[0], b->psqt[1] + pawns.score[1]};
+    evaluatePassedPawns(b, pawns.passed, score, NULL);
+    evaluatePieces(b, score, NULL);
+
+    return (score[0] * phase + score[1] * (MAX_PHASE - phase)) / MAX_PHASE;
+}
+
+// Bitbase wins all score alike, this drives the losing king to the edge
+// and the winning king towards it so search can find the mate
+static int winProgress(const Board *b, int winner)
+{
+    int loser_sq = b->king_squares[!winner];
+    int winner_sq = b->king_squares[winner];
+    int file = loser_sq % 8, rank = loser_sq / 8;
+    int edge = MAX(3 - MIN(file, 7 - file), 3 - MIN(rank, 7 - rank));
+    int kings = MAX(abs(file - winner_sq % 8), abs(rank - winner_sq / 8));
+    return 20 * edge + 10 * (7 - kings);
+}
+
+// Evaluates with the selected EvalMode, from white's point of view
+// Exact results are cached by zobrist hash, see evalcache.h
+int evaluateBoard(const Board *b, int alpha, int beta)
+{
+    int eval;
+    if (probeEvalCache(b->zobrist_hash, &eval))
+        return eval;
+
+    // Endgames covered by bitbases, wins keep the evaluation on top so
+    // that search still makes progress towards converting them
+    BitbaseResult wdl = probeBitbase(b);
+    if (wdl != BITBASE_UNKNOWN) {
+        alpha = INT_MIN;
+        beta = INT_MAX;
+    }
+
+    bool is_lazy = false;
+    if (wdl == BITBASE_DRAW)
+        eval = 0;
+    else if (eval_mode == EVAL_NNUE && nnueIsLoaded())
+        eval = nnueEvaluate(b);
+    else
+        eval = evaluateClassic(b, alpha, beta, &is_lazy);
+
+    if (wdl == BITBASE_WIN || wdl == BITBASE_LOSS) {
+        bool white_wins = (wdl == BITBASE_WIN) == ((b->color_to_move & WHITE) != 0);
+        int bonus = BITBASE_WIN_SCORE + winProgress(b, !white_wins);
+        eval += white_wins ? bonus : -bonus;
+    }
+
+    if (!is_lazy)
+        storeEvalCache(b->zobrist_hash, eval);
+    return eval;
+}
+
+// Other threads' counts are up to STATS_BATCH evaluations behind
+LazyEvalStats getLazyEvalStats(void)
+{
+    flushLazyEvalStats();
+    LazyEvalStats stats = {
+        .evals = atomic_load_explicit(&lazy_evals, memory_order_relaxed),
+        .lazy_exits = atomic_load_explicit(&lazy_exits, memory_order_relaxed),
+    };
+    return stats;
+}
+
+void resetLazyEvalStats(void)
+{
+    local_evals = local_exits = 0;
+    atomic_store_explicit(&lazy_evals, 0, memory_order_relaxed);
+    atomic_store_explicit(&lazy_exits, 0, memory_order_relaxed);
+}
+
+void traceEvaluation(const Board *b, EvalTrace *trace)
+{
+    memset(trace, 0, sizeof(*trace));
+
+    for (int sq = 0; sq < 64; sq++) {
+        if (b->pieces[sq] == EMPTY_PIECE)
+            continue;
+        bool is_white = (b->pieces[sq] & WHITE) != 0;
+        int piece_idx = getPieceIdx(b->pieces[sq]);
+        // Same flip as populateEvalValues()
+        int table_sq = is_white ? sq ^ 56 : sq;
+        TRACE(EP_MATERIAL + piece_idx, is_white ? 1 : -1);
+        TRACE(EP_PSQT + piece_idx * 64 + table_sq, is_white ? 1 : -1);
+    }
+
+    int score[2] = {0, 0};
+    PawnEntry pawns = evaluatePawns(b, trace);
+    evaluatePassedPawns(b, pawns.passed, score, trace);
+    evaluatePieces(b, score, trace);
+    trace->phase = MIN(b->phase, MAX_PHASE);
+}
+
+void getEvalParams(int params[NUM_EVAL_PARAMS][2])
+{
+    for (int stage = 0; stage < 2; stage++) {
+        for (int piece_idx = 0; piece_idx < 6; piece_idx++) {
+            params[EP_MATERIAL + piece_idx][stage] = MATERIAL[piece_idx][stage];
+            params[EP_MOBILITY + piece_idx][stage] = MOBILITY[piece_idx][stage];
+            for (int sq = 0; sq < 64; sq++)
+                params[EP_PSQT + piece_idx * 64 + sq][stage] =
+                    PIECE_SQUARE_TABLES[piece_idx][stage][sq];
+        }
+        for (int rank = 0; rank < 8; rank++) {
+            params[EP_PASSED_PAWN + rank][stage] = PASSED_PAWN[rank][stage];
+            params[EP_PASSED_PAWN_FREE + rank][stage] = PASSED_PAWN_FREE[rank][stage];
+        }
+        params[EP_DOUBLED_PAWN][stage] = DOUBLED_PAWN[stage];
+        params[EP_ISOLATED_PAWN][stage] = ISOLATED_PAWN[stage];
+        params[EP_KING_ZONE_ATTACK][stage] = KING_ZONE_ATTACK[stage];
+        params[EP_ROOK_OPEN_FILE][stage] = ROOK_OPEN_FILE[stage];
+        params[EP_ROOK_SEMI_OPEN_FILE][stage] = ROOK_SEMI_OPEN_FILE[stage];
+    }
+}
+
+bool setEvalMode(EvalMode mode)
+{
+    if (mode == EVAL_NNUE && !nnueIsLoaded())
+        return false;
+    eval_mode = mode;
+    clearEvalCache();
+    return true;
+}
+
+EvalMode getEvalMode(void)
+{
+    return eval_mode;
+}
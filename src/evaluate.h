@@ -0,0 +1,84 @@
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include "board.h"
+
+#include <stdint.h>
+
+// Phase of a position with all non pawn material on board,
+// phase drops towards 0 as pieces get traded (endgame)
+#define MAX_PHASE 24
+
+// Material + piece square value of a colored piece on a square, from white's
+// point of view (negative for black pieces). [..][0] is the midgame value,
+// [..][1] the endgame value. Precomputed once by populateEvalValues()
+extern int PSQT[2][6][64][2];
+
+typedef enum {
+    EVAL_CLASSIC, // hand written terms, see evaluate.c
+    EVAL_NNUE,    // neural network, see nnue.h
+} EvalMode;
+
+// Contribution of each piece type to the game phase
+extern const int PHASE_WEIGHTS[6];
+
+void populateEvalValues(void);
+
+// Recomputes material/psqt and phase accumulators from scratch
+// moveMake() keeps Board's copies of these updated incrementally
+void getPsqtScores(const Board *b, int psqt[2], int *phase);
+
+// Largest score the terms after material/psqt are expected to add up to
+// When material/psqt alone is further than this outside the search window,
+// evaluateBoard() returns it without computing the rest (lazy evaluation)
+#define LAZY_EVAL_MARGIN 250
+
+typedef struct {
+    uint64_t evals;      // classic evaluations not answered by the eval cache
+    uint64_t lazy_exits; // of which returned material/psqt only
+} LazyEvalStats;
+
+// Evaluation from white's point of view, alpha and beta are the search
+// window (INT_MIN, INT_MAX for an exact score). A score outside the window
+// may be a lazy estimate, it is then still on the same side of the window
+int evaluateBoard(const Board *b, int alpha, int beta);
+
+LazyEvalStats getLazyEvalStats(void);
+void resetLazyEvalStats(void);
+
+// Classic evaluation is linear in its weights (see evalparams.h) before
+// tapering, below is their layout as one vector of [midgame, endgame] pairs
+enum {
+    EP_MATERIAL = 0,                            // [6] by PieceIdx
+    EP_PSQT = EP_MATERIAL + 6,                  // [6][64] as the tables are laid out
+    EP_MOBILITY = EP_PSQT + 6 * 64,             // [6] by PieceIdx
+    EP_PASSED_PAWN = EP_MOBILITY + 6,           // [8] by relative rank
+    EP_PASSED_PAWN_FREE = EP_PASSED_PAWN + 8,   // [8] by relative rank
+    EP_DOUBLED_PAWN = EP_PASSED_PAWN_FREE + 8,
+    EP_ISOLATED_PAWN,
+    EP_KING_ZONE_ATTACK,
+    EP_ROOK_OPEN_FILE,
+    EP_ROOK_SEMI_OPEN_FILE,
+    NUM_EVAL_PARAMS,
+};
+
+// How many times each weight counts towards the evaluation of a position,
+// white's count minus black's. Used by the tuner (tuner.c) to fit weights:
+// mg = sum(coefs[i] * params[i][0]), eg likewise, then tapered by phase
+typedef struct {
+    int16_t coefs[NUM_EVAL_PARAMS];
+    int phase; // clamped to MAX_PHASE
+} EvalTrace;
+
+// Fills trace for the classic evaluation of b, bypassing the caches
+void traceEvaluation(const Board *b, EvalTrace *trace);
+
+// Current weights in the layout above
+void getEvalParams(int params[NUM_EVAL_PARAMS][2]);
+
+// Switches evaluation used by evaluateBoard(), clears the eval cache
+// Returns false if EVAL_NNUE is asked for without a loaded network
+bool setEvalMode(EvalMode mode);
+EvalMode getEvalMode(void);
+
+#endif // !EVALUATE_H
@@ -0,0 +1,328 @@
+#include "board.h"
+#include "book.h"
+#include "engine.h"
+#include "gameindex.h"
+#include "notation.h"
+#include "pgn.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Opening explorer over PGN game collections
+//
+// Usage: ./build/explorer index games.idx games.pgn... [--threads n]
+//                         [--memory mb] [--tmp dir] [--max-ply n]
+//        ./build/explorer query games.idx [fen] [--games n]
+//        ./build/explorer book book.bin games.pgn... [--threads n]
+//                         [--max-ply n] [--min-games n]
+//
+// index replays every game on all cores and writes the position index
+// (gameindex.h), sorting with at most --memory MB (256 by default) of
+// entries in memory and temporary runs in --tmp. query looks the position
+// (the initial one without a FEN) up and prints how often it occurred and
+// with which results, the same for every legal move, and the first games it
+// occurred in, read back from the PGN files. book writes an opening book
+// (book.h) of the moves played in the first --max-ply plies (20 by default)
+// at least --min-games times (2), weighted by the points they scored: 2 for
+// a win and 1 for a draw.
+
+#define DEFAULT_MEMORY_MB 256
+#define DEFAULT_GAMES 10
+#define DEFAULT_BOOK_PLIES 20
+#define DEFAULT_MIN_GAMES 2
+
+typedef struct {
+    Move move;
+    char san[SAN_MAX_LENGTH];
+    PositionStats stats;
+} MoveStats;
+
+// Times a move was played from a position and the half points it scored
+typedef struct {
+    uint64_t key;
+    uint16_t move;
+    uint32_t games, points;
+} BookCount;
+
+typedef struct {
+    BookCount *counts;
+    size_t count, capacity;
+} BookCounts;
+
+typedef struct {
+    BookCounts *threads;        // one per reading thread
+    int max_ply;
+} BookBuilder;
+
+static int compareBookCounts(const void *a, const void *b)
+{
+    const BookCount *x = a, *y = b;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return (int)x->move - (int)y->move;
+}
+
+// Sorts the counts and adds up those of the same move
+static void foldBookCounts(BookCounts *c)
+{
+    qsort(c->counts, c->count, sizeof(BookCount), compareBookCounts);
+    size_t n = 0;
+    for (size_t i = 0; i < c->count; i++) {
+        if (n > 0 && compareBookCounts(&c->counts[n - 1], &c->counts[i]) == 0) {
+            c->counts[n - 1].games += c->counts[i].games;
+            c->counts[n - 1].points += c->counts[i].points;
+        }
+        else
+            c->counts[n++] = c->counts[i];
+    }
+    c->count = n;
+}
+
+static void countBookMoves(const PgnGame *game, int thread, void *data)
+{
+    BookBuilder *builder = data;
+    BookCounts *c = &builder->threads[thread];
+    if (game->error == PGN_BAD_FEN)
+        return;
+
+    Board b = game->start;
+    int plies = MIN(game->move_count, builder->max_ply);
+    for (int ply = 0; ply < plies; ply++) {
+        // Folding first keeps memory to the distinct moves
+        if (c->count == c->capacity) {
+            foldBookCounts(c);
+            if (c->count >= c->capacity / 2) {
+                c->capacity = MAX(2 * c->capacity, (size_t)4096);
+                c->counts = realloc(c->counts, c->capacity * sizeof(BookCount));
+            }
+        }
+        bool white = b.color_to_move & WHITE;
+        PgnResult win = white ? PGN_WHITE_WINS : PGN_BLACK_WINS;
+        c->counts[c->count++] = (BookCount){
+            .key = polyglotKey(&b),
+            .move = bookEncodeMove(game->moves[ply]),
+            .games = 1,
+            .points = game->result == win ? 2 : game->result == PGN_DRAW ? 1 : 0,
+        };
+        b = moveMake(game->moves[ply], b);
+    }
+}
+
+static bool buildBook(const char *path, const char *const *paths, int path_count, int threads,
+                      int max_ply, int min_games)
+{
+    BookBuilder builder = {.threads = calloc(threads, sizeof(BookCounts)), .max_ply = max_ply};
+    long games = pgnReadFiles(paths, path_count, threads, countBookMoves, &builder);
+    BookCounts all = {0};
+    for (int i = 0; i < threads; i++) {
+        all.counts = realloc(all.counts, (all.count + builder.threads[i].count + 1)
+                                             * sizeof(BookCount));
+        memcpy(all.counts + all.count, builder.threads[i].counts,
+               builder.threads[i].count * sizeof(BookCount));
+        all.count += builder.threads[i].count;
+        free(builder.threads[i].counts);
+    }
+    free(builder.threads);
+    foldBookCounts(&all);
+
+    // Weights are the points scaled down to 16 bits, moves that never
+    // scored aren't played
+    uint32_t max_points = 0;
+    for (size_t i = 0; i < all.count; i++)
+        max_points = MAX(max_points, all.counts[i].points);
+    uint32_t divisor = max_points / 65536 + 1;
+    BookEntry *entries = malloc((all.count + 1) * sizeof(BookEntry));
+    size_t n = 0;
+    for (size_t i = 0; i < all.count; i++) {
+        const BookCount *c = &all.counts[i];
+        if (c->games < (uint32_t)min_games || c->points == 0)
+            continue;
+        entries[n++] = (BookEntry){
+            .key = c->key,
+            .move = c->move,
+            .weight = MAX(c->points / divisor, 1u),
+        };
+    }
+    bool ok = games >= 0 && bookWrite(path, entries, n);
+    if (ok)
+        printf("Wrote %zu moves of %ld games to %s\n", n, games, path);
+    free(entries);
+    free(all.counts);
+    return ok;
+}
+
+static void printStats(const char *label, PositionStats s)
+{
+    double n = s.games > 0 ? s.games : 1;
+    printf("%-10s %10lu %6.1lf%% %6.1lf%% %6.1lf%%\n", label, (unsigned long)s.games,
+           100 * s.white_wins / n, 100 * s.draws / n, 100 * s.black_wins / n);
+}
+
+static int compareMoveStats(const void *a, const void *b)
+{
+    const MoveStats *x = a, *y = b;
+    return (x->stats.games < y->stats.games) - (x->stats.games > y->stats.games);
+}
+
+// Prints the tags of the game at offset, mapping its file
+static void printGame(const char *path, uint64_t offset, PgnResult result)
+{
+    static const char *const RESULTS[4] = {"*", "1-0", "0-1", "1/2-1/2"};
+    printf("  %s:%lu %-7s", path, (unsigned long)offset, RESULTS[result]);
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (uint64_t)st.st_size <= offset) {
+        if (fd >= 0)
+            close(fd);
+        printf("\n");
+        return;
+    }
+    const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("\n");
+        return;
+    }
+
+    PgnReader r;
+    pgnReaderInit(&r, data, st.st_size);
+    r.pos = data + offset;
+    PgnGame *game = malloc(sizeof(PgnGame));
+    if (pgnReadGame(&r, game)) {
+        const char *names[4] = {"White", "Black", "Event", "Date"};
+        for (int i = 0; i < 4; i++) {
+            const PgnTag *tag = pgnFindTag(game, names[i]);
+            if (tag != NULL)
+                printf(" %s%.*s", i == 1 ? "- " : i > 1 ? "| " : "", (int)tag->value_length,
+                       tag->value);
+        }
+    }
+    printf("\n");
+    free(game);
+    munmap((void *)data, st.st_size);
+}
+
+static int query(const char *index_path, const char *fen, int n_games)
+{
+    Board b;
+    FenError err = parseFen(fen, strlen(fen), &b, NULL);
+    if (err != FEN_OK) {
+        fprintf(stderr, "explorer: invalid fen: %s\n", fenErrorString(err));
+        return 1;
+    }
+    GameIndex index;
+    if (!gameIndexOpen(&index, index_path))
+        return 1;
+
+    double start = wallTimeMs();
+    printf("%-10s %10s %7s %7s %7s\n", "", "games", "white", "draw", "black");
+    printStats("position", gameIndexStats(&index, b.zobrist_hash));
+
+    MoveList mlist = generateMoves(&b);
+    MoveStats moves[256];
+    int n = 0;
+    for (size_t i = 0; i < mlist.count; i++) {
+        Board child = moveMake(mlist.moves[i], b);
+        PositionStats stats = gameIndexStats(&index, child.zobrist_hash);
+        if (stats.games == 0)
+            continue;
+        moves[n].move = mlist.moves[i];
+        moves[n].stats = stats;
+        writeSan(&b, mlist.moves[i], moves[n].san);
+        n++;
+    }
+    qsort(moves, n, sizeof(MoveStats), compareMoveStats);
+    for (int i = 0; i < n; i++)
+        printStats(moves[i].san, moves[i].stats);
+    double ms = wallTimeMs() - start;
+
+    uint64_t count;
+    const GameIndexEntry *e = gameIndexFind(&index, b.zobrist_hash, &count);
+    if (count > 0 && n_games > 0)
+        printf("\nGames:\n");
+    for (uint64_t i = 0; i < count && i < (uint64_t)n_games; i++) {
+        int file = GAME_ENTRY_FILE(&e[i]);
+        printGame(file < index.path_count ? index.paths[file] : "?", GAME_ENTRY_OFFSET(&e[i]),
+                  GAME_ENTRY_RESULT(&e[i]));
+    }
+    printf("\n%lu entries, %zu lookups in %.3lf ms\n", (unsigned long)index.count,
+           mlist.count + 1, ms);
+    gameIndexClose(&index);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *command = argc > 1 ? argv[1] : "", *index_path = argc > 2 ? argv[2] : NULL;
+    const char **paths = calloc(argc, sizeof(char *));
+    int path_count = 0, n_games = DEFAULT_GAMES, min_games = DEFAULT_MIN_GAMES;
+    GameIndexOptions opts = {
+        .memory = (size_t)DEFAULT_MEMORY_MB << 20,
+        .threads = sysconf(_SC_NPROCESSORS_ONLN),
+    };
+    bool usage = index_path == NULL
+                 || (strcmp(command, "index") != 0 && strcmp(command, "query") != 0
+                     && strcmp(command, "book") != 0);
+    for (int i = 3; i < argc && !usage; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            opts.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc)
+            opts.memory = (size_t)atol(argv[++i]) << 20;
+        else if (strcmp(argv[i], "--tmp") == 0 && i + 1 < argc)
+            opts.tmp_dir = argv[++i];
+        else if (strcmp(argv[i], "--max-ply") == 0 && i + 1 < argc)
+            opts.max_ply = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--games") == 0 && i + 1 < argc)
+            n_games = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--min-games") == 0 && i + 1 < argc)
+            min_games = atoi(argv[++i]);
+        else if (argv[i][0] != '-')
+            paths[path_count++] = argv[i];
+        else
+            usage = true;
+    }
+    bool querying = strcmp(command, "query") == 0;
+    if (usage || (querying ? path_count > 1 : path_count == 0)) {
+        fprintf(stderr, "Usage: %s index games.idx games.pgn... [--threads n] [--memory mb] "
+                        "[--tmp dir] [--max-ply n]\n"
+                        "       %s query games.idx [fen] [--games n]\n"
+                        "       %s book book.bin games.pgn... [--threads n] [--max-ply n] "
+                        "[--min-games n]\n", argv[0], argv[0], argv[0]);
+        free(paths);
+        return 1;
+    }
+    opts.threads = MAX(1, MIN(opts.threads, 256));
+
+    precomputeValues();
+    if (querying) {
+        int ret = query(index_path, path_count > 0 ? paths[0] : START_FEN, n_games);
+        free(paths);
+        return ret;
+    }
+    if (strcmp(command, "book") == 0) {
+        bool ok = buildBook(index_path, paths, path_count, opts.threads,
+                            opts.max_ply > 0 ? opts.max_ply : DEFAULT_BOOK_PLIES, min_games);
+        free(paths);
+        return ok ? 0 : 1;
+    }
+
+    opts.paths = paths;
+    opts.path_count = path_count;
+    double start = wallTimeMs();
+    bool ok = buildGameIndex(&opts, index_path);
+    GameIndex index;
+    if (ok && gameIndexOpen(&index, index_path)) {
+        printf("Indexed %lu positions of %d files in %.1lf s\n", (unsigned long)index.count,
+               path_count, (wallTimeMs() - start) / 1000);
+        gameIndexClose(&index);
+    }
+    free(paths);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,369 @@
+#include "gameindex.h"
+#include "engine.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MIN_BUFFER_ENTRIES 1024
+#define RUN_IO_BUFFER (1 << 20)
+
+// Interpolation steps before the lookup falls back to bisection, which
+// bounds the cost on unevenly spread hashes
+#define MAX_INTERPOLATION_STEPS 8
+
+typedef struct {
+    GameIndexEntry *entries;
+    size_t count, capacity;
+} EntryBuffer;
+
+typedef struct {
+    const GameIndexOptions *opts;
+    EntryBuffer *buffers;       // one per reading thread
+
+    // Sorted runs written to tmp_dir so far
+    pthread_mutex_t lock;
+    char **runs;
+    int run_count;
+    uint64_t total;             // entries in the runs
+    bool failed;
+} Indexer;
+
+static int compareEntries(const void *a, const void *b)
+{
+    const GameIndexEntry *x = a, *y = b;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    return (x->game > y->game) - (x->game < y->game);
+}
+
+static void writeRun(Indexer *ix, EntryBuffer *buf)
+{
+    qsort(buf->entries, buf->count, sizeof(GameIndexEntry), compareEntries);
+
+    char path[4096];
+    pthread_mutex_lock(&ix->lock);
+    int run = ix->run_count++;
+    ix->total += buf->count;
+    snprintf(path, sizeof(path), "%s/gameindex.%d.%d.run",
+             ix->opts->tmp_dir != NULL ? ix->opts->tmp_dir : "/tmp", (int)getpid(), run);
+    ix->runs = realloc(ix->runs, ix->run_count * sizeof(char *));
+    ix->runs[run] = strdup(path);
+    pthread_mutex_unlock(&ix->lock);
+
+    FILE *f = fopen(path, "wb");
+    bool ok = f != NULL && fwrite(buf->entries, sizeof(GameIndexEntry), buf->count, f) == buf->count;
+    if (f != NULL)
+        ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "gameindex: can't write %s\n", path);
+        ix->failed = true;
+    }
+    buf->count = 0;
+}
+
+// Adds every position of the game once, with the game's location and result
+static void indexGame(const PgnGame *game, int thread, void *data)
+{
+    Indexer *ix = data;
+    EntryBuffer *buf = &ix->buffers[thread];
+    if (game->error == PGN_BAD_FEN)
+        return;
+
+    uint64_t code = (uint64_t)game->offset << 10 | (uint64_t)game->file << 2 | game->result;
+    int plies = ix->opts->max_ply > 0 ? MIN(ix->opts->max_ply, game->move_count) : game->move_count;
+    uint64_t hashes[PGN_MAX_PLIES + 1];
+    Board b = game->start;
+    for (int ply = 0;; ply++) {
+        // A position can only come back while no capture or pawn move is made
+        bool repeated = false;
+        for (int i = ply - 1; i >= 0 && i >= ply - b.halfmove_clock && !repeated; i--)
+            repeated = hashes[i] == b.zobrist_hash;
+        hashes[ply] = b.zobrist_hash;
+
+        if (!repeated) {
+            if (buf->count == buf->capacity)
+                writeRun(ix, buf);
+            buf->entries[buf->count++] = (GameIndexEntry){.hash = b.zobrist_hash, .game = code};
+        }
+        if (ply == plies)
+            break;
+        b = moveMake(game->moves[ply], b);
+    }
+}
+
+static bool writeHeader(FILE *f, uint64_t count, const GameIndexOptions *opts)
+{
+    unsigned char header[GAME_INDEX_HEADER_SIZE] = "CEGI";
+    uint32_t version = GAME_INDEX_VERSION, file_count = opts->path_count, names_size = 0;
+    for (int i = 0; i < opts->path_count; i++)
+        names_size += strlen(opts->paths[i]) + 1;
+    memcpy(header + 4, &version, sizeof(version));
+    memcpy(header + 8, &count, sizeof(count));
+    memcpy(header + 16, &file_count, sizeof(file_count));
+    memcpy(header + 20, &names_size, sizeof(names_size));
+    return fwrite(header, 1, sizeof(header), f) == sizeof(header);
+}
+
+static bool writeNames(FILE *f, const GameIndexOptions *opts)
+{
+    for (int i = 0; i < opts->path_count; i++) {
+        if (fwrite(opts->paths[i], 1, strlen(opts->paths[i]) + 1, f) != strlen(opts->paths[i]) + 1)
+            return false;
+    }
+    return true;
+}
+
+typedef struct {
+    FILE *f;
+    GameIndexEntry head;
+} RunReader;
+
+// Min heap of run indices by their head entry
+static void siftDown(RunReader *runs, int *heap, int n, int i)
+{
+    for (;;) {
+        int smallest = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && compareEntries(&runs[heap[l]].head, &runs[heap[smallest]].head) < 0)
+            smallest = l;
+        if (r < n && compareEntries(&runs[heap[r]].head, &runs[heap[smallest]].head) < 0)
+            smallest = r;
+        if (smallest == i)
+            return;
+        int tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// k-way merge of the sorted runs into the index file
+static bool mergeRuns(Indexer *ix, FILE *out)
+{
+    int n = ix->run_count, live = 0;
+    RunReader *runs = calloc(n, sizeof(RunReader));
+    int *heap = malloc(n * sizeof(int));
+    bool ok = true;
+    for (int i = 0; i < n && ok; i++) {
+        runs[i].f = fopen(ix->runs[i], "rb");
+        if (runs[i].f == NULL) {
+            fprintf(stderr, "gameindex: can't read %s\n", ix->runs[i]);
+            ok = false;
+            break;
+        }
+        setvbuf(runs[i].f, NULL, _IOFBF, RUN_IO_BUFFER);
+        if (fread(&runs[i].head, sizeof(GameIndexEntry), 1, runs[i].f) == 1)
+            heap[live++] = i;
+    }
+    for (int i = live / 2 - 1; i >= 0; i--)
+        siftDown(runs, heap, live, i);
+
+    while (ok && live > 0) {
+        RunReader *run = &runs[heap[0]];
+        ok = fwrite(&run->head, sizeof(GameIndexEntry), 1, out) == 1;
+        if (fread(&run->head, sizeof(GameIndexEntry), 1, run->f) != 1)
+            heap[0] = heap[--live];
+        siftDown(runs, heap, live, 0);
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (runs[i].f != NULL)
+            fclose(runs[i].f);
+    }
+    free(runs);
+    free(heap);
+    return ok;
+}
+
+bool buildGameIndex(const GameIndexOptions *opts, const char *path)
+{
+    if (opts->path_count > GAME_INDEX_MAX_FILES) {
+        fprintf(stderr, "gameindex: at most %d PGN files per index\n", GAME_INDEX_MAX_FILES);
+        return false;
+    }
+    int n_threads = MAX(opts->threads, 1);
+    size_t capacity = MAX(opts->memory / sizeof(GameIndexEntry) / n_threads,
+                          (size_t)MIN_BUFFER_ENTRIES);
+    Indexer ix = {.opts = opts, .lock = PTHREAD_MUTEX_INITIALIZER};
+    ix.buffers = calloc(n_threads, sizeof(EntryBuffer));
+    for (int i = 0; i < n_threads; i++) {
+        ix.buffers[i].entries = malloc(capacity * sizeof(GameIndexEntry));
+        ix.buffers[i].capacity = capacity;
+    }
+
+    bool ok = pgnReadFiles(opts->paths, opts->path_count, n_threads, indexGame, &ix) >= 0
+              && !ix.failed;
+
+    FILE *out = ok ? fopen(path, "wb") : NULL;
+    if (ok && out == NULL) {
+        fprintf(stderr, "gameindex: can't write %s\n", path);
+        ok = false;
+    }
+    if (ok) {
+        setvbuf(out, NULL, _IOFBF, RUN_IO_BUFFER);
+        if (ix.run_count == 0) {
+            // Everything fit in memory, one sort and no temporary files
+            uint64_t total = 0;
+            for (int i = 0; i < n_threads; i++)
+                total += ix.buffers[i].count;
+            GameIndexEntry *all = malloc(MAX(total, 1) * sizeof(GameIndexEntry));
+            size_t n = 0;
+            for (int i = 0; i < n_threads; i++) {
+                memcpy(all + n, ix.buffers[i].entries, ix.buffers[i].count * sizeof(GameIndexEntry));
+                n += ix.buffers[i].count;
+            }
+            qsort(all, n, sizeof(GameIndexEntry), compareEntries);
+            ok = writeHeader(out, n, opts) && fwrite(all, sizeof(GameIndexEntry), n, out) == n;
+            free(all);
+        }
+        else {
+            for (int i = 0; i < n_threads; i++) {
+                if (ix.buffers[i].count > 0)
+                    writeRun(&ix, &ix.buffers[i]);
+            }
+            ok = !ix.failed && writeHeader(out, ix.total, opts) && mergeRuns(&ix, out);
+        }
+        ok = ok && writeNames(out, opts);
+        ok = fclose(out) == 0 && ok;
+        if (!ok)
+            fprintf(stderr, "gameindex: can't write %s\n", path);
+    }
+
+    for (int i = 0; i < ix.run_count; i++) {
+        unlink(ix.runs[i]);
+        free(ix.runs[i]);
+    }
+    free(ix.runs);
+    for (int i = 0; i < n_threads; i++)
+        free(ix.buffers[i].entries);
+    free(ix.buffers);
+    return ok;
+}
+
+bool gameIndexOpen(GameIndex *index, const char *path)
+{
+    memset(index, 0, sizeof(*index));
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "gameindex: can't open %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void *mapping = size >= GAME_INDEX_HEADER_SIZE
+                        ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                        : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "gameindex: can't mmap %s\n", path);
+        return false;
+    }
+
+    const unsigned char *header = mapping;
+    uint32_t version, file_count, names_size;
+    uint64_t count;
+    memcpy(&version, header + 4, sizeof(version));
+    memcpy(&count, header + 8, sizeof(count));
+    memcpy(&file_count, header + 16, sizeof(file_count));
+    memcpy(&names_size, header + 20, sizeof(names_size));
+    bool ok = memcmp(header, "CEGI", 4) == 0 && version == GAME_INDEX_VERSION
+              && file_count <= GAME_INDEX_MAX_FILES
+              && count <= (size - GAME_INDEX_HEADER_SIZE) / sizeof(GameIndexEntry)
+              && size == GAME_INDEX_HEADER_SIZE + count * sizeof(GameIndexEntry) + names_size;
+
+    // Null terminated paths, one per file
+    const char *names = (const char *)header + GAME_INDEX_HEADER_SIZE
+                        + (ok ? count * sizeof(GameIndexEntry) : 0);
+    const char *names_end = names + (ok ? names_size : 0);
+    for (uint32_t i = 0; ok && i < file_count; i++) {
+        const char *nul = memchr(names, '\0', names_end - names);
+        ok = nul != NULL;
+        index->paths[i] = names;
+        names = ok ? nul + 1 : names;
+    }
+    if (!ok) {
+        fprintf(stderr, "gameindex: %s isn't a game index (version %d)\n", path,
+                GAME_INDEX_VERSION);
+        munmap(mapping, size);
+        memset(index, 0, sizeof(*index));
+        return false;
+    }
+
+    madvise(mapping, size, MADV_RANDOM);
+    index->entries = (const GameIndexEntry *)(header + GAME_INDEX_HEADER_SIZE);
+    index->count = count;
+    index->path_count = file_count;
+    index->mapping = mapping;
+    index->mapping_size = size;
+    return true;
+}
+
+void gameIndexClose(GameIndex *index)
+{
+    if (index->mapping != NULL)
+        munmap(index->mapping, index->mapping_size);
+    memset(index, 0, sizeof(*index));
+}
+
+const GameIndexEntry *gameIndexFind(const GameIndex *index, uint64_t hash, uint64_t *count)
+{
+    const GameIndexEntry *e = index->entries;
+    uint64_t lo = 0, hi = index->count;
+
+    // First entry with the hash: guess where it lies between the hashes at
+    // both ends, then bisect what's left
+    for (int step = 0; step < MAX_INTERPOLATION_STEPS && hi - lo > 16; step++) {
+        uint64_t lo_hash = e[lo].hash, hi_hash = e[hi - 1].hash;
+        if (hash <= lo_hash) {
+            hi = lo;
+            break;
+        }
+        if (hash > hi_hash) {
+            lo = hi;
+            break;
+        }
+        uint64_t mid = lo + (uint64_t)((double)(hash - lo_hash) / (double)(hi_hash - lo_hash)
+                                       * (hi - 1 - lo));
+        mid = MIN(mid, hi - 1);
+        if (e[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (e[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    uint64_t end = lo;
+    while (end < index->count && e[end].hash == hash)
+        end++;
+    *count = end - lo;
+    return e + lo;
+}
+
+PositionStats gameIndexStats(const GameIndex *index, uint64_t hash)
+{
+    PositionStats stats = {0};
+    uint64_t count;
+    const GameIndexEntry *e = gameIndexFind(index, hash, &count);
+    for (uint64_t i = 0; i < count; i++) {
+        PgnResult result = GAME_ENTRY_RESULT(&e[i]);
+        stats.white_wins += result == PGN_WHITE_WINS;
+        stats.draws += result == PGN_DRAW;
+        stats.black_wins += result == PGN_BLACK_WINS;
+    }
+    stats.games = count;
+    return stats;
+}
@@ -0,0 +1,72 @@
+#ifndef GAMEINDEX_H
+#define GAMEINDEX_H
+
+#include "pgn.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Index of the positions of PGN game collections, keyed by zobrist_hash
+//
+// Every position of every game (once per game) gives an entry with the
+// game's location and result. Entries are sorted by hash with an external
+// merge sort, so collections larger than memory can be indexed, and looked
+// up with an interpolation search (hashes are uniformly distributed).
+//
+// File layout (little endian), mapped read only with mmap:
+//   32 byte header: "CEGI", uint32 version, uint64 number of entries,
+//                   uint32 number of PGN files, uint32 size of their names,
+//                   8 bytes of zero padding
+//   GameIndexEntry entries[], sorted by hash then game
+//   PGN file paths, each null terminated
+
+#define GAME_INDEX_VERSION 1
+#define GAME_INDEX_HEADER_SIZE 32
+#define GAME_INDEX_MAX_FILES 256
+
+typedef struct {
+    uint64_t hash;
+    uint64_t game;  // offset in its file << 10 | file << 2 | PgnResult
+} GameIndexEntry;
+
+#define GAME_ENTRY_OFFSET(e) ((e)->game >> 10)
+#define GAME_ENTRY_FILE(e) ((int)(((e)->game >> 2) & 255))
+#define GAME_ENTRY_RESULT(e) ((PgnResult)((e)->game & 3))
+
+typedef struct {
+    const char *const *paths;   // PGN files, at most GAME_INDEX_MAX_FILES
+    int path_count;
+    const char *tmp_dir;        // for sorted runs, "/tmp" if NULL
+    size_t memory;              // bytes of entries kept in memory
+    int threads;
+    int max_ply;                // positions past it aren't indexed, 0 for all
+} GameIndexOptions;
+
+typedef struct {
+    uint64_t games;             // occurrences, one per game
+    uint64_t white_wins, draws, black_wins;   // the rest have no result
+} PositionStats;
+
+// Writes the index of the games in opts->paths to path, returns false (and
+// prints why) if a file can't be read or written
+bool buildGameIndex(const GameIndexOptions *opts, const char *path);
+
+typedef struct {
+    const GameIndexEntry *entries;
+    uint64_t count;
+    const char *paths[GAME_INDEX_MAX_FILES];
+    int path_count;
+    void *mapping;
+    size_t mapping_size;
+} GameIndex;
+
+bool gameIndexOpen(GameIndex *index, const char *path);
+void gameIndexClose(GameIndex *index);
+
+// Entries of a position, count is set to their number (0 if it never
+// occurred)
+const GameIndexEntry *gameIndexFind(const GameIndex *index, uint64_t hash, uint64_t *count);
+PositionStats gameIndexStats(const GameIndex *index, uint64_t hash);
+
+#endif // !GAMEINDEX_H
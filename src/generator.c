@@ -21,10 +21,15 @@ uint64_t KNIGHT_ATTACK_MAPS[64] = { 0ull };
 // precomputed once by populateSquaresTillEdges()
 int SQUARES_TILL_EDGE[64][8];
 
+// Squares from a given square till board's edge in each direction
+// precomputed once by populateRayMasks()
+uint64_t RAY_MASKS[64][8];
+
 void populateGeneratorValues(void)
 {
     populateSquaresTillEdges();
     populateAttackMaps();
+    populateRayMasks();
 }
 
 // Finds squares between a square and board's edge in all possible directions
@@ -74,6 +79,18 @@ void populateAttackMaps(void)
     }
 }
 
+// Needs SQUARES_TILL_EDGE to be populated first
+void populateRayMasks(void)
+{
+    for (int sq = 0; sq < 64; sq++) {
+        for (int direction = 0; direction < 8; direction++) {
+            RAY_MASKS[sq][direction] = 0;
+            for (int n = 1; n <= SQUARES_TILL_EDGE[sq][direction]; n++)
+                RAY_MASKS[sq][direction] |= 1ull << (sq + DIR_OFFSETS[direction] * n);
+        }
+    }
+}
+
 MoveList generatePseudoLegalMoves(const Board *b)
 {
     MoveList pseudolegals = {.count = 0};
@@ -349,3 +366,41 @@ uint64_t generateAttackMap(const Board *b, Piece attacking_color)
     }
     return attacks;
 }
+
+// Attacks along the given directions, each ray is cut after its first blocker
+// Nearest blocker is the lowest set bit for rays going up the board
+// and the highest set bit for rays going down
+static uint64_t slidingAttacks(int src_sq, uint64_t occupied, int start, int end)
+{
+    uint64_t attacks = 0;
+    for (int direction = start; direction < end; direction++) {
+        uint64_t ray = RAY_MASKS[src_sq][direction];
+        uint64_t blockers = ray & occupied;
+        if (blockers) {
+            int blocker_sq = DIR_OFFSETS[direction] > 0 ? LSB(blockers) : MSB(blockers);
+            ray ^= RAY_MASKS[blocker_sq][direction];
+        }
+        attacks |= ray;
+    }
+    return attacks;
+}
+
+uint64_t rookAttacks(int src_sq, uint64_t occupied)
+{
+    return slidingAttacks(src_sq, occupied, 0, 4);
+}
+
+uint64_t bishopAttacks(int src_sq, uint64_t occupied)
+{
+    return slidingAttacks(src_sq, occupied, 4, 8);
+}
+
+// Squares attacked by all pawns of a color
+uint64_t pawnAttacks(uint64_t pawns, int col_idx)
+{
+    const uint64_t not_a_file = ~0x0101010101010101ull;
+    const uint64_t not_h_file = ~0x8080808080808080ull;
+    if (col_idx == 0)
+        return ((pawns << 7) & not_h_file) | ((pawns << 9) & not_a_file);
+    return ((pawns >> 9) & not_h_file) | ((pawns >> 7) & not_a_file);
+}
@@ -5,11 +5,18 @@
 #include "movelist.h"
 #include <stdint.h>
 
+// Attack maps of king and knight on each square, and squares seen from
+// a square in each Direction on an empty board (precomputed)
+extern uint64_t KING_ATTACK_MAPS[64];
+extern uint64_t KNIGHT_ATTACK_MAPS[64];
+extern uint64_t RAY_MASKS[64][8];
+
 // Computes some global variables, required for the move generation
 // Precomputing makes the move generation fast
 void populateGeneratorValues(void);
 void populateSquaresTillEdges(void);
 void populateAttackMaps(void);
+void populateRayMasks(void);
 
 MoveList generatePseudoLegalMoves(const Board *b);
 void fillSlidingMoves(const Board *b, int src_sq, MoveList *list);
@@ -20,4 +27,9 @@ uint64_t generateSlidingAttackMap(const Board *b, int src_sq);
 uint64_t generatePawnAttackMap(const Board *b, int src_sq);
 uint64_t generateAttackMap(const Board *b, Piece attacking_color);
 
+// Bitboard attack sets of sliders given the occupied squares
+uint64_t rookAttacks(int src_sq, uint64_t occupied);
+uint64_t bishopAttacks(int src_sq, uint64_t occupied);
+uint64_t pawnAttacks(uint64_t pawns, int col_idx);
+
 #endif // !GENERATOR_H
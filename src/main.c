@@ -1,20 +1,41 @@
+#include "assets.h"
+#include "bitbase.h"
 #include "board.h"
+#include "book.h"
 #include "engine.h"
+#include "enginethread.h"
 #include "move.h"
+#include "nnue.h"
+#include "notation.h"
 #include "piece.h"
 #include "utils.h"
 
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
 #include <raylib.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
 #define CELL_SIZE 80
 #define BOARD_PADDING 10
 #define BOARD_SIZE (CELL_SIZE * 8)
 #define WINDOW_SIZE (BOARD_SIZE + BOARD_PADDING * 2)
 
+// Analysis panel right of the board
+#define PANEL_WIDTH 260
+#define PANEL_FONT_SIZE 20
+#define PANEL_REFRESH_MS 250
+
+// Time the computer takes per move, ms
+#define COMPUTER_MOVE_TIME 3000
+
+// Moves that can be taken back
+#define MAX_GAME_PLIES 1024
+
 #define PIECE_PADDING 4
 #define PIECE_SIZE (CELL_SIZE - PIECE_PADDING*2)
 
@@ -23,6 +44,8 @@
 #define COLOR_MOVE              (Color) { 0xcb, 0xdd, 0xaf, 0xff }
 #define COLOR_CHECKER_DARK      (Color) { 0xc7, 0xce, 0xd1, 0xff }
 #define COLOR_CHECKER_LIGHT     WHITE
+#define COLOR_ARROW             (Color) { 0x3c, 0x8d, 0xd0, 0xb0 }
+#define COLOR_PANEL_TEXT        (Color) { 0xe8, 0xea, 0xeb, 0xff }
 
 // Piece definitions confilct with colors from raylib
 #define WHITE_PIECE 1 << 6
@@ -38,6 +61,8 @@ typedef struct {
     int y;
 } V2;
 
+// Only touched by the render loop, the engine thread gets copies of the
+// board with each command and answers with events
 typedef struct {
     Board board;
     MoveList mlist;
@@ -45,6 +70,33 @@ typedef struct {
     bool king_checked;
     bool prom_pending;
     bool computer_thinking;
+
+    // Positions and moves played so far, for take backs and repetitions
+    Board played_boards[MAX_GAME_PLIES];
+    Move played_moves[MAX_GAME_PLIES];
+    int ply;
+
+    // Id of the engine search whose result is awaited, others are stale
+    uint32_t search_id;
+
+    // After its move the computer searches the reply it expects, if the
+    // user plays it that search continues as the computer's next one
+    bool ponder_enabled;
+    bool pondering;
+    Move ponder_move;
+
+    // Analysis mode searches the position without limit on the user's
+    // turn, instead of pondering, and shows what it finds
+    bool analysis_enabled;
+    bool analysing;
+    uint32_t analysis_id;
+    bool has_analysis_info;
+    SearchInfo analysis_info;
+    double analysis_start_ms;
+    double panel_refresh_ms;
+    uint64_t panel_nodes;
+    double panel_nps;
+
     char prom_move[10];
     int dragged_piece_src_sq;
     V2 dragged_piece_draw_pos;
@@ -72,11 +124,20 @@ void drawCheckmate();
 void drawPromotionWindow(Piece promoting_color);
 void loadTextureMapAndPieceRects();
 void unloadTextureMap();
+void *decodeSounds(void *arg);
 void loadSounds();
+bool soundsReady();
 void unloadSounds();
 void playMoveSound(const Board *b, Move m);
 void updateStateWithMove(GameState *state, Move m);
-void *playComputerMove(void *st);
+void takeBack(GameState *state);
+void makeUserMove(GameState *state, Move m);
+void startComputerSearch(GameState *state, const Board *b, bool ponder);
+void handleEngineEvents(GameState *state);
+void startAnalysis(GameState *state);
+void stopAnalysis(GameState *state);
+void drawAnalysis(GameState *state);
+void drawArrow(int src_sq, int dst_sq, Color color);
 
 Piece promotables[4] = {
     BISHOP,
@@ -93,17 +154,49 @@ Rectangle piece_texture_rect[256];
 
 Sound sounds[NUM_SOUNDS];
 
+// Sounds are decoded by a background thread after the window is up and
+// loaded into the audio device on first use once ready
+Wave sound_waves[NUM_SOUNDS];
+atomic_bool sounds_decoded;
+bool sounds_loaded;
+pthread_t sound_decoder_tid;
+
+EngineThread engine;
+
+// Opening book the computer plays from before searching, see book.h
+Book book;
+bool book_loaded;
+
 int main(int argc, char **argv)
 {
-    char *init_fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    char *init_fen = START_FEN;
     char *fen = (argc >= 2) ? argv[1] : init_fen;
     precomputeValues();
 
-    GameState state = initGameState(initBoardFromFen(fen));
+    // Endgame bitbases, see build/bbgen
+    char *bitbase_dir = getenv("CHESS_BITBASES");
+    int bitbases = bitbaseLoad(bitbase_dir != NULL ? bitbase_dir : "bitbases");
+    if (bitbases > 0)
+        printf("Loaded %d endgame bitbases\n", bitbases);
+
+    // Evaluate with a network instead of the classic terms if one is given
+    char *nnue_file = getenv("CHESS_NNUE");
+    if (nnue_file != NULL && nnueLoad(nnue_file) && setEvalMode(EVAL_NNUE))
+        printf("Using network: %s (%s)\n", nnue_file, nnueSimdName());
+
+    // Opening book, see build/explorer book
+    char *book_file = getenv("CHESS_BOOK");
+    book_loaded = book_file != NULL && bookOpen(&book, book_file);
+    if (book_loaded)
+        printf("Loaded book: %s (%lu moves)\n", book_file, (unsigned long)book.count);
+    srand(time(NULL));
+
+    static GameState state;
+    state = initGameState(initBoardFromFen(fen));
+    engineStart(&engine, sysconf(_SC_NPROCESSORS_ONLN));
     bool computer_playing = true;
 
-    InitWindow(WINDOW_SIZE, WINDOW_SIZE, "Chess");
-    InitAudioDevice();
+    InitWindow(WINDOW_SIZE + PANEL_WIDTH, WINDOW_SIZE, "Chess");
     SetTargetFPS(60);
     loadTextureMapAndPieceRects();
     loadSounds();
@@ -112,6 +205,26 @@ int main(int argc, char **argv)
         BeginDrawing();
 		ClearBackground(COLOR_BLACK);
 
+		if (IsKeyPressed(KEY_P)) {
+			state.ponder_enabled = !state.ponder_enabled;
+			printf("Pondering: %s\n", state.ponder_enabled ? "on" : "off");
+		}
+
+		if (IsKeyPressed(KEY_U))
+			takeBack(&state);
+
+		if (IsKeyPressed(KEY_A)) {
+			state.analysis_enabled = !state.analysis_enabled;
+			printf("Analysis: %s\n", state.analysis_enabled ? "on" : "off");
+			if (state.pondering) {
+				engineStop(&engine);
+				state.pondering = false;
+				state.search_id = 0;
+			}
+			if (!state.analysis_enabled)
+				stopAnalysis(&state);
+		}
+
 		if (IsKeyPressed(KEY_F)) {
 			char fen[100];
 			printBoardFenToString(fen, sizeof(fen), &state.board);
@@ -120,6 +233,7 @@ int main(int argc, char **argv)
 
 
         drawBoard(&state);
+        drawAnalysis(&state);
         if (state.mlist.count == 0) {
             drawCheckmate();
             EndDrawing();
@@ -140,15 +254,10 @@ int main(int argc, char **argv)
                         char move_str[10];
                         char prom_notations[4] = {'b', 'r', 'n', 'q'};  // similar to display order
                         snprintf(move_str, sizeof(move_str), "%s%c", state.prom_move, prom_notations[i]);
-                        for (size_t i = 0; i < state.mlist.count; i++) {
-                            Move m = state.mlist.moves[i];
-                            char str[10];
-                            printMoveToString(str, sizeof(str), m, false);
-                            if (strcmp(move_str, str) == 0) {
-                                updateStateWithMove(&state, m);
-                                playMoveSound(&state.board, m);
-                                state.prom_pending = false;
-                            }
+                        Move m = parseCoordinateMove(&state.board, move_str, strlen(move_str));
+                        if (m != EMPTY_MOVE) {
+                            makeUserMove(&state, m);
+                            state.prom_pending = false;
                         }
                     }
                 }
@@ -157,15 +266,24 @@ int main(int argc, char **argv)
             continue;
         }
 
+        handleEngineEvents(&state);
         if (computer_playing && !state.computer_thinking) {
             if (state.board.color_to_move & BLACK_PIECE) {
-                pthread_t tid;
-                printf("Computer thinking...\n");
-                state.computer_thinking = true;
-                pthread_create(&tid, NULL, playComputerMove, (void *)&state);
-                continue;
+                Move m = book_loaded ? bookPick(&book, &state.board, false, rand64())
+                                     : EMPTY_MOVE;
+                if (m != EMPTY_MOVE) {
+                    printf("Book move\n");
+                    updateStateWithMove(&state, m);
+                    playMoveSound(&state.board, m);
+                } else {
+                    printf("Computer thinking...\n");
+                    startComputerSearch(&state, &state.board, false);
+                }
             }
         }
+        if (state.analysis_enabled && !state.analysing && !state.computer_thinking
+            && !state.pondering)
+            startAnalysis(&state);
 
         EndDrawing();
 
@@ -191,7 +309,7 @@ int main(int argc, char **argv)
         if (IsMouseButtonReleased(MOUSE_LEFT_BUTTON)) {
             int src_sq = state.dragged_piece_src_sq;
             int dst_sq = rankByPosY(GetMouseY()) * 8 + fileByPosX(GetMouseX());
-            if (src_sq != -1 && isValidSquare(dst_sq) && dst_sq != src_sq) {
+            if (src_sq != -1 && isValidSquare(dst_sq) && dst_sq != src_sq && !state.computer_thinking) {
 
                 char try[10];   // String representation of tried move
                 snprintf(try, sizeof(try), "%s%s", SQNAMES[src_sq], SQNAMES[dst_sq]);
@@ -199,16 +317,13 @@ int main(int argc, char **argv)
 
                 for (size_t i = 0; i < state.mlist.count; i++) {
                     Move m = state.mlist.moves[i];
-                    char str[10];
-                    printMoveToString(str, sizeof(str), m, false);
-                    if (strncmp(str, try, 4) == 0) {
+                    if (getMoveSrc(m) == src_sq && getMoveDst(m) == dst_sq) {
                         MoveFlag flag = getMoveFlag(m);
                         if (flag & PROMOTION) {
                             state.prom_pending = true;
                             strcpy(state.prom_move, try);
                         } else {
-                            updateStateWithMove(&state, m);
-                            playMoveSound(&state.board, m);
+                            makeUserMove(&state, m);
                         }
                         break;
                     }
@@ -218,9 +333,11 @@ int main(int argc, char **argv)
         }
     }
 
+    engineQuit(&engine);
+    if (book_loaded)
+        bookClose(&book);
     unloadTextureMap();
     unloadSounds();
-    CloseAudioDevice();
     CloseWindow();
 }
 
@@ -245,7 +362,9 @@ V2 sqDrawPos(int sq)
 
 void loadTextureMapAndPieceRects()
 {
-    piece_texture_map = LoadTexture("./resources/chess-pieces.png");
+    Image img = LoadImageFromMemory(".png", chess_pieces_png, chess_pieces_png_len);
+    piece_texture_map = LoadTextureFromImage(img);
+    UnloadImage(img);
     GenTextureMipmaps(&piece_texture_map);
     SetTextureFilter(piece_texture_map, TEXTURE_FILTER_TRILINEAR);
 
@@ -270,12 +389,39 @@ void loadTextureMapAndPieceRects()
 }
 
 
+// Decoding mp3s only needs the CPU, so it's done off the render thread
+void *decodeSounds(void *arg)
+{
+    (void)arg;
+    sound_waves[SOUND_MOVE] = LoadWaveFromMemory(".mp3", move_self_mp3, move_self_mp3_len);
+    sound_waves[SOUND_CAPTURE] = LoadWaveFromMemory(".mp3", capture_mp3, capture_mp3_len);
+    sound_waves[SOUND_CHECK] = LoadWaveFromMemory(".mp3", move_check_mp3, move_check_mp3_len);
+    sound_waves[SOUND_PROMOTION] = LoadWaveFromMemory(".mp3", promote_mp3, promote_mp3_len);
+    atomic_store(&sounds_decoded, true);
+    return NULL;
+}
+
 void loadSounds()
 {
-    sounds[SOUND_MOVE] = LoadSound("./resources/move-self.mp3");
-    sounds[SOUND_CAPTURE] = LoadSound("./resources/capture.mp3");
-    sounds[SOUND_CHECK] = LoadSound("./resources/move-check.mp3");
-    sounds[SOUND_PROMOTION] = LoadSound("./resources/promote.mp3");
+    pthread_create(&sound_decoder_tid, NULL, decodeSounds, NULL);
+}
+
+// Opens the audio device and creates the sounds once they're decoded,
+// returns false until then
+bool soundsReady()
+{
+    if (sounds_loaded)
+        return true;
+    if (!atomic_load(&sounds_decoded))
+        return false;
+
+    InitAudioDevice();
+    for (int i = 0; i < NUM_SOUNDS; i++) {
+        sounds[i] = LoadSoundFromWave(sound_waves[i]);
+        UnloadWave(sound_waves[i]);
+    }
+    sounds_loaded = true;
+    return true;
 }
 
 
@@ -286,8 +432,15 @@ void unloadTextureMap()
 
 void unloadSounds()
 {
+    pthread_join(sound_decoder_tid, NULL);
+    if (!sounds_loaded) {
+        for (int i = 0; i < NUM_SOUNDS; i++)
+            UnloadWave(sound_waves[i]);
+        return;
+    }
     for (int i = 0; i < NUM_SOUNDS; i++)
         UnloadSound(sounds[i]);
+    CloseAudioDevice();
 }
 
 
@@ -305,6 +458,8 @@ Texture2D getPieceTexture(const char *path)
 // Should be called after move is made on board
 void playMoveSound(const Board *b, Move m)
 {
+    if (!soundsReady())
+        return;
     if (isKingChecked(b, WHITE_PIECE) || isKingChecked(b, BLACK_PIECE)) { // @todo: is this slow?
         PlaySound(sounds[SOUND_CHECK]);
         return;
@@ -401,6 +556,12 @@ GameState initGameState(Board b)
         .king_checked = isKingChecked(&b, b.color_to_move),
         .prom_pending = false,
         .computer_thinking = false,
+        .ply = 0,
+        .search_id = 0,
+        .ponder_enabled = true,
+        .pondering = false,
+        .analysis_enabled = false,
+        .analysing = false,
         .dragged_piece_src_sq = -1,
     };
     return state;
@@ -408,6 +569,11 @@ GameState initGameState(Board b)
 
 void updateStateWithMove(GameState *state, Move m)
 {
+    if (state->ply < MAX_GAME_PLIES) {
+        state->played_boards[state->ply] = state->board;
+        state->played_moves[state->ply] = m;
+        state->ply++;
+    }
     state->board = moveMake(m, state->board);
     state->last_move = m;
     state->king_checked = isKingChecked(&state->board, state->board.color_to_move);
@@ -434,12 +600,229 @@ void drawPromotionWindow(Piece promoting_color)
     }
 }
 
-void *playComputerMove(void *st)
+// Ends pondering before the user's move is made, a ponder hit hands the
+// running search over to the computer's turn, any other move cancels it
+void makeUserMove(GameState *state, Move m)
 {
-    GameState *state = (GameState *) st;
-    Move m = findBestMove(&state->board);
+    stopAnalysis(state);
+    if (state->pondering) {
+        state->pondering = false;
+        if (m == state->ponder_move) {
+            printf("Ponder hit\n");
+            state->computer_thinking = true;
+            enginePonderHit(&engine);
+        } else {
+            engineStop(&engine);
+            state->search_id = 0;
+        }
+    }
     updateStateWithMove(state, m);
     playMoveSound(&state->board, m);
+}
+
+// Undoes moves until it's the user's turn again, aborting any search
+void takeBack(GameState *state)
+{
+    stopAnalysis(state);
+    engineStop(&engine);
+    state->search_id = 0;
     state->computer_thinking = false;
-    return NULL;
+    state->pondering = false;
+    state->prom_pending = false;
+
+    int plies = (state->board.color_to_move & BLACK_PIECE) ? 1 : 2;
+    if (state->ply < plies)
+        return;
+    state->ply -= plies;
+    state->board = state->played_boards[state->ply];
+    state->last_move = state->ply > 0 ? state->played_moves[state->ply - 1] : EMPTY_MOVE;
+    state->king_checked = isKingChecked(&state->board, state->board.color_to_move);
+    state->mlist = generateMoves(&state->board);
+    printf("gui: took back %d plies\n", plies);
+}
+
+// Sends b, the current board or the one after the reply we ponder on,
+// to the engine thread with the game so far
+void startComputerSearch(GameState *state, const Board *b, bool ponder)
+{
+    EngineCommand cmd = {
+        .type = ENGINE_CMD_SEARCH,
+        .board = *b,
+        .limits = {.movetime = COMPUTER_MOVE_TIME},
+        .ponder = ponder,
+    };
+    int first = MAX(state->ply + ponder - ENGINE_MAX_HISTORY, 0);
+    for (int i = first; i < state->ply; i++)
+        cmd.history[cmd.history_count++] = state->played_boards[i].zobrist_hash;
+    if (ponder)
+        cmd.history[cmd.history_count++] = state->board.zobrist_hash;
+
+    uint32_t id = engineSend(&engine, &cmd);
+    if (id == 0)
+        return;
+    state->search_id = id;
+    state->computer_thinking = !ponder;
+    state->pondering = ponder;
+}
+
+// Plays the computer's move once its search is done, then starts pondering
+void handleEngineEvents(GameState *state)
+{
+    EngineEvent event;
+    while (enginePoll(&engine, &event)) {
+        if (state->analysing && event.id == state->analysis_id
+            && event.type == ENGINE_EVENT_INFO) {
+            state->analysis_info = event.info;
+            state->has_analysis_info = true;
+        }
+        if (event.id != state->search_id || event.type != ENGINE_EVENT_BESTMOVE)
+            continue;
+        state->search_id = 0;
+        if (!state->computer_thinking || event.best_move == EMPTY_MOVE)
+            continue;
+
+        Move m = event.best_move;
+        SearchInfo *info = &event.info;
+        printf("Searched depth: %d, score: %d, nodes: %lu, time: %.0lf ms\n", info->depth,
+               info->score, (unsigned long)info->nodes, info->ms);
+        updateStateWithMove(state, m);
+        playMoveSound(&state->board, m);
+        state->computer_thinking = false;
+
+        // Search the expected reply until the user moves
+        if (state->ponder_enabled && !state->analysis_enabled
+            && info->pv_length >= 2 && info->pv[0] == m) {
+            Board expected = moveMake(info->pv[1], state->board);
+            state->ponder_move = info->pv[1];
+            startComputerSearch(state, &expected, true);
+        }
+    }
+}
+
+// Searches the current position until stopped, reusing the transposition
+// table filled by the earlier searches
+void startAnalysis(GameState *state)
+{
+    if (state->mlist.count == 0)
+        return;
+    EngineCommand cmd = {
+        .type = ENGINE_CMD_SEARCH,
+        .board = state->board,
+        .limits = {.infinite = true},
+    };
+    int first = MAX(state->ply - ENGINE_MAX_HISTORY, 0);
+    for (int i = first; i < state->ply; i++)
+        cmd.history[cmd.history_count++] = state->played_boards[i].zobrist_hash;
+
+    uint32_t id = engineSend(&engine, &cmd);
+    if (id == 0)
+        return;
+    state->analysing = true;
+    state->analysis_id = id;
+    state->has_analysis_info = false;
+    state->analysis_start_ms = wallTimeMs();
+    state->panel_refresh_ms = 0;
+}
+
+void stopAnalysis(GameState *state)
+{
+    if (!state->analysing)
+        return;
+    engineStop(&engine);
+    state->analysing = false;
+    state->has_analysis_info = false;
+}
+
+// Arrow for the best move and a panel with the search's progress, numbers
+// are refreshed a few times per second so they stay readable
+void drawAnalysis(GameState *state)
+{
+    int x = WINDOW_SIZE;
+    int y = BOARD_PADDING;
+    int line = PANEL_FONT_SIZE + 6;
+    char text[64];
+
+    if (!state->analysis_enabled) {
+        DrawText("Analysis off (A)", x, y, PANEL_FONT_SIZE, COLOR_PANEL_TEXT);
+        return;
+    }
+    DrawText("Analysis (A)", x, y, PANEL_FONT_SIZE, COLOR_PANEL_TEXT);
+    y += line * 3 / 2;
+    if (!state->analysing) {
+        DrawText(state->computer_thinking ? "Computer thinking..." : "Waiting...",
+                 x, y, PANEL_FONT_SIZE, COLOR_PANEL_TEXT);
+        return;
+    }
+
+    double now = wallTimeMs();
+    if (now - state->panel_refresh_ms >= PANEL_REFRESH_MS) {
+        double elapsed = now - state->analysis_start_ms;
+        state->panel_nodes = engineNodes(&engine);
+        state->panel_nps = elapsed > 0 ? state->panel_nodes * 1000.0 / elapsed : 0;
+        state->panel_refresh_ms = now;
+    }
+    if (!state->has_analysis_info)
+        return;
+
+    const SearchInfo *info = &state->analysis_info;
+    if (info->pv_length > 0)
+        drawArrow(getMoveSrc(info->pv[0]), getMoveDst(info->pv[0]), COLOR_ARROW);
+
+    if (IS_MATE_SCORE(info->score)) {
+        int moves = (MATE_SCORE - abs(info->score) + 1) / 2;
+        snprintf(text, sizeof(text), "Score: %s#%d", info->score > 0 ? "" : "-", moves);
+    } else {
+        snprintf(text, sizeof(text), "Score: %+.2lf", info->score / 100.0);
+    }
+    DrawText(text, x, y, PANEL_FONT_SIZE, COLOR_PANEL_TEXT);
+    y += line;
+    snprintf(text, sizeof(text), "Depth: %d", info->depth);
+    DrawText(text, x, y, PANEL_FONT_SIZE, COLOR_PANEL_TEXT);
+    y += line;
+    snprintf(text, sizeof(text), "Nodes: %lu", (unsigned long)state->panel_nodes);
+    DrawText(text, x, y, PANEL_FONT_SIZE, COLOR_PANEL_TEXT);
+    y += line;
+    snprintf(text, sizeof(text), "NPS: %.0lfk", state->panel_nps / 1000);
+    DrawText(text, x, y, PANEL_FONT_SIZE, COLOR_PANEL_TEXT);
+    y += line * 3 / 2;
+
+    // Best line, four moves per row
+    DrawText("Best line:", x, y, PANEL_FONT_SIZE, COLOR_PANEL_TEXT);
+    for (int i = 0; i < info->pv_length; i += 4) {
+        y += line;
+        text[0] = '\0';
+        for (int j = i; j < i + 4 && j < info->pv_length; j++) {
+            char move_str[10];
+            printMoveToString(move_str, sizeof(move_str), info->pv[j], false);
+            strcat(text, move_str);
+            strcat(text, " ");
+        }
+        DrawText(text, x, y, PANEL_FONT_SIZE, COLOR_PANEL_TEXT);
+    }
+}
+
+void drawArrow(int src_sq, int dst_sq, Color color)
+{
+    V2 src = sqDrawPos(src_sq);
+    V2 dst = sqDrawPos(dst_sq);
+    Vector2 from = {src.x + CELL_SIZE / 2.0f, src.y + CELL_SIZE / 2.0f};
+    Vector2 to = {dst.x + CELL_SIZE / 2.0f, dst.y + CELL_SIZE / 2.0f};
+
+    float dx = to.x - from.x;
+    float dy = to.y - from.y;
+    float len = sqrtf(dx * dx + dy * dy);
+    if (len == 0)
+        return;
+    dx /= len;
+    dy /= len;
+
+    // Shaft stops where the head starts, head points at the square's center
+    const float head = CELL_SIZE * 0.35f;
+    Vector2 base = {to.x - dx * head, to.y - dy * head};
+    DrawLineEx(from, base, CELL_SIZE * 0.15f, color);
+    Vector2 left = {base.x + dy * head * 0.6f, base.y - dx * head * 0.6f};
+    Vector2 right = {base.x - dy * head * 0.6f, base.y + dx * head * 0.6f};
+    // raylib wants counter clockwise vertices, which flips with direction
+    DrawTriangle(to, left, right, color);
+    DrawTriangle(to, right, left, color);
 }
@@ -0,0 +1,884 @@
+#include "board.h"
+#include "engine.h"
+#include "epd.h"
+#include "move.h"
+#include "notation.h"
+#include "rules.h"
+#include "transposition.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Engine against engine matches on all cores, with a sequential probability
+// ratio test (SPRT) deciding when the result is significant
+//
+// Usage: ./build/match [--engine1 cmd] [--engine2 cmd] [--openings file]
+//                      [--games n] [--concurrency n] [--nodes n] [--depth n]
+//                      [--movetime ms] [--tc s+s] [--hash mb] [--elo0 e]
+//                      [--elo1 e] [--alpha a] [--beta b] [--random-plies n]
+//                      [--pgn file] [--seed n]
+//
+// An engine is either "internal", this build's search run in process (the
+// default), or the command line of a UCI engine, e.g. another build's
+// build/engine, run through /bin/sh as a child process talking over pipes.
+// Every concurrent game has its own pair of child processes, restarted if
+// one crashes. In process players share the transposition table.
+//
+// Openings are read from an EPD or FEN file (one position per line) and
+// used in order, wrapping around. Without a file each opening is
+// random-plies random moves (8 by default) from the initial position. Each
+// opening is played twice, once with each engine as white, and the pair
+// is scored as a whole (pentanomial), which cancels most of the bias of
+// unbalanced openings.
+//
+// Moves are limited by --nodes (10000 by default when nothing else is
+// given), --depth, --movetime or a clock of --tc base+increment seconds,
+// e.g. 10+0.1. Only time limits show speed differences between builds.
+// Games end by the rules, checked here whatever the engines claim, or are
+// adjudicated from the scores the engines report (both in rules.h), or are
+// drawn after MAX_MATCH_PLIES. An engine loses by an illegal move, by exceeding its clock
+// by more than TIME_MARGIN_MS, or by crashing or not answering within
+// ENGINE_TIMEOUT_MS.
+//
+// The SPRT tests H0: engine1 is elo0 (0) Elo stronger than engine2, against
+// H1: it's elo1 (5) Elo stronger, in logistic Elo, with false positive rate
+// alpha and false negative rate beta (0.05 each). The log likelihood ratio
+// of the pair results is computed as in fishtest's generalized SPRT, and
+// the match stops once it leaves [log(beta / (1 - alpha)), log((1 - beta) /
+// alpha)], or after --games games (10000). Progress is printed to stderr
+// every few seconds, the result to stdout.
+
+#define DEFAULT_GAMES 10000
+#define DEFAULT_NODES 10000
+#define DEFAULT_RANDOM_PLIES 8
+#define MAX_MATCH_PLIES 400
+
+#define TIME_MARGIN_MS 100
+#define ENGINE_TIMEOUT_MS 60000
+#define HANDSHAKE_TIMEOUT_MS 10000
+#define QUIT_TIMEOUT_MS 1000
+
+#define REPORT_INTERVAL_MS 5000
+#define MAX_NAME_LENGTH 64
+#define LINE_BUFFER_SIZE 16384
+
+typedef struct {
+    Board start;
+    Move moves[MAX_MATCH_PLIES];
+    int count;
+} Opening;
+
+static pthread_mutex_t SPAWN_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+// One side of a game, the in process search or a UCI engine
+typedef struct {
+    const char *command;        // NULL in process
+    pid_t pid;                  // 0 while not running
+    int to, from;               // pipe ends, engine's stdin and stdout
+    char buffer[LINE_BUFFER_SIZE];
+    size_t buffered;
+    char name[MAX_NAME_LENGTH];
+} Player;
+
+typedef struct {
+    Board start;
+    Move moves[MAX_MATCH_PLIES];
+    uint64_t history[MAX_MATCH_PLIES];   // hashes of the positions before each move
+    int count;
+    int white;                  // engine playing white, 0 or 1
+    int white_points;           // 2 win, 1 draw, 0 loss
+    int forfeit;                // engine that forfeited, -1 if none
+    char reason[2 * MAX_NAME_LENGTH];
+} Game;
+
+typedef struct {
+    const char *commands[2];
+    char names[2][MAX_NAME_LENGTH];
+    SearchLimits limits;        // depth, nodes and movetime
+    int base_ms, inc_ms;        // clock, base_ms 0 without one
+    int hash_mb;                // sent to child engines, 0 keeps their own
+    const Opening *openings;    // NULL for random ones
+    int opening_count;
+    int random_plies;
+    uint64_t seed;
+    int pairs;                  // at most
+    double elo0, elo1, alpha, beta;
+
+    _Atomic int next_pair;
+    _Atomic bool stop;
+
+    pthread_mutex_t lock;       // guards what follows
+    int wdl[3];                 // engine1's wins, draws and losses
+    int pentanomial[5];         // pairs by engine1's half points, 0 to 4
+    int forfeits[2];            // games lost by illegal moves, time or crashes
+    FILE *pgn;
+    const char *decision;       // NULL until the SPRT ends
+} Match;
+
+typedef struct {
+    double score;               // engine1's, per game
+    double elo, error;          // error is the 95% confidence interval's half
+    double llr, lower, upper;
+} Estimate;
+
+typedef struct {
+    Match *match;
+    Player players[2];
+    Game games[2];
+} Worker;
+
+static double eloFromScore(double score)
+{
+    score = MIN(MAX(score, 1e-6), 1 - 1e-6);
+    return -400 * log10(1 / score - 1);
+}
+
+static double scoreFromElo(double elo)
+{
+    return 1 / (1 + pow(10, -elo / 400));
+}
+
+// Empty pentanomial bins count as this many pairs, so that distributions
+// fitted to one sided results keep every outcome possible
+#define EMPTY_BIN_PAIRS 1e-3
+
+// Distribution q of pair scores i / 4 closest to p (the maximum likelihood
+// one) whose mean is s: q[i] = p[i] / (1 + theta (i / 4 - s)), with theta
+// found by bisection so that q sums to 1
+static void fitMean(const double p[5], double s, double q[5])
+{
+    double lo = -1 / (1 - s), hi = 1 / s;
+    for (int iter = 0; iter < 100; iter++) {
+        double theta = (lo + hi) / 2, sum = 0;
+        for (int i = 0; i < 5; i++)
+            sum += p[i] * (i / 4.0 - s) / (1 + theta * (i / 4.0 - s));
+        if (sum > 0)
+            lo = theta;
+        else
+            hi = theta;
+    }
+    double theta = (lo + hi) / 2;
+    for (int i = 0; i < 5; i++)
+        q[i] = p[i] / (1 + theta * (i / 4.0 - s));
+}
+
+// Generalized SPRT: the log likelihood ratio of the pair results under the
+// distributions fitted to the scores of elo1 and elo0
+static Estimate estimate(const Match *m)
+{
+    Estimate e = {
+        .lower = log(m->beta / (1 - m->alpha)),
+        .upper = log((1 - m->beta) / m->alpha),
+    };
+    double p[5], n = 0;
+    int pairs = 0;
+    for (int i = 0; i < 5; i++) {
+        pairs += m->pentanomial[i];
+        p[i] = m->pentanomial[i] > 0 ? m->pentanomial[i] : EMPTY_BIN_PAIRS;
+        n += p[i];
+    }
+    if (pairs == 0)
+        return e;
+    for (int i = 0; i < 5; i++) {
+        p[i] /= n;
+        e.score += p[i] * i / 4;
+    }
+
+    double q0[5], q1[5], variance = 0;
+    fitMean(p, scoreFromElo(m->elo0), q0);
+    fitMean(p, scoreFromElo(m->elo1), q1);
+    for (int i = 0; i < 5; i++) {
+        e.llr += pairs * p[i] * log(q1[i] / q0[i]);
+        variance += p[i] * (i / 4.0 - e.score) * (i / 4.0 - e.score);
+    }
+    double margin = 1.96 * sqrt(variance / pairs);
+    e.elo = eloFromScore(e.score);
+    e.error = (eloFromScore(e.score + margin) - eloFromScore(e.score - margin)) / 2;
+    return e;
+}
+
+static void printEstimate(FILE *out, const Match *m)
+{
+    Estimate e = estimate(m);
+    int games = m->wdl[0] + m->wdl[1] + m->wdl[2];
+    fprintf(out, "games %d, +%d =%d -%d, score %.1lf%%, elo %.1lf +- %.1lf, "
+                 "llr %.2lf [%.2lf, %.2lf]\n",
+            games, m->wdl[0], m->wdl[1], m->wdl[2], 100 * e.score, e.elo, e.error, e.llr,
+            e.lower, e.upper);
+}
+
+// Random moves from the initial position, the same for every run with the
+// same seed, again if they end the game
+static void randomOpening(const Match *m, int pair, Opening *o)
+{
+    uint64_t rng = (m->seed + pair + 1) * 0x9e3779b97f4a7c15ull;
+    uint64_t history[MAX_MATCH_PLIES];
+    for (;;) {
+        Board b = o->start = initBoardFromFen(START_FEN);
+        o->count = 0;
+        while (o->count < m->random_plies) {
+            MoveList mlist = generateMoves(&b);
+            if (mlist.count == 0)
+                break;
+            Move move = mlist.moves[nextRandom(&rng) % mlist.count];
+            history[o->count] = b.zobrist_hash;
+            o->moves[o->count++] = move;
+            b = moveMake(move, b);
+        }
+        if (o->count == m->random_plies && gameEnd(&b, history, o->count) == GAME_ONGOING)
+            return;
+    }
+}
+
+static void stopPlayer(Player *p);
+
+// Writes all of the formatted line, false if the engine is gone
+static bool sendLine(Player *p, const char *fmt, ...)
+{
+    char line[LINE_BUFFER_SIZE];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line) - 1, fmt, args);
+    va_end(args);
+    len = MIN(len, (int)sizeof(line) - 2);
+    line[len++] = '\n';
+    for (int written = 0; written < len;) {
+        ssize_t n = write(p->to, line + written, len - written);
+        if (n <= 0)
+            return false;
+        written += n;
+    }
+    return true;
+}
+
+// Reads the next line into line (null terminated, without the newline)
+// Returns 1 for a line, 0 once deadline (wallTimeMs()) passed, -1 if the
+// engine closed its output
+static int readLine(Player *p, char *line, size_t size, double deadline)
+{
+    for (;;) {
+        char *newline = memchr(p->buffer, '\n', p->buffered);
+        if (newline != NULL) {
+            size_t len = newline - p->buffer;
+            size_t n = MIN(len, size - 1);
+            memcpy(line, p->buffer, n);
+            line[n] = '\0';
+            if (n > 0 && line[n - 1] == '\r')
+                line[n - 1] = '\0';
+            p->buffered -= len + 1;
+            memmove(p->buffer, newline + 1, p->buffered);
+            return 1;
+        }
+        // Lines longer than the buffer are dropped
+        if (p->buffered == sizeof(p->buffer))
+            p->buffered = 0;
+
+        double left = deadline - wallTimeMs();
+        if (left <= 0)
+            return 0;
+        struct pollfd fd = {.fd = p->from, .events = POLLIN};
+        if (poll(&fd, 1, (int)left + 1) <= 0)
+            continue;
+        ssize_t n = read(p->from, p->buffer + p->buffered, sizeof(p->buffer) - p->buffered);
+        if (n <= 0)
+            return -1;
+        p->buffered += n;
+    }
+}
+
+// Reads lines until one starting with prefix, false on timeout or EOF
+static bool waitFor(Player *p, const char *prefix, double timeout_ms)
+{
+    char line[LINE_BUFFER_SIZE];
+    double deadline = wallTimeMs() + timeout_ms;
+    size_t len = strlen(prefix);
+    while (readLine(p, line, sizeof(line), deadline) > 0) {
+        if (strncmp(line, prefix, len) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Starts a UCI engine and waits until it's ready, nothing to do in process
+static bool startPlayer(Player *p, int hash_mb)
+{
+    if (p->command == NULL) {
+        snprintf(p->name, sizeof(p->name), "internal");
+        return true;
+    }
+    if (p->pid > 0)
+        return true;
+
+    // Pipes are made close on exec under a lock, so engines started by
+    // other threads don't inherit them and keep them open
+    int to[2], from[2];
+    pthread_mutex_lock(&SPAWN_LOCK);
+    bool piped = pipe(to) == 0;
+    if (piped && pipe(from) != 0) {
+        close(to[0]);
+        close(to[1]);
+        piped = false;
+    }
+    pid_t pid = -1;
+    if (piped) {
+        for (int i = 0; i < 2; i++) {
+            fcntl(to[i], F_SETFD, FD_CLOEXEC);
+            fcntl(from[i], F_SETFD, FD_CLOEXEC);
+        }
+        pid = fork();
+        if (pid == 0) {
+            dup2(to[0], STDIN_FILENO);
+            dup2(from[1], STDOUT_FILENO);
+            execl("/bin/sh", "sh", "-c", p->command, (char *)NULL);
+            _exit(127);
+        }
+        close(to[0]);
+        close(from[1]);
+        if (pid < 0) {
+            close(to[1]);
+            close(from[0]);
+        }
+    }
+    pthread_mutex_unlock(&SPAWN_LOCK);
+    if (pid < 0)
+        return false;
+    p->pid = pid;
+    p->to = to[1];
+    p->from = from[0];
+    p->buffered = 0;
+
+    char line[LINE_BUFFER_SIZE];
+    snprintf(p->name, sizeof(p->name), "%s", p->command);
+    double deadline = wallTimeMs() + HANDSHAKE_TIMEOUT_MS;
+    bool ok = sendLine(p, "uci");
+    while (ok && (ok = readLine(p, line, sizeof(line), deadline) > 0)) {
+        if (strncmp(line, "id name ", 8) == 0)
+            snprintf(p->name, sizeof(p->name), "%.*s", MAX_NAME_LENGTH - 1, line + 8);
+        else if (strcmp(line, "uciok") == 0)
+            break;
+    }
+    if (ok && hash_mb > 0)
+        ok = sendLine(p, "setoption name Hash value %d", hash_mb);
+    ok = ok && sendLine(p, "isready") && waitFor(p, "readyok", HANDSHAKE_TIMEOUT_MS);
+    if (!ok)
+        stopPlayer(p);
+    return ok;
+}
+
+// Asks the engine to quit, killing it if it doesn't
+static void stopPlayer(Player *p)
+{
+    if (p->pid <= 0)
+        return;
+    if (sendLine(p, "quit")) {
+        char line[LINE_BUFFER_SIZE];
+        double deadline = wallTimeMs() + QUIT_TIMEOUT_MS;
+        while (readLine(p, line, sizeof(line), deadline) > 0)
+            ;
+    }
+    kill(p->pid, SIGKILL);
+    waitpid(p->pid, NULL, 0);
+    close(p->to);
+    close(p->from);
+    p->pid = 0;
+}
+
+// Score in an info line, side to move's point of view
+static bool parseScore(const char *line, int *score)
+{
+    const char *s = strstr(line, " score ");
+    if (s == NULL)
+        return false;
+    if (strncmp(s + 7, "cp ", 3) == 0)
+        *score = atoi(s + 10);
+    else if (strncmp(s + 7, "mate ", 5) == 0) {
+        int moves = atoi(s + 12);
+        *score = moves > 0 ? MATE_SCORE - 2 * moves + 1 : -MATE_SCORE - 2 * moves;
+    }
+    else
+        return false;
+    return true;
+}
+
+// Search of the UCI engine on b, the game's last position. Returns 1 with
+// the move, 0 if the engine ran out of time, -1 if it's gone. has_score is
+// set once an info line reports a score
+static int uciMove(const Match *m, Player *p, const Game *g, const Board *b, const int clocks[2],
+                    Move *move, int *score, bool *has_score)
+{
+    // Whole game so the engine sees repetitions
+    char command[LINE_BUFFER_SIZE], fen[FEN_MAX_LENGTH];
+    writeFen(&g->start, fen);
+    int len = snprintf(command, sizeof(command), "position fen %s moves", fen);
+    for (int i = 0; i < g->count; i++) {
+        char move_str[10];
+        printMoveToString(move_str, sizeof(move_str), g->moves[i], false);
+        len += snprintf(command + len, sizeof(command) - len, " %s", move_str);
+    }
+    len += snprintf(command + len, sizeof(command) - len, "\ngo");
+    if (m->base_ms > 0)
+        len += snprintf(command + len, sizeof(command) - len, " wtime %d btime %d winc %d binc %d",
+                        clocks[0], clocks[1], m->inc_ms, m->inc_ms);
+    if (m->limits.depth > 0)
+        len += snprintf(command + len, sizeof(command) - len, " depth %d", m->limits.depth);
+    if (m->limits.nodes > 0)
+        len += snprintf(command + len, sizeof(command) - len, " nodes %lu",
+                        (unsigned long)m->limits.nodes);
+    if (m->limits.movetime > 0)
+        len += snprintf(command + len, sizeof(command) - len, " movetime %d", m->limits.movetime);
+    if (len >= (int)sizeof(command) - 1 || !sendLine(p, "%s", command))
+        return -1;
+
+    int side = b->color_to_move == WHITE ? 0 : 1;
+    double deadline = wallTimeMs()
+                      + (m->base_ms > 0 ? clocks[side] + TIME_MARGIN_MS
+                                        : m->limits.movetime + ENGINE_TIMEOUT_MS);
+    char line[LINE_BUFFER_SIZE];
+    int read;
+    while ((read = readLine(p, line, sizeof(line), deadline)) > 0) {
+        if (strncmp(line, "info ", 5) == 0)
+            *has_score |= parseScore(line, score);
+        else if (strncmp(line, "bestmove ", 9) == 0) {
+            const char *str = line + 9;
+            *move = parseCoordinateMove(b, str, strcspn(str, " "));
+            return 1;
+        }
+    }
+    return read;
+}
+
+// Gets the move of the side to move in b, false if it forfeits the game
+// (reason set in g). Clocks are updated, scores are the side to move's.
+// Moves that come without a score (single legal moves we don't search,
+// book moves of UCI engines) leave has_score false
+static bool playerMove(const Match *m, Player *p, Game *g, const Board *b, int clocks[2],
+                       Move *move, int *score, bool *has_score)
+{
+    int side = b->color_to_move == WHITE ? 0 : 1;
+    double start = wallTimeMs();
+    *move = EMPTY_MOVE;
+    *score = 0;
+    *has_score = false;
+    if (p->command == NULL) {
+        SearchContext ctx = {
+            .limits = m->limits,
+            .threads = 1,
+            .history = g->history,
+            .history_count = g->count,
+        };
+        if (m->base_ms > 0) {
+            memcpy(ctx.limits.time, clocks, sizeof(ctx.limits.time));
+            ctx.limits.inc[0] = ctx.limits.inc[1] = m->inc_ms;
+        }
+        atomic_init(&ctx.stop, false);
+        atomic_init(&ctx.ponder, false);
+        atomic_init(&ctx.nodes, 0);
+        SearchInfo info;
+        *move = findBestMove(b, &ctx, &info);
+        *score = side == 0 ? info.score : -info.score;
+        *has_score = info.depth > 0;
+    }
+    else {
+        // An engine past its deadline is restarted for the next game
+        int read = uciMove(m, p, g, b, clocks, move, score, has_score);
+        if (read <= 0) {
+            snprintf(g->reason, sizeof(g->reason), "%s %s", p->name,
+                     read < 0 ? "disconnected" : m->base_ms > 0 ? "lost on time" : "timed out");
+            stopPlayer(p);
+            return false;
+        }
+    }
+
+    if (*move == EMPTY_MOVE) {
+        snprintf(g->reason, sizeof(g->reason), "%s played an illegal move", p->name);
+        return false;
+    }
+    if (m->base_ms > 0) {
+        clocks[side] -= wallTimeMs() - start;
+        if (clocks[side] < -TIME_MARGIN_MS) {
+            snprintf(g->reason, sizeof(g->reason), "%s lost on time", p->name);
+            return false;
+        }
+        clocks[side] += m->inc_ms;
+    }
+    return true;
+}
+
+// Plays o with engine white as white, the result is left in g
+static void playGame(const Match *m, Player players[2], const Opening *o, int white, Game *g)
+{
+    g->start = o->start;
+    g->white = white;
+    g->count = 0;
+    g->forfeit = -1;
+    g->reason[0] = '\0';
+    Board b = o->start;
+    for (int i = 0; i < o->count; i++) {
+        g->history[g->count] = b.zobrist_hash;
+        g->moves[g->count++] = o->moves[i];
+        b = moveMake(o->moves[i], b);
+    }
+
+    int clocks[2] = {m->base_ms, m->base_ms};
+    Adjudicator adjudicator = {0};
+    g->white_points = -1;
+    while (g->white_points < 0) {
+        GameEnd end = gameEnd(&b, g->history, g->count);
+        if (end != GAME_ONGOING || g->count >= MAX_MATCH_PLIES) {
+            g->white_points = end != GAME_CHECKMATE ? 1 : b.color_to_move == WHITE ? 0 : 2;
+            snprintf(g->reason, sizeof(g->reason), "%s",
+                     end != GAME_ONGOING ? gameEndString(end) : "move limit");
+            break;
+        }
+
+        int side = b.color_to_move == WHITE ? 0 : 1;
+        int engine = side == 0 ? white : 1 - white;
+        Move move;
+        int score;
+        bool has_score;
+        bool moved = startPlayer(&players[engine], m->hash_mb);
+        if (!moved)
+            snprintf(g->reason, sizeof(g->reason), "%s failed to start", m->names[engine]);
+        else
+            moved = playerMove(m, &players[engine], g, &b, clocks, &move, &score, &has_score);
+        if (!moved) {
+            g->white_points = side == 0 ? 0 : 2;
+            g->forfeit = engine;
+            break;
+        }
+
+        // Only plies with a reported score count towards adjudication
+        if (has_score) {
+            Adjudication adjudication =
+                adjudicate(&adjudicator, side == 0 ? score : -score, g->count);
+            if (adjudication == ADJUDICATE_WHITE_WINS || adjudication == ADJUDICATE_BLACK_WINS) {
+                g->white_points = adjudication == ADJUDICATE_WHITE_WINS ? 2 : 0;
+                snprintf(g->reason, sizeof(g->reason), "adjudicated win");
+            }
+            else if (adjudication == ADJUDICATE_DRAW) {
+                g->white_points = 1;
+                snprintf(g->reason, sizeof(g->reason), "adjudicated draw");
+            }
+        }
+
+        g->history[g->count] = b.zobrist_hash;
+        g->moves[g->count++] = move;
+        b = moveMake(move, b);
+    }
+}
+
+static void writeGame(FILE *out, const Match *m, const Game *g, int round)
+{
+    static const char *RESULTS[3] = {"0-1", "1/2-1/2", "1-0"};
+    char fen[FEN_MAX_LENGTH];
+    writeFen(&g->start, fen);
+    fprintf(out, "[Event \"match\"]\n[Round \"%d\"]\n[White \"%s\"]\n[Black \"%s\"]\n"
+                 "[Result \"%s\"]\n[Termination \"%s\"]\n",
+            round, m->names[g->white], m->names[1 - g->white], RESULTS[g->white_points],
+            g->reason);
+    if (strcmp(fen, START_FEN) != 0)
+        fprintf(out, "[SetUp \"1\"]\n[FEN \"%s\"]\n", fen);
+    fprintf(out, "\n");
+
+    Board b = g->start;
+    int column = 0;
+    for (int i = 0; i < g->count; i++) {
+        char token[32], san[SAN_MAX_LENGTH];
+        int len = 0;
+        if ((b.color_to_move & WHITE) || i == 0)
+            len = snprintf(token, sizeof(token), (b.color_to_move & WHITE) ? "%d. " : "%d... ",
+                           b.fullmoves);
+        writeSan(&b, g->moves[i], san);
+        len += snprintf(token + len, sizeof(token) - len, "%s", san);
+        if (column > 0 && column + len + 1 > 79) {
+            fprintf(out, "\n");
+            column = 0;
+        }
+        column += fprintf(out, column > 0 ? " %s" : "%s", token);
+        b = moveMake(g->moves[i], b);
+    }
+    fprintf(out, "%s%s\n\n", column > 0 ? " " : "", RESULTS[g->white_points]);
+}
+
+// Adds a finished pair, engine1 white in the first game, and ends the match
+// once the SPRT is decided. Pairs finished after that aren't counted
+static void recordPair(Match *m, const Game games[2], int pair)
+{
+    pthread_mutex_lock(&m->lock);
+    if (m->decision != NULL) {
+        pthread_mutex_unlock(&m->lock);
+        return;
+    }
+    int points = 0;
+    for (int i = 0; i < 2; i++) {
+        int engine1_points = games[i].white == 0 ? games[i].white_points : 2 - games[i].white_points;
+        m->wdl[2 - engine1_points]++;
+        points += engine1_points;
+        if (games[i].forfeit >= 0)
+            m->forfeits[games[i].forfeit]++;
+        if (m->pgn != NULL)
+            writeGame(m->pgn, m, &games[i], 2 * pair + i + 1);
+    }
+    m->pentanomial[points]++;
+
+    Estimate e = estimate(m);
+    if (e.llr >= e.upper || e.llr <= e.lower) {
+        m->decision = e.llr >= e.upper ? "H1 accepted" : "H0 accepted";
+        atomic_store(&m->stop, true);
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+static void *playThread(void *arg)
+{
+    Worker *w = arg;
+    Match *m = w->match;
+    for (int i = 0; i < 2; i++)
+        w->players[i].command = m->commands[i];
+
+    Opening *random_opening = malloc(sizeof(Opening));
+    int pair;
+    while (!atomic_load(&m->stop) && (pair = atomic_fetch_add(&m->next_pair, 1)) < m->pairs) {
+        const Opening *o = random_opening;
+        if (m->openings != NULL)
+            o = &m->openings[pair % m->opening_count];
+        else
+            randomOpening(m, pair, random_opening);
+
+        // A pair cut short by the end of the match isn't counted
+        playGame(m, w->players, o, 0, &w->games[0]);
+        if (atomic_load(&m->stop))
+            break;
+        playGame(m, w->players, o, 1, &w->games[1]);
+        recordPair(m, w->games, pair);
+    }
+    for (int i = 0; i < 2; i++)
+        stopPlayer(&w->players[i]);
+    free(random_opening);
+    return NULL;
+}
+
+// Reads the opening file, NULL (having said why) if there are no positions
+static Opening *readOpenings(const char *path, int *count)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "match: can't open %s\n", path);
+        return NULL;
+    }
+    Opening *openings = NULL;
+    int n = 0, capacity = 0, line_number = 0;
+    char *line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, f) != -1) {
+        line_number++;
+        const char *text = line + strspn(line, " \t\r\n");
+        if (*text == '\0' || *text == '#')
+            continue;
+
+        EpdRecord rec;
+        EpdError err = parseEpd(line, strlen(line), &rec);
+        if (err != EPD_OK) {
+            fprintf(stderr, "match: line %d skipped, %s\n", line_number,
+                    err == EPD_BAD_FEN ? fenErrorString(rec.fen_error) : epdErrorString(err));
+            continue;
+        }
+        if (gameEnd(&rec.board, NULL, 0) != GAME_ONGOING) {
+            fprintf(stderr, "match: line %d skipped, game already over\n", line_number);
+            continue;
+        }
+        if (n == capacity) {
+            capacity = MAX(2 * capacity, 64);
+            openings = realloc(openings, capacity * sizeof(Opening));
+        }
+        openings[n++] = (Opening){.start = rec.board};
+    }
+    free(line);
+    fclose(f);
+    if (n == 0) {
+        fprintf(stderr, "match: no openings in %s\n", path);
+        free(openings);
+        return NULL;
+    }
+    *count = n;
+    return openings;
+}
+
+// Parses base+increment in seconds
+static bool parseTimeControl(const char *str, int *base_ms, int *inc_ms)
+{
+    char *end;
+    double base = strtod(str, &end);
+    double inc = *end == '+' ? strtod(end + 1, &end) : 0;
+    *base_ms = base * 1000;
+    *inc_ms = inc * 1000;
+    return *end == '\0' && *base_ms > 0 && *inc_ms >= 0;
+}
+
+int main(int argc, char **argv)
+{
+    static Match match = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .random_plies = DEFAULT_RANDOM_PLIES,
+        .elo1 = 5,
+        .alpha = 0.05,
+        .beta = 0.05,
+    };
+    Match *m = &match;
+    const char *openings_path = NULL, *pgn_path = NULL;
+    int games = DEFAULT_GAMES, concurrency = sysconf(_SC_NPROCESSORS_ONLN);
+    m->seed = time(NULL);
+    bool usage = false;
+    for (int i = 1; i < argc && !usage; i++) {
+        if (i + 1 >= argc)
+            usage = true;
+        else if (strcmp(argv[i], "--engine1") == 0 || strcmp(argv[i], "--engine2") == 0) {
+            const char *command = argv[++i];
+            m->commands[argv[i - 1][8] - '1'] = strcmp(command, "internal") != 0 ? command : NULL;
+        }
+        else if (strcmp(argv[i], "--openings") == 0)
+            openings_path = argv[++i];
+        else if (strcmp(argv[i], "--games") == 0)
+            games = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--concurrency") == 0)
+            concurrency = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--nodes") == 0)
+            m->limits.nodes = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--depth") == 0)
+            m->limits.depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--movetime") == 0)
+            m->limits.movetime = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tc") == 0)
+            usage = !parseTimeControl(argv[++i], &m->base_ms, &m->inc_ms);
+        else if (strcmp(argv[i], "--hash") == 0)
+            m->hash_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--elo0") == 0)
+            m->elo0 = atof(argv[++i]);
+        else if (strcmp(argv[i], "--elo1") == 0)
+            m->elo1 = atof(argv[++i]);
+        else if (strcmp(argv[i], "--alpha") == 0)
+            m->alpha = atof(argv[++i]);
+        else if (strcmp(argv[i], "--beta") == 0)
+            m->beta = atof(argv[++i]);
+        else if (strcmp(argv[i], "--random-plies") == 0)
+            m->random_plies = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pgn") == 0)
+            pgn_path = argv[++i];
+        else if (strcmp(argv[i], "--seed") == 0)
+            m->seed = strtoull(argv[++i], NULL, 10);
+        else
+            usage = true;
+    }
+    if (usage || games < 2 || m->random_plies < 0 || m->random_plies >= MAX_MATCH_PLIES
+        || m->elo1 <= m->elo0 || m->alpha <= 0 || m->alpha >= 1 || m->beta <= 0 || m->beta >= 1) {
+        fprintf(stderr, "Usage: %s [--engine1 cmd] [--engine2 cmd] [--openings file] [--games n] "
+                        "[--concurrency n] [--nodes n] [--depth n] [--movetime ms] [--tc s+s] "
+                        "[--hash mb] [--elo0 e] [--elo1 e] [--alpha a] [--beta b] "
+                        "[--random-plies n] [--pgn file] [--seed n]\n", argv[0]);
+        return 1;
+    }
+    m->pairs = games / 2;
+    concurrency = MAX(1, MIN(concurrency, 256));
+    if (m->limits.depth <= 0 && m->limits.nodes == 0 && m->limits.movetime <= 0 && m->base_ms == 0)
+        m->limits.nodes = DEFAULT_NODES;
+
+    precomputeValues();
+    if ((m->commands[0] == NULL || m->commands[1] == NULL) && m->hash_mb > 0
+        && !setTranspositionTableSize(m->hash_mb)) {
+        fprintf(stderr, "match: can't allocate %d MB hash\n", m->hash_mb);
+        return 1;
+    }
+    if (openings_path != NULL
+        && (m->openings = readOpenings(openings_path, &m->opening_count)) == NULL)
+        return 1;
+    if (pgn_path != NULL && (m->pgn = fopen(pgn_path, "w")) == NULL) {
+        fprintf(stderr, "match: can't open %s\n", pgn_path);
+        return 1;
+    }
+
+    // Engines writing to a closed pipe mustn't kill the match, and both
+    // should start before any game does
+    signal(SIGPIPE, SIG_IGN);
+    for (int i = 0; i < 2; i++) {
+        static Player player;
+        player.command = m->commands[i];
+        if (!startPlayer(&player, m->hash_mb)) {
+            fprintf(stderr, "match: can't start %s\n", m->commands[i]);
+            return 1;
+        }
+        snprintf(m->names[i], sizeof(m->names[i]), "%s", player.name);
+        stopPlayer(&player);
+    }
+    if (strcmp(m->names[0], m->names[1]) == 0) {
+        for (int i = 0; i < 2; i++)
+            snprintf(m->names[i] + strlen(m->names[i]),
+                     sizeof(m->names[i]) - strlen(m->names[i]), " %d", i + 1);
+    }
+    fprintf(stderr, "%s vs %s, %d games at most on %d threads\n", m->names[0], m->names[1],
+            2 * m->pairs, concurrency);
+
+    double start = wallTimeMs();
+    Worker *workers = calloc(concurrency, sizeof(Worker));
+    pthread_t *tids = malloc(concurrency * sizeof(pthread_t));
+    int started = 0;
+    for (int i = 0; i < concurrency; i++) {
+        workers[i].match = m;
+        if (pthread_create(&tids[i], NULL, playThread, &workers[i]) != 0)
+            break;
+        started++;
+    }
+    if (started == 0)
+        playThread(&workers[0]);
+
+    // Reports until every pair is played or the SPRT ends
+    double last_report = start;
+    for (;;) {
+        pthread_mutex_lock(&m->lock);
+        int pairs = 0;
+        for (int i = 0; i < 5; i++)
+            pairs += m->pentanomial[i];
+        bool done = m->decision != NULL || pairs >= m->pairs;
+        pthread_mutex_unlock(&m->lock);
+        if (done)
+            break;
+        usleep(100 * 1000);
+        if (wallTimeMs() - last_report >= REPORT_INTERVAL_MS) {
+            last_report = wallTimeMs();
+            pthread_mutex_lock(&m->lock);
+            printEstimate(stderr, m);
+            pthread_mutex_unlock(&m->lock);
+        }
+    }
+    atomic_store(&m->stop, true);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    printf("%s vs %s, %.1lf s\n", m->names[0], m->names[1], (wallTimeMs() - start) / 1000);
+    printEstimate(stdout, m);
+    printf("pentanomial %d %d %d %d %d, forfeits %d %d\n", m->pentanomial[0], m->pentanomial[1],
+           m->pentanomial[2], m->pentanomial[3], m->pentanomial[4], m->forfeits[0],
+           m->forfeits[1]);
+    printf("sprt elo0 %.1lf elo1 %.1lf alpha %.2lf beta %.2lf: %s\n", m->elo0, m->elo1, m->alpha,
+           m->beta, m->decision != NULL ? m->decision : "undecided");
+    bool ok = true;
+    if (m->pgn != NULL && fclose(m->pgn) != 0) {
+        fprintf(stderr, "match: can't write %s\n", pgn_path);
+        ok = false;
+    }
+    free(workers);
+    free(tids);
+    free((void *)m->openings);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,398 @@
+#include "nnue.h"
+#include "evalcache.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define NNUE_HEADER_SIZE 64
+#define NNUE_WEIGHT_COUNT                                                      \
+    (NNUE_INPUTS * NNUE_HIDDEN + NNUE_HIDDEN + 2 * NNUE_HIDDEN + 1)
+
+typedef struct {
+    const int16_t *feature_weights; // [NNUE_INPUTS][NNUE_HIDDEN]
+    const int16_t *feature_bias;    // [NNUE_HIDDEN]
+    const int16_t *output_weights;  // [2 * NNUE_HIDDEN]
+    int16_t output_bias;
+
+    // Backing memory, either a mapped file or weights we allocated
+    void *mapping;
+    size_t mapping_size;
+    int16_t *allocated;
+} Network;
+
+typedef struct {
+    alignas(64) int16_t values[2][NNUE_HIDDEN]; // [perspective][neuron]
+    uint64_t key;  // zobrist hash of the board these values belong to
+    bool computed; // false until values are brought up to date
+    DirtyPiece dirty[4];
+    int dirty_count;
+} Accumulator;
+
+typedef struct {
+    Accumulator acc[NNUE_MAX_PLY];
+    int ply;
+    int overflow; // pushes ignored past NNUE_MAX_PLY
+} AccumulatorStack;
+
+static Network net;
+static bool net_loaded = false;
+
+static _Thread_local AccumulatorStack stack;
+
+// Network's piece order (pawn, knight, bishop, rook, queen, king) by PieceIdx
+static const int NETWORK_PIECE_ORDER[6] = {
+    [KING_IDX] = 5,
+    [QUEEN_IDX] = 4,
+    [BISHOP_IDX] = 2,
+    [KNIGHT_IDX] = 1,
+    [ROOK_IDX] = 3,
+    [PAWN_IDX] = 0,
+};
+
+static int featureIndex(int perspective, Piece p, int sq)
+{
+    int col_idx = (p & WHITE) ? 0 : 1;
+    if (perspective == 1) {
+        col_idx ^= 1;
+        sq ^= 56;
+    }
+    return col_idx * 384 + NETWORK_PIECE_ORDER[getPieceIdx(p)] * 64 + sq;
+}
+
+//
+// SIMD kernels, NNUE_HIDDEN is a multiple of every vector width used
+//
+
+#if defined(__AVX2__)
+
+const char *nnueSimdName(void) { return "avx2"; }
+
+static void addWeights(int16_t *acc, const int16_t *w)
+{
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(acc + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(w + i));
+        _mm256_storeu_si256((__m256i *)(acc + i), _mm256_add_epi16(a, b));
+    }
+}
+
+static void subWeights(int16_t *acc, const int16_t *w)
+{
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(acc + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(w + i));
+        _mm256_storeu_si256((__m256i *)(acc + i), _mm256_sub_epi16(a, b));
+    }
+}
+
+// Sum of clamp(acc[i], 0, QA) * w[i]
+static int32_t clippedDot(const int16_t *acc, const int16_t *w)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i qa = _mm256_set1_epi16(NNUE_QA);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(acc + i));
+        v = _mm256_min_epi16(_mm256_max_epi16(v, zero), qa);
+        __m256i weights = _mm256_loadu_si256((const __m256i *)(w + i));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(v, weights));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                              _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+}
+
+#elif defined(__SSE2__)
+
+const char *nnueSimdName(void) { return "sse2"; }
+
+static void addWeights(int16_t *acc, const int16_t *w)
+{
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(acc + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(w + i));
+        _mm_storeu_si128((__m128i *)(acc + i), _mm_add_epi16(a, b));
+    }
+}
+
+static void subWeights(int16_t *acc, const int16_t *w)
+{
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(acc + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(w + i));
+        _mm_storeu_si128((__m128i *)(acc + i), _mm_sub_epi16(a, b));
+    }
+}
+
+static int32_t clippedDot(const int16_t *acc, const int16_t *w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i qa = _mm_set1_epi16(NNUE_QA);
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(acc + i));
+        v = _mm_min_epi16(_mm_max_epi16(v, zero), qa);
+        __m128i weights = _mm_loadu_si128((const __m128i *)(w + i));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(v, weights));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+#else
+
+const char *nnueSimdName(void) { return "scalar"; }
+
+static void addWeights(int16_t *acc, const int16_t *w)
+{
+    for (int i = 0; i < NNUE_HIDDEN; i++)
+        acc[i] += w[i];
+}
+
+static void subWeights(int16_t *acc, const int16_t *w)
+{
+    for (int i = 0; i < NNUE_HIDDEN; i++)
+        acc[i] -= w[i];
+}
+
+static int32_t clippedDot(const int16_t *acc, const int16_t *w)
+{
+    int32_t sum = 0;
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        int32_t v = MIN(MAX(acc[i], 0), NNUE_QA);
+        sum += v * w[i];
+    }
+    return sum;
+}
+
+#endif
+
+//
+// Network loading
+//
+
+static void setNetworkPointers(const int16_t *weights, int16_t output_bias)
+{
+    net.feature_weights = weights;
+    net.feature_bias = weights + NNUE_INPUTS * NNUE_HIDDEN;
+    net.output_weights = net.feature_bias + NNUE_HIDDEN;
+    net.output_bias = output_bias;
+}
+
+void nnueUnload(void)
+{
+    if (net.mapping != NULL)
+        munmap(net.mapping, net.mapping_size);
+    free(net.allocated);
+    memset(&net, 0, sizeof(net));
+    net_loaded = false;
+    clearEvalCache();
+}
+
+bool nnueLoad(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "nnue: can't open %s\n", path);
+        return false;
+    }
+
+    struct stat st;
+    size_t expected = NNUE_HEADER_SIZE + NNUE_WEIGHT_COUNT * sizeof(int16_t);
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != expected) {
+        fprintf(stderr, "nnue: %s should be %zu bytes\n", path, expected);
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, expected, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "nnue: can't mmap %s\n", path);
+        return false;
+    }
+
+    const unsigned char *header = mapping;
+    uint32_t version, hidden;
+    memcpy(&version, header + 4, sizeof(version));
+    memcpy(&hidden, header + 8, sizeof(hidden));
+    if (memcmp(header, "CENN", 4) != 0 || version != NNUE_VERSION ||
+        hidden != NNUE_HIDDEN) {
+        fprintf(stderr, "nnue: %s has unsupported header\n", path);
+        munmap(mapping, expected);
+        return false;
+    }
+
+    nnueUnload();
+    const int16_t *weights = (const int16_t *)(header + NNUE_HEADER_SIZE);
+    setNetworkPointers(weights, weights[NNUE_WEIGHT_COUNT - 1]);
+    net.mapping = mapping;
+    net.mapping_size = expected;
+    net_loaded = true;
+    return true;
+}
+
+void nnueInitRandom(uint64_t seed)
+{
+    int16_t *weights = malloc(NNUE_WEIGHT_COUNT * sizeof(int16_t));
+    if (weights == NULL)
+        return;
+
+    // xorshift64, independent from rand() so ZOBRIST values stay untouched
+    uint64_t x = seed ? seed : 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < NNUE_WEIGHT_COUNT; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        weights[i] = (int16_t)((int)(x % 65) - 32);
+    }
+
+    nnueUnload();
+    setNetworkPointers(weights, weights[NNUE_WEIGHT_COUNT - 1]);
+    net.allocated = weights;
+    net_loaded = true;
+}
+
+bool nnueIsLoaded(void)
+{
+    return net_loaded;
+}
+
+//
+// Accumulators
+//
+
+static void refreshAccumulator(Accumulator *acc, const Board *b)
+{
+    for (int perspective = 0; perspective < 2; perspective++) {
+        memcpy(acc->values[perspective], net.feature_bias,
+               sizeof(acc->values[perspective]));
+        for (int col_idx = 0; col_idx < 2; col_idx++) {
+            for (uint64_t bb = b->occupancy[col_idx]; bb; bb &= bb - 1) {
+                int sq = LSB(bb);
+                int f = featureIndex(perspective, b->pieces[sq], sq);
+                addWeights(acc->values[perspective],
+                           net.feature_weights + f * NNUE_HIDDEN);
+            }
+        }
+    }
+    acc->key = b->zobrist_hash;
+    acc->computed = true;
+}
+
+// Brings acc up to date from its computed parent using acc's dirty pieces
+static void updateAccumulator(Accumulator *acc, const Accumulator *parent)
+{
+    memcpy(acc->values, parent->values, sizeof(acc->values));
+    for (int i = 0; i < acc->dirty_count; i++) {
+        const DirtyPiece *d = &acc->dirty[i];
+        for (int perspective = 0; perspective < 2; perspective++) {
+            int f = featureIndex(perspective, d->piece, d->sq);
+            const int16_t *w = net.feature_weights + f * NNUE_HIDDEN;
+            if (d->added)
+                addWeights(acc->values[perspective], w);
+            else
+                subWeights(acc->values[perspective], w);
+        }
+    }
+    acc->computed = true;
+}
+
+static int outputLayer(const Accumulator *acc, Piece color_to_move)
+{
+    int us = (color_to_move & WHITE) ? 0 : 1;
+    int32_t out = clippedDot(acc->values[us], net.output_weights) +
+                  clippedDot(acc->values[1 - us], net.output_weights + NNUE_HIDDEN) +
+                  net.output_bias;
+    int score = (int)((int64_t)out * NNUE_SCALE / (NNUE_QA * NNUE_QB));
+
+    // Network scores the side to move, engine scores from white's side
+    return us == 0 ? score : -score;
+}
+
+// Root accumulator is computed right away, so every node below can be
+// updated from its parent instead of being refreshed
+void nnueResetStack(const Board *root)
+{
+    stack.ply = 0;
+    stack.overflow = 0;
+    stack.acc[0].dirty_count = 0;
+    if (net_loaded)
+        refreshAccumulator(&stack.acc[0], root);
+    else
+        stack.acc[0].computed = false;
+}
+
+void nnuePush(const Board *b)
+{
+    if (!net_loaded)
+        return;
+    if (stack.ply + 1 >= NNUE_MAX_PLY) {
+        stack.overflow++;
+        return;
+    }
+
+    Accumulator *acc = &stack.acc[++stack.ply];
+    acc->computed = false;
+    acc->key = b->zobrist_hash;
+    acc->dirty_count = b->dirty_count;
+    memcpy(acc->dirty, b->dirty, sizeof(DirtyPiece) * b->dirty_count);
+}
+
+void nnuePop(void)
+{
+    if (!net_loaded)
+        return;
+    if (stack.overflow > 0)
+        stack.overflow--;
+    else if (stack.ply > 0)
+        stack.ply--;
+}
+
+int nnueEvaluate(const Board *b)
+{
+    Accumulator *top = &stack.acc[stack.ply];
+
+    if (top->key != b->zobrist_hash) {
+        // Not called on the top of the stack, can't use ancestors
+        refreshAccumulator(top, b);
+    }
+    else if (!top->computed) {
+        // Walk down to the nearest computed ancestor and replay moves from it
+        int k = stack.ply;
+        while (k > 0 && !stack.acc[k].computed)
+            k--;
+        if (stack.acc[k].computed) {
+            for (int i = k + 1; i <= stack.ply; i++)
+                updateAccumulator(&stack.acc[i], &stack.acc[i - 1]);
+        }
+        else {
+            refreshAccumulator(top, b);
+        }
+    }
+
+    return outputLayer(top, b->color_to_move);
+}
+
+int nnueEvaluateFull(const Board *b)
+{
+    static _Thread_local Accumulator acc;
+    refreshAccumulator(&acc, b);
+    return outputLayer(&acc, b->color_to_move);
+}
@@ -0,0 +1,66 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include "board.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Efficiently updatable neural network evaluation
+//
+// Architecture: (768 -> NNUE_HIDDEN) x 2 -> 1
+// 768 inputs are one hot (color, piece, square) features seen from each side,
+// both perspectives share the feature transformer weights. The int16
+// accumulators of the hidden layer are updated incrementally from the
+// DirtyPiece events moveMake() records, then clipped to [0, NNUE_QA] and
+// dotted with the output weights (side to move first).
+//
+// Network file layout (little endian), mapped read only with mmap:
+//   64 byte header: "CENN", uint32 version, uint32 hidden size, zero padding
+//   int16 feature_weights[768][NNUE_HIDDEN]
+//   int16 feature_bias[NNUE_HIDDEN]
+//   int16 output_weights[2 * NNUE_HIDDEN]
+//   int16 output_bias
+// Feature index = color * 384 + piece * 64 + square, relative to the
+// perspective (colors swapped and ranks flipped for black), with pieces
+// ordered pawn, knight, bishop, rook, queen, king.
+
+#define NNUE_HIDDEN 256
+#define NNUE_INPUTS 768
+#define NNUE_QA 255
+#define NNUE_QB 64
+#define NNUE_SCALE 400
+#define NNUE_VERSION 1
+
+// Deepest ply accumulators are kept for, deeper nodes are refreshed
+#define NNUE_MAX_PLY 128
+
+// Maps a network file, returns false (and keeps any previous network)
+// if the file can't be read or doesn't match the expected layout
+bool nnueLoad(const char *path);
+
+// Builds a network with small pseudorandom weights, used for tests and
+// benchmarks when no trained network is available
+void nnueInitRandom(uint64_t seed);
+
+void nnueUnload(void);
+bool nnueIsLoaded(void);
+
+// Name of the SIMD kernels compiled in (avx2, sse2 or scalar)
+const char *nnueSimdName(void);
+
+// Accumulator stack of the calling thread. Search resets it at the root and
+// pushes/pops the board made by each moveMake() around recursion, so that
+// nnueEvaluate() only has to apply the last few moves' DirtyPiece events
+void nnueResetStack(const Board *root);
+void nnuePush(const Board *b);
+void nnuePop(void);
+
+// Evaluation from white's point of view, b should be the top of the stack,
+// otherwise (or if there's no usable parent) the accumulator is refreshed
+int nnueEvaluate(const Board *b);
+
+// Evaluates without touching the stack, recomputing accumulators from scratch
+int nnueEvaluateFull(const Board *b);
+
+#endif // !NNUE_H
@@ -0,0 +1,280 @@
+#include "notation.h"
+#include "engine.h"
+#include "generator.h"
+#include "utils.h"
+
+#include <string.h>
+
+// Pseudo legal moves of the piece on sq, added to list
+static void fillSquareMoves(const Board *b, int sq, MoveList *list)
+{
+    Piece p = b->pieces[sq];
+    if (p & PAWN)
+        fillPawnMoves(b, sq, list);
+    else if (p & KNIGHT)
+        fillKnightMoves(b, sq, list);
+    else if (p & KING)
+        fillKingMoves(b, sq, list);
+    else if (p & (ROOK | BISHOP | QUEEN))
+        fillSlidingMoves(b, sq, list);
+}
+
+// Squares from which a piece of type could move to dst, a superset for
+// pawns (their file and the neighbouring ones)
+static uint64_t sourcesOf(const Board *b, Piece type, int dst)
+{
+    uint64_t occupied = b->occupancy[0] | b->occupancy[1];
+    if (type & KING)
+        return KING_ATTACK_MAPS[dst];
+    if (type & KNIGHT)
+        return KNIGHT_ATTACK_MAPS[dst];
+    if (type & BISHOP)
+        return bishopAttacks(dst, occupied);
+    if (type & ROOK)
+        return rookAttacks(dst, occupied);
+    if (type & QUEEN)
+        return bishopAttacks(dst, occupied) | rookAttacks(dst, occupied);
+    if (type & PAWN) {
+        uint64_t file = 0x0101010101010101ULL << (dst % 8);
+        return file | ((file << 1) & ~0x0101010101010101ULL)
+               | ((file >> 1) & ~0x8080808080808080ULL);
+    }
+    return 0;
+}
+
+// Pseudo legal moves to dst of the side to move's pieces of one type
+// standing on sources, resolving a move only needs those. Attacks are
+// symmetric for pieces other than pawns, so their moves are made up from
+// the sources instead of generated (castling is resolved separately)
+static MoveList movesTo(const Board *b, Piece type, int dst, uint64_t sources)
+{
+    MoveList list = {.count = 0};
+    int col_idx = (b->color_to_move & WHITE) ? 0 : 1;
+    uint64_t pieces = b->bitboards[col_idx][getPieceIdx(type)] & sourcesOf(b, type, dst) & sources;
+    if (type & PAWN) {
+        for (; pieces; pieces &= pieces - 1) {
+            MoveList moves = {.count = 0};
+            fillSquareMoves(b, LSB(pieces), &moves);
+            for (size_t i = 0; i < moves.count; i++) {
+                if (getMoveDst(moves.moves[i]) == dst)
+                    list.moves[list.count++] = moves.moves[i];
+            }
+        }
+    }
+    else if (!((b->occupancy[col_idx] >> dst) & 1)) {
+        MoveFlag flag = b->pieces[dst] != EMPTY_PIECE ? CAPTURE : QUIET;
+        for (; pieces; pieces &= pieces - 1)
+            list.moves[list.count++] = moveEncode(flag, LSB(pieces), dst);
+    }
+    return list;
+}
+
+static bool isLegal(const Board *b, Move m)
+{
+    int col_idx = (b->color_to_move & WHITE) ? 0 : 1;
+    int king_sq = b->king_squares[col_idx], src = getMoveSrc(m);
+
+    // Out of check, a piece off the king's lines can't be pinned
+    uint64_t lines = bishopAttacks(king_sq, 0) | rookAttacks(king_sq, 0);
+    if (src != king_sq && getMoveFlag(m) != EP_CAPTURE && !((lines >> src) & 1)
+        && !isSquareAttacked(b, king_sq, !col_idx))
+        return true;
+
+    Board updated = moveMake(m, *b);
+    return !isSquareAttacked(&updated, updated.king_squares[col_idx], !col_idx);
+}
+
+// Promotion flag bits (KNIGHT_PROMOTION & 3 ...) for a piece letter, -1 if
+// it isn't one
+static int promotionBits(char c)
+{
+    switch (c) {
+    case 'N': case 'n': return KNIGHT_PROMOTION & 3;
+    case 'B': case 'b': return BISHOP_PROMOTION & 3;
+    case 'R': case 'r': return ROOK_PROMOTION & 3;
+    case 'Q': case 'q': return QUEEN_PROMOTION & 3;
+    }
+    return -1;
+}
+
+static bool isFile(char c)
+{
+    return c >= 'a' && c <= 'h';
+}
+
+static bool isRank(char c)
+{
+    return c >= '1' && c <= '8';
+}
+
+Move parseCoordinateMove(const Board *b, const char *str, size_t len)
+{
+    if ((len != 4 && len != 5) || !isFile(str[0]) || !isRank(str[1])
+        || !isFile(str[2]) || !isRank(str[3]))
+        return EMPTY_MOVE;
+    int src = (str[1] - '1') * 8 + (str[0] - 'a');
+    int dst = (str[3] - '1') * 8 + (str[2] - 'a');
+    int promotion = len == 5 ? promotionBits(str[4]) : -1;
+    if (len == 5 && promotion < 0)
+        return EMPTY_MOVE;
+
+    if (b->pieces[src] == EMPTY_PIECE || !haveSameColor(b->pieces[src], b->color_to_move))
+        return EMPTY_MOVE;
+    MoveList mlist = {.count = 0};
+    fillSquareMoves(b, src, &mlist);
+    for (size_t i = 0; i < mlist.count; i++) {
+        Move m = mlist.moves[i];
+        MoveFlag flag = getMoveFlag(m);
+        if (getMoveDst(m) != dst)
+            continue;
+        if ((flag & PROMOTION) ? (flag & 3) == promotion : promotion < 0)
+            return isLegal(b, m) ? m : EMPTY_MOVE;
+    }
+    return EMPTY_MOVE;
+}
+
+Move parseSan(const Board *b, const char *str, size_t len)
+{
+    // Check marks and annotations say nothing about the move
+    size_t n = len;
+    while (n > 0 && memchr("+#!?", str[n - 1], 4) != NULL)
+        n--;
+    if (n < 2)
+        return EMPTY_MOVE;
+
+    // Castling, also written with zeros
+    MoveFlag castle = QUIET;
+    if ((n == 3 && (memcmp(str, "O-O", 3) == 0 || memcmp(str, "0-0", 3) == 0)))
+        castle = KING_CASTLE;
+    else if (n == 5 && (memcmp(str, "O-O-O", 5) == 0 || memcmp(str, "0-0-0", 5) == 0))
+        castle = QUEEN_CASTLE;
+    if (castle != QUIET) {
+        int col_idx = (b->color_to_move & WHITE) ? 0 : 1;
+        MoveList mlist = {.count = 0};
+        fillKingMoves(b, b->king_squares[col_idx], &mlist);
+        for (size_t i = 0; i < mlist.count; i++) {
+            if (getMoveFlag(mlist.moves[i]) == castle)
+                return mlist.moves[i];
+        }
+        return EMPTY_MOVE;
+    }
+
+    size_t i = 0;
+    Piece type = PAWN;
+    switch (str[0]) {
+    case 'K': type = KING, i++; break;
+    case 'Q': type = QUEEN, i++; break;
+    case 'R': type = ROOK, i++; break;
+    case 'B': type = BISHOP, i++; break;
+    case 'N': type = KNIGHT, i++; break;
+    }
+
+    // e8=Q, or e8Q for pawns
+    int promotion = -1;
+    if (n >= 2 && str[n - 2] == '=') {
+        promotion = promotionBits(str[n - 1]);
+        if (promotion < 0)
+            return EMPTY_MOVE;
+        n -= 2;
+    }
+    else if (type == PAWN && memchr("NBRQ", str[n - 1], 4) != NULL) {
+        promotion = promotionBits(str[--n]);
+    }
+
+    if (n < i + 2 || !isFile(str[n - 2]) || !isRank(str[n - 1]))
+        return parseCoordinateMove(b, str, len);
+    int dst = (str[n - 1] - '1') * 8 + (str[n - 2] - 'a');
+    n -= 2;
+
+    // Disambiguation and capture marks, long algebraic (Ng1-f3) too
+    int from_file = -1, from_rank = -1;
+    for (; i < n; i++) {
+        if (isFile(str[i]))
+            from_file = str[i] - 'a';
+        else if (isRank(str[i]))
+            from_rank = str[i] - '1';
+        else if (str[i] != 'x' && str[i] != ':' && str[i] != '-')
+            return EMPTY_MOVE;
+    }
+
+    uint64_t sources = ~0ULL;
+    if (from_file >= 0)
+        sources &= 0x0101010101010101ULL << from_file;
+    if (from_rank >= 0)
+        sources &= 0xffULL << (8 * from_rank);
+    MoveList mlist = movesTo(b, type, dst, sources);
+    Move found = EMPTY_MOVE;
+    int matches = 0;
+    for (size_t j = 0; j < mlist.count; j++) {
+        Move m = mlist.moves[j];
+        int src = getMoveSrc(m);
+        MoveFlag flag = getMoveFlag(m);
+        if (getMoveDst(m) != dst)
+            continue;
+        if ((from_file >= 0 && src % 8 != from_file) || (from_rank >= 0 && src / 8 != from_rank))
+            continue;
+        if ((flag & PROMOTION) ? (flag & 3) != promotion : promotion >= 0)
+            continue;
+        if (!isLegal(b, m))
+            continue;
+        found = m;
+        matches++;
+    }
+    if (matches == 1)
+        return found;
+    return matches == 0 ? parseCoordinateMove(b, str, len) : EMPTY_MOVE;
+}
+
+int writeSan(const Board *b, Move m, char *out)
+{
+    int n = 0;
+    MoveFlag flag = getMoveFlag(m);
+    int src = getMoveSrc(m), dst = getMoveDst(m);
+    Piece p = b->pieces[src];
+
+    if (flag == KING_CASTLE || flag == QUEEN_CASTLE) {
+        n = flag == KING_CASTLE ? 3 : 5;
+        memcpy(out, "O-O-O", n);
+    }
+    else {
+        if (p & PAWN) {
+            if (flag & CAPTURE)
+                out[n++] = 'a' + src % 8;
+        }
+        else {
+            out[n++] = pieceToNotation(p & ~BLACK);
+
+            // Square of the piece as far as needed to tell it from others
+            // of the same type that can go to dst
+            bool ambiguous = false, same_file = false, same_rank = false;
+            MoveList mlist = movesTo(b, p, dst, ~0ULL);
+            for (size_t i = 0; i < mlist.count; i++) {
+                int other = getMoveSrc(mlist.moves[i]);
+                if (getMoveDst(mlist.moves[i]) != dst || other == src || !isLegal(b, mlist.moves[i]))
+                    continue;
+                ambiguous = true;
+                same_file |= other % 8 == src % 8;
+                same_rank |= other / 8 == src / 8;
+            }
+            if (ambiguous && (!same_file || same_rank))
+                out[n++] = 'a' + src % 8;
+            if (ambiguous && same_file)
+                out[n++] = '1' + src / 8;
+        }
+        if (flag & CAPTURE)
+            out[n++] = 'x';
+        out[n++] = 'a' + dst % 8;
+        out[n++] = '1' + dst / 8;
+        if (flag & PROMOTION) {
+            out[n++] = '=';
+            out[n++] = "NBRQ"[flag & 3];
+        }
+    }
+
+    Board updated = moveMake(m, *b);
+    int col_idx = (updated.color_to_move & WHITE) ? 0 : 1;
+    if (isSquareAttacked(&updated, updated.king_squares[col_idx], !col_idx))
+        out[n++] = generateMoves(&updated).count == 0 ? '#' : '+';
+    out[n] = '\0';
+    return n;
+}
@@ -0,0 +1,26 @@
+#ifndef NOTATION_H
+#define NOTATION_H
+
+#include "board.h"
+#include "move.h"
+
+#include <stddef.h>
+
+// Reading moves as written by people and other programs, str[0, len) needs
+// no null terminator and b must be the position the move is played in
+
+// Standard algebraic notation (Nbd7, exd6, e8=Q+, O-O), falls back to
+// coordinates. Returns EMPTY_MOVE for illegal or ambiguous moves
+Move parseSan(const Board *b, const char *str, size_t len);
+
+// Coordinate notation as used by UCI (e2e4, e7e8q)
+Move parseCoordinateMove(const Board *b, const char *str, size_t len);
+
+// Bytes writeSan() may write, including the null terminator
+#define SAN_MAX_LENGTH 10
+
+// Writes m, a legal move of b, in standard algebraic notation with check
+// and mate marks, returns its length
+int writeSan(const Board *b, Move m, char *out);
+
+#endif // !NOTATION_H
@@ -0,0 +1,104 @@
+#include "output.h"
+#include "utils.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+void textAppendf(Text *t, const char *fmt, ...)
+{
+    for (;;) {
+        va_list args;
+        va_start(args, fmt);
+        char *end = t->data != NULL ? t->data + t->length : NULL;
+        int n = vsnprintf(end, t->capacity - t->length, fmt, args);
+        va_end(args);
+        if (n < 0)
+            return;
+        if ((size_t)n < t->capacity - t->length) {
+            t->length += n;
+            return;
+        }
+        size_t capacity = MAX(2 * t->capacity, t->length + n + 1);
+        char *data = realloc(t->data, capacity);
+        if (data == NULL)
+            return;
+        t->data = data;
+        t->capacity = capacity;
+    }
+}
+
+void textAppendJsonString(Text *t, const char *str, size_t length)
+{
+    textAppendf(t, "\"");
+    for (size_t i = 0; i < length; i++) {
+        char c = str[i];
+        if (c == '"' || c == '\\')
+            textAppendf(t, "\\%c", c);
+        else if ((unsigned char)c < 0x20)
+            textAppendf(t, "\\u%04x", c);
+        else
+            textAppendf(t, "%c", c);
+    }
+    textAppendf(t, "\"");
+}
+
+void textFree(Text *t)
+{
+    free(t->data);
+    *t = (Text){0};
+}
+
+bool orderedOutputInit(OrderedOutput *o, FILE *out, bool ordered, int first, int limit)
+{
+    *o = (OrderedOutput){.out = out, .ordered = ordered, .limit = MAX(limit, 1), .next = first};
+    o->pending = calloc(o->limit, sizeof(PendingOutput));
+    pthread_mutex_init(&o->lock, NULL);
+    pthread_cond_init(&o->written, NULL);
+    return o->pending != NULL;
+}
+
+void orderedOutputFree(OrderedOutput *o)
+{
+    for (int i = 0; o->pending != NULL && i < o->limit; i++)
+        textFree(&o->pending[i].text);
+    free(o->pending);
+    pthread_mutex_destroy(&o->lock);
+    pthread_cond_destroy(&o->written);
+}
+
+void orderedOutputWrite(OrderedOutput *o, int item, Text *t)
+{
+    Text empty = {0};
+    if (t == NULL)
+        t = &empty;
+    pthread_mutex_lock(&o->lock);
+    if (!o->ordered) {
+        if (t->length > 0) {
+            fwrite(t->data, 1, t->length, o->out);
+            fflush(o->out);
+        }
+        pthread_mutex_unlock(&o->lock);
+        textFree(t);
+        return;
+    }
+
+    while (item - o->next >= o->limit)
+        pthread_cond_wait(&o->written, &o->lock);
+    PendingOutput *slot = &o->pending[item % o->limit];
+    slot->text = *t;
+    slot->ready = true;
+    *t = (Text){0};
+
+    int written = 0;
+    for (; (slot = &o->pending[o->next % o->limit])->ready; o->next++, written++) {
+        fwrite(slot->text.data, 1, slot->text.length, o->out);
+        textFree(&slot->text);
+        slot->ready = false;
+    }
+    if (written > 0) {
+        fflush(o->out);
+        pthread_cond_broadcast(&o->written);
+    }
+    pthread_mutex_unlock(&o->lock);
+}
@@ -0,0 +1,50 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Output of the batch tools, where threads produce the results of numbered
+// items (lines, games) that are written in input order
+
+// Text built with printf style appends, grows as needed
+typedef struct {
+    char *data;
+    size_t length, capacity;
+} Text;
+
+void textAppendf(Text *t, const char *fmt, ...);
+// Appends str as a JSON string
+void textAppendJsonString(Text *t, const char *str, size_t length);
+void textFree(Text *t);
+
+typedef struct {
+    Text text;
+    bool ready;
+} PendingOutput;
+
+// Writes results as they come or, if ordered, each once all earlier ones
+// are written. Results of later items are held meanwhile, at most limit of
+// them: a thread whose item is limit or more past the next one to write
+// waits. The thread with the next item never waits, so every thread gets
+// through eventually
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t written;     // signaled when next advances
+    FILE *out;
+    bool ordered;
+    PendingOutput *pending;     // ring of limit slots, item % limit
+    int limit;
+    int next;                   // item written next
+} OrderedOutput;
+
+bool orderedOutputInit(OrderedOutput *o, FILE *out, bool ordered, int first, int limit);
+void orderedOutputFree(OrderedOutput *o);
+
+// Writes the result of item, t (NULL for items without output) is taken
+// over and left empty. Flushes what it writes
+void orderedOutputWrite(OrderedOutput *o, int item, Text *t);
+
+#endif // !OUTPUT_H
@@ -0,0 +1,214 @@
+#include "packed.h"
+#include "evaluate.h"
+#include "utils.h"
+#include "zobrist.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PACKED_MAX_FULLMOVES 4095
+
+// Piece of each 4 bit code, indexed like PieceIdx and white first
+static const Piece PACKED_PIECES[12] = {
+    WHITE | KING, WHITE | QUEEN, WHITE | BISHOP, WHITE | KNIGHT, WHITE | ROOK, WHITE | PAWN,
+    BLACK | KING, BLACK | QUEEN, BLACK | BISHOP, BLACK | KNIGHT, BLACK | ROOK, BLACK | PAWN,
+};
+
+void packPosition(const Board *b, PackedPosition *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->occupancy = b->occupancy[0] | b->occupancy[1];
+    int i = 0;
+    for (uint64_t occupied = p->occupancy; occupied && i < 32; occupied &= occupied - 1, i++) {
+        Piece piece = b->pieces[LSB(occupied)];
+        int code = getPieceIdx(piece) + ((piece & BLACK) ? 6 : 0);
+        p->pieces[i / 2] |= code << (4 * (i % 2));
+    }
+
+    p->flags = (b->color_to_move == BLACK) | (b->castle_rights << 1);
+    p->halfmove_clock = MIN(b->halfmove_clock, 255);
+    int fullmoves = MIN(b->fullmoves, PACKED_MAX_FULLMOVES);
+    p->fullmoves_ep = fullmoves | (b->ep_square != -1 ? (b->ep_square % 8 + 1) << 12 : 0);
+    p->score = PACKED_NO_SCORE;
+    p->best_move = EMPTY_MOVE;
+}
+
+// Board state is built from the occupied squares only, without the 64
+// square passes of initBoardFromPieces()
+bool unpackPosition(const PackedPosition *p, Board *out)
+{
+    if (POPCOUNT(p->occupancy) > 32)
+        return false;
+
+    Board b = {
+        .color_to_move = (p->flags & 1) ? BLACK : WHITE,
+        .castle_rights = (p->flags >> 1) & 15,
+        .ep_square = -1,
+        .halfmove_clock = p->halfmove_clock,
+        .fullmoves = p->fullmoves_ep & PACKED_MAX_FULLMOVES,
+        .king_squares = {-1, -1},
+    };
+    int i = 0;
+    for (uint64_t occupied = p->occupancy; occupied; occupied &= occupied - 1, i++) {
+        int code = (p->pieces[i / 2] >> (4 * (i % 2))) & 15;
+        int sq = LSB(occupied);
+        if (code >= 12)
+            return false;
+        int col_idx = code >= 6, piece_idx = code % 6;
+        if (piece_idx == KING_IDX) {
+            if (b.king_squares[col_idx] != -1)
+                return false;
+            b.king_squares[col_idx] = sq;
+        }
+        else if (piece_idx == PAWN_IDX) {
+            if (sq < 8 || sq >= 56)
+                return false;
+            b.pawn_hash ^= ZOBRIST.pieces[col_idx][PAWN_IDX][sq];
+        }
+        b.pieces[sq] = PACKED_PIECES[code];
+        b.bitboards[col_idx][piece_idx] |= 1ull << sq;
+        b.occupancy[col_idx] |= 1ull << sq;
+        b.zobrist_hash ^= ZOBRIST.pieces[col_idx][piece_idx][sq];
+        b.psqt[0] += PSQT[col_idx][piece_idx][sq][0];
+        b.psqt[1] += PSQT[col_idx][piece_idx][sq][1];
+        b.phase += PHASE_WEIGHTS[piece_idx];
+    }
+    if (b.king_squares[0] == -1 || b.king_squares[1] == -1 || b.fullmoves == 0)
+        return false;
+
+    static const struct {
+        CastleRight right;
+        Piece color;
+        int king_sq, rook_sq;
+    } HOMES[4] = {
+        {WKSC, WHITE, 4, 7}, {WQSC, WHITE, 4, 0}, {BKSC, BLACK, 60, 63}, {BQSC, BLACK, 60, 56},
+    };
+    for (int h = 0; h < 4; h++) {
+        if ((b.castle_rights & HOMES[h].right)
+            && (b.pieces[HOMES[h].king_sq] != (HOMES[h].color | KING)
+                || b.pieces[HOMES[h].rook_sq] != (HOMES[h].color | ROOK)))
+            return false;
+    }
+
+    int ep_file = p->fullmoves_ep >> 12;
+    if (ep_file > 8)
+        return false;
+    if (ep_file > 0) {
+        bool white = b.color_to_move == WHITE;
+        int sq = (white ? 40 : 16) + ep_file - 1;
+        int pawn_sq = white ? sq - 8 : sq + 8;
+        int from_sq = white ? sq + 8 : sq - 8;
+        if (b.pieces[sq] != EMPTY_PIECE || b.pieces[from_sq] != EMPTY_PIECE
+            || b.pieces[pawn_sq] != ((white ? BLACK : WHITE) | PAWN))
+            return false;
+        b.ep_square = sq;
+        b.zobrist_hash ^= ZOBRIST.ep_square[sq];
+    }
+    if (b.color_to_move == BLACK)
+        b.zobrist_hash ^= ZOBRIST.black;
+    b.zobrist_hash ^= ZOBRIST.castles[b.castle_rights];
+
+    int them = b.color_to_move == WHITE ? 1 : 0;
+    if (isSquareAttacked(&b, b.king_squares[them], !them))
+        return false;
+    *out = b;
+    return true;
+}
+
+PackedResult packedResult(const PackedPosition *p)
+{
+    return (p->flags >> 5) & 3;
+}
+
+void packedSetResult(PackedPosition *p, PackedResult result)
+{
+    p->flags = (p->flags & ~(3 << 5)) | (result << 5);
+}
+
+bool packedWriterOpen(PackedWriter *w, const char *path)
+{
+    w->count = 0;
+    w->f = fopen(path, "wb");
+    if (w->f == NULL) {
+        fprintf(stderr, "packed: can't write %s\n", path);
+        return false;
+    }
+
+    // The count is filled in on close
+    unsigned char header[PACKED_HEADER_SIZE] = "CEPK";
+    uint32_t version = PACKED_VERSION;
+    memcpy(header + 4, &version, sizeof(version));
+    return fwrite(header, 1, sizeof(header), w->f) == sizeof(header);
+}
+
+bool packedWrite(PackedWriter *w, const PackedPosition *positions, size_t n)
+{
+    size_t written = fwrite(positions, sizeof(PackedPosition), n, w->f);
+    w->count += written;
+    return written == n;
+}
+
+bool packedWriterClose(PackedWriter *w)
+{
+    bool ok = fseek(w->f, 8, SEEK_SET) == 0 && fwrite(&w->count, sizeof(w->count), 1, w->f) == 1;
+    ok = fclose(w->f) == 0 && ok;
+    w->f = NULL;
+    return ok;
+}
+
+bool packedOpen(PackedFile *f, const char *path)
+{
+    memset(f, 0, sizeof(*f));
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "packed: can't open %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void *mapping = size >= PACKED_HEADER_SIZE
+                        ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                        : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "packed: can't mmap %s\n", path);
+        return false;
+    }
+
+    const unsigned char *header = mapping;
+    uint32_t version;
+    uint64_t count;
+    memcpy(&version, header + 4, sizeof(version));
+    memcpy(&count, header + 8, sizeof(count));
+    if (memcmp(header, "CEPK", 4) != 0 || version != PACKED_VERSION
+        || (size - PACKED_HEADER_SIZE) / sizeof(PackedPosition) != count
+        || (size - PACKED_HEADER_SIZE) % sizeof(PackedPosition) != 0) {
+        fprintf(stderr, "packed: %s isn't a complete packed file (version %d)\n", path,
+                PACKED_VERSION);
+        munmap(mapping, size);
+        return false;
+    }
+
+    f->positions = (const PackedPosition *)(header + PACKED_HEADER_SIZE);
+    f->count = count;
+    f->mapping = mapping;
+    f->mapping_size = size;
+    return true;
+}
+
+void packedClose(PackedFile *f)
+{
+    if (f->mapping != NULL)
+        munmap(f->mapping, f->mapping_size);
+    memset(f, 0, sizeof(*f));
+}
+
+const PackedPosition *packedGet(const PackedFile *f, uint64_t i)
+{
+    return i < f->count ? &f->positions[i] : NULL;
+}
@@ -0,0 +1,88 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+#include "board.h"
+#include "move.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Fixed size binary positions for datasets and bulk test corpora
+//
+// A position takes 32 bytes: the occupancy bitboard, then a 4 bit code per
+// occupied square from a1 up (PieceIdx, + 6 for black), which fits the 32
+// pieces a legal position can have. Score, result and best move are
+// optional annotations, e.g. from self-play.
+//
+// File layout (little endian), mapped read only with mmap:
+//   16 byte header: "CEPK", uint32 version, uint64 number of positions
+//   PackedPosition positions[]
+
+#define PACKED_VERSION 1
+#define PACKED_HEADER_SIZE 16
+
+// Score of a position without one
+#define PACKED_NO_SCORE INT16_MIN
+
+typedef enum {
+    PACKED_RESULT_UNKNOWN,
+    PACKED_WHITE_WINS,
+    PACKED_DRAW,
+    PACKED_BLACK_WINS,
+} PackedResult;
+
+typedef struct {
+    uint64_t occupancy;
+    uint8_t pieces[16];     // 4 bit codes, low nibble first
+    uint8_t flags;          // bit 0 black to move, bits 1-4 CastleRight,
+                            // bits 5-6 PackedResult
+    uint8_t halfmove_clock;
+    uint16_t fullmoves_ep;  // bits 0-11 fullmove number, bits 12-15 en
+                            // passant file + 1 (0 without)
+    int16_t score;          // side to move's point of view, PACKED_NO_SCORE
+    Move best_move;         // EMPTY_MOVE without
+} PackedPosition;
+
+_Static_assert(sizeof(PackedPosition) == 32, "PackedPosition should take 32 bytes");
+
+// Packs b without score, result or best move. Clocks saturate at what the
+// format holds (255 and 4095)
+void packPosition(const Board *b, PackedPosition *p);
+
+// Returns false if p doesn't describe a position (corrupt or not a packed
+// file), b is only written on success
+bool unpackPosition(const PackedPosition *p, Board *b);
+
+PackedResult packedResult(const PackedPosition *p);
+void packedSetResult(PackedPosition *p, PackedResult result);
+
+// Appends positions to a file, the header count is written on close
+typedef struct {
+    FILE *f;
+    uint64_t count;
+} PackedWriter;
+
+bool packedWriterOpen(PackedWriter *w, const char *path);
+bool packedWrite(PackedWriter *w, const PackedPosition *positions, size_t n);
+bool packedWriterClose(PackedWriter *w);
+
+// Read only mapping of a packed file, positions are read in place and can be
+// shared by any number of threads
+typedef struct {
+    const PackedPosition *positions;
+    uint64_t count;
+    void *mapping;
+    size_t mapping_size;
+} PackedFile;
+
+// Returns false (and prints why) if the file can't be mapped or isn't a
+// complete packed file
+bool packedOpen(PackedFile *f, const char *path);
+void packedClose(PackedFile *f);
+
+// Position i of the file, NULL past the end
+const PackedPosition *packedGet(const PackedFile *f, uint64_t i);
+
+#endif // !PACKED_H
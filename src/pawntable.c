@@ -0,0 +1,92 @@
+#include "pawntable.h"
+#include "utils.h"
+
+#include <stdatomic.h>
+
+// Entries are stored without locks, check holds the key xored with all the
+// data words. A slot half written by another thread fails the check on read.
+// An all zero (empty) slot matches key 0, which only a position without pawns
+// has, and correctly reads back as a zero score with no passed pawns
+typedef struct {
+    _Atomic uint64_t check;
+    _Atomic uint64_t scores;
+    _Atomic uint64_t passed[2];
+} PawnSlot;
+
+static PawnSlot PAWN_TABLE[PAWN_TABLE_SIZE];
+
+static _Atomic uint64_t pawn_table_hits;
+static _Atomic uint64_t pawn_table_misses;
+static _Thread_local uint32_t local_hits, local_misses;
+
+static void flushPawnTableStats(void)
+{
+    atomic_fetch_add_explicit(&pawn_table_hits, local_hits, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pawn_table_misses, local_misses, memory_order_relaxed);
+    local_hits = local_misses = 0;
+}
+
+bool probePawnTable(uint64_t key, PawnEntry *entry)
+{
+    PawnSlot *slot = &PAWN_TABLE[key & (PAWN_TABLE_SIZE - 1)];
+    uint64_t check = atomic_load_explicit(&slot->check, memory_order_relaxed);
+    uint64_t scores = atomic_load_explicit(&slot->scores, memory_order_relaxed);
+    uint64_t passed0 = atomic_load_explicit(&slot->passed[0], memory_order_relaxed);
+    uint64_t passed1 = atomic_load_explicit(&slot->passed[1], memory_order_relaxed);
+
+    if (local_hits + local_misses >= STATS_BATCH)
+        flushPawnTableStats();
+    if ((check ^ scores ^ passed0 ^ passed1) != key) {
+        local_misses++;
+        return false;
+    }
+
+    entry->score[0] = (int32_t)(uint32_t)scores;
+    entry->score[1] = (int32_t)(uint32_t)(scores >> 32);
+    entry->passed[0] = passed0;
+    entry->passed[1] = passed1;
+    local_hits++;
+    return true;
+}
+
+// Always replaces whatever is in the slot
+void storePawnTable(uint64_t key, const PawnEntry *entry)
+{
+    PawnSlot *slot = &PAWN_TABLE[key & (PAWN_TABLE_SIZE - 1)];
+    uint64_t scores = (uint64_t)(uint32_t)entry->score[0] |
+                      ((uint64_t)(uint32_t)entry->score[1] << 32);
+    atomic_store_explicit(&slot->scores, scores, memory_order_relaxed);
+    atomic_store_explicit(&slot->passed[0], entry->passed[0], memory_order_relaxed);
+    atomic_store_explicit(&slot->passed[1], entry->passed[1], memory_order_relaxed);
+    atomic_store_explicit(&slot->check,
+                          key ^ scores ^ entry->passed[0] ^ entry->passed[1],
+                          memory_order_relaxed);
+}
+
+void clearPawnTable(void)
+{
+    for (int i = 0; i < PAWN_TABLE_SIZE; i++) {
+        atomic_store_explicit(&PAWN_TABLE[i].check, 0, memory_order_relaxed);
+        atomic_store_explicit(&PAWN_TABLE[i].scores, 0, memory_order_relaxed);
+        atomic_store_explicit(&PAWN_TABLE[i].passed[0], 0, memory_order_relaxed);
+        atomic_store_explicit(&PAWN_TABLE[i].passed[1], 0, memory_order_relaxed);
+    }
+}
+
+// Other threads' counts are up to STATS_BATCH probes behind
+PawnTableStats getPawnTableStats(void)
+{
+    flushPawnTableStats();
+    PawnTableStats stats = {
+        .hits = atomic_load_explicit(&pawn_table_hits, memory_order_relaxed),
+        .misses = atomic_load_explicit(&pawn_table_misses, memory_order_relaxed),
+    };
+    return stats;
+}
+
+void resetPawnTableStats(void)
+{
+    local_hits = local_misses = 0;
+    atomic_store_explicit(&pawn_table_hits, 0, memory_order_relaxed);
+    atomic_store_explicit(&pawn_table_misses, 0, memory_order_relaxed);
+}
@@ -0,0 +1,32 @@
+#ifndef PAWNTABLE_H
+#define PAWNTABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Number of entries in the pawn table, must be a power of 2
+#define PAWN_TABLE_SIZE (1 << 14)
+
+// Cached result of pawn structure evaluation
+// score: white's point of view, [0] midgame, [1] endgame
+// passed: passed pawns of each color (0 white, 1 black)
+typedef struct {
+    int score[2];
+    uint64_t passed[2];
+} PawnEntry;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+} PawnTableStats;
+
+// Looks up entry stored with pawn hash key, returns false on a miss
+// Safe to call from multiple threads, torn entries are detected and missed
+bool probePawnTable(uint64_t key, PawnEntry *entry);
+void storePawnTable(uint64_t key, const PawnEntry *entry);
+void clearPawnTable(void);
+
+PawnTableStats getPawnTableStats(void);
+void resetPawnTableStats(void);
+
+#endif // !PAWNTABLE_H
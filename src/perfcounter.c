@@ -0,0 +1,165 @@
+#include "perfcounter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char *PERF_EVENT_NAMES[NUM_PERF_EVENTS] = {
+    "cycles",
+    "instructions",
+    "branch-misses",
+    "L1d-misses",
+    "LLC-misses",
+    "dTLB-misses",
+};
+
+#ifdef __linux__
+
+// perf_event_attr type and config for each PerfEvent
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} PERF_EVENT_CONFIGS[NUM_PERF_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+static int openPerfEvent(PerfEvent e)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_EVENT_CONFIGS[e].type;
+    attr.config = PERF_EVENT_CONFIGS[e].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1; // Also count threads spawned by the workload
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // Current process, any cpu, no group leader
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+bool perfCountersOpen(PerfCounters *pc)
+{
+    bool any = false;
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        pc->values[e] = 0;
+        pc->fds[e] = openPerfEvent(e);
+        pc->available[e] = pc->fds[e] >= 0;
+        any |= pc->available[e];
+    }
+    return any;
+}
+
+void perfCountersClose(PerfCounters *pc)
+{
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (pc->available[e])
+            close(pc->fds[e]);
+        pc->available[e] = false;
+        pc->fds[e] = -1;
+    }
+}
+
+void perfCountersStart(PerfCounters *pc)
+{
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (!pc->available[e])
+            continue;
+        ioctl(pc->fds[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fds[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perfCountersStop(PerfCounters *pc)
+{
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (!pc->available[e])
+            continue;
+        ioctl(pc->fds[e], PERF_EVENT_IOC_DISABLE, 0);
+
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (read(pc->fds[e], data, sizeof(data)) != sizeof(data)) {
+            pc->values[e] = 0;
+            continue;
+        }
+
+        // Scale up if the kernel had to multiplex counters
+        if (data[2] != 0 && data[2] < data[1])
+            pc->values[e] = (uint64_t)((double)data[0] * data[1] / data[2]);
+        else
+            pc->values[e] = data[0];
+    }
+}
+
+#else
+
+// No hardware counters outside Linux, benchmarks only report wall time
+bool perfCountersOpen(PerfCounters *pc)
+{
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        pc->fds[e] = -1;
+        pc->available[e] = false;
+        pc->values[e] = 0;
+    }
+    return false;
+}
+
+void perfCountersClose(PerfCounters *pc) { (void)pc; }
+void perfCountersStart(PerfCounters *pc) { (void)pc; }
+void perfCountersStop(PerfCounters *pc) { (void)pc; }
+
+#endif // __linux__
+
+bool perfCountersAny(const PerfCounters *pc)
+{
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (pc->available[e])
+            return true;
+    }
+    return false;
+}
+
+void printPerfCounters(const PerfCounters *pc, uint64_t nodes)
+{
+    if (!perfCountersAny(pc))
+        return;
+
+    if (pc->available[PERF_CYCLES] && pc->available[PERF_INSTRUCTIONS] &&
+        pc->values[PERF_CYCLES] != 0) {
+        printf("    IPC: %.2lf", (double)pc->values[PERF_INSTRUCTIONS] /
+                                     (double)pc->values[PERF_CYCLES]);
+    }
+    if (nodes == 0) {
+        printf("\n");
+        return;
+    }
+
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (!pc->available[e])
+            continue;
+        printf("    %s/node: %.2lf", PERF_EVENT_NAMES[e],
+               (double)pc->values[e] / (double)nodes);
+    }
+    printf("\n");
+}
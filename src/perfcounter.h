@@ -0,0 +1,39 @@
+#ifndef PERFCOUNTER_H
+#define PERFCOUNTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hardware events read around a benchmark workload
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    NUM_PERF_EVENTS,
+} PerfEvent;
+
+// Holds file descriptors of opened counters (Linux perf_event_open)
+// Counters that can't be opened (no kernel support, containers, paranoid
+// settings, other platforms) are marked unavailable and simply not reported
+typedef struct {
+    int fds[NUM_PERF_EVENTS];
+    bool available[NUM_PERF_EVENTS];
+    uint64_t values[NUM_PERF_EVENTS];
+} PerfCounters;
+
+extern const char *PERF_EVENT_NAMES[NUM_PERF_EVENTS];
+
+// Returns false if no counter at all could be opened
+bool perfCountersOpen(PerfCounters *pc);
+void perfCountersClose(PerfCounters *pc);
+void perfCountersStart(PerfCounters *pc);
+void perfCountersStop(PerfCounters *pc);
+bool perfCountersAny(const PerfCounters *pc);
+
+// Prints IPC and per node miss rates for the last start/stop interval
+void printPerfCounters(const PerfCounters *pc, uint64_t nodes);
+
+#endif // !PERFCOUNTER_H
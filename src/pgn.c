@@ -0,0 +1,370 @@
+#include "pgn.h"
+#include "engine.h"
+#include "notation.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Chunks handed to each thread by pgnReadFiles(), files smaller than this
+// aren't split
+#define MIN_CHUNK_SIZE (1 << 20)
+
+static bool isPgnSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static const char *skipSpace(const char *p, const char *end)
+{
+    while (p < end && isPgnSpace(*p))
+        p++;
+    return p;
+}
+
+static const char *skipLine(const char *p, const char *end)
+{
+    const char *newline = memchr(p, '\n', end - p);
+    return newline != NULL ? newline + 1 : end;
+}
+
+static const char *skipComment(const char *p, const char *end)
+{
+    const char *close = memchr(p, '}', end - p);
+    return close != NULL ? close + 1 : end;
+}
+
+// p is at the opening parenthesis, variations may nest
+static const char *skipVariation(const char *p, const char *end)
+{
+    int depth = 0;
+    while (p < end) {
+        char c = *p++;
+        if (c == '(')
+            depth++;
+        else if (c == ')' && --depth == 0)
+            return p;
+        else if (c == '{')
+            p = skipComment(p, end);
+        else if (c == ';')
+            p = skipLine(p, end);
+    }
+    return end;
+}
+
+// [Name "value"], p is at the bracket
+static const char *readTag(const char *p, const char *end, PgnGame *game)
+{
+    const char *line_end = memchr(p, '\n', end - p);
+    if (line_end == NULL)
+        line_end = end;
+
+    p++;
+    while (p < line_end && (*p == ' ' || *p == '\t'))
+        p++;
+    PgnTag tag = {.name = p};
+    while (p < line_end && !isPgnSpace(*p) && *p != '"' && *p != ']')
+        p++;
+    tag.name_length = p - tag.name;
+
+    const char *quote = memchr(p, '"', line_end - p);
+    if (quote != NULL) {
+        tag.value = p = quote + 1;
+        while (p < line_end && *p != '"')
+            p += *p == '\\' && p + 1 < line_end ? 2 : 1;
+        tag.value_length = p - tag.value;
+    }
+    else {
+        tag.value = p;
+    }
+    if (tag.name_length > 0 && game->tag_count < PGN_MAX_TAGS)
+        game->tags[game->tag_count++] = tag;
+    return line_end < end ? line_end + 1 : end;
+}
+
+static bool tagIs(const PgnTag *tag, const char *name)
+{
+    size_t n = strlen(name);
+    return tag->name_length == n && memcmp(tag->name, name, n) == 0;
+}
+
+const PgnTag *pgnFindTag(const PgnGame *game, const char *name)
+{
+    for (int i = 0; i < game->tag_count; i++) {
+        if (tagIs(&game->tags[i], name))
+            return &game->tags[i];
+    }
+    return NULL;
+}
+
+static PgnResult parseResultToken(const char *token, size_t n)
+{
+    if (n == 3 && memcmp(token, "1-0", 3) == 0)
+        return PGN_WHITE_WINS;
+    if (n == 3 && memcmp(token, "0-1", 3) == 0)
+        return PGN_BLACK_WINS;
+    if (n == 7 && memcmp(token, "1/2-1/2", 7) == 0)
+        return PGN_DRAW;
+    return PGN_RESULT_UNKNOWN;
+}
+
+void pgnReaderInit(PgnReader *r, const char *data, size_t size)
+{
+    r->data = r->pos = data;
+    r->end = data + size;
+    r->file = 0;
+}
+
+bool pgnReadGame(PgnReader *r, PgnGame *game)
+{
+    const char *p = skipSpace(r->pos, r->end), *end = r->end, *begin = p;
+    r->pos = p;
+    if (p == end)
+        return false;
+
+    game->offset = p - r->data;
+    game->file = r->file;
+    game->tag_count = 0;
+    game->move_count = 0;
+    game->result = PGN_RESULT_UNKNOWN;
+    game->error = PGN_OK;
+    while (p < end && *p == '[')
+        p = skipSpace(readTag(p, end, game), end);
+
+    const PgnTag *fen = pgnFindTag(game, "FEN");
+    const char *start_fen = fen != NULL ? fen->value : START_FEN;
+    size_t start_fen_length = fen != NULL ? fen->value_length : strlen(START_FEN);
+    if (parseFen(start_fen, start_fen_length, &game->start, NULL) != FEN_OK) {
+        game->start = initBoardFromFen(START_FEN);
+        game->error = PGN_BAD_FEN;
+    }
+    const PgnTag *result_tag = pgnFindTag(game, "Result");
+    if (result_tag != NULL)
+        game->result = parseResultToken(result_tag->value, result_tag->value_length);
+
+    // Movetext, up to a result or the next game's tags
+    Board b = game->start;
+    bool reading = game->error == PGN_OK;
+    while (p < end) {
+        char c = *p;
+        if (isPgnSpace(c)) {
+            p++;
+        }
+        else if (c == '[' && (p == begin || p[-1] == '\n')) {
+            break;
+        }
+        else if (c == '{') {
+            p = skipComment(p + 1, end);
+        }
+        else if (c == ';' || (c == '%' && (p == begin || p[-1] == '\n'))) {
+            p = skipLine(p, end);
+        }
+        else if (c == '(') {
+            p = skipVariation(p, end);
+        }
+        else if (c == ')' || c == '$') {
+            // Stray parenthesis or numeric annotation glyph
+            for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+                ;
+        }
+        else {
+            const char *token = p;
+            while (p < end && !isPgnSpace(*p) && memchr("{}();[$", *p, 7) == NULL)
+                p++;
+            size_t n = p - token;
+
+            PgnResult result = parseResultToken(token, n);
+            if (result != PGN_RESULT_UNKNOWN || (n == 1 && *token == '*')) {
+                game->result = result;
+                break;
+            }
+
+            // Move numbers (12. or 12...), possibly stuck to the move
+            size_t digits = 0;
+            while (digits < n && token[digits] >= '0' && token[digits] <= '9')
+                digits++;
+            if (digits > 0 && digits < n && token[digits] == '.') {
+                while (digits < n && token[digits] == '.')
+                    digits++;
+                token += digits;
+                n -= digits;
+            }
+            if (n == 0 || !reading)
+                continue;
+
+            Move m = parseSan(&b, token, n);
+            if (m == EMPTY_MOVE) {
+                game->error = PGN_BAD_MOVE;
+                reading = false;
+            }
+            else if (game->move_count == PGN_MAX_PLIES) {
+                game->error = PGN_TOO_LONG;
+                reading = false;
+            }
+            else {
+                game->moves[game->move_count++] = m;
+                b = moveMake(m, b);
+            }
+        }
+    }
+    game->end = b;
+
+    // Past the result, and the blank lines so the next game starts at pos
+    while (p < end && !isPgnSpace(*p) && *p != '[')
+        p++;
+    r->pos = skipSpace(p, end);
+    return true;
+}
+
+size_t pgnNextGameOffset(const char *data, size_t size, size_t offset)
+{
+    if (offset == 0 || offset >= size)
+        return MIN(offset, size);
+
+    // A game starts with a tag line that doesn't follow another one
+    const char *line = data + offset, *end = data + size;
+    while (line > data && line[-1] != '\n')
+        line--;
+    bool after_tag = *line == '[';
+    for (const char *p = skipLine(data + offset, end); p < end; p = skipLine(p, end)) {
+        if (*p == '[' && !after_tag)
+            return p - data;
+        after_tag = *p == '[';
+    }
+    return size;
+}
+
+//
+// Reading files on several threads
+//
+
+typedef struct {
+    const char *data;
+    size_t size;
+    size_t begin, end;  // games starting in [begin, end)
+    int file;
+} PgnChunk;
+
+typedef struct {
+    PgnChunk *chunks;
+    int chunk_count;
+    _Atomic int next_chunk;
+    _Atomic long games;
+    PgnGameCallback on_game;
+    void *data;
+} PgnJob;
+
+typedef struct {
+    PgnJob *job;
+    int thread;
+} PgnWorker;
+
+static void *readChunks(void *arg)
+{
+    PgnWorker *worker = arg;
+    PgnJob *job = worker->job;
+    PgnGame *game = malloc(sizeof(PgnGame));
+    if (game == NULL)
+        return NULL;
+
+    long games = 0;
+    int i;
+    while ((i = atomic_fetch_add(&job->next_chunk, 1)) < job->chunk_count) {
+        const PgnChunk *chunk = &job->chunks[i];
+        PgnReader r;
+        pgnReaderInit(&r, chunk->data, chunk->size);
+        r.pos = chunk->data + chunk->begin;
+        r.file = chunk->file;
+        while (r.pos < chunk->data + chunk->end && pgnReadGame(&r, game)) {
+            job->on_game(game, worker->thread, job->data);
+            games++;
+        }
+    }
+    atomic_fetch_add(&job->games, games);
+    free(game);
+    return NULL;
+}
+
+long pgnReadFiles(const char *const *paths, int n_paths, int n_threads,
+                  PgnGameCallback on_game, void *data)
+{
+    n_threads = MAX(n_threads, 1);
+    const char **maps = calloc(n_paths, sizeof(char *));
+    size_t *sizes = calloc(n_paths, sizeof(size_t));
+    PgnJob job = {.on_game = on_game, .data = data};
+    long games = -1;
+
+    size_t total = 0;
+    for (int i = 0; i < n_paths; i++) {
+        int fd = open(paths[i], O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            fprintf(stderr, "pgn: can't open %s\n", paths[i]);
+            if (fd >= 0)
+                close(fd);
+            goto done;
+        }
+        sizes[i] = st.st_size;
+        if (sizes[i] > 0) {
+            void *mapping = mmap(NULL, sizes[i], PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                fprintf(stderr, "pgn: can't mmap %s\n", paths[i]);
+                sizes[i] = 0;
+                close(fd);
+                goto done;
+            }
+            madvise(mapping, sizes[i], MADV_SEQUENTIAL);
+            maps[i] = mapping;
+        }
+        close(fd);
+        total += sizes[i];
+    }
+
+    // A few chunks per thread so they finish together
+    size_t chunk_size = MAX(total / (n_threads * 8), (size_t)MIN_CHUNK_SIZE);
+    int capacity = n_paths + total / chunk_size + 1;
+    job.chunks = malloc(capacity * sizeof(PgnChunk));
+    for (int i = 0; i < n_paths; i++) {
+        for (size_t begin = 0; begin < sizes[i] && job.chunk_count < capacity;) {
+            size_t end = pgnNextGameOffset(maps[i], sizes[i], begin + chunk_size);
+            job.chunks[job.chunk_count++] = (PgnChunk){
+                .data = maps[i], .size = sizes[i], .begin = begin, .end = end, .file = i,
+            };
+            begin = end;
+        }
+    }
+
+    pthread_t *tids = malloc(n_threads * sizeof(pthread_t));
+    PgnWorker *workers = malloc(n_threads * sizeof(PgnWorker));
+    int started = 0;
+    for (int i = 0; i < n_threads; i++) {
+        workers[i] = (PgnWorker){.job = &job, .thread = i};
+        if (pthread_create(&tids[i], NULL, readChunks, &workers[i]) != 0)
+            break;
+        started++;
+    }
+    if (started == 0)
+        readChunks(&workers[0]);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    games = atomic_load(&job.games);
+    free(tids);
+    free(workers);
+
+done:
+    for (int i = 0; i < n_paths; i++) {
+        if (maps[i] != NULL)
+            munmap((void *)maps[i], sizes[i]);
+    }
+    free(job.chunks);
+    free(maps);
+    free(sizes);
+    return games;
+}
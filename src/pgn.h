@@ -0,0 +1,83 @@
+#ifndef PGN_H
+#define PGN_H
+
+#include "board.h"
+#include "move.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Streaming reader of PGN game archives
+//
+// Games are read one at a time from a buffer, usually a memory mapped file,
+// without copying: tag names and values point into the buffer. Comments,
+// variations, NAGs and move numbers are skipped and the SAN moves of the main
+// line are resolved and replayed with moveMake() from the FEN tag or the
+// initial position.
+
+#define PGN_MAX_TAGS 32
+#define PGN_MAX_PLIES 1024
+
+typedef struct {
+    const char *name;
+    size_t name_length;
+    const char *value;      // without quotes, escapes (\" and \\) kept
+    size_t value_length;
+} PgnTag;
+
+typedef enum {
+    PGN_RESULT_UNKNOWN,     // * or missing
+    PGN_WHITE_WINS,
+    PGN_BLACK_WINS,
+    PGN_DRAW,
+} PgnResult;
+
+typedef enum {
+    PGN_OK,
+    PGN_BAD_FEN,            // moves are empty
+    PGN_BAD_MOVE,           // illegal or unreadable, moves end before it
+    PGN_TOO_LONG,           // more than PGN_MAX_PLIES moves, the rest is dropped
+} PgnError;
+
+typedef struct {
+    PgnTag tags[PGN_MAX_TAGS];
+    int tag_count;
+    Board start;
+    Move moves[PGN_MAX_PLIES];
+    int move_count;
+    Board end;              // after the last move read
+    PgnResult result;       // from the movetext, else from the Result tag
+    PgnError error;
+    size_t offset;          // of the game's first byte in the buffer
+    int file;               // index of the file with pgnReadFiles(), else 0
+} PgnGame;
+
+typedef struct {
+    const char *data, *pos, *end;
+    int file;
+} PgnReader;
+
+void pgnReaderInit(PgnReader *r, const char *data, size_t size);
+
+// Reads the next game, false at the end of the input
+bool pgnReadGame(PgnReader *r, PgnGame *game);
+
+// Value of a tag, NULL if the game doesn't have it
+const PgnTag *pgnFindTag(const PgnGame *game, const char *name);
+
+// Start of the first game at or after data + offset, for splitting a buffer
+// between threads. Returns size if there's none
+size_t pgnNextGameOffset(const char *data, size_t size, size_t offset);
+
+// Called for every game read by pgnReadFiles(), thread is the reader's
+// index in [0, n_threads)
+typedef void (*PgnGameCallback)(const PgnGame *game, int thread, void *data);
+
+// Reads every game of the files on n_threads threads, files are memory
+// mapped and large ones split at game boundaries. Games of one chunk come in
+// order, chunks in any order. Returns the number of games, -1 if a file
+// can't be read
+long pgnReadFiles(const char *const *paths, int n_paths, int n_threads,
+                  PgnGameCallback on_game, void *data);
+
+#endif // !PGN_H
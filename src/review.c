@@ -0,0 +1,460 @@
+#include "board.h"
+#include "engine.h"
+#include "notation.h"
+#include "output.h"
+#include "pgn.h"
+#include "transposition.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Review of whole games: the evaluation and best move of every position,
+// with the moves played flagged by how much they lose
+//
+// Usage: ./build/review games.pgn... [--threads n] [--depth n] [--nodes n]
+//                       [--movetime ms] [--hash mb] [--json] [--output file]
+//
+// Games are handed out to a pool of threads, each reviewing one game at a
+// time with single threaded searches to the given budget (100000 nodes if
+// none).
+//
+// A move's loss is the drop of the mover's evaluation from the position
+// before it to the position after it, with scores capped at SCORE_CAP so
+// that a longer mate doesn't count as a loss. Moves other than the best one
+// losing at least INACCURACY, MISTAKE or BLUNDER centipawns are flagged.
+// Games are written in input order as PGN with [%eval] comments (white's
+// point of view) and ?!, ? or ?? NAGs, or with --json as one line each:
+//   {"game":1,"white":"A","black":"B","result":"1-0","plies":[{"ply":1,
+//    "move":"e4","eval":{"cp":31},"best":"e4","best_eval":{"cp":31},
+//    "depth":9,"loss":0,"class":null},...],"summary":{"white":{"acpl":12,
+//    "inaccuracies":1,"mistakes":0,"blunders":0},"black":{...}}}
+
+#define DEFAULT_NODES 100000
+#define SCORE_CAP 1000
+#define INACCURACY 50
+#define MISTAKE 100
+#define BLUNDER 300
+
+#define PGN_LINE_LENGTH 79
+#define PENDING_PER_THREAD 4
+
+typedef enum {
+    MOVE_GOOD,
+    MOVE_INACCURACY,
+    MOVE_MISTAKE,
+    MOVE_BLUNDER,
+} MoveClass;
+
+static const char *const CLASS_NAMES[4] = {NULL, "inaccuracy", "mistake", "blunder"};
+static const char *const CLASS_NAGS[4] = {NULL, "$6", "$2", "$4"};     // ?!, ? and ??
+
+static const char *const RESULTS[4] = {"*", "1-0", "0-1", "1/2-1/2"};
+
+// Search result of one position of the game
+typedef struct {
+    int score;          // white's point of view
+    Move best;          // EMPTY_MOVE if the game is over
+    int depth;
+} PlyReview;
+
+typedef struct {
+    SearchLimits limits;
+    bool json;
+
+    // Games are read in order through all the files, mapped until the end
+    pthread_mutex_t input_lock;
+    const char **mappings;
+    size_t *sizes;
+    int file_count;
+    int file;
+    PgnReader reader;
+    int game_number;            // of the last game read
+
+    OrderedOutput output;
+
+    pthread_mutex_t stats_lock;
+    int reviewed;
+    int plies;
+    uint64_t nodes;
+} Review;
+
+// A PGN tag value as a JSON string, its \" and \\ escapes are valid JSON
+static void appendTagString(Text *t, const PgnTag *tag)
+{
+    textAppendf(t, "\"");
+    for (size_t i = 0; tag != NULL && i < tag->value_length; i++) {
+        char c = tag->value[i];
+        if (c == '\\' && i + 1 < tag->value_length
+            && (tag->value[i + 1] == '"' || tag->value[i + 1] == '\\'))
+            textAppendf(t, "\\%c", tag->value[++i]);
+        else if (c == '\\' || c == '"')
+            textAppendf(t, "\\%c", c);
+        else if ((unsigned char)c < 0x20)
+            textAppendf(t, "\\u%04x", c);
+        else
+            textAppendf(t, "%c", c);
+    }
+    textAppendf(t, "\"");
+}
+
+// Adds a movetext token, starting a new line if it doesn't fit
+static void appendToken(Text *t, int *column, const char *token)
+{
+    int len = strlen(token);
+    if (*column > 0 && *column + 1 + len > PGN_LINE_LENGTH) {
+        textAppendf(t, "\n");
+        *column = 0;
+    }
+    textAppendf(t, "%s%s", *column > 0 ? " " : "", token);
+    *column += (*column > 0) + len;
+}
+
+// Moves until mate, negative if white gets mated
+static int mateMoves(int score)
+{
+    int plies = MATE_SCORE - abs(score);
+    return score > 0 ? (plies + 1) / 2 : -(plies + 1) / 2;
+}
+
+static void appendEvalJson(Text *t, int score)
+{
+    if (IS_MATE_SCORE(score))
+        textAppendf(t, "{\"mate\":%d}", mateMoves(score));
+    else
+        textAppendf(t, "{\"cp\":%d}", score);
+}
+
+static int capScore(int score)
+{
+    return MAX(-SCORE_CAP, MIN(score, SCORE_CAP));
+}
+
+// Centipawns the mover gives up going from before to after
+static int moveLoss(const Board *b, const PlyReview *before, const PlyReview *after)
+{
+    int sign = (b->color_to_move & WHITE) ? 1 : -1;
+    return MAX(0, sign * (capScore(before->score) - capScore(after->score)));
+}
+
+static MoveClass classifyMove(Move played, const PlyReview *before, int loss)
+{
+    if (played == before->best)
+        return MOVE_GOOD;
+    if (loss >= BLUNDER)
+        return MOVE_BLUNDER;
+    if (loss >= MISTAKE)
+        return MOVE_MISTAKE;
+    return loss >= INACCURACY ? MOVE_INACCURACY : MOVE_GOOD;
+}
+
+// Searches b, positions with a single legal move too. Returns the nodes
+// searched
+static uint64_t reviewPosition(const SearchLimits *limits, const Board *b,
+                               const uint64_t *history, int history_count, PlyReview *out)
+{
+    MoveList mlist = generateMoves(b);
+    bool white = b->color_to_move & WHITE;
+    if (mlist.count == 0) {
+        bool mated = isKingChecked(b, b->color_to_move);
+        *out = (PlyReview){.score = mated ? (white ? -MATE_SCORE : MATE_SCORE) : 0,
+                           .best = EMPTY_MOVE};
+        return 0;
+    }
+
+    SearchContext ctx = {
+        .limits = *limits,
+        .threads = 1,
+        .history = history,
+        .history_count = history_count,
+        .search_single_move = true,
+    };
+    atomic_init(&ctx.stop, false);
+    atomic_init(&ctx.ponder, false);
+    atomic_init(&ctx.nodes, 0);
+    SearchInfo info;
+    out->best = findBestMove(b, &ctx, &info);
+    out->score = info.score;
+    out->depth = info.depth;
+    return info.nodes;
+}
+
+typedef struct {
+    int moves;
+    int loss;
+    int classes[4];
+} SideSummary;
+
+static void writePgn(Text *t, const PgnGame *game, const Board *boards, const PlyReview *plies)
+{
+    for (int i = 0; i < game->tag_count; i++) {
+        const PgnTag *tag = &game->tags[i];
+        textAppendf(t, "[%.*s \"%.*s\"]\n", (int)tag->name_length, tag->name,
+                (int)tag->value_length, tag->value);
+    }
+    textAppendf(t, "\n");
+
+    int column = 0;
+    char token[128];
+    for (int i = 0; i < game->move_count; i++) {
+        const Board *b = &boards[i];
+        bool white = b->color_to_move & WHITE;
+        snprintf(token, sizeof(token), white ? "%d." : "%d...", b->fullmoves);
+        appendToken(t, &column, token);
+
+        char san[SAN_MAX_LENGTH], best[SAN_MAX_LENGTH];
+        writeSan(b, game->moves[i], san);
+        int loss = moveLoss(b, &plies[i], &plies[i + 1]);
+        MoveClass class = classifyMove(game->moves[i], &plies[i], loss);
+        appendToken(t, &column, san);
+        if (class != MOVE_GOOD)
+            appendToken(t, &column, CLASS_NAGS[class]);
+        if (plies[i + 1].best == EMPTY_MOVE)
+            continue;
+
+        int score = plies[i + 1].score;
+        char eval[32];
+        if (IS_MATE_SCORE(score))
+            snprintf(eval, sizeof(eval), "#%d", mateMoves(score));
+        else
+            snprintf(eval, sizeof(eval), "%.2lf", score / 100.0);
+        if (class != MOVE_GOOD) {
+            writeSan(b, plies[i].best, best);
+            snprintf(token, sizeof(token), "{ [%%eval %s] %c%s, %s was best }", eval,
+                     CLASS_NAMES[class][0] - 'a' + 'A', CLASS_NAMES[class] + 1, best);
+        }
+        else
+            snprintf(token, sizeof(token), "{ [%%eval %s] }", eval);
+        appendToken(t, &column, token);
+    }
+    if (game->error != PGN_OK)
+        appendToken(t, &column, "{ Not reviewed past an unreadable or illegal move }");
+    appendToken(t, &column, RESULTS[game->result]);
+    textAppendf(t, "\n\n");
+}
+
+static void writeJson(Text *t, int number, const PgnGame *game, const Board *boards,
+                      const PlyReview *plies)
+{
+    textAppendf(t, "{\"game\":%d,\"white\":", number);
+    appendTagString(t, pgnFindTag(game, "White"));
+    textAppendf(t, ",\"black\":");
+    appendTagString(t, pgnFindTag(game, "Black"));
+    textAppendf(t, ",\"result\":\"%s\",\"plies\":[", RESULTS[game->result]);
+
+    SideSummary sides[2] = {0};
+    for (int i = 0; i < game->move_count; i++) {
+        const Board *b = &boards[i];
+        char san[SAN_MAX_LENGTH], best[SAN_MAX_LENGTH];
+        writeSan(b, game->moves[i], san);
+        writeSan(b, plies[i].best, best);
+        int loss = moveLoss(b, &plies[i], &plies[i + 1]);
+        MoveClass class = classifyMove(game->moves[i], &plies[i], loss);
+        SideSummary *side = &sides[(b->color_to_move & WHITE) ? 0 : 1];
+        side->moves++;
+        side->loss += loss;
+        side->classes[class]++;
+
+        textAppendf(t, "%s{\"ply\":%d,\"move\":\"%s\",\"eval\":", i > 0 ? "," : "", i + 1, san);
+        appendEvalJson(t, plies[i + 1].score);
+        textAppendf(t, ",\"best\":\"%s\",\"best_eval\":", best);
+        appendEvalJson(t, plies[i].score);
+        textAppendf(t, ",\"depth\":%d,\"loss\":%d,\"class\":", plies[i].depth, loss);
+        if (class != MOVE_GOOD)
+            textAppendf(t, "\"%s\"}", CLASS_NAMES[class]);
+        else
+            textAppendf(t, "null}");
+    }
+
+    textAppendf(t, "],\"summary\":{");
+    for (int c = 0; c < 2; c++) {
+        const SideSummary *side = &sides[c];
+        textAppendf(t, "%s\"%s\":{\"acpl\":%d,\"inaccuracies\":%d,\"mistakes\":%d,\"blunders\":%d}",
+                c > 0 ? "," : "", c == 0 ? "white" : "black",
+                side->moves > 0 ? side->loss / side->moves : 0, side->classes[MOVE_INACCURACY],
+                side->classes[MOVE_MISTAKE], side->classes[MOVE_BLUNDER]);
+    }
+    textAppendf(t, "}");
+    if (game->error != PGN_OK)
+        textAppendf(t, ",\"error\":\"%s\"", game->error == PGN_BAD_FEN ? "bad fen" : "bad move");
+    textAppendf(t, "}\n");
+}
+
+// Reviews the game into t
+static void reviewGame(Review *review, int number, const PgnGame *game, Text *t)
+{
+    int n = game->error == PGN_BAD_FEN ? 0 : game->move_count;
+    Board *boards = malloc((n + 1) * sizeof(Board));
+    uint64_t *hashes = malloc((n + 1) * sizeof(uint64_t));
+    PlyReview *plies = malloc((n + 1) * sizeof(PlyReview));
+    boards[0] = game->start;
+    for (int i = 0; i < n; i++)
+        boards[i + 1] = moveMake(game->moves[i], boards[i]);
+    for (int i = 0; i <= n; i++)
+        hashes[i] = boards[i].zobrist_hash;
+
+    uint64_t nodes = 0;
+    for (int i = 0; i <= n; i++)
+        nodes += reviewPosition(&review->limits, &boards[i], hashes, i, &plies[i]);
+
+    if (review->json)
+        writeJson(t, number, game, boards, plies);
+    else
+        writePgn(t, game, boards, plies);
+
+    pthread_mutex_lock(&review->stats_lock);
+    review->reviewed++;
+    review->plies += n;
+    review->nodes += nodes;
+    pthread_mutex_unlock(&review->stats_lock);
+    free(boards);
+    free(hashes);
+    free(plies);
+}
+
+// Reads the next game, returns its number, 0 after the last file
+static int readGame(Review *review, PgnGame *game)
+{
+    pthread_mutex_lock(&review->input_lock);
+    int number = 0;
+    while (review->file < review->file_count) {
+        if (pgnReadGame(&review->reader, game)) {
+            number = ++review->game_number;
+            break;
+        }
+        if (++review->file < review->file_count)
+            pgnReaderInit(&review->reader, review->mappings[review->file],
+                          review->sizes[review->file]);
+    }
+    pthread_mutex_unlock(&review->input_lock);
+    return number;
+}
+
+static void *reviewThread(void *arg)
+{
+    Review *review = arg;
+    PgnGame *game = malloc(sizeof(PgnGame));
+    int number;
+    while ((number = readGame(review, game)) != 0) {
+        Text t = {0};
+        reviewGame(review, number, game, &t);
+        orderedOutputWrite(&review->output, number, &t);
+    }
+    free(game);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    const char **paths = calloc(argc, sizeof(char *));
+    int path_count = 0, n_threads = sysconf(_SC_NPROCESSORS_ONLN), hash_mb = TT_DEFAULT_MB;
+    bool json = false, usage = false;
+    SearchLimits limits = {0};
+    for (int i = 1; i < argc && !usage; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            n_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+            limits.depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc)
+            limits.nodes = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--movetime") == 0 && i + 1 < argc)
+            limits.movetime = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc)
+            hash_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (argv[i][0] != '-')
+            paths[path_count++] = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || path_count == 0) {
+        fprintf(stderr, "Usage: %s games.pgn... [--threads n] [--depth n] [--nodes n] "
+                        "[--movetime ms] [--hash mb] [--json] [--output file]\n", argv[0]);
+        free(paths);
+        return 1;
+    }
+    n_threads = MAX(1, MIN(n_threads, 256));
+    if (limits.depth <= 0 && limits.nodes == 0 && limits.movetime <= 0)
+        limits.nodes = DEFAULT_NODES;
+
+    precomputeValues();
+    if (hash_mb > 0 && !setTranspositionTableSize(hash_mb)) {
+        fprintf(stderr, "review: can't allocate %d MB hash\n", hash_mb);
+        return 1;
+    }
+
+    static Review review = {
+        .input_lock = PTHREAD_MUTEX_INITIALIZER,
+        .stats_lock = PTHREAD_MUTEX_INITIALIZER,
+    };
+    review.limits = limits;
+    review.json = json;
+    review.mappings = calloc(path_count, sizeof(char *));
+    review.sizes = calloc(path_count, sizeof(size_t));
+    review.file_count = path_count;
+    for (int i = 0; i < path_count; i++) {
+        int fd = open(paths[i], O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            fprintf(stderr, "review: can't open %s\n", paths[i]);
+            return 1;
+        }
+        review.sizes[i] = st.st_size;
+        void *mapping = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+                                       : NULL;
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            fprintf(stderr, "review: can't mmap %s\n", paths[i]);
+            return 1;
+        }
+        review.mappings[i] = mapping;
+    }
+    pgnReaderInit(&review.reader, review.mappings[0], review.sizes[0]);
+    FILE *out = output == NULL ? stdout : fopen(output, "w");
+    if (out == NULL) {
+        fprintf(stderr, "review: can't open %s\n", output);
+        return 1;
+    }
+    orderedOutputInit(&review.output, out, true, 1, PENDING_PER_THREAD * n_threads);
+
+    double start = wallTimeMs();
+    pthread_t *tids = malloc(n_threads * sizeof(pthread_t));
+    int started = 0;
+    for (int i = 0; i < n_threads; i++) {
+        if (pthread_create(&tids[i], NULL, reviewThread, &review) != 0)
+            break;
+        started++;
+    }
+    if (started == 0)
+        reviewThread(&review);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    double seconds = (wallTimeMs() - start) / 1000;
+
+    fprintf(stderr, "Reviewed %d games, %d plies in %.1lf s with %d threads, %lu nodes, %.0lf nps\n",
+            review.reviewed, review.plies, seconds, MAX(started, 1), (unsigned long)review.nodes,
+            seconds > 0 ? review.nodes / seconds : 0);
+
+    for (int i = 0; i < path_count; i++) {
+        if (review.mappings[i] != NULL)
+            munmap((void *)review.mappings[i], review.sizes[i]);
+    }
+    free(review.mappings);
+    free(review.sizes);
+    orderedOutputFree(&review.output);
+    free(tids);
+    free(paths);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "rules.h"
+#include "engine.h"
+#include "utils.h"
+
+#include <stdlib.h>
+
+static const char *GAME_END_STRINGS[] = {
+    [GAME_ONGOING] = "ongoing",
+    [GAME_CHECKMATE] = "checkmate",
+    [GAME_STALEMATE] = "stalemate",
+    [GAME_FIFTY_MOVES] = "50 move rule",
+    [GAME_REPETITION] = "threefold repetition",
+    [GAME_INSUFFICIENT_MATERIAL] = "insufficient material",
+};
+
+static bool isInsufficientMaterial(const Board *b)
+{
+    int minors = 0;
+    for (int c = 0; c < 2; c++) {
+        const uint64_t *bb = b->bitboards[c];
+        if (bb[PAWN_IDX] | bb[ROOK_IDX] | bb[QUEEN_IDX])
+            return false;
+        minors += POPCOUNT(bb[KNIGHT_IDX] | bb[BISHOP_IDX]);
+    }
+    return minors <= 1;
+}
+
+// Whether b occurred twice before, only positions since the last capture or
+// pawn move can
+static bool isThreefold(const Board *b, const uint64_t *history, int count)
+{
+    int seen = 0;
+    for (int i = count - 2; i >= 0 && i >= count - b->halfmove_clock; i -= 2)
+        seen += history[i] == b->zobrist_hash;
+    return seen >= 2;
+}
+
+GameEnd gameEnd(const Board *b, const uint64_t *history, int count)
+{
+    if (generateMoves(b).count == 0)
+        return isKingChecked(b, b->color_to_move) ? GAME_CHECKMATE : GAME_STALEMATE;
+    if (b->halfmove_clock >= 100)
+        return GAME_FIFTY_MOVES;
+    if (isThreefold(b, history, count))
+        return GAME_REPETITION;
+    if (isInsufficientMaterial(b))
+        return GAME_INSUFFICIENT_MATERIAL;
+    return GAME_ONGOING;
+}
+
+const char *gameEndString(GameEnd end)
+{
+    return GAME_END_STRINGS[end];
+}
+
+Adjudication adjudicate(Adjudicator *a, int white_score, int ply)
+{
+    int sign = white_score > 0 ? 1 : -1;
+    a->winning_plies = abs(white_score) >= RESIGN_SCORE
+                               && (a->winning_plies == 0 || sign == a->last_sign)
+                           ? a->winning_plies + 1
+                           : 0;
+    a->last_sign = sign;
+    a->drawn_plies = abs(white_score) <= DRAW_SCORE ? a->drawn_plies + 1 : 0;
+    if (a->winning_plies >= RESIGN_PLIES)
+        return sign > 0 ? ADJUDICATE_WHITE_WINS : ADJUDICATE_BLACK_WINS;
+    if (a->drawn_plies >= DRAW_PLIES && ply >= DRAW_MIN_PLY)
+        return ADJUDICATE_DRAW;
+    return ADJUDICATE_NONE;
+}
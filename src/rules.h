@@ -0,0 +1,55 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include "board.h"
+
+#include <stdint.h>
+
+// How a game stands by the rules, for the programs playing whole games
+// (selfplay, match). Draws are claimed as soon as they can be: the 50 move
+// rule at 100 halfmoves, a third occurrence of a position, or neither side
+// having more than one minor piece and no pawns, rooks or queens
+
+typedef enum {
+    GAME_ONGOING,
+    GAME_CHECKMATE,             // the side to move lost
+    GAME_STALEMATE,
+    GAME_FIFTY_MOVES,
+    GAME_REPETITION,
+    GAME_INSUFFICIENT_MATERIAL,
+} GameEnd;
+
+// history holds the Zobrist hashes of the count positions before b, oldest
+// first. Mate takes precedence over the draw rules
+GameEnd gameEnd(const Board *b, const uint64_t *history, int count);
+const char *gameEndString(GameEnd end);
+
+// Adjudication from the scores of the searches: a game is won once the
+// score stays above RESIGN_SCORE for RESIGN_PLIES plies, and drawn once it
+// stays within DRAW_SCORE for DRAW_PLIES plies after DRAW_MIN_PLY
+#define RESIGN_SCORE 1000
+#define RESIGN_PLIES 6
+#define DRAW_SCORE 10
+#define DRAW_PLIES 12
+#define DRAW_MIN_PLY 80
+
+typedef enum {
+    ADJUDICATE_NONE,
+    ADJUDICATE_WHITE_WINS,
+    ADJUDICATE_BLACK_WINS,
+    ADJUDICATE_DRAW,
+} Adjudication;
+
+// Counters of one game, zero initialized
+typedef struct {
+    int winning_plies;
+    int drawn_plies;
+    int last_sign;
+} Adjudicator;
+
+// Counts the score of the search at ply (plies played so far), from
+// white's point of view. Only plies with a score count: moves played
+// without a search (forced or book moves) are left out
+Adjudication adjudicate(Adjudicator *a, int white_score, int ply);
+
+#endif // !RULES_H
@@ -0,0 +1,329 @@
+#include "board.h"
+#include "engine.h"
+#include "packed.h"
+#include "rules.h"
+#include "transposition.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Self-play generation of scored positions for tuning, on all cores
+//
+// Usage: ./build/selfplay output.pack [--games n] [--threads n] [--nodes n]
+//                         [--depth n] [--random-plies n] [--hash mb]
+//                         [--seed n]
+//
+// Each thread plays games against itself: random-plies random moves (8 by
+// default) then every move searched single threaded with the node (5000 by
+// default) or depth budget, sharing the transposition table. A position is
+// kept when the side to move isn't in check, the best move is quiet (no
+// capture or promotion) and the score isn't a mate, with the score (side to
+// move's point of view) and best move. Once the game is over its result is
+// set in all its positions, which are handed to a writer thread appending
+// them to the packed file (packed.h).
+//
+// Games end by the rules, are adjudicated from the scores of the searches
+// (both in rules.h), or are drawn after MAX_SELFPLAY_PLIES.
+// Progress, with positions per second and each thread's nodes per second,
+// is printed to stderr every few seconds.
+
+#define DEFAULT_GAMES 1000
+#define DEFAULT_NODES 5000
+#define DEFAULT_RANDOM_PLIES 8
+#define MAX_SELFPLAY_PLIES 400
+
+#define REPORT_INTERVAL_MS 5000
+
+// Positions of finished games waiting for the writer thread
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    PackedPosition *buffer;
+    size_t count, capacity;
+    bool done;                  // no more games are coming
+    PackedWriter writer;
+    bool failed;
+} Output;
+
+typedef struct {
+    SearchLimits limits;
+    int random_plies;
+    int games;
+    Output output;
+
+    _Atomic int games_started;
+    _Atomic int games_done;
+    _Atomic uint64_t positions;
+    _Atomic int results[4];     // by PackedResult
+} Generator;
+
+typedef struct {
+    Generator *gen;
+    uint64_t rng;           // nextRandom() state of this thread
+    _Atomic uint64_t nodes;
+} Worker;
+
+static void submitGame(Output *out, const PackedPosition *positions, size_t n)
+{
+    pthread_mutex_lock(&out->lock);
+    if (out->count + n > out->capacity) {
+        out->capacity = MAX(2 * out->capacity, out->count + n);
+        out->buffer = realloc(out->buffer, out->capacity * sizeof(PackedPosition));
+    }
+    memcpy(out->buffer + out->count, positions, n * sizeof(PackedPosition));
+    out->count += n;
+    pthread_cond_signal(&out->ready);
+    pthread_mutex_unlock(&out->lock);
+}
+
+// Swaps the shared buffer for its own and writes outside of the lock, so
+// players never wait on the disk
+static void *writerThread(void *arg)
+{
+    Output *out = arg;
+    PackedPosition *spare = NULL;
+    size_t spare_capacity = 0;
+    pthread_mutex_lock(&out->lock);
+    for (;;) {
+        while (out->count == 0 && !out->done)
+            pthread_cond_wait(&out->ready, &out->lock);
+        if (out->count == 0)
+            break;
+
+        PackedPosition *full = out->buffer;
+        size_t n = out->count, full_capacity = out->capacity;
+        out->buffer = spare;
+        out->capacity = spare_capacity;
+        out->count = 0;
+        pthread_mutex_unlock(&out->lock);
+
+        if (!packedWrite(&out->writer, full, n))
+            out->failed = true;
+        spare = full;
+        spare_capacity = full_capacity;
+        pthread_mutex_lock(&out->lock);
+    }
+    pthread_mutex_unlock(&out->lock);
+    free(spare);
+    return NULL;
+}
+
+// Random moves from the initial position, again if they end the game
+static Board randomOpening(Worker *w, uint64_t *history, int *ply)
+{
+    const Board start = initBoardFromFen(START_FEN);
+    for (;;) {
+        Board b = start;
+        *ply = 0;
+        while (*ply < w->gen->random_plies) {
+            MoveList mlist = generateMoves(&b);
+            if (mlist.count == 0)
+                break;
+            history[(*ply)++] = b.zobrist_hash;
+            b = moveMake(mlist.moves[nextRandom(&w->rng) % mlist.count], b);
+        }
+        if (*ply == w->gen->random_plies && generateMoves(&b).count > 0)
+            return b;
+    }
+}
+
+static void playGame(Worker *w, PackedPosition *positions)
+{
+    Generator *gen = w->gen;
+    uint64_t history[MAX_SELFPLAY_PLIES];
+    int ply, n = 0;
+    Board b = randomOpening(w, history, &ply);
+
+    Adjudicator adjudicator = {0};
+    PackedResult result = PACKED_RESULT_UNKNOWN;
+    while (result == PACKED_RESULT_UNKNOWN) {
+        GameEnd end = gameEnd(&b, history, ply);
+        if (end == GAME_CHECKMATE) {
+            result = b.color_to_move == WHITE ? PACKED_BLACK_WINS : PACKED_WHITE_WINS;
+            break;
+        }
+        if (end != GAME_ONGOING || ply >= MAX_SELFPLAY_PLIES) {
+            result = PACKED_DRAW;
+            break;
+        }
+        bool in_check = isKingChecked(&b, b.color_to_move);
+
+        SearchContext ctx = {
+            .limits = gen->limits,
+            .threads = 1,
+            .history = history,
+            .history_count = ply,
+        };
+        atomic_init(&ctx.stop, false);
+        atomic_init(&ctx.ponder, false);
+        atomic_init(&ctx.nodes, 0);
+        SearchInfo info;
+        Move best_move = findBestMove(&b, &ctx, &info);
+        atomic_fetch_add(&w->nodes, info.nodes);
+
+        // Single legal moves are played without a search, depth 0 and no
+        // score, so they are neither recorded nor counted for adjudication
+        if (info.depth > 0) {
+            int score = b.color_to_move == WHITE ? info.score : -info.score;
+            if (!in_check && !(getMoveFlag(best_move) & (CAPTURE | PROMOTION))
+                && !IS_MATE_SCORE(score)) {
+                packPosition(&b, &positions[n]);
+                positions[n].score = score;
+                positions[n].best_move = best_move;
+                n++;
+            }
+
+            Adjudication adjudication = adjudicate(&adjudicator, info.score, ply);
+            if (adjudication == ADJUDICATE_WHITE_WINS)
+                result = PACKED_WHITE_WINS;
+            else if (adjudication == ADJUDICATE_BLACK_WINS)
+                result = PACKED_BLACK_WINS;
+            else if (adjudication == ADJUDICATE_DRAW)
+                result = PACKED_DRAW;
+        }
+
+        history[ply++] = b.zobrist_hash;
+        b = moveMake(best_move, b);
+    }
+
+    for (int i = 0; i < n; i++)
+        packedSetResult(&positions[i], result);
+    submitGame(&gen->output, positions, n);
+    atomic_fetch_add(&gen->positions, n);
+    atomic_fetch_add(&gen->results[result], 1);
+    atomic_fetch_add(&gen->games_done, 1);
+}
+
+static void *playThread(void *arg)
+{
+    Worker *w = arg;
+    PackedPosition *positions = malloc(MAX_SELFPLAY_PLIES * sizeof(PackedPosition));
+    while (atomic_fetch_add(&w->gen->games_started, 1) < w->gen->games)
+        playGame(w, positions);
+    free(positions);
+    return NULL;
+}
+
+static void printProgress(Generator *gen, const Worker *workers, int n_workers, double ms)
+{
+    uint64_t positions = atomic_load(&gen->positions);
+    fprintf(stderr, "games %d/%d, positions %lu (%.0lf/s), +%d =%d -%d, knps",
+            atomic_load(&gen->games_done), gen->games, (unsigned long)positions,
+            ms > 0 ? positions * 1000.0 / ms : 0, atomic_load(&gen->results[PACKED_WHITE_WINS]),
+            atomic_load(&gen->results[PACKED_DRAW]), atomic_load(&gen->results[PACKED_BLACK_WINS]));
+    for (int i = 0; i < n_workers; i++)
+        fprintf(stderr, " %.0lf", ms > 0 ? atomic_load(&workers[i].nodes) / ms : 0);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    int n_threads = sysconf(_SC_NPROCESSORS_ONLN), hash_mb = TT_DEFAULT_MB;
+    int games = DEFAULT_GAMES, random_plies = DEFAULT_RANDOM_PLIES;
+    uint64_t seed = time(NULL);
+    SearchLimits limits = {0};
+    bool usage = false;
+    for (int i = 1; i < argc && !usage; i++) {
+        if (strcmp(argv[i], "--games") == 0 && i + 1 < argc)
+            games = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            n_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc)
+            limits.nodes = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+            limits.depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--random-plies") == 0 && i + 1 < argc)
+            random_plies = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc)
+            hash_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (output == NULL && argv[i][0] != '-')
+            output = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || output == NULL || games <= 0 || random_plies < 0
+        || random_plies >= MAX_SELFPLAY_PLIES) {
+        fprintf(stderr, "Usage: %s output.pack [--games n] [--threads n] [--nodes n] "
+                        "[--depth n] [--random-plies n] [--hash mb] [--seed n]\n", argv[0]);
+        return 1;
+    }
+    n_threads = MAX(1, MIN(n_threads, 256));
+    if (limits.depth <= 0 && limits.nodes == 0)
+        limits.nodes = DEFAULT_NODES;
+
+    precomputeValues();
+    if (hash_mb > 0 && !setTranspositionTableSize(hash_mb)) {
+        fprintf(stderr, "selfplay: can't allocate %d MB hash\n", hash_mb);
+        return 1;
+    }
+
+    static Generator gen = {
+        .output = {
+            .lock = PTHREAD_MUTEX_INITIALIZER,
+            .ready = PTHREAD_COND_INITIALIZER,
+        },
+    };
+    gen.limits = limits;
+    gen.random_plies = random_plies;
+    gen.games = games;
+    if (!packedWriterOpen(&gen.output.writer, output))
+        return 1;
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, writerThread, &gen.output) != 0) {
+        fprintf(stderr, "selfplay: can't start the writer thread\n");
+        return 1;
+    }
+
+    double start = wallTimeMs();
+    Worker *workers = calloc(n_threads, sizeof(Worker));
+    pthread_t *tids = malloc(n_threads * sizeof(pthread_t));
+    int started = 0;
+    for (int i = 0; i < n_threads; i++) {
+        workers[i].gen = &gen;
+        workers[i].rng = (seed + i + 1) * 0x9e3779b97f4a7c15ull;
+        if (pthread_create(&tids[i], NULL, playThread, &workers[i]) != 0)
+            break;
+        started++;
+    }
+    if (started == 0)
+        playThread(&workers[0]);
+    int n_workers = MAX(started, 1);
+
+    // Reports until every game is played
+    double last_report = start;
+    while (atomic_load(&gen.games_done) < games) {
+        usleep(100 * 1000);
+        if (wallTimeMs() - last_report >= REPORT_INTERVAL_MS) {
+            last_report = wallTimeMs();
+            printProgress(&gen, workers, n_workers, last_report - start);
+        }
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    pthread_mutex_lock(&gen.output.lock);
+    gen.output.done = true;
+    pthread_cond_signal(&gen.output.ready);
+    pthread_mutex_unlock(&gen.output.lock);
+    pthread_join(writer, NULL);
+    bool ok = packedWriterClose(&gen.output.writer) && !gen.output.failed;
+
+    printProgress(&gen, workers, n_workers, wallTimeMs() - start);
+    fprintf(stderr, "Wrote %lu positions to %s in %.1lf s\n", (unsigned long)gen.output.writer.count,
+            output, (wallTimeMs() - start) / 1000);
+    free(gen.output.buffer);
+    free(workers);
+    free(tids);
+    if (!ok)
+        fprintf(stderr, "selfplay: can't write %s\n", output);
+    return ok ? 0 : 1;
+}
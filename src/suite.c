@@ -0,0 +1,233 @@
+#include "board.h"
+#include "engine.h"
+#include "epd.h"
+#include "transposition.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Tactical test suite runner, measures how long the search takes to find
+// the solutions of an EPD suite (bm and am opcodes)
+//
+// Usage: ./build/suite suite.epd [--movetime ms] [--threads n] [--hash mb]
+//                      [--csv file]
+//
+// Each position is searched for movetime ms (1000 by default) with a cleared
+// hash. A position is solved at the first completed iteration whose best
+// move is a bm move (or no am move) and stays so until the end of the
+// search. The number of positions solved within growing times is printed as
+// a curve, and the per position results are written as CSV, so two builds
+// can be compared on the same suite.
+
+#define DEFAULT_MOVETIME 1000
+
+typedef struct {
+    const EpdRecord *rec;
+    // Earliest iteration since which the best move has been correct
+    bool found;
+    double found_ms;
+    uint64_t found_nodes;
+    int found_depth;
+} Attempt;
+
+static bool isSolution(const EpdRecord *rec, Move m)
+{
+    if (m == EMPTY_MOVE)
+        return false;
+    for (int i = 0; i < rec->avoid_move_count; i++) {
+        if (rec->avoid_moves[i] == m)
+            return false;
+    }
+    if (rec->best_move_count == 0)
+        return true;
+    for (int i = 0; i < rec->best_move_count; i++) {
+        if (rec->best_moves[i] == m)
+            return true;
+    }
+    return false;
+}
+
+static void onIteration(const SearchInfo *info, void *data)
+{
+    Attempt *attempt = data;
+    if (info->pv_length == 0 || !isSolution(attempt->rec, info->pv[0])) {
+        attempt->found = false;
+        return;
+    }
+    if (attempt->found)
+        return;
+    attempt->found = true;
+    attempt->found_ms = info->ms;
+    attempt->found_nodes = info->nodes;
+    attempt->found_depth = info->depth;
+}
+
+static void writeCsvField(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; *str != '\0'; str++) {
+        if (*str == '"')
+            fputc('"', f);
+        fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+int main(int argc, char **argv)
+{
+    const char *input = NULL, *csv_path = NULL;
+    int movetime = DEFAULT_MOVETIME, n_threads = 1, hash_mb = TT_DEFAULT_MB;
+    bool usage = false;
+    for (int i = 1; i < argc && !usage; i++) {
+        if (strcmp(argv[i], "--movetime") == 0 && i + 1 < argc)
+            movetime = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            n_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc)
+            hash_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+            csv_path = argv[++i];
+        else if (input == NULL && argv[i][0] != '-')
+            input = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || input == NULL || movetime <= 0) {
+        fprintf(stderr, "Usage: %s suite.epd [--movetime ms] [--threads n] [--hash mb] "
+                        "[--csv file]\n", argv[0]);
+        return 1;
+    }
+    n_threads = MAX(1, MIN(n_threads, 256));
+
+    precomputeValues();
+    if (hash_mb > 0 && !setTranspositionTableSize(hash_mb)) {
+        fprintf(stderr, "suite: can't allocate %d MB hash\n", hash_mb);
+        return 1;
+    }
+
+    FILE *f = fopen(input, "r");
+    if (f == NULL) {
+        fprintf(stderr, "suite: can't open %s\n", input);
+        return 1;
+    }
+    FILE *csv = NULL;
+    if (csv_path != NULL && (csv = fopen(csv_path, "w")) == NULL) {
+        fprintf(stderr, "suite: can't open %s\n", csv_path);
+        return 1;
+    }
+    if (csv != NULL)
+        fprintf(csv, "line,id,bm,am,best_move,solved,solve_ms,solve_nodes,solve_depth,"
+                     "depth,nodes,ms\n");
+
+    // Solve times in ms, for the curve
+    double *solve_times = NULL;
+    int solved = 0, total = 0, line_number = 0;
+    char *line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, f) != -1) {
+        line_number++;
+        const char *text = line + strspn(line, " \t\r\n");
+        if (*text == '\0' || *text == '#')
+            continue;
+
+        EpdRecord rec;
+        EpdError err = parseEpd(line, strlen(line), &rec);
+        if (err == EPD_OK && rec.best_move_count == 0 && rec.avoid_move_count == 0)
+            err = EPD_BAD_OPERATION;
+        if (err != EPD_OK) {
+            fprintf(stderr, "suite: line %d skipped, %s\n", line_number,
+                    err == EPD_BAD_FEN ? fenErrorString(rec.fen_error)
+                                       : err == EPD_BAD_OPERATION ? "no bm or am"
+                                                                  : epdErrorString(err));
+            continue;
+        }
+
+        Attempt attempt = {.rec = &rec};
+        SearchContext ctx = {
+            .limits = {.movetime = movetime},
+            .threads = n_threads,
+            .on_iteration = onIteration,
+            .callback_data = &attempt,
+        };
+        atomic_init(&ctx.stop, false);
+        atomic_init(&ctx.ponder, false);
+        atomic_init(&ctx.nodes, 0);
+        clearTranspositionTable();
+        SearchInfo info;
+        Move best_move = findBestMove(&rec.board, &ctx, &info);
+
+        // The last, unfinished iteration can still change the move
+        bool is_solved = isSolution(&rec, best_move);
+        if (is_solved && !attempt.found) {
+            attempt.found_ms = info.ms;
+            attempt.found_nodes = info.nodes;
+            attempt.found_depth = info.depth;
+        }
+        total++;
+        if (is_solved) {
+            solve_times = realloc(solve_times, (solved + 1) * sizeof(double));
+            solve_times[solved++] = attempt.found_ms;
+        }
+
+        char best_str[10] = "", move_str[10];
+        if (best_move != EMPTY_MOVE)
+            printMoveToString(best_str, sizeof(best_str), best_move, false);
+        printf("%4d %-20.20s %-5s %-6s", total, rec.id[0] != '\0' ? rec.id : "-", best_str,
+               is_solved ? "solved" : "-");
+        if (is_solved)
+            printf(" %8.0lf ms %10lu nodes depth %d", attempt.found_ms,
+                   (unsigned long)attempt.found_nodes, attempt.found_depth);
+        printf("\n");
+        fflush(stdout);
+
+        if (csv != NULL) {
+            fprintf(csv, "%d,", line_number);
+            writeCsvField(csv, rec.id);
+            const Move *lists[2] = {rec.best_moves, rec.avoid_moves};
+            const int counts[2] = {rec.best_move_count, rec.avoid_move_count};
+            for (int l = 0; l < 2; l++) {
+                fputc(',', csv);
+                for (int i = 0; i < counts[l]; i++) {
+                    printMoveToString(move_str, sizeof(move_str), lists[l][i], false);
+                    fprintf(csv, "%s%s", i > 0 ? " " : "", move_str);
+                }
+            }
+            fprintf(csv, ",%s,%d,", best_str, is_solved);
+            if (is_solved)
+                fprintf(csv, "%.1lf,%lu,%d", attempt.found_ms, (unsigned long)attempt.found_nodes,
+                        attempt.found_depth);
+            else
+                fprintf(csv, ",,");
+            fprintf(csv, ",%d,%lu,%.1lf\n", info.depth, (unsigned long)info.nodes, info.ms);
+            fflush(csv);
+        }
+    }
+
+    // Solved within each time, in steps of 1, 2, 5 up to the move time
+    printf("\nSolved %d of %d positions with %d ms per position, %d threads\n", solved, total,
+           movetime, n_threads);
+    printf("%10s %8s\n", "time_ms", "solved");
+    const int steps[3] = {1, 2, 5};
+    long scale = 1;
+    for (int i = 0;; i++) {
+        if (i > 0 && i % 3 == 0)
+            scale *= 10;
+        long limit = MIN(steps[i % 3] * scale, movetime);
+        int count = 0;
+        for (int j = 0; j < solved; j++)
+            count += solve_times[j] <= limit;
+        printf("%10ld %8d\n", limit, count);
+        if (limit == movetime)
+            break;
+    }
+
+    free(solve_times);
+    free(line);
+    fclose(f);
+    if (csv != NULL)
+        fclose(csv);
+    return 0;
+}
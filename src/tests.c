@@ -1,16 +1,56 @@
+#include "bitbase.h"
 #include "board.h"
+#include "book.h"
+#include "dataset.h"
 #include "engine.h"
+#include "enginethread.h"
+#include "epd.h"
+#include "evalcache.h"
+#include "gameindex.h"
+#include "generator.h"
+#include "nnue.h"
+#include "notation.h"
+#include "packed.h"
+#include "pawntable.h"
+#include "perfcounter.h"
+#include "pgn.h"
+#include "rules.h"
+#include "transposition.h"
+#include "utils.h"
 
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include <stdio.h>
 
 void testIsKingChecked();
 void testPerformance();
 void testMoveGeneration();
 void testZobristHashes();
+void testEvalAccumulators();
+void testSlidingAttacks();
+void testPawnTable();
+void testEvalCache();
+void testNnueAccumulators();
+void testEvalTrace();
+void testLazyEval();
+void testBitbases();
+void testSearch();
+void testEngineThread();
 void testFenGeneration();
+void testFenParser();
+void testEpd();
+void testPgn();
+void testPackedPositions();
+void testGameIndex();
+void testDedup();
+void testBook();
+void testGameEnd();
 
 int main(void)
 {
@@ -18,7 +58,25 @@ int main(void)
 
     testIsKingChecked();
 	testFenGeneration();
+    testFenParser();
+    testEpd();
+    testPgn();
+    testPackedPositions();
+    testGameIndex();
+    testDedup();
+    testBook();
+    testGameEnd();
     testZobristHashes();
+    testEvalAccumulators();
+    testSlidingAttacks();
+    testPawnTable();
+    testEvalCache();
+    testNnueAccumulators();
+    testEvalTrace();
+    testLazyEval();
+    testBitbases();
+    testSearch();
+    testEngineThread();
     testMoveGeneration();
     testPerformance();
 }
@@ -128,14 +186,23 @@ void testPerformance(void)
     char *fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
     printf("\ntestPerformance()\nUsing fen: %s\n", fen);
     Board b = initBoardFromFen(fen);
+
+    // Hardware counters are optional, printPerfCounters() is a no-op without them
+    PerfCounters pc = {0};
+    perfCountersOpen(&pc);
+
     int max_depth = 6;
     for (int d = 1; d <= max_depth; d++) {
+        perfCountersStart(&pc);
         clock_t start = clock();
         uint64_t total = generateTillDepth(b, d, false);
         clock_t diff = clock() - start;
+        perfCountersStop(&pc);
         double ms = (double)diff * 1000 / (double)CLOCKS_PER_SEC;
         printf("Depth %d, moves: %10llu, time: %lf ms\n", d, total, ms);
+        printPerfCounters(&pc, total);
     }
+    perfCountersClose(&pc);
 }
 
 void testIsKingChecked(void)
@@ -195,9 +262,12 @@ bool checkZobristTillDepth(const Board *b, int depth)
 {
     if (depth == 0) {
         uint64_t calculated_hash = getZobristHash(b);
-        if (b->zobrist_hash == calculated_hash)
+        uint64_t calculated_pawn_hash = getPawnZobristHash(b);
+        if (b->zobrist_hash == calculated_hash && b->pawn_hash == calculated_pawn_hash)
             return true;
         printf("calculated_hash: %llu, b.zobrist_hash: %llu\n", calculated_hash, b->zobrist_hash);
+        printf("calculated_pawn_hash: %" PRIu64 ", b.pawn_hash: %" PRIu64 "\n",
+               calculated_pawn_hash, b->pawn_hash);
         return false;
     }
 
@@ -250,6 +320,528 @@ void testZobristHashes(void)
     }
 }
 
+// Checks bitboards and occupancy against the piece array
+bool bitboardsMatchPieces(const Board *b)
+{
+    uint64_t bitboards[2][6] = {{0}};
+    uint64_t occupancy[2] = {0};
+    for (int sq = 0; sq < 64; sq++) {
+        if (b->pieces[sq] == EMPTY_PIECE)
+            continue;
+        int col_idx = (b->pieces[sq] & WHITE) ? 0 : 1;
+        bitboards[col_idx][getPieceIdx(b->pieces[sq])] |= 1ull << sq;
+        occupancy[col_idx] |= 1ull << sq;
+    }
+    return memcmp(bitboards, b->bitboards, sizeof(bitboards)) == 0 &&
+           memcmp(occupancy, b->occupancy, sizeof(occupancy)) == 0;
+}
+
+bool checkEvalTillDepth(const Board *b, int depth)
+{
+    if (depth == 0) {
+        if (!bitboardsMatchPieces(b)) {
+            printf("bitboards don't match pieces\n");
+            return false;
+        }
+        int psqt[2], phase;
+        getPsqtScores(b, psqt, &phase);
+        if (b->psqt[0] == psqt[0] && b->psqt[1] == psqt[1] && b->phase == phase)
+            return true;
+        printf("calculated psqt: [%d %d], phase: %d, b.psqt: [%d %d], b.phase: %d\n",
+               psqt[0], psqt[1], phase, b->psqt[0], b->psqt[1], b->phase);
+        return false;
+    }
+
+    MoveList mlist = generateMoves(b);
+
+    for (size_t i = 0; i < mlist.count; i++) {
+        Board updated = moveMake(mlist.moves[i], *b);
+        if (!checkEvalTillDepth(&updated, depth - 1)) {
+            char move_str[15];
+            printMoveToString(move_str, sizeof(move_str), mlist.moves[i], true);
+            printf("On move: %s, depth: %d\n", move_str, depth);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Compares incrementally updated bitboards, material/psqt and phase against
+// a full recompute
+void testEvalAccumulators(void)
+{
+    printf("\ntestEvalAccumulators()\n");
+    int depth = 3;
+    char *fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "rnbqkbnr/pp1p1ppp/8/2pPp3/8/8/PPP1PPPP/RNBQKBNR w KQkq c6 0 3",
+        "8/4pP2/1k1N2qP/1n1P4/PpK2b1P/8/1rP4R/8 w - - 0 1",
+    };
+
+    const int n = sizeof(fens) / sizeof(fens[0]);
+    for (int i = 0; i < n; i++) {
+        Board b = initBoardFromFen(fens[i]);
+        bool passed = checkEvalTillDepth(&b, depth);
+        printf("[%s]: depth: %d, fen: %s\n", passed ? "pass" : "FAIL", depth, fens[i]);
+    }
+}
+
+// Compares bitboard slider attacks against the ray walking attack maps
+void testSlidingAttacks(void)
+{
+    printf("\ntestSlidingAttacks()\n");
+    char *fens[] = {
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "6R1/5P2/3p4/2Qr4/1p1pp2p/p4P1R/KP1P4/4k3 w - - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    };
+
+    const int n = sizeof(fens) / sizeof(fens[0]);
+    for (int i = 0; i < n; i++) {
+        Board b = initBoardFromFen(fens[i]);
+        uint64_t occupied = b.occupancy[0] | b.occupancy[1];
+        bool passed = true;
+        for (int sq = 0; sq < 64; sq++) {
+            Piece p = b.pieces[sq];
+            if (!(p & (ROOK | BISHOP | QUEEN)))
+                continue;
+            uint64_t attacks = 0;
+            if (p & (ROOK | QUEEN))
+                attacks |= rookAttacks(sq, occupied);
+            if (p & (BISHOP | QUEEN))
+                attacks |= bishopAttacks(sq, occupied);
+            if (attacks != generateSlidingAttackMap(&b, sq)) {
+                printf("Mismatch on square: %d\n", sq);
+                passed = false;
+            }
+        }
+        printf("[%s]: fen: %s\n", passed ? "pass" : "FAIL", fens[i]);
+    }
+}
+
+// Evaluation must be the same whether pawn structure comes from the table or not
+void testPawnTable(void)
+{
+    printf("\ntestPawnTable()\n");
+    char *fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "8/4pP2/1k1N2qP/1n1P4/PpK2b1P/8/1rP4R/8 w - - 0 1",
+        "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1",
+    };
+
+    const int n = sizeof(fens) / sizeof(fens[0]);
+    for (int i = 0; i < n; i++) {
+        Board b = initBoardFromFen(fens[i]);
+        clearPawnTable();
+        resetPawnTableStats();
+        clearEvalCache();
+        int missed = evaluateBoard(&b, INT_MIN, INT_MAX);
+        clearEvalCache();
+        int hit = evaluateBoard(&b, INT_MIN, INT_MAX);
+        PawnTableStats stats = getPawnTableStats();
+        bool passed = missed == hit && stats.hits == 1 && stats.misses == 1;
+        printf("[%s]: eval: %d, cached eval: %d, hits: %" PRIu64 ", misses: %" PRIu64 ", fen: %s\n",
+               passed ? "pass" : "FAIL", missed, hit, stats.hits, stats.misses, fens[i]);
+    }
+}
+
+// Cached evaluations must match fresh ones, including after a resize
+void testEvalCache(void)
+{
+    printf("\ntestEvalCache()\n");
+    char *fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    };
+
+    const int n = sizeof(fens) / sizeof(fens[0]);
+    for (int i = 0; i < n; i++) {
+        Board b = initBoardFromFen(fens[i]);
+        setEvalCacheSize(1000); // rounds down to 512 entries
+        resetEvalCacheStats();
+        int missed = evaluateBoard(&b, INT_MIN, INT_MAX);
+        int hit = evaluateBoard(&b, INT_MIN, INT_MAX);
+        EvalCacheStats stats = getEvalCacheStats();
+        bool passed = missed == hit && stats.hits == 1 && stats.misses == 1 &&
+                      getEvalCacheSize() == 512;
+        printf("[%s]: eval: %d, cached eval: %d, hits: %" PRIu64 ", misses: %" PRIu64 ", fen: %s\n",
+               passed ? "pass" : "FAIL", missed, hit, stats.hits, stats.misses, fens[i]);
+    }
+    setEvalCacheSize(EVAL_CACHE_DEFAULT_SIZE);
+}
+
+// Incrementally updated accumulators should match a full refresh
+bool checkNnueTillDepth(const Board *b, int depth)
+{
+    int incremental = nnueEvaluate(b), full = nnueEvaluateFull(b);
+    if (incremental != full) {
+        printf("incremental eval: %d, full eval: %d\n", incremental, full);
+        return false;
+    }
+    if (depth == 0)
+        return true;
+
+    MoveList mlist = generateMoves(b);
+
+    for (size_t i = 0; i < mlist.count; i++) {
+        Board updated = moveMake(mlist.moves[i], *b);
+        nnuePush(&updated);
+        bool passed = checkNnueTillDepth(&updated, depth - 1);
+        nnuePop();
+        if (!passed) {
+            char move_str[15];
+            printMoveToString(move_str, sizeof(move_str), mlist.moves[i], true);
+            printf("On move: %s, depth: %d\n", move_str, depth);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void testNnueAccumulators(void)
+{
+    printf("\ntestNnueAccumulators(), simd: %s\n", nnueSimdName());
+    char *fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    };
+
+    nnueInitRandom(42);
+    const int n = sizeof(fens) / sizeof(fens[0]);
+    const int depth = 3;
+    for (int i = 0; i < n; i++) {
+        Board b = initBoardFromFen(fens[i]);
+        nnueResetStack(&b);
+        bool passed = checkNnueTillDepth(&b, depth);
+        printf("[%s]: depth: %d, fen: %s\n", passed ? "pass" : "FAIL", depth, fens[i]);
+    }
+    nnueUnload();
+}
+
+// Weights times traced coefficients should add up to the evaluation
+void testEvalTrace(void)
+{
+    printf("\ntestEvalTrace()\n");
+    char *fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "r1bqkbnr/ppp2ppp/8/3Pn3/2B5/5N2/PPPPQPPP/RNB2RK1 b kq - 0 1",
+    };
+
+    static int params[NUM_EVAL_PARAMS][2];
+    getEvalParams(params);
+    const int n = sizeof(fens) / sizeof(fens[0]);
+    for (int i = 0; i < n; i++) {
+        Board b = initBoardFromFen(fens[i]);
+        EvalTrace trace;
+        traceEvaluation(&b, &trace);
+        int mg = 0, eg = 0;
+        for (int p = 0; p < NUM_EVAL_PARAMS; p++) {
+            mg += trace.coefs[p] * params[p][0];
+            eg += trace.coefs[p] * params[p][1];
+        }
+        int traced = (mg * trace.phase + eg * (MAX_PHASE - trace.phase)) / MAX_PHASE;
+        int eval = evaluateBoard(&b, INT_MIN, INT_MAX);
+        printf("[%s]: eval: %d, traced eval: %d, fen: %s\n", traced == eval ? "pass" : "FAIL",
+               eval, traced, fens[i]);
+    }
+}
+
+// Far outside the window only material/psqt is computed and not cached
+// (so the exact evaluation after it is computed again), the estimate
+// should stay within the margin of the full evaluation
+void testLazyEval(void)
+{
+    printf("\ntestLazyEval()\n");
+    char *fens[] = {
+        "4k3/8/8/8/8/8/PPPPPPPP/RNBQKBNR w KQ - 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/8/8/4K3 b kq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    };
+
+    const int n = sizeof(fens) / sizeof(fens[0]);
+    for (int i = 0; i < n; i++) {
+        Board b = initBoardFromFen(fens[i]);
+        clearEvalCache();
+        resetLazyEvalStats();
+        int lazy = evaluateBoard(&b, -50, 50);
+        LazyEvalStats stats = getLazyEvalStats();
+        int exact = evaluateBoard(&b, INT_MIN, INT_MAX);
+        bool expect_lazy = abs(lazy) > 50 + LAZY_EVAL_MARGIN;
+        bool passed = (stats.lazy_exits == 1) == expect_lazy &&
+                      getLazyEvalStats().evals == (expect_lazy ? 2u : 1u) &&
+                      abs(exact - lazy) <= LAZY_EVAL_MARGIN &&
+                      (!expect_lazy || (lazy > 50) == (exact > 50));
+        printf("[%s]: lazy eval: %d, eval: %d, lazy exits: %" PRIu64 ", fen: %s\n",
+               passed ? "pass" : "FAIL", lazy, exact, stats.lazy_exits, fens[i]);
+    }
+}
+
+// A bitbase position is won if a move leads to a lost one, lost if every
+// move leads to a won one (or it's mate)
+bool checkBitbaseConsistency(const Board *b)
+{
+    BitbaseResult result = probeBitbase(b);
+    MoveList mlist = generateMoves(b);
+    bool any_lost = false, all_won = true;
+    for (size_t i = 0; i < mlist.count; i++) {
+        Board updated = moveMake(mlist.moves[i], *b);
+        BitbaseResult child = POPCOUNT(updated.occupancy[0] | updated.occupancy[1]) == 2
+                                  ? BITBASE_DRAW
+                                  : probeBitbase(&updated);
+        any_lost |= child == BITBASE_LOSS;
+        all_won &= child == BITBASE_WIN;
+    }
+    if (mlist.count == 0)
+        return result == (isKingChecked(b, b->color_to_move) ? BITBASE_LOSS : BITBASE_DRAW);
+    return result == (any_lost ? BITBASE_WIN : all_won ? BITBASE_LOSS : BITBASE_DRAW);
+}
+
+void testBitbases(void)
+{
+    printf("\ntestBitbases()\n");
+    bool generated = generateBitbase("KPK", NULL, 2);
+    printf("[%s]: generated KPK and the tables it depends on: %d\n",
+           generated && bitbaseCount() == 3 ? "pass" : "FAIL", bitbaseCount());
+
+    struct {
+        char *fen;
+        BitbaseResult expected;
+    } cases[] = {
+        {"8/8/8/4k3/8/8/8/K6Q w - - 0 1", BITBASE_WIN},
+        {"8/8/8/4k3/8/8/8/K6Q b - - 0 1", BITBASE_LOSS},
+        {"k7/2Q5/1K6/8/8/8/8/8 b - - 0 1", BITBASE_DRAW}, // stalemate
+        {"8/8/8/8/8/8/1k6/R3K3 b - - 0 1", BITBASE_DRAW},  // rook hangs
+        {"8/8/8/4k3/8/8/r7/6K1 b - - 0 1", BITBASE_WIN},   // colors flipped
+        {"k7/8/K7/P7/8/8/8/8 w - - 0 1", BITBASE_DRAW},    // rook pawn
+        {"4k3/8/4K3/4P3/8/8/8/8 b - - 0 1", BITBASE_LOSS},
+        {"8/8/3K4/3P4/8/8/8/3k4 w - - 0 1", BITBASE_WIN},
+        {"8/8/8/8/8/4k3/8/4K2R w K - 0 1", BITBASE_UNKNOWN}, // castling rights
+        {"4k3/8/8/8/8/8/4P3/4K2Q w - - 0 1", BITBASE_UNKNOWN}, // no table
+    };
+    const int n = sizeof(cases) / sizeof(cases[0]);
+    for (int i = 0; i < n; i++) {
+        Board b = initBoardFromFen(cases[i].fen);
+        BitbaseResult result = probeBitbase(&b);
+        printf("[%s]: result: %d, expected: %d, fen: %s\n",
+               result == cases[i].expected ? "pass" : "FAIL", result, cases[i].expected,
+               cases[i].fen);
+    }
+
+    // Sample positions of each table, results should agree with their children
+    char *tables[] = {"KQK", "KRK", "KPK"};
+    Piece strong[] = {WHITE | QUEEN, WHITE | ROOK, WHITE | PAWN};
+    for (int t = 0; t < 3; t++) {
+        int checked = 0, failed = 0;
+        for (int wk = 0; wk < 64; wk += 3) {
+            for (int bk = 1; bk < 64; bk += 5) {
+                for (int sq = 8; sq < 56; sq += 7) {
+                    if (wk == bk || wk == sq || bk == sq)
+                        continue;
+                    Piece pieces[64] = {EMPTY_PIECE};
+                    pieces[wk] = WHITE | KING;
+                    pieces[bk] = BLACK | KING;
+                    pieces[sq] = strong[t];
+                    for (int stm = 0; stm < 2; stm++) {
+                        Board b = initBoardFromPieces(pieces, stm == 0 ? WHITE : BLACK);
+                        if (isKingChecked(&b, stm == 0 ? BLACK : WHITE) ||
+                            (KING_ATTACK_MAPS[wk] & (1ull << bk)))
+                            continue;
+                        checked++;
+                        failed += !checkBitbaseConsistency(&b);
+                    }
+                }
+            }
+        }
+        printf("[%s]: %s consistent in %d of %d positions\n", failed == 0 ? "pass" : "FAIL",
+               tables[t], checked - failed, checked);
+    }
+
+    // Search still mates in won endgames instead of settling for the bitbase score
+    Board b = initBoardFromFen("7k/8/5K2/8/8/8/8/6Q1 w - - 0 1");
+    clearTranspositionTable();
+    SearchContext ctx = {.limits = {.depth = 4}, .threads = 1};
+    SearchInfo info;
+    Move m = findBestMove(&b, &ctx, &info);
+    char move_str[10];
+    printMoveToString(move_str, sizeof(move_str), m, false);
+    printf("[%s]: KQK mate in 1: move: %s, score: %d\n",
+           strcmp(move_str, "g1g7") == 0 && info.score == MATE_SCORE - 1 ? "pass" : "FAIL",
+           move_str, info.score);
+
+    b = initBoardFromFen("8/8/8/4k3/8/8/8/K6Q w - - 0 1");
+    int plies = 0;
+    for (; plies < 60 && generateMoves(&b).count > 0; plies++) {
+        ctx = (SearchContext){.limits = {.depth = 5}, .threads = 1};
+        b = moveMake(findBestMove(&b, &ctx, NULL), b);
+    }
+    bool mated = generateMoves(&b).count == 0 && isKingChecked(&b, BLACK);
+    printf("[%s]: KQK played out: mate: %d, plies: %d\n", mated ? "pass" : "FAIL", mated, plies);
+    bitbaseUnload();
+}
+
+typedef struct {
+    const Board *b;
+    SearchContext ctx;
+    Move best_move;
+    atomic_bool done;
+} PonderArgs;
+
+static void *ponderThread(void *arg)
+{
+    PonderArgs *args = arg;
+    args->best_move = findBestMove(args->b, &args->ctx, NULL);
+    atomic_store(&args->done, true);
+    return NULL;
+}
+
+void testSearch(void)
+{
+    printf("\ntestSearch()\n");
+    struct {
+        char *fen;
+        int threads;
+        char *best_move;
+        int score;
+    } cases[] = {
+        {"6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1", 1, "a1a8", MATE_SCORE - 1},
+        {"r5k1/5ppp/8/8/8/8/5PPP/6K1 b - - 0 1", 1, "a8a1", -(MATE_SCORE - 1)},
+        {"6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1", 2, "a1a8", MATE_SCORE - 1},
+        {"r1bqkbnr/pppp1ppp/2n5/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 0 1", 1, "h5f7", MATE_SCORE - 1},
+    };
+
+    const int n = sizeof(cases) / sizeof(cases[0]);
+    for (int i = 0; i < n; i++) {
+        Board b = initBoardFromFen(cases[i].fen);
+        clearTranspositionTable();
+        SearchContext ctx = {.limits = {.depth = 4}, .threads = cases[i].threads};
+        SearchInfo info;
+        Move m = findBestMove(&b, &ctx, &info);
+        char move_str[10];
+        printMoveToString(move_str, sizeof(move_str), m, false);
+        bool passed = strcmp(move_str, cases[i].best_move) == 0 && info.score == cases[i].score
+                      && info.pv_length >= 1 && info.pv[0] == m;
+        printf("[%s]: move: %s, score: %d, depth: %d, threads: %d, fen: %s\n", passed ? "pass" : "FAIL",
+               move_str, info.score, info.depth, cases[i].threads, cases[i].fen);
+    }
+
+    // Stalemate is a draw, not a mate
+    Board b = initBoardFromFen("7k/5Q2/6K1/8/8/8/8/8 b - - 0 1");
+    int score = bestEvaluation(&b, 2, false, INT_MIN, INT_MAX);
+    printf("[%s]: stalemate score: %d\n", score == 0 ? "pass" : "FAIL", score);
+
+    // Limits
+    b = initBoardFromFen(START_FEN);
+    SearchContext ctx = {.limits = {.nodes = 20000}};
+    SearchInfo info;
+    Move m = findBestMove(&b, &ctx, &info);
+    printf("[%s]: node limit: 20000, searched: %lu\n",
+           m != EMPTY_MOVE && info.nodes >= 20000 && info.nodes < 20000 + 1024 ? "pass" : "FAIL",
+           (unsigned long)info.nodes);
+
+    // Pondering doesn't end on its own, the ponder hit starts the clock
+    b = initBoardFromFen("6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1");
+    PonderArgs args = {.b = &b, .ctx = {.limits = {.movetime = 50}}};
+    atomic_store(&args.ctx.ponder, true);
+    pthread_t tid;
+    pthread_create(&tid, NULL, ponderThread, &args);
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = 200 * 1000000};
+    nanosleep(&ts, NULL);
+    bool searching = !atomic_load(&args.done);
+    double hit_ms = wallTimeMs();
+    atomic_store(&args.ctx.ponder, false);
+    pthread_join(tid, NULL);
+    double ms = wallTimeMs() - hit_ms;
+    char move_str[10];
+    printMoveToString(move_str, sizeof(move_str), args.best_move, false);
+    printf("[%s]: ponder: searching before hit: %d, move: %s, after hit: %.0lf ms\n",
+           searching && strcmp(move_str, "a1a8") == 0 && ms < 1000 ? "pass" : "FAIL",
+           searching, move_str, ms);
+
+    SearchLimits limits = {.time = {60000, 1000}, .inc = {1000, 0}};
+    int white_budget = searchTimeBudget(&limits, WHITE);
+    int black_budget = searchTimeBudget(&limits, BLACK);
+    printf("[%s]: time budget white: %d ms, black: %d ms\n",
+           white_budget == 2750 && black_budget == 33 ? "pass" : "FAIL", white_budget, black_budget);
+}
+
+// Waits for the bestmove of search id, returns ms waited or -1 on timeout
+static double waitBestMove(EngineThread *e, uint32_t id, Move *best_move)
+{
+    double start = wallTimeMs();
+    EngineEvent event;
+    while (wallTimeMs() - start < 5000) {
+        if (!enginePoll(e, &event)) {
+            struct timespec ts = {.tv_sec = 0, .tv_nsec = 1000000};
+            nanosleep(&ts, NULL);
+            continue;
+        }
+        if (event.type == ENGINE_EVENT_BESTMOVE && event.id == id) {
+            *best_move = event.best_move;
+            return wallTimeMs() - start;
+        }
+    }
+    return -1;
+}
+
+void testEngineThread(void)
+{
+    printf("\ntestEngineThread()\n");
+    static EngineThread e;
+    engineStart(&e, 2);
+    static EngineCommand cmd;
+    cmd = (EngineCommand){
+        .type = ENGINE_CMD_SEARCH,
+        .board = initBoardFromFen(START_FEN),
+        .limits = {.infinite = true},
+    };
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = 100 * 1000000};
+
+    // Infinite search ends within milliseconds of a stop
+    uint32_t id = engineSend(&e, &cmd);
+    nanosleep(&ts, NULL);
+    engineStop(&e);
+    Move m = EMPTY_MOVE;
+    double ms = waitBestMove(&e, id, &m);
+    printf("[%s]: stopped infinite search in %.1lf ms, move: %d\n",
+           ms >= 0 && ms < 50 && m != EMPTY_MOVE ? "pass" : "FAIL", ms, m);
+
+    // Queued searches are stopped too
+    uint32_t first = engineSend(&e, &cmd);
+    uint32_t second = engineSend(&e, &cmd);
+    engineStop(&e);
+    Move m2 = EMPTY_MOVE;
+    double ms1 = waitBestMove(&e, first, &m);
+    double ms2 = waitBestMove(&e, second, &m2);
+    printf("[%s]: stopped queued searches, ids: %u %u\n",
+           ms1 >= 0 && ms2 >= 0 && second == first + 1 ? "pass" : "FAIL", first, second);
+
+    // Ponder search returns after the hit, nothing if it's stopped
+    cmd.limits = (SearchLimits){.movetime = 50};
+    cmd.ponder = true;
+    id = engineSend(&e, &cmd);
+    nanosleep(&ts, NULL);
+    enginePonderHit(&e);
+    ms = waitBestMove(&e, id, &m);
+    id = engineSend(&e, &cmd);
+    engineStop(&e);
+    waitBestMove(&e, id, &m2);
+    printf("[%s]: ponder hit: %.1lf ms, move: %d, ponder miss move: %d\n",
+           ms >= 0 && ms < 500 && m != EMPTY_MOVE && m2 == EMPTY_MOVE ? "pass" : "FAIL",
+           ms, m, m2);
+
+    engineQuit(&e);
+}
 
 void testFenGeneration(void) 
 {
@@ -278,3 +870,674 @@ void testFenGeneration(void)
 		printf("[%s]: actual_fen: \"%s\", generated_fen: \"%s\"\n", passed ? "pass" : "FAIL", fens[i], generated);
 	}
 }
+
+void testFenParser(void)
+{
+    printf("\ntestFenParser()\n");
+    struct {
+        const char *fen;
+        FenError expected;
+    } cases[] = {
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", FEN_OK},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -", FEN_OK},
+        {"  4k3/8/8/8/8/8/8/4K3 b - - 12 40\r", FEN_OK},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBN w KQkq - 0 1", FEN_BAD_PLACEMENT},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNRR w KQkq - 0 1", FEN_BAD_PLACEMENT},
+        {"rnbqkbnr/pppppppp/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", FEN_BAD_PLACEMENT},
+        {"rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", FEN_BAD_PLACEMENT},
+        {"rnbqkbnr/ppppxppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", FEN_BAD_PLACEMENT},
+        {"rnbqqbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQ - 0 1", FEN_BAD_KINGS},
+        {"4k3/8/8/8/8/8/8/3KK3 w - - 0 1", FEN_BAD_KINGS},
+        {"4k2P/8/8/8/8/8/8/4K3 w - - 0 1", FEN_BAD_PAWNS},
+        {"4k3/8/8/8/8/8/8/4K3 x - - 0 1", FEN_BAD_SIDE},
+        {"4k3/8/8/8/8/8/8/4K3", FEN_BAD_SIDE},
+        {"4k3/8/8/8/8/8/8/4K2R w Q - 0 1", FEN_BAD_CASTLING},
+        {"4k3/8/8/8/8/8/8/4K2R w KK - 0 1", FEN_BAD_CASTLING},
+        {"4k3/8/8/8/8/8/8/4K2R w X - 0 1", FEN_BAD_CASTLING},
+        {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e6 0 1", FEN_BAD_EP_SQUARE},
+        {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq d3 0 1", FEN_BAD_EP_SQUARE},
+        {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3x 0 1", FEN_BAD_EP_SQUARE},
+        {"4k3/8/8/8/8/8/8/4K3 w - - 0x 1", FEN_BAD_CLOCKS},
+        {"4k3/8/8/8/8/8/8/4K3 w - - 0 0", FEN_BAD_CLOCKS},
+        {"4k3/4R3/8/8/8/8/8/4K3 w - - 0 1", FEN_OPPONENT_IN_CHECK},
+        {"4k3/4R3/8/8/8/8/8/4K3 b - - 0 1", FEN_OK},
+    };
+    const int n = sizeof(cases) / sizeof(cases[0]);
+    for (int i = 0; i < n; i++) {
+        Board b;
+        FenError err = parseFen(cases[i].fen, strlen(cases[i].fen), &b, NULL);
+        printf("[%s]: error: \"%s\", expected: \"%s\", fen: \"%s\"\n",
+               err == cases[i].expected ? "pass" : "FAIL", fenErrorString(err),
+               fenErrorString(cases[i].expected), cases[i].fen);
+    }
+
+    // A span of a larger buffer, parsing stops at its end and reports what
+    // it read
+    const char *text = "8/8/4k3/8/8/3K4/8/8 b - - 3 60 and more\n8/8/8";
+    size_t consumed = 0;
+    Board b;
+    FenError err = parseFen(text, strlen(text), &b, &consumed);
+    printf("[%s]: consumed: %zu, expected: 30, halfmove_clock: %d, fullmoves: %d\n",
+           err == FEN_OK && consumed == 30 && b.halfmove_clock == 3 && b.fullmoves == 60
+               ? "pass" : "FAIL",
+           consumed, b.halfmove_clock, b.fullmoves);
+    err = parseFen(text, 25, &b, &consumed);
+    printf("[%s]: span without clocks, consumed: %zu, expected: 25\n",
+           err == FEN_OK && consumed == 25 && b.fullmoves == 1 ? "pass" : "FAIL", consumed);
+
+    // Writing and reading back a position keeps everything
+    const char *fen = "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 7 23";
+    char written[FEN_MAX_LENGTH];
+    Board parsed = initBoardFromFen(fen), reparsed;
+    int len = writeFen(&parsed, written);
+    err = parseFen(written, len, &reparsed, NULL);
+    printf("[%s]: round trip: \"%s\"\n",
+           err == FEN_OK && strcmp(fen, written) == 0 && (size_t)len == strlen(fen)
+               && reparsed.zobrist_hash == parsed.zobrist_hash ? "pass" : "FAIL",
+           written);
+}
+
+void testEpd(void)
+{
+    printf("\ntestEpd()\n");
+    const char *line =
+        "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - "
+        "bm Qxf7#; am Qxe5+ Nc3; id \"mate; in one\"; hmvc 4; fmvn 4;";
+    EpdRecord rec;
+    EpdError err = parseEpd(line, strlen(line), &rec);
+    char best[10], avoid[2][10];
+    printMoveToString(best, sizeof(best), rec.best_moves[0], false);
+    printMoveToString(avoid[0], sizeof(avoid[0]), rec.avoid_moves[0], false);
+    printMoveToString(avoid[1], sizeof(avoid[1]), rec.avoid_moves[1], false);
+    bool passed = err == EPD_OK && rec.best_move_count == 1 && strcmp(best, "h5f7") == 0
+                  && rec.avoid_move_count == 2 && strcmp(avoid[0], "h5e5") == 0
+                  && strcmp(avoid[1], "b1c3") == 0 && strcmp(rec.id, "mate; in one") == 0
+                  && rec.board.halfmove_clock == 4 && rec.board.fullmoves == 4;
+    printf("[%s]: error: \"%s\", bm: %s, am: %s %s, id: \"%s\"\n", passed ? "pass" : "FAIL",
+           epdErrorString(err), best, avoid[0], avoid[1], rec.id);
+
+    // Perft suite layout, counts checked against the move generator
+    line = "r3k2r/8/8/8/8/8/8/R3K2R w KQkq - ;D1 26 ;D2 568 ;D3 13744";
+    err = parseEpd(line, strlen(line), &rec);
+    passed = err == EPD_OK && rec.perft_depth == 3 && rec.perft[2] == 568;
+    for (int d = 1; passed && d <= rec.perft_depth; d++)
+        passed = generateTillDepth(rec.board, d, false) == rec.perft[d];
+    printf("[%s]: perft depth: %d, D3: %lu\n", passed ? "pass" : "FAIL", rec.perft_depth,
+           (unsigned long)rec.perft[3]);
+
+    // SAN forms, each resolves to exactly one legal move
+    Board b = initBoardFromFen("r3k2r/1P6/8/3pP3/8/2N3N1/8/R3K2R w KQkq d6 0 1");
+    struct {
+        const char *san;
+        const char *expected;
+    } sans[] = {
+        {"O-O", "e1g1"}, {"0-0-0", "e1c1"}, {"exd6", "e5d6"}, {"e6", "e5e6"},
+        {"bxa8=Q+", "b7a8q"}, {"b8N", "b7b8n"}, {"Nce4", "c3e4"}, {"Nc3e4", "c3e4"},
+        {"Ng3-e4", "g3e4"}, {"Rxa8", "a1a8"}, {"e1d2", "e1d2"}, {"Ne4", ""},
+        {"b8", ""}, {"Kf3", ""},
+    };
+    const int n = sizeof(sans) / sizeof(sans[0]);
+    for (int i = 0; i < n; i++) {
+        Move m = parseSan(&b, sans[i].san, strlen(sans[i].san));
+        char str[10] = "";
+        if (m != EMPTY_MOVE)
+            printMoveToString(str, sizeof(str), m, false);
+        printf("[%s]: san: %s, move: \"%s\", expected: \"%s\"\n",
+               strcmp(str, sans[i].expected) == 0 ? "pass" : "FAIL", sans[i].san, str,
+               sans[i].expected);
+    }
+
+    const char *bad[] = {
+        "r3k2r/8/8/8/8/8/8/R3K2R w KQkq - bm Qh5;",
+        "r3k2r/8/8/8/8/8/8/R3K2R w KQkq - id \"unterminated;",
+        "r3k2r/8/8/8/8/8/8/R3K2R w KQkq - D2 many;",
+        "r3k2r/8/8/8/8/8/8/R3K2 w KQkq - bm O-O;",
+    };
+    const EpdError bad_expected[] = {EPD_BAD_MOVE, EPD_BAD_OPERATION, EPD_BAD_OPERATION,
+                                     EPD_BAD_FEN};
+    for (int i = 0; i < 4; i++) {
+        err = parseEpd(bad[i], strlen(bad[i]), &rec);
+        printf("[%s]: error: \"%s\", line: %s\n", err == bad_expected[i] ? "pass" : "FAIL",
+               epdErrorString(err), bad[i]);
+    }
+}
+
+void testPgn(void)
+{
+    printf("\ntestPgn()\n");
+    const char *pgn =
+        "[Event \"Casual \\\"blitz\\\"\"]\n"
+        "[White \"A\"]\n"
+        "[Result \"1-0\"]\n"
+        "\n"
+        "1. e4 e5 2. Nf3 {2. f4 is sharper} Nc6 (2... d6 3. d4 (3. Bc4) exd4) 3. Bc4 $1\n"
+        "Nd4?! ; a line comment (\n"
+        "4. Nxe5 Qg5 5.Nxf7 Qxg2 6. Rf1 Qxe4+ 7. Be2 Nf3# 1-0\n"
+        "\n"
+        "[FEN \"8/8/8/8/8/5k1q/8/6K1 b - - 0 1\"]\n"
+        "[SetUp \"1\"]\n"
+        "\n"
+        "1... Qg2# 0-1\n"
+        "\n"
+        "[Event \"Broken\"]\n"
+        "\n"
+        "1. e4 e5 2. Ke3 *\n";
+    PgnReader r;
+    pgnReaderInit(&r, pgn, strlen(pgn));
+    PgnGame *game = malloc(sizeof(PgnGame));
+
+    // Mainline only, the game ends in mate with the last knight move
+    bool read = pgnReadGame(&r, game);
+    const PgnTag *event = pgnFindTag(game, "Event");
+    char end_fen[FEN_MAX_LENGTH] = "";
+    writeFen(&game->end, end_fen);
+    bool passed = read && game->error == PGN_OK && game->tag_count == 3 && event != NULL
+                  && event->value_length == 16 && memcmp(event->value, "Casual \\\"blitz", 14) == 0
+                  && game->move_count == 14 && game->result == PGN_WHITE_WINS
+                  && generateMoves(&game->end).count == 0;
+    printf("[%s]: game 1, moves: %d, tags: %d, end: %s\n", passed ? "pass" : "FAIL",
+           game->move_count, game->tag_count, end_fen);
+
+    read = pgnReadGame(&r, game);
+    passed = read && game->error == PGN_OK && game->move_count == 1
+             && game->result == PGN_BLACK_WINS && game->start.color_to_move == BLACK;
+    printf("[%s]: game 2 from FEN, moves: %d, result: %d\n", passed ? "pass" : "FAIL",
+           game->move_count, game->result);
+
+    read = pgnReadGame(&r, game);
+    passed = read && game->error == PGN_BAD_MOVE && game->move_count == 2
+             && game->result == PGN_RESULT_UNKNOWN && !pgnReadGame(&r, game);
+    printf("[%s]: game 3 with an illegal move, error: %d, moves: %d\n", passed ? "pass" : "FAIL",
+           game->error, game->move_count);
+
+    // Games found from the middle of the buffer, as when splitting a file
+    size_t second = pgnNextGameOffset(pgn, strlen(pgn), 40);
+    size_t third = pgnNextGameOffset(pgn, strlen(pgn), second + 1);
+    passed = strncmp(pgn + second, "[FEN", 4) == 0 && strncmp(pgn + third, "[Event \"Broken", 14) == 0
+             && pgnNextGameOffset(pgn, strlen(pgn), third + 1) == strlen(pgn);
+    printf("[%s]: game offsets: %zu %zu\n", passed ? "pass" : "FAIL", second, third);
+    free(game);
+
+    // SAN written for every move of random games reads back as the move
+    struct {
+        const char *fen;
+        const char *move;
+        const char *expected;
+    } sans[] = {
+        {"r3k2r/1P6/8/3pP3/8/2N3N1/8/R3K2R w KQkq d6 0 1", "c3e4", "Nce4"},
+        {"r3k2r/1P6/8/3pP3/8/2N3N1/8/R3K2R w KQkq d6 0 1", "e5d6", "exd6"},
+        {"r3k2r/1P6/8/3pP3/8/2N3N1/8/R3K2R w KQkq d6 0 1", "b7a8q", "bxa8=Q+"},
+        {"r3k2r/1P6/8/3pP3/8/2N3N1/8/R3K2R w KQkq d6 0 1", "e1c1", "O-O-O"},
+        {"6k1/5ppp/8/8/8/8/8/R3K1R1 w - - 0 1", "a1a8", "Ra8#"},
+        {"1k6/8/8/8/4Q2Q/8/8/K6Q w - - 0 1", "h4e1", "Qh4e1"},
+    };
+    for (int i = 0; i < 6; i++) {
+        Board b = initBoardFromFen(sans[i].fen);
+        char san[SAN_MAX_LENGTH];
+        writeSan(&b, parseCoordinateMove(&b, sans[i].move, strlen(sans[i].move)), san);
+        printf("[%s]: move: %s, san: \"%s\", expected: \"%s\"\n",
+               strcmp(san, sans[i].expected) == 0 ? "pass" : "FAIL", sans[i].move, san,
+               sans[i].expected);
+    }
+
+    srand(3);
+    Board start = initBoardFromFen(START_FEN);
+    Board b = start;
+    int checked = 0, mismatches = 0;
+    for (int ply = 0; ply < 4000; ply++) {
+        MoveList mlist = generateMoves(&b);
+        if (mlist.count == 0 || b.halfmove_clock >= 100) {
+            b = start;
+            continue;
+        }
+        for (size_t i = 0; i < mlist.count; i++) {
+            char san[SAN_MAX_LENGTH];
+            int n = writeSan(&b, mlist.moves[i], san);
+            mismatches += parseSan(&b, san, n) != mlist.moves[i];
+            checked++;
+        }
+        b = moveMake(mlist.moves[rand() % mlist.count], b);
+    }
+    printf("[%s]: san round trip, moves: %d, mismatches: %d\n", mismatches == 0 ? "pass" : "FAIL",
+           checked, mismatches);
+}
+
+void testPackedPositions(void)
+{
+    printf("\ntestPackedPositions()\n");
+
+    // Positions of random games come back with the same state, hashes and
+    // accumulators included
+    srand(4);
+    Board start = initBoardFromFen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    Board b = start;
+    int checked = 0, mismatches = 0;
+    PackedPosition packed[64];
+    for (int i = 0; i < 2000; i++) {
+        MoveList mlist = generateMoves(&b);
+        if (mlist.count == 0 || b.halfmove_clock >= 100) {
+            b = start;
+            continue;
+        }
+        b = moveMake(mlist.moves[rand() % mlist.count], b);
+        PackedPosition *p = &packed[checked % 64];
+        packPosition(&b, p);
+        Board unpacked;
+        char fen[FEN_MAX_LENGTH], unpacked_fen[FEN_MAX_LENGTH];
+        writeFen(&b, fen);
+        bool same = unpackPosition(p, &unpacked);
+        if (same)
+            writeFen(&unpacked, unpacked_fen);
+        same = same && strcmp(fen, unpacked_fen) == 0 && unpacked.zobrist_hash == b.zobrist_hash
+               && unpacked.pawn_hash == b.pawn_hash && unpacked.psqt[0] == b.psqt[0]
+               && unpacked.psqt[1] == b.psqt[1] && unpacked.phase == b.phase
+               && memcmp(unpacked.bitboards, b.bitboards, sizeof(b.bitboards)) == 0;
+        mismatches += !same;
+        checked++;
+    }
+    printf("[%s]: round trip, positions: %d, mismatches: %d\n", mismatches == 0 ? "pass" : "FAIL",
+           checked, mismatches);
+
+    // Annotations and corrupt records
+    PackedPosition p = packed[0];
+    p.score = -35;
+    p.best_move = moveEncode(QUIET, 12, 28);
+    packedSetResult(&p, PACKED_BLACK_WINS);
+    PackedPosition bad_code = p, bad_castle = p;
+    bad_code.pieces[0] |= 0x0f;
+    bad_castle.flags |= 0x1e;
+    Board unpacked;
+    bool passed = packedResult(&p) == PACKED_BLACK_WINS && unpackPosition(&p, &unpacked)
+                  && !unpackPosition(&bad_code, &unpacked) && !unpackPosition(&bad_castle, &unpacked);
+    printf("[%s]: annotations kept, corrupt records rejected\n", passed ? "pass" : "FAIL");
+
+    // Written then mapped back
+    char path[] = "/tmp/testpackedXXXXXX";
+    int fd = mkstemp(path);
+    PackedWriter w;
+    passed = fd >= 0 && packedWriterOpen(&w, path) && packedWrite(&w, packed, 64)
+             && packedWrite(&w, &p, 1) && packedWriterClose(&w);
+    PackedFile f;
+    passed = passed && packedOpen(&f, path);
+    if (passed) {
+        passed = f.count == 65 && memcmp(packedGet(&f, 0), packed, 64 * sizeof(PackedPosition)) == 0
+                 && packedGet(&f, 64)->score == -35 && packedGet(&f, 64)->best_move == p.best_move
+                 && packedGet(&f, 65) == NULL;
+        packedClose(&f);
+    }
+    printf("[%s]: file of %d positions mapped back\n", passed ? "pass" : "FAIL", 65);
+    if (fd >= 0) {
+        close(fd);
+        unlink(path);
+    }
+}
+
+void testGameIndex(void)
+{
+    printf("\ntestGameIndex()\n");
+
+    // Random games with random results, counted by hand after 1. e4
+    srand(5);
+    static const char *const RESULTS[4] = {"*", "1-0", "0-1", "1/2-1/2"};
+    const int n_games = 400;
+    size_t size = (size_t)n_games * 512, length = 0;
+    char *pgn = malloc(size);
+    Board start = initBoardFromFen(START_FEN);
+    Move e4 = parseCoordinateMove(&start, "e2e4", 4);
+    PositionStats all = {0}, after_e4 = {0};
+    for (int g = 0; g < n_games; g++) {
+        PgnResult result = rand() % 4;
+        length += sprintf(pgn + length, "[Result \"%s\"]\n\n", RESULTS[result]);
+        Board b = start;
+        int plies = 10 + rand() % 30;
+        for (int ply = 0; ply < plies; ply++) {
+            MoveList mlist = generateMoves(&b);
+            if (mlist.count == 0)
+                break;
+            Move m = ply == 0 && rand() % 2 ? e4 : mlist.moves[rand() % mlist.count];
+            if (ply == 0 && m == e4) {
+                after_e4.games++;
+                after_e4.white_wins += result == PGN_WHITE_WINS;
+                after_e4.draws += result == PGN_DRAW;
+                after_e4.black_wins += result == PGN_BLACK_WINS;
+            }
+            if (ply % 2 == 0)
+                length += sprintf(pgn + length, "%d. ", ply / 2 + 1);
+            length += writeSan(&b, m, pgn + length);
+            pgn[length++] = ' ';
+            b = moveMake(m, b);
+        }
+        length += sprintf(pgn + length, "%s\n\n", RESULTS[result]);
+        all.games++;
+        all.white_wins += result == PGN_WHITE_WINS;
+        all.draws += result == PGN_DRAW;
+        all.black_wins += result == PGN_BLACK_WINS;
+    }
+
+    char pgn_path[] = "/tmp/testgamesXXXXXX";
+    char sorted_path[] = "/tmp/testindexXXXXXX", merged_path[] = "/tmp/testindexXXXXXX";
+    int fds[3] = {mkstemp(pgn_path), mkstemp(sorted_path), mkstemp(merged_path)};
+    bool passed = fds[0] >= 0 && fds[1] >= 0 && fds[2] >= 0
+                  && write(fds[0], pgn, length) == (ssize_t)length;
+
+    // Sorted in memory and, with the smallest buffers, through merged runs
+    const char *paths[1] = {pgn_path};
+    GameIndexOptions opts = {.paths = paths, .path_count = 1, .memory = 64 << 20, .threads = 2};
+    passed = passed && buildGameIndex(&opts, sorted_path);
+    opts.memory = 0;
+    passed = passed && buildGameIndex(&opts, merged_path);
+    GameIndex sorted = {0}, merged = {0};
+    passed = passed && gameIndexOpen(&sorted, sorted_path) && gameIndexOpen(&merged, merged_path);
+    bool same = passed && sorted.count == merged.count && sorted.count > 4096
+                && memcmp(sorted.entries, merged.entries, sorted.count * sizeof(GameIndexEntry)) == 0
+                && merged.path_count == 1 && strcmp(merged.paths[0], pgn_path) == 0;
+    for (uint64_t i = 1; same && i < merged.count; i++)
+        same = merged.entries[i - 1].hash < merged.entries[i].hash
+               || (merged.entries[i - 1].hash == merged.entries[i].hash
+                   && merged.entries[i - 1].game < merged.entries[i].game);
+    printf("[%s]: entries: %lu, merged runs same as the in memory sort\n", same ? "pass" : "FAIL",
+           (unsigned long)merged.count);
+
+    // Stats of known positions, entries point at the games
+    if (passed) {
+        PositionStats s = gameIndexStats(&merged, start.zobrist_hash);
+        Board b = moveMake(e4, start);
+        PositionStats t = gameIndexStats(&merged, b.zobrist_hash);
+        uint64_t count;
+        const GameIndexEntry *e = gameIndexFind(&merged, start.zobrist_hash, &count);
+        bool found = count == (uint64_t)n_games;
+        for (uint64_t i = 0; found && i < count; i++)
+            found = GAME_ENTRY_FILE(&e[i]) == 0 && GAME_ENTRY_OFFSET(&e[i]) < length
+                    && pgn[GAME_ENTRY_OFFSET(&e[i])] == '[';
+        passed = memcmp(&s, &all, sizeof(s)) == 0 && memcmp(&t, &after_e4, sizeof(t)) == 0
+                 && found && gameIndexStats(&merged, start.zobrist_hash ^ 1).games == 0
+                 && gameIndexFind(&merged, 0, &count) != NULL && count == 0;
+        printf("[%s]: start: %lu games, +%lu =%lu -%lu, after e4: %lu games, +%lu =%lu -%lu\n",
+               passed ? "pass" : "FAIL", (unsigned long)s.games, (unsigned long)s.white_wins,
+               (unsigned long)s.draws, (unsigned long)s.black_wins, (unsigned long)t.games,
+               (unsigned long)t.white_wins, (unsigned long)t.draws, (unsigned long)t.black_wins);
+    }
+    else
+        printf("[FAIL]: index not built\n");
+
+    gameIndexClose(&sorted);
+    gameIndexClose(&merged);
+    char *tmp_paths[3] = {pgn_path, sorted_path, merged_path};
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+            unlink(tmp_paths[i]);
+        }
+    }
+    free(pgn);
+}
+
+// Packed positions by the position only, without clocks and annotations
+static int comparePackedSquares(const void *a, const void *b)
+{
+    const PackedPosition *x = a, *y = b;
+    if (x->occupancy != y->occupancy)
+        return x->occupancy < y->occupancy ? -1 : 1;
+    int c = memcmp(x->pieces, y->pieces, sizeof(x->pieces));
+    if (c != 0)
+        return c;
+    int xs = (x->flags & 31) | (x->fullmoves_ep >> 12) << 5;
+    int ys = (y->flags & 31) | (y->fullmoves_ep >> 12) << 5;
+    return xs - ys;
+}
+
+void testDedup(void)
+{
+    printf("\ntestDedup()\n");
+
+    // No false negatives, false positives near the rate the filter is sized for
+    BloomFilter filter;
+    bool passed = bloomInit(&filter, 20000, 0.01);
+    uint64_t seed = 0x9e3779b97f4a7c15ull, x = seed;
+    int missing = 0, false_positives = 0, repeats = 0;
+    for (int i = 0; i < 20000; i++) {
+        x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+        repeats += bloomInsert(&filter, x);
+    }
+    x = seed;
+    for (int i = 0; i < 20000; i++) {
+        x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+        missing += !bloomContains(&filter, x);
+    }
+    for (int i = 0; i < 20000; i++) {
+        x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+        false_positives += bloomContains(&filter, x);
+    }
+    passed = passed && missing == 0 && false_positives < 400 && repeats < 400;
+    printf("[%s]: bloom filter, %d bits, %d hashes, missing: %d, false positives: %d / 20000\n",
+           passed ? "pass" : "FAIL", (int)filter.bit_count, filter.hash_count, missing,
+           false_positives);
+    bloomFree(&filter);
+
+    // Short random games repeat their first positions often, and reach some
+    // by transposition with other clocks. Scores hold the input order
+    srand(6);
+    const int n = 6000;
+    PackedPosition *positions = malloc(n * sizeof(PackedPosition));
+    Board start = initBoardFromFen(START_FEN);
+    Board b = start;
+    for (int i = 0; i < n; i++) {
+        MoveList mlist = generateMoves(&b);
+        if (mlist.count == 0 || rand() % 12 == 0)
+            b = start;
+        else
+            b = moveMake(mlist.moves[rand() % MIN(mlist.count, 4)], b);
+        packPosition(&b, &positions[i]);
+        positions[i].score = i;
+    }
+    int expected = 0;
+    PackedPosition *sorted = malloc(n * sizeof(PackedPosition));
+    memcpy(sorted, positions, n * sizeof(PackedPosition));
+    qsort(sorted, n, sizeof(PackedPosition), comparePackedSquares);
+    for (int i = 0; i < n; i++)
+        expected += i == 0 || comparePackedSquares(&sorted[i - 1], &sorted[i]) != 0;
+
+    char input[] = "/tmp/testdedupXXXXXX", output[] = "/tmp/testdedupXXXXXX";
+    int fds[2] = {mkstemp(input), mkstemp(output)};
+    PackedWriter w;
+    bool written = fds[0] >= 0 && fds[1] >= 0 && packedWriterOpen(&w, input)
+                   && packedWrite(&w, positions, n) && packedWriterClose(&w);
+
+    // In memory, then with the smallest buffers and a filter letting half
+    // the positions through, which sorts most of them in merged runs
+    const char *paths[1] = {input};
+    struct {
+        size_t memory;
+        double fp_rate;
+    } configs[2] = {{64 << 20, 0.01}, {0, 0.5}};
+    for (int c = 0; c < 2; c++) {
+        DedupOptions opts = {.paths = paths, .path_count = 1, .memory = configs[c].memory,
+                             .fp_rate = configs[c].fp_rate};
+        DedupStats stats = {0};
+        PackedFile f = {0};
+        passed = written && dedupPackedFiles(&opts, output, &stats) && packedOpen(&f, output);
+
+        // Every position once, with the first occurrence's annotations
+        if (passed) {
+            passed = f.count == (uint64_t)expected && stats.written == f.count
+                     && stats.positions == (uint64_t)n && stats.invalid == 0;
+            memcpy(sorted, f.positions, f.count * sizeof(PackedPosition));
+            qsort(sorted, f.count, sizeof(PackedPosition), comparePackedSquares);
+            for (uint64_t i = 0; passed && i < f.count; i++) {
+                passed = i == 0 || comparePackedSquares(&sorted[i - 1], &sorted[i]) != 0;
+                for (int j = 0; j < sorted[i].score && passed; j++)
+                    passed = comparePackedSquares(&positions[j], &sorted[i]) != 0;
+            }
+            packedClose(&f);
+        }
+        printf("[%s]: fp rate %.2lf, positions: %d, unique: %d, written: %lu, candidates: %lu\n",
+               passed ? "pass" : "FAIL", configs[c].fp_rate, n, expected,
+               (unsigned long)stats.written, (unsigned long)stats.candidates);
+    }
+
+    char *tmp_paths[2] = {input, output};
+    for (int i = 0; i < 2; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+            unlink(tmp_paths[i]);
+        }
+    }
+    free(sorted);
+    free(positions);
+}
+
+void testBook(void)
+{
+    printf("\ntestBook()\n");
+
+    // Keys from the Polyglot book format description, en passant only
+    // counts with a pawn ready to capture
+    struct {
+        char *fen;
+        uint64_t key;
+    } keys[] = {
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 0x463b96181691fc9cull},
+        {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1", 0x823c9b50fd114196ull},
+        {"rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2", 0x0756b94461c50fb0ull},
+        {"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2", 0x662fafb965db29d4ull},
+        {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3", 0x22a48b5a8e47ff78ull},
+        {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR b kq - 0 3", 0x652a607ca3f242c1ull},
+        {"rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4", 0x00fdd303c946bdd9ull},
+        {"rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3", 0x3c8123ea7b067637ull},
+        {"rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4", 0x5c3f9b829b279560ull},
+    };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        Board b = initBoardFromFen(keys[i].fen);
+        uint64_t key = polyglotKey(&b);
+        printf("[%s]: polyglot key: %016" PRIx64 ", fen: %s\n",
+               key == keys[i].key ? "pass" : "FAIL", key, keys[i].fen);
+    }
+
+    // Polyglot move encoding, castling as the king taking its rook
+    struct {
+        char *fen;
+        uint16_t move;
+        MoveFlag flag;
+        int src, dst;
+    } moves[4] = {
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 0x031c, DOUBLE_PAWN_PUSH, 12, 28},
+        {"r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1", 0x0107, KING_CASTLE, 4, 6},
+        {"r3k2r/8/8/8/8/8/8/R3K2R b KQkq - 0 1", 0x0f38, QUEEN_CASTLE, 60, 58},
+        {"8/P7/8/8/8/8/k6K/8 w - - 0 1", 0x4c38, PROMOTION | 3, 48, 56},
+    };
+    for (int i = 0; i < 4; i++) {
+        Board b = initBoardFromFen(moves[i].fen);
+        Move m = bookDecodeMove(&b, moves[i].move);
+        bool passed = m == moveEncode(moves[i].flag, moves[i].src, moves[i].dst)
+                      && bookEncodeMove(m) == moves[i].move;
+        printf("[%s]: book move 0x%04x\n", passed ? "pass" : "FAIL", moves[i].move);
+    }
+
+    // Big endian entries
+    BookEntry e = {0x0102030405060708ull, 0x090a, 0x0b0c, 0x0d0e0f10};
+    uint8_t bytes[BOOK_ENTRY_SIZE];
+    bookEncodeEntry(&e, bytes);
+    bool passed = true;
+    for (int i = 0; i < BOOK_ENTRY_SIZE; i++)
+        passed = passed && bytes[i] == i + 1;
+    BookEntry d = bookDecodeEntry(bytes);
+    passed = passed && d.key == e.key && d.move == e.move && d.weight == e.weight
+             && d.learn == e.learn;
+    printf("[%s]: book entry byte order\n", passed ? "pass" : "FAIL");
+
+    // Two moves from the start, an illegal one left by a key collision and
+    // a reply to 1. e4, written out of order
+    Board start = initBoardFromFen(START_FEN);
+    Move e4 = bookDecodeMove(&start, 0x031c), d4 = bookDecodeMove(&start, 0x02db);
+    Board after_e4 = moveMake(e4, start), after_d4 = moveMake(d4, start);
+    Move c5 = bookDecodeMove(&after_e4, 0x0ca2);
+    BookEntry entries[4] = {
+        {polyglotKey(&start), 0x031c, 10, 0},
+        {polyglotKey(&after_e4), 0x0ca2, 5, 0},
+        {polyglotKey(&start), 0x0324, 100, 0},
+        {polyglotKey(&start), 0x02db, 30, 0},
+    };
+    char path[] = "/tmp/testbookXXXXXX";
+    int fd = mkstemp(path);
+    Book book;
+    passed = fd >= 0 && e4 != EMPTY_MOVE && d4 != EMPTY_MOVE && c5 != EMPTY_MOVE
+             && bookWrite(path, entries, 4) && bookOpen(&book, path);
+    if (fd >= 0)
+        close(fd);
+    if (passed) {
+        BookMove found[BOOK_MAX_MOVES];
+        int n = bookProbe(&book, &start, found, BOOK_MAX_MOVES);
+        passed = book.count == 4 && n == 2 && found[0].move == d4 && found[0].weight == 30
+                 && found[1].move == e4 && found[1].weight == 10;
+        passed = passed && bookProbe(&book, &after_e4, found, BOOK_MAX_MOVES) == 1
+                 && found[0].move == c5 && bookProbe(&book, &after_d4, found, BOOK_MAX_MOVES) == 0;
+        printf("[%s]: book probe, %d moves from the start\n", passed ? "pass" : "FAIL", n);
+
+        // d4 for 30 of every 40 random values
+        passed = bookPick(&book, &start, true, 35) == d4 && bookPick(&book, &start, false, 29) == d4
+                 && bookPick(&book, &start, false, 30) == e4
+                 && bookPick(&book, &start, false, 75) == e4
+                 && bookPick(&book, &after_d4, false, 0) == EMPTY_MOVE;
+        printf("[%s]: book pick\n", passed ? "pass" : "FAIL");
+        bookClose(&book);
+    }
+    else
+        printf("[FAIL]: could not write and open a book\n");
+    unlink(path);
+}
+
+void testGameEnd(void)
+{
+    printf("\ntestGameEnd()\n");
+
+    struct {
+        char *fen;
+        GameEnd expected;
+    } tests[] = {
+        {"7k/6Q1/6K1/8/8/8/8/8 b - - 0 1", GAME_CHECKMATE},
+        {"7k/6Q1/6K1/8/8/8/8/8 b - - 100 80", GAME_CHECKMATE},
+        {"7k/5Q2/6K1/8/8/8/8/8 b - - 0 1", GAME_STALEMATE},
+        {"4k3/8/8/8/8/8/8/R3K3 w - - 100 80", GAME_FIFTY_MOVES},
+        {"4k3/8/8/8/8/8/8/R3K3 w - - 99 80", GAME_ONGOING},
+        {"4k3/8/8/8/8/8/8/2B1K3 w - - 0 1", GAME_INSUFFICIENT_MATERIAL},
+        {"4k3/8/8/8/8/8/8/1NB1K3 w - - 0 1", GAME_ONGOING},
+        {"4k3/8/8/8/8/8/4P3/4K3 w - - 0 1", GAME_ONGOING},
+    };
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        Board b = initBoardFromFen(tests[i].fen);
+        GameEnd end = gameEnd(&b, NULL, 0);
+        printf("[%s]: %s, fen: %s\n", end == tests[i].expected ? "pass" : "FAIL",
+               gameEndString(end), tests[i].fen);
+    }
+
+    // The initial position comes back after every 4 knight moves, the
+    // third time ends the game
+    const char *moves[4] = {"g1f3", "g8f6", "f3g1", "f6g8"};
+    Board b = initBoardFromFen(START_FEN);
+    uint64_t history[8];
+    bool passed = true;
+    for (int ply = 0; ply < 8; ply++) {
+        passed = passed && gameEnd(&b, history, ply) == GAME_ONGOING;
+        history[ply] = b.zobrist_hash;
+        b = moveMake(parseCoordinateMove(&b, moves[ply % 4], 4), b);
+    }
+    GameEnd end = gameEnd(&b, history, 8);
+    passed = passed && end == GAME_REPETITION;
+    printf("[%s]: %s after 8 knight moves\n", passed ? "pass" : "FAIL", gameEndString(end));
+
+    // A win needs RESIGN_PLIES winning scores in a row, a draw DRAW_PLIES
+    // level ones from DRAW_MIN_PLY on
+    Adjudicator a = {0};
+    int ply;
+    Adjudication adjudication;
+    for (ply = 0, adjudication = ADJUDICATE_NONE; adjudication == ADJUDICATE_NONE; ply++)
+        adjudication = adjudicate(&a, -RESIGN_SCORE, ply);
+    printf("[%s]: adjudicated win after %d winning scores\n",
+           adjudication == ADJUDICATE_BLACK_WINS && ply == RESIGN_PLIES ? "pass" : "FAIL", ply);
+
+    a = (Adjudicator){0};
+    for (ply = 0, adjudication = ADJUDICATE_NONE; adjudication == ADJUDICATE_NONE; ply++)
+        adjudication = adjudicate(&a, 0, ply);
+    printf("[%s]: adjudicated draw at ply %d\n",
+           adjudication == ADJUDICATE_DRAW && ply - 1 == DRAW_MIN_PLY ? "pass" : "FAIL", ply - 1);
+}
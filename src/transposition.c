@@ -0,0 +1,129 @@
+#include "transposition.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+// Same lockless scheme as the eval cache, check is key ^ data
+typedef struct {
+    _Atomic uint64_t check;
+    _Atomic uint64_t data;
+} TTSlot;
+
+// data layout, low to high:
+//   move 16 bits, score 16 bits, depth 8 bits, bound 2 bits, age 8 bits
+// bound is never 0 for a stored entry, so empty slots never verify
+#define DATA_MOVE(d)  ((Move)((d) & 0xffff))
+#define DATA_SCORE(d) ((int)(int16_t)(((d) >> 16) & 0xffff))
+#define DATA_DEPTH(d) ((int)(((d) >> 32) & 0xff))
+#define DATA_BOUND(d) ((TTBound)(((d) >> 40) & 0x3))
+#define DATA_AGE(d)   ((uint8_t)(((d) >> 42) & 0xff))
+
+static TTSlot *tt = NULL;
+static size_t tt_size = 0;
+static size_t tt_mb = 0;
+// Bumped by every search, several may run at once (batch analysis)
+static _Atomic uint8_t tt_age = 0;
+
+bool setTranspositionTableSize(size_t mb)
+{
+    free(tt);
+    tt = NULL;
+    tt_size = 0;
+    tt_mb = 0;
+    if (mb == 0)
+        return true;
+
+    // Round down to a power of 2 so index is a mask of the key
+    size_t entries = mb * 1024 * 1024 / sizeof(TTSlot);
+    size_t size = 1;
+    while (size * 2 <= entries)
+        size *= 2;
+
+    tt = calloc(size, sizeof(TTSlot));
+    if (tt == NULL)
+        return false;
+    tt_size = size;
+    tt_mb = mb;
+    return true;
+}
+
+size_t getTranspositionTableSize(void)
+{
+    return tt_mb;
+}
+
+void clearTranspositionTable(void)
+{
+    for (size_t i = 0; i < tt_size; i++) {
+        atomic_store_explicit(&tt[i].check, 0, memory_order_relaxed);
+        atomic_store_explicit(&tt[i].data, 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&tt_age, 0, memory_order_relaxed);
+}
+
+void newTranspositionSearch(void)
+{
+    atomic_fetch_add_explicit(&tt_age, 1, memory_order_relaxed);
+}
+
+bool probeTranspositionTable(uint64_t key, TTEntry *entry)
+{
+    if (tt_size == 0)
+        return false;
+
+    TTSlot *slot = &tt[key & (tt_size - 1)];
+    uint64_t check = atomic_load_explicit(&slot->check, memory_order_relaxed);
+    uint64_t data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+    if ((check ^ data) != key || DATA_BOUND(data) == 0)
+        return false;
+
+    entry->move = DATA_MOVE(data);
+    entry->score = DATA_SCORE(data);
+    entry->depth = DATA_DEPTH(data);
+    entry->bound = DATA_BOUND(data);
+    return true;
+}
+
+// Keeps a deeper entry of the current search for another position,
+// everything else is replaced
+void storeTranspositionTable(uint64_t key, const TTEntry *entry)
+{
+    if (tt_size == 0)
+        return;
+
+    TTSlot *slot = &tt[key & (tt_size - 1)];
+    uint64_t old_check = atomic_load_explicit(&slot->check, memory_order_relaxed);
+    uint64_t old_data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+    uint8_t age = atomic_load_explicit(&tt_age, memory_order_relaxed);
+    bool same_position = (old_check ^ old_data) == key;
+    if (!same_position && DATA_AGE(old_data) == age && DATA_DEPTH(old_data) > entry->depth)
+        return;
+
+    // Keep the old move if a fail low found none for the same position
+    Move move = entry->move;
+    if (move == EMPTY_MOVE && same_position)
+        move = DATA_MOVE(old_data);
+
+    uint64_t data = (uint64_t)move
+                    | (uint64_t)(uint16_t)(int16_t)entry->score << 16
+                    | (uint64_t)(entry->depth & 0xff) << 32
+                    | (uint64_t)entry->bound << 40
+                    | (uint64_t)age << 42;
+    atomic_store_explicit(&slot->data, data, memory_order_relaxed);
+    atomic_store_explicit(&slot->check, key ^ data, memory_order_relaxed);
+}
+
+int getTranspositionTableUsage(void)
+{
+    size_t sample = tt_size < 1000 ? tt_size : 1000;
+    if (sample == 0)
+        return 0;
+    uint8_t age = atomic_load_explicit(&tt_age, memory_order_relaxed);
+    int used = 0;
+    for (size_t i = 0; i < sample; i++) {
+        uint64_t data = atomic_load_explicit(&tt[i].data, memory_order_relaxed);
+        if (DATA_BOUND(data) != 0 && DATA_AGE(data) == age)
+            used++;
+    }
+    return used * 1000 / sample;
+}
@@ -0,0 +1,47 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include "move.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Default size in megabytes, allocated by precomputeValues()
+#define TT_DEFAULT_MB 16
+
+// What the stored score says about the position's real score
+typedef enum {
+    TT_EXACT = 1,
+    TT_LOWER,   // real score >= score (search failed high)
+    TT_UPPER,   // real score <= score (search failed low)
+} TTBound;
+
+// score: white's point of view, mates relative to the stored position
+typedef struct {
+    Move move;
+    int score;
+    int depth;
+    TTBound bound;
+} TTEntry;
+
+// Resizes (and clears) the table, 0 disables it
+// Not safe to call while a search is running
+bool setTranspositionTableSize(size_t mb);
+size_t getTranspositionTableSize(void);
+void clearTranspositionTable(void);
+
+// Called at the start of each search, entries of older searches are
+// replaced first
+void newTranspositionSearch(void);
+
+// Direct mapped lookup by zobrist hash, returns false on a miss
+// Safe to call from multiple threads, torn entries are detected and missed
+bool probeTranspositionTable(uint64_t key, TTEntry *entry);
+void storeTranspositionTable(uint64_t key, const TTEntry *entry);
+
+// Permille of slots written by the current search, sampled from the
+// first thousand slots (UCI hashfull)
+int getTranspositionTableUsage(void);
+
+#endif // !TRANSPOSITION_H
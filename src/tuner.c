@@ -0,0 +1,603 @@
+#include "board.h"
+#include "engine.h"
+#include "evaluate.h"
+#include "packed.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Texel tuner for the classic evaluation weights (evalparams.h)
+//
+// Usage: ./build/tuner positions_file [--threads n] [--epochs n] [--lr rate]
+//                      [--k scaling] [--output file]
+//
+// Each line of the positions file holds a FEN and the game's result, either
+// as "1-0", "0-1", "1/2-1/2" or as white's score in brackets ([1.0], [0.5],
+// [0.0]). Packed position files (packed.h) with results can be given
+// instead. Positions are resolved with a quiescence search and the quiet leaf
+// is traced (see EvalTrace), the weights are then fitted with Adam to
+// minimize (result - sigmoid(K * eval))^2 over all positions. The generated
+// table is written to DEFAULT_OUTPUT in the current directory, copy it over
+// src/evalparams.c and rebuild to use it.
+
+#define QSEARCH_MAX_DEPTH 16
+#define DEFAULT_OUTPUT "tuned_evalparams.c"
+
+// Nonzero trace coefficient packed in 16 bits:
+// parameter index in the low 9 bits, signed coefficient in the high 7 bits
+typedef uint16_t TuneEntry;
+#define ENTRY_INDEX_BITS 9
+#define ENTRY_COEF_MAX 63
+_Static_assert(NUM_EVAL_PARAMS <= (1 << ENTRY_INDEX_BITS), "TuneEntry index too small");
+
+typedef struct {
+    size_t start;   // first entry in the shard's entries
+    uint16_t count;
+    uint8_t phase;
+    uint8_t result; // white's score doubled, 0 loss, 1 draw, 2 win
+} TunePosition;
+
+// Positions loaded by one thread, the same thread computes their gradient
+typedef struct {
+    const char *begin, *end; // lines of the positions file to load
+    const PackedPosition *packed_begin, *packed_end; // or packed positions
+    TunePosition *positions;
+    size_t count, capacity;
+    TuneEntry *entries;
+    size_t entry_count, entry_capacity;
+    size_t skipped;
+
+    // Gradient pass input and output
+    const double (*params)[2];
+    double k;
+    bool want_gradient;
+    double loss;
+    double gradient[NUM_EVAL_PARAMS][2];
+} Shard;
+
+//
+// Loading
+//
+
+// Finds the game result in a line, returns white's score doubled (0, 1, 2)
+// or -1 if there's none. fen_len is set to the length before the result
+static int parseResult(const char *line, size_t len, size_t *fen_len)
+{
+    static const struct {
+        const char *token;
+        int result;
+    } TOKENS[] = {
+        {"1/2-1/2", 1}, {"1-0", 2}, {"0-1", 0},
+        {"[1.0]", 2}, {"[0.5]", 1}, {"[0.0]", 0},
+        {"[1]", 2}, {"[0]", 0},
+    };
+
+    for (size_t i = 0; i < sizeof(TOKENS) / sizeof(TOKENS[0]); i++) {
+        size_t n = strlen(TOKENS[i].token);
+        for (size_t j = 0; j + n <= len; j++) {
+            if (memcmp(line + j, TOKENS[i].token, n) == 0) {
+                *fen_len = j;
+                return TOKENS[i].result;
+            }
+        }
+    }
+    return -1;
+}
+
+// Rough values for ordering captures, by PieceIdx
+static const int ORDER_VALUES[6] = {
+    [KING_IDX] = 100, [QUEEN_IDX] = 9, [BISHOP_IDX] = 3,
+    [KNIGHT_IDX] = 3, [ROOK_IDX] = 5, [PAWN_IDX] = 1,
+};
+
+// Quiescence search over captures and promotions, follows the principal
+// variation down to a quiet position and copies it to leaf
+static int resolveQuiet(const Board *b, bool is_maximizing, int alpha, int beta, int ply,
+                        Board *leaf)
+{
+    int best_score = evaluateBoard(b, alpha, beta);
+    *leaf = *b;
+    if (ply >= QSEARCH_MAX_DEPTH)
+        return best_score;
+    if (is_maximizing ? best_score >= beta : best_score <= alpha)
+        return best_score;
+    if (is_maximizing)
+        alpha = MAX(alpha, best_score);
+    else
+        beta = MIN(beta, best_score);
+
+    // Most valuable victim, least valuable attacker first
+    MoveList mlist = generateMoves(b);
+    Move moves[256];
+    int keys[256], n = 0;
+    for (size_t i = 0; i < mlist.count; i++) {
+        Move m = mlist.moves[i];
+        MoveFlag flag = getMoveFlag(m);
+        if (!(flag & (CAPTURE | PROMOTION)))
+            continue;
+        Piece victim = b->pieces[getMoveDst(m)];
+        int key = (victim == EMPTY_PIECE ? 1 : ORDER_VALUES[getPieceIdx(victim)]) * 16 -
+                  ORDER_VALUES[getPieceIdx(b->pieces[getMoveSrc(m)])];
+        if (flag & PROMOTION)
+            key += 8 * 16;
+        int j = n++;
+        for (; j > 0 && keys[j - 1] < key; j--) {
+            moves[j] = moves[j - 1];
+            keys[j] = keys[j - 1];
+        }
+        moves[j] = m;
+        keys[j] = key;
+    }
+
+    for (int i = 0; i < n; i++) {
+        Board updated = moveMake(moves[i], *b);
+        Board child_leaf;
+        int score = resolveQuiet(&updated, !is_maximizing, alpha, beta, ply + 1, &child_leaf);
+        if (is_maximizing ? score > best_score : score < best_score) {
+            best_score = score;
+            *leaf = child_leaf;
+            if (is_maximizing)
+                alpha = MAX(alpha, score);
+            else
+                beta = MIN(beta, score);
+        }
+        if (alpha >= beta)
+            break;
+    }
+
+    return best_score;
+}
+
+static void addEntry(Shard *shard, int index, int coef)
+{
+    if (shard->entry_count == shard->entry_capacity) {
+        shard->entry_capacity = MAX(shard->entry_capacity * 2, (size_t)1 << 16);
+        shard->entries = realloc(shard->entries, shard->entry_capacity * sizeof(TuneEntry));
+        if (shard->entries == NULL) {
+            fprintf(stderr, "tuner: out of memory\n");
+            exit(1);
+        }
+    }
+    shard->entries[shard->entry_count++] =
+        (TuneEntry)(index | ((unsigned)coef << ENTRY_INDEX_BITS));
+}
+
+static void addPosition(Shard *shard, const EvalTrace *trace, int result)
+{
+    if (shard->count == shard->capacity) {
+        shard->capacity = MAX(shard->capacity * 2, (size_t)1 << 12);
+        shard->positions = realloc(shard->positions, shard->capacity * sizeof(TunePosition));
+        if (shard->positions == NULL) {
+            fprintf(stderr, "tuner: out of memory\n");
+            exit(1);
+        }
+    }
+
+    TunePosition *pos = &shard->positions[shard->count++];
+    pos->start = shard->entry_count;
+    pos->phase = trace->phase;
+    pos->result = result;
+    for (int i = 0; i < NUM_EVAL_PARAMS; i++) {
+        // Coefficients too large for an entry are split into several
+        for (int coef = trace->coefs[i]; coef != 0;) {
+            int part = MAX(-ENTRY_COEF_MAX, MIN(ENTRY_COEF_MAX, coef));
+            addEntry(shard, i, part);
+            coef -= part;
+        }
+    }
+    pos->count = shard->entry_count - pos->start;
+}
+
+// Resolves b to a quiet leaf and adds its trace
+static void loadPosition(Shard *shard, const Board *b, int result)
+{
+    Board leaf;
+    bool is_maximizing = (b->color_to_move & WHITE) ? true : false;
+    resolveQuiet(b, is_maximizing, INT_MIN, INT_MAX, 0, &leaf);
+
+    EvalTrace trace;
+    traceEvaluation(&leaf, &trace);
+    addPosition(shard, &trace, result);
+}
+
+static void *loadShard(void *arg)
+{
+    Shard *shard = arg;
+
+    for (const char *line = shard->begin; line < shard->end;) {
+        const char *eol = memchr(line, '\n', shard->end - line);
+        if (eol == NULL)
+            eol = shard->end;
+        size_t len = eol - line, fen_len = 0;
+        int result = parseResult(line, len, &fen_len);
+        const char *next = eol + 1;
+
+        // The FEN is parsed in place, separators and EPD opcodes between it
+        // and its result are ignored and malformed lines are skipped
+        while (fen_len > 0 && memchr(" \t;\"", line[fen_len - 1], 4) != NULL)
+            fen_len--;
+        Board b;
+        if (result < 0 || parseFen(line, fen_len, &b, NULL) != FEN_OK) {
+            shard->skipped += len > 0;
+            line = next;
+            continue;
+        }
+
+        loadPosition(shard, &b, result);
+        line = next;
+    }
+    return NULL;
+}
+
+static void *loadPackedShard(void *arg)
+{
+    Shard *shard = arg;
+    static const int RESULTS[4] = {
+        [PACKED_RESULT_UNKNOWN] = -1, [PACKED_WHITE_WINS] = 2, [PACKED_DRAW] = 1,
+        [PACKED_BLACK_WINS] = 0,
+    };
+
+    for (const PackedPosition *p = shard->packed_begin; p < shard->packed_end; p++) {
+        int result = RESULTS[packedResult(p)];
+        Board b;
+        if (result < 0 || !unpackPosition(p, &b)) {
+            shard->skipped++;
+            continue;
+        }
+        loadPosition(shard, &b, result);
+    }
+    return NULL;
+}
+
+//
+// Fitting
+//
+
+static double sigmoid(double k, double eval)
+{
+    return 1.0 / (1.0 + exp(-k * eval * M_LN10 / 400.0));
+}
+
+static double linearEval(const Shard *shard, const TunePosition *pos, const double (*params)[2])
+{
+    double mg = 0, eg = 0;
+    for (size_t i = pos->start; i < pos->start + pos->count; i++) {
+        TuneEntry entry = shard->entries[i];
+        int index = entry & ((1 << ENTRY_INDEX_BITS) - 1);
+        int coef = (int16_t)entry >> ENTRY_INDEX_BITS;
+        mg += coef * params[index][0];
+        eg += coef * params[index][1];
+    }
+    return (mg * pos->phase + eg * (MAX_PHASE - pos->phase)) / MAX_PHASE;
+}
+
+// Sums squared error of the shard's positions, and its gradient if wanted
+static void *gradientShard(void *arg)
+{
+    Shard *shard = arg;
+    shard->loss = 0;
+    if (shard->want_gradient)
+        memset(shard->gradient, 0, sizeof(shard->gradient));
+
+    for (size_t p = 0; p < shard->count; p++) {
+        const TunePosition *pos = &shard->positions[p];
+        double s = sigmoid(shard->k, linearEval(shard, pos, shard->params));
+        double error = pos->result / 2.0 - s;
+        shard->loss += error * error;
+        if (!shard->want_gradient)
+            continue;
+
+        // d(error^2)/d(eval), split between midgame and endgame weights
+        double d = -2.0 * error * s * (1 - s) * shard->k * M_LN10 / 400.0;
+        double d_mg = d * pos->phase / MAX_PHASE;
+        double d_eg = d * (MAX_PHASE - pos->phase) / MAX_PHASE;
+        for (size_t i = pos->start; i < pos->start + pos->count; i++) {
+            TuneEntry entry = shard->entries[i];
+            int index = entry & ((1 << ENTRY_INDEX_BITS) - 1);
+            int coef = (int16_t)entry >> ENTRY_INDEX_BITS;
+            shard->gradient[index][0] += coef * d_mg;
+            shard->gradient[index][1] += coef * d_eg;
+        }
+    }
+    return NULL;
+}
+
+static void runShards(Shard *shards, int n_shards, void *(*work)(void *))
+{
+    pthread_t threads[n_shards];
+    for (int i = 0; i < n_shards; i++)
+        pthread_create(&threads[i], NULL, work, &shards[i]);
+    for (int i = 0; i < n_shards; i++)
+        pthread_join(threads[i], NULL);
+}
+
+// Mean squared error over all positions, sums gradients into gradient if given
+static double computeLoss(Shard *shards, int n_shards, size_t total, const double (*params)[2],
+                          double k, double gradient[NUM_EVAL_PARAMS][2])
+{
+    for (int i = 0; i < n_shards; i++) {
+        shards[i].params = params;
+        shards[i].k = k;
+        shards[i].want_gradient = gradient != NULL;
+    }
+    runShards(shards, n_shards, gradientShard);
+
+    double loss = 0;
+    if (gradient != NULL)
+        memset(gradient, 0, sizeof(double) * NUM_EVAL_PARAMS * 2);
+    for (int i = 0; i < n_shards; i++) {
+        loss += shards[i].loss;
+        if (gradient == NULL)
+            continue;
+        for (int p = 0; p < NUM_EVAL_PARAMS; p++) {
+            gradient[p][0] += shards[i].gradient[p][0] / total;
+            gradient[p][1] += shards[i].gradient[p][1] / total;
+        }
+    }
+    return loss / total;
+}
+
+// Scaling constant K that best maps current evaluations to results,
+// golden section search assuming the loss is unimodal in K
+static double fitScaling(Shard *shards, int n_shards, size_t total, const double (*params)[2])
+{
+    const double ratio = (sqrt(5) - 1) / 2;
+    double lo = 0.1, hi = 3.0;
+    double a = hi - ratio * (hi - lo), b = lo + ratio * (hi - lo);
+    double loss_a = computeLoss(shards, n_shards, total, params, a, NULL);
+    double loss_b = computeLoss(shards, n_shards, total, params, b, NULL);
+    while (hi - lo > 1e-3) {
+        if (loss_a < loss_b) {
+            hi = b;
+            b = a;
+            loss_b = loss_a;
+            a = hi - ratio * (hi - lo);
+            loss_a = computeLoss(shards, n_shards, total, params, a, NULL);
+        }
+        else {
+            lo = a;
+            a = b;
+            loss_a = loss_b;
+            b = lo + ratio * (hi - lo);
+            loss_b = computeLoss(shards, n_shards, total, params, b, NULL);
+        }
+    }
+    return (lo + hi) / 2;
+}
+
+//
+// Output
+//
+
+static int rounded(double x)
+{
+    return (int)lround(x);
+}
+
+static void writePairs(FILE *f, const char *name, const double (*params)[2], int first, int n)
+{
+    fprintf(f, "const int %s[%d][2] = {\n   ", name, n);
+    for (int i = 0; i < n; i++)
+        fprintf(f, " {%d, %d},", rounded(params[first + i][0]), rounded(params[first + i][1]));
+    fprintf(f, "\n};\n\n");
+}
+
+static void writePieceTable(FILE *f, const char *name, const double (*params)[2],
+                            const char *const piece_names[6], int first, int n)
+{
+    fprintf(f, "const int %s[6][2] = {\n", name);
+    for (int i = 0; i < n; i++)
+        fprintf(f, "    [%s] = {%d, %d},\n", piece_names[i], rounded(params[first + i][0]),
+                rounded(params[first + i][1]));
+    fprintf(f, "};\n\n");
+}
+
+static void writeSingle(FILE *f, const char *name, const double (*params)[2], int index)
+{
+    fprintf(f, "const int %s[2] = {%d, %d};\n", name, rounded(params[index][0]),
+            rounded(params[index][1]));
+}
+
+static bool writeParams(const char *path, const double (*params)[2])
+{
+    static const char *const PIECE_NAMES[6] = {
+        [KING_IDX] = "KING_IDX", [QUEEN_IDX] = "QUEEN_IDX",   [BISHOP_IDX] = "BISHOP_IDX",
+        [KNIGHT_IDX] = "KNIGHT_IDX", [ROOK_IDX] = "ROOK_IDX", [PAWN_IDX] = "PAWN_IDX",
+    };
+    static const char *const TABLE_NAMES[6] = {
+        [KING_IDX] = "KING", [QUEEN_IDX] = "QUEEN",   [BISHOP_IDX] = "BISHOP",
+        [KNIGHT_IDX] = "KNIGHT", [ROOK_IDX] = "ROOK", [PAWN_IDX] = "PAWN",
+    };
+    // Same order as the tables have always been listed in
+    static const int TABLE_ORDER[6] = {PAWN_IDX, KNIGHT_IDX, BISHOP_IDX, ROOK_IDX, QUEEN_IDX, KING_IDX};
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "tuner: can't write %s\n", path);
+        return false;
+    }
+
+    fprintf(f, "// Generated by ./build/tuner, rerun it instead of editing by hand\n");
+    fprintf(f, "// See evalparams.h for what each weight means\n\n");
+    fprintf(f, "#include \"evalparams.h\"\n#include \"piece.h\"\n\n");
+
+    writePieceTable(f, "MATERIAL", params, PIECE_NAMES, EP_MATERIAL, 6);
+
+    for (int t = 0; t < 6; t++) {
+        int piece_idx = TABLE_ORDER[t];
+        for (int stage = 0; stage < 2; stage++) {
+            fprintf(f, "const int %s_%s[64] = {\n", TABLE_NAMES[piece_idx], stage ? "EG" : "MG");
+            for (int sq = 0; sq < 64; sq++) {
+                fprintf(f, "%s%4d,", sq % 8 == 0 ? "   " : "",
+                        rounded(params[EP_PSQT + piece_idx * 64 + sq][stage]));
+                if (sq % 8 == 7)
+                    fprintf(f, "\n");
+            }
+            fprintf(f, "};\n\n");
+        }
+    }
+
+    writePieceTable(f, "MOBILITY", params, PIECE_NAMES, EP_MOBILITY, 6);
+    writePairs(f, "PASSED_PAWN", params, EP_PASSED_PAWN, 8);
+    writePairs(f, "PASSED_PAWN_FREE", params, EP_PASSED_PAWN_FREE, 8);
+    writeSingle(f, "DOUBLED_PAWN", params, EP_DOUBLED_PAWN);
+    writeSingle(f, "ISOLATED_PAWN", params, EP_ISOLATED_PAWN);
+    writeSingle(f, "KING_ZONE_ATTACK", params, EP_KING_ZONE_ATTACK);
+    writeSingle(f, "ROOK_OPEN_FILE", params, EP_ROOK_OPEN_FILE);
+    writeSingle(f, "ROOK_SEMI_OPEN_FILE", params, EP_ROOK_SEMI_OPEN_FILE);
+
+    return fclose(f) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *input = NULL, *output = DEFAULT_OUTPUT;
+    int n_threads = sysconf(_SC_NPROCESSORS_ONLN), epochs = 1000;
+    double lr = 1.0, k = 0;
+    bool usage = false;
+    for (int i = 1; i < argc && !usage; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            n_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--epochs") == 0 && i + 1 < argc)
+            epochs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--lr") == 0 && i + 1 < argc)
+            lr = atof(argv[++i]);
+        else if (strcmp(argv[i], "--k") == 0 && i + 1 < argc)
+            k = atof(argv[++i]);
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (input == NULL && argv[i][0] != '-')
+            input = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || input == NULL) {
+        fprintf(stderr, "Usage: %s positions_file [--threads n] [--epochs n] [--lr rate] "
+                        "[--k scaling] [--output file]\n", argv[0]);
+        return 1;
+    }
+    n_threads = MAX(1, MIN(n_threads, 256));
+
+    precomputeValues();
+
+    int fd = open(input, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "tuner: can't open %s\n", input);
+        return 1;
+    }
+    size_t size = st.st_size;
+    const char *data = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "tuner: can't mmap %s\n", input);
+        return 1;
+    }
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+    Shard *shards = calloc(n_threads, sizeof(Shard));
+    double start = wallTimeMs();
+
+    if (size >= 4 && memcmp(data, "CEPK", 4) == 0) {
+        munmap((void *)data, size);
+        PackedFile packed;
+        if (!packedOpen(&packed, input))
+            return 1;
+
+        // Same number of positions per thread
+        for (int i = 0; i < n_threads; i++) {
+            shards[i].packed_begin = packed.positions + packed.count * i / n_threads;
+            shards[i].packed_end = packed.positions + packed.count * (i + 1) / n_threads;
+        }
+        runShards(shards, n_threads, loadPackedShard);
+        packedClose(&packed);
+    }
+    else {
+        // Split the file at line boundaries, one shard per thread
+        const char *begin = data, *end = data + size;
+        for (int i = 0; i < n_threads; i++) {
+            const char *split = i == n_threads - 1 ? end : data + size * (i + 1) / n_threads;
+            if (split < begin)
+                split = begin;
+            while (split < end && split[-1] != '\n')
+                split++;
+            shards[i].begin = begin;
+            shards[i].end = split;
+            begin = split;
+        }
+        runShards(shards, n_threads, loadShard);
+        munmap((void *)data, size);
+    }
+
+    size_t total = 0, skipped = 0, entries = 0;
+    for (int i = 0; i < n_threads; i++) {
+        total += shards[i].count;
+        skipped += shards[i].skipped;
+        entries += shards[i].entry_count;
+    }
+    printf("Loaded %zu positions (%zu skipped) in %.1lf s with %d threads, %.1lf MB\n", total,
+           skipped, (wallTimeMs() - start) / 1000, n_threads,
+           (total * sizeof(TunePosition) + entries * sizeof(TuneEntry)) / 1e6);
+    if (total == 0) {
+        fprintf(stderr, "tuner: no positions with results in %s\n", input);
+        return 1;
+    }
+
+    static double params[NUM_EVAL_PARAMS][2], gradient[NUM_EVAL_PARAMS][2];
+    static double m[NUM_EVAL_PARAMS][2], v[NUM_EVAL_PARAMS][2];
+    int initial[NUM_EVAL_PARAMS][2];
+    getEvalParams(initial);
+    for (int i = 0; i < NUM_EVAL_PARAMS; i++)
+        for (int stage = 0; stage < 2; stage++)
+            params[i][stage] = initial[i][stage];
+
+    if (k <= 0)
+        k = fitScaling(shards, n_threads, total, (const double (*)[2])params);
+    printf("K: %.4lf, initial loss: %.6lf\n", k,
+           computeLoss(shards, n_threads, total, (const double (*)[2])params, k, NULL));
+
+    // Adam, step sizes are in centipawns
+    const double beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+    start = wallTimeMs();
+    for (int epoch = 1; epoch <= epochs; epoch++) {
+        double loss = computeLoss(shards, n_threads, total, (const double (*)[2])params, k, gradient);
+        for (int i = 0; i < NUM_EVAL_PARAMS; i++) {
+            for (int stage = 0; stage < 2; stage++) {
+                double g = gradient[i][stage];
+                m[i][stage] = beta1 * m[i][stage] + (1 - beta1) * g;
+                v[i][stage] = beta2 * v[i][stage] + (1 - beta2) * g * g;
+                double m_hat = m[i][stage] / (1 - pow(beta1, epoch));
+                double v_hat = v[i][stage] / (1 - pow(beta2, epoch));
+                params[i][stage] -= lr * m_hat / (sqrt(v_hat) + epsilon);
+            }
+        }
+
+        if (epoch % 10 == 0 || epoch == epochs) {
+            double ms = wallTimeMs() - start;
+            printf("epoch: %d, loss: %.6lf, %.1lf ms/epoch\n", epoch, loss, ms / epoch);
+        }
+        // Checkpoint so long runs can be stopped at any time
+        if (epoch % 100 == 0 && !writeParams(output, (const double (*)[2])params))
+            return 1;
+    }
+
+    if (!writeParams(output, (const double (*)[2])params))
+        return 1;
+    printf("Final loss: %.6lf, wrote %s\n",
+           computeLoss(shards, n_threads, total, (const double (*)[2])params, k, NULL), output);
+
+    for (int i = 0; i < n_threads; i++) {
+        free(shards[i].positions);
+        free(shards[i].entries);
+    }
+    free(shards);
+    return 0;
+}
@@ -0,0 +1,371 @@
+#include "bitbase.h"
+#include "board.h"
+#include "book.h"
+#include "engine.h"
+#include "evalcache.h"
+#include "move.h"
+#include "nnue.h"
+#include "notation.h"
+#include "transposition.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+// Headless front end speaking the UCI protocol on stdin/stdout, so the
+// engine can be run by tournament managers and other GUIs
+//
+// Usage: ./build/engine
+//
+// Supported commands: uci, isready, ucinewgame, setoption (Hash, Threads,
+// OwnBook, BookFile, BookBestMove), position [startpos | fen ...]
+// [moves ...], go [depth n] [nodes n] [movetime ms] [wtime ms] [btime ms]
+// [winc ms] [binc ms] [movestogo n] [infinite] [ponder], ponderhit, stop,
+// quit, and d to print the board
+//
+// With an opening book (BookFile, or CHESS_BOOK in the environment) go
+// answers at once with a book move while the position is in the book.
+// Moves are picked at random by weight, or the heaviest with BookBestMove.
+
+#define MAX_GAME_PLIES 1024
+#define MAX_THREADS 256
+#define MAX_HASH_MB 65536
+
+typedef struct {
+    Board board;
+    // Hashes of positions played before board, oldest first
+    uint64_t history[MAX_GAME_PLIES];
+    int history_count;
+
+    int threads;
+    SearchContext ctx;
+    pthread_t search_tid;
+    bool searching;
+
+    Book book;
+    bool book_loaded, own_book, book_best;
+} Uci;
+
+static void printScore(int score, Piece color_to_move)
+{
+    // UCI scores are from the side to move's point of view
+    if (!(color_to_move & WHITE))
+        score = -score;
+    if (IS_MATE_SCORE(score)) {
+        int plies = MATE_SCORE - abs(score);
+        printf("score mate %d", score > 0 ? (plies + 1) / 2 : -(plies + 1) / 2);
+    } else {
+        printf("score cp %d", score);
+    }
+}
+
+static void printInfo(const SearchInfo *info, void *data)
+{
+    const Uci *uci = data;
+    uint64_t nps = info->ms > 0 ? info->nodes * 1000 / info->ms : 0;
+    printf("info depth %d ", info->depth);
+    printScore(info->score, uci->board.color_to_move);
+    printf(" nodes %lu nps %lu time %.0lf hashfull %d pv", (unsigned long)info->nodes,
+           (unsigned long)nps, info->ms, info->hashfull);
+    for (int i = 0; i < info->pv_length; i++) {
+        char move_str[10];
+        printMoveToString(move_str, sizeof(move_str), info->pv[i], false);
+        printf(" %s", move_str);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static void *searchThread(void *arg)
+{
+    Uci *uci = arg;
+    SearchInfo info;
+    Move best_move = findBestMove(&uci->board, &uci->ctx, &info);
+
+    char move_str[10] = "0000";
+    if (best_move != EMPTY_MOVE)
+        printMoveToString(move_str, sizeof(move_str), best_move, false);
+    printf("bestmove %s", move_str);
+
+    // Reply we expect, the GUI sends it back with go ponder
+    if (info.pv_length >= 2 && info.pv[0] == best_move) {
+        printMoveToString(move_str, sizeof(move_str), info.pv[1], false);
+        printf(" ponder %s", move_str);
+    }
+    printf("\n");
+    fflush(stdout);
+    return NULL;
+}
+
+// Stops a running search and waits for its bestmove
+static void stopSearch(Uci *uci)
+{
+    if (!uci->searching)
+        return;
+    atomic_store(&uci->ctx.stop, true);
+    pthread_join(uci->search_tid, NULL);
+    uci->searching = false;
+}
+
+// Replaces the book, path NULL only closes it
+static void loadBook(Uci *uci, const char *path)
+{
+    if (uci->book_loaded)
+        bookClose(&uci->book);
+    uci->book_loaded = path != NULL && bookOpen(&uci->book, path);
+    if (path != NULL && !uci->book_loaded)
+        printf("info string could not open book %s\n", path);
+}
+
+static void setOption(Uci *uci, char *saveptr)
+{
+    // setoption name <id> value <x>, both may contain spaces: the name
+    // runs up to value and the value to the end of the line
+    char *token = strtok_r(NULL, " ", &saveptr);
+    if (token == NULL || strcmp(token, "name") != 0)
+        return;
+    char name[64] = "";
+    while ((token = strtok_r(NULL, " ", &saveptr)) != NULL && strcmp(token, "value") != 0) {
+        if (strlen(name) + strlen(token) + 2 > sizeof(name))
+            return;
+        if (name[0] != '\0')
+            strcat(name, " ");
+        strcat(name, token);
+    }
+    if (token == NULL)
+        return;
+    char *value = saveptr + strspn(saveptr, " ");
+    size_t len = strlen(value);
+    while (len > 0 && value[len - 1] == ' ')
+        value[--len] = '\0';
+    if (len == 0)
+        return;
+
+    if (strcasecmp(name, "Hash") == 0) {
+        int mb = atoi(value);
+        if (mb < 1 || mb > MAX_HASH_MB || !setTranspositionTableSize(mb)) {
+            printf("info string could not allocate %s MB hash\n", value);
+            setTranspositionTableSize(TT_DEFAULT_MB);
+        }
+    }
+    else if (strcasecmp(name, "Threads") == 0) {
+        int threads = atoi(value);
+        if (threads >= 1 && threads <= MAX_THREADS)
+            uci->threads = threads;
+    }
+    else if (strcasecmp(name, "OwnBook") == 0) {
+        uci->own_book = strcasecmp(value, "true") == 0;
+    }
+    else if (strcasecmp(name, "BookFile") == 0) {
+        loadBook(uci, strcmp(value, "<empty>") != 0 ? value : NULL);
+    }
+    else if (strcasecmp(name, "BookBestMove") == 0) {
+        uci->book_best = strcasecmp(value, "true") == 0;
+    }
+}
+
+static void setPosition(Uci *uci, char *saveptr)
+{
+    char *token = strtok_r(NULL, " ", &saveptr);
+    if (token == NULL)
+        return;
+
+    char fen[100] = START_FEN;
+    if (strcmp(token, "fen") == 0) {
+        fen[0] = '\0';
+        while ((token = strtok_r(NULL, " ", &saveptr)) != NULL && strcmp(token, "moves") != 0) {
+            if (strlen(fen) + strlen(token) + 2 > sizeof(fen))
+                return;
+            if (fen[0] != '\0')
+                strcat(fen, " ");
+            strcat(fen, token);
+        }
+    }
+    else if (strcmp(token, "startpos") == 0) {
+        token = strtok_r(NULL, " ", &saveptr);
+    }
+    else {
+        return;
+    }
+
+    // Built aside, the position is only replaced if the fen and every move
+    // are valid
+    Board board;
+    FenError err = parseFen(fen, strlen(fen), &board, NULL);
+    if (err != FEN_OK) {
+        printf("info string invalid fen: %s\n", fenErrorString(err));
+        fflush(stdout);
+        return;
+    }
+    uint64_t history[MAX_GAME_PLIES];
+    int history_count = 0;
+    bool moves = token != NULL && strcmp(token, "moves") == 0;
+    while (moves && (token = strtok_r(NULL, " ", &saveptr)) != NULL) {
+        Move m = parseCoordinateMove(&board, token, strlen(token));
+        if (m == EMPTY_MOVE) {
+            printf("info string illegal move %s\n", token);
+            fflush(stdout);
+            return;
+        }
+        // Keep the most recent positions, older ones can't repeat anymore
+        if (history_count == MAX_GAME_PLIES) {
+            memmove(history, history + 1, (MAX_GAME_PLIES - 1) * sizeof(uint64_t));
+            history_count--;
+        }
+        history[history_count++] = board.zobrist_hash;
+        board = moveMake(m, board);
+    }
+
+    uci->board = board;
+    memcpy(uci->history, history, history_count * sizeof(uint64_t));
+    uci->history_count = history_count;
+}
+
+static void go(Uci *uci, char *saveptr)
+{
+    SearchLimits limits = {0};
+    bool ponder = false;
+    char *token;
+    while ((token = strtok_r(NULL, " ", &saveptr)) != NULL) {
+        if (strcmp(token, "infinite") == 0) {
+            limits.infinite = true;
+            continue;
+        }
+        if (strcmp(token, "ponder") == 0) {
+            ponder = true;
+            continue;
+        }
+        char *value = strtok_r(NULL, " ", &saveptr);
+        if (value == NULL)
+            break;
+        if (strcmp(token, "depth") == 0)
+            limits.depth = atoi(value);
+        else if (strcmp(token, "nodes") == 0)
+            limits.nodes = strtoull(value, NULL, 10);
+        else if (strcmp(token, "movetime") == 0)
+            limits.movetime = atoi(value);
+        else if (strcmp(token, "wtime") == 0)
+            limits.time[0] = atoi(value);
+        else if (strcmp(token, "btime") == 0)
+            limits.time[1] = atoi(value);
+        else if (strcmp(token, "winc") == 0)
+            limits.inc[0] = atoi(value);
+        else if (strcmp(token, "binc") == 0)
+            limits.inc[1] = atoi(value);
+        else if (strcmp(token, "movestogo") == 0)
+            limits.movestogo = atoi(value);
+    }
+
+    // Book moves are played without searching, but not while pondering or
+    // analysing
+    if (uci->own_book && uci->book_loaded && !ponder && !limits.infinite) {
+        Move m = bookPick(&uci->book, &uci->board, uci->book_best, rand64());
+        if (m != EMPTY_MOVE) {
+            char move_str[10];
+            printMoveToString(move_str, sizeof(move_str), m, false);
+            printf("info string book move\nbestmove %s\n", move_str);
+            return;
+        }
+    }
+
+    uci->ctx = (SearchContext){
+        .limits = limits,
+        .threads = uci->threads,
+        .history = uci->history,
+        .history_count = uci->history_count,
+        .on_iteration = printInfo,
+        .callback_data = uci,
+    };
+    atomic_init(&uci->ctx.stop, false);
+    atomic_init(&uci->ctx.ponder, ponder);
+    atomic_init(&uci->ctx.nodes, 0);
+    uci->searching = pthread_create(&uci->search_tid, NULL, searchThread, uci) == 0;
+}
+
+int main(void)
+{
+    precomputeValues();
+
+    // Same environment as the GUI for bitbases and the network
+    char *bitbase_dir = getenv("CHESS_BITBASES");
+    bitbaseLoad(bitbase_dir != NULL ? bitbase_dir : "bitbases");
+    char *nnue_file = getenv("CHESS_NNUE");
+    if (nnue_file != NULL && nnueLoad(nnue_file))
+        setEvalMode(EVAL_NNUE);
+    // Zobrist keys are drawn first, so this only varies book moves
+    srand(time(NULL));
+
+    static Uci uci = {.threads = 1, .own_book = true};
+    loadBook(&uci, getenv("CHESS_BOOK"));
+    uci.board = initBoardFromFen(START_FEN);
+
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &line_size, stdin)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+
+        char *saveptr;
+        char *command = strtok_r(line, " ", &saveptr);
+        if (command == NULL)
+            continue;
+
+        if (strcmp(command, "uci") == 0) {
+            printf("id name Chessengine\n");
+            printf("id author diwasrimal\n");
+            printf("option name Hash type spin default %d min 1 max %d\n", TT_DEFAULT_MB, MAX_HASH_MB);
+            printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+            printf("option name Ponder type check default false\n");
+            printf("option name OwnBook type check default true\n");
+            printf("option name BookFile type string default <empty>\n");
+            printf("option name BookBestMove type check default false\n");
+            printf("uciok\n");
+        }
+        else if (strcmp(command, "isready") == 0) {
+            printf("readyok\n");
+        }
+        else if (strcmp(command, "ucinewgame") == 0) {
+            stopSearch(&uci);
+            clearTranspositionTable();
+            clearEvalCache();
+        }
+        else if (strcmp(command, "setoption") == 0) {
+            stopSearch(&uci);
+            setOption(&uci, saveptr);
+        }
+        else if (strcmp(command, "position") == 0) {
+            stopSearch(&uci);
+            setPosition(&uci, saveptr);
+        }
+        else if (strcmp(command, "go") == 0) {
+            stopSearch(&uci);
+            go(&uci, saveptr);
+        }
+        else if (strcmp(command, "ponderhit") == 0) {
+            // The search keeps what it found and continues on our clock
+            if (uci.searching)
+                atomic_store(&uci.ctx.ponder, false);
+        }
+        else if (strcmp(command, "stop") == 0) {
+            stopSearch(&uci);
+        }
+        else if (strcmp(command, "d") == 0) {
+            printBoard(uci.board);
+        }
+        else if (strcmp(command, "quit") == 0) {
+            break;
+        }
+        fflush(stdout);
+    }
+
+    stopSearch(&uci);
+    loadBook(&uci, NULL);
+    free(line);
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include "utils.h"
 #include <stdlib.h>
+#include <time.h>
 
 const char *SQNAMES[64] = {
     "a1", "b1", "c1", "d1", "e1", "f1", "g1", "h1",
@@ -53,3 +54,19 @@ uint64_t rand64(void)
     uint64_t r2 = rand();
     return (r1 << 32) | (r2);
 }
+
+uint64_t nextRandom(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+double wallTimeMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
@@ -7,6 +7,11 @@
 #define MAX(x, y) ((x > y) ? x : y)
 #define MIN(x, y) ((x < y) ? x : y)
 
+// Bit tricks on 64 bit boards, compile to popcnt/tzcnt/lzcnt where available
+#define POPCOUNT(bb) __builtin_popcountll(bb)
+#define LSB(bb) __builtin_ctzll(bb)
+#define MSB(bb) (63 - __builtin_clzll(bb))
+
 // Mapping of a square's index to its name
 extern const char *SQNAMES[64];
 
@@ -16,4 +21,15 @@ int squareNameToIdx(char *name);
 uint64_t decToBin(int n);
 uint64_t rand64(void);
 
+// xorshift64 step of a generator owned by the caller, state must not be 0.
+// For threads that need their own reproducible sequence, unlike rand64()
+uint64_t nextRandom(uint64_t *state);
+
+// Statistics counted on many threads are added to shared atomic totals
+// every this many events, so threads don't contend on the totals' cache line
+#define STATS_BATCH 1024
+
+// Monotonic clock in milliseconds, for measuring elapsed time
+double wallTimeMs(void);
+
 #endif // UTILS_H